@@ -0,0 +1,184 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Aot.cpp contains the loading of recompiled ROMs and Chip8::runAot, the
+ * execution engine that runs them.
+ *
+ * A module is opened once per process and shared by every machine
+ * running that program; what each machine has written over is tracked
+ * per machine in its Aot. Modules are never closed, a machine may be
+ * running one until the program exits.
+ */
+
+#include "Aot.h"
+#include "Chip8.h"
+#include "error.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#if CHIP8_AOT
+#include <dlfcn.h>
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+
+/*
+ * IN:  (uint64_t) image hash
+ * OUT: (const AotModule*) the module recompiled from that image, or
+ *      nullptr if there isn't a usable one
+ *      Modules that exist but can't be used are reported once.
+ */
+const AotModule* findModule(uint64_t hash)
+{
+    static std::mutex lock;
+    static std::map<uint64_t, const AotModule*> opened;
+
+    std::lock_guard<std::mutex> hold(lock);
+    std::map<uint64_t, const AotModule*>::iterator found = opened.find(hash);
+    if (found != opened.end())
+        return found->second;
+
+    const AotModule* module = nullptr;
+#if CHIP8_AOT
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%016llx.so", static_cast<unsigned long long>(hash));
+    std::string path = Aot::directory() + name;
+
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0)
+    {
+        typedef const AotModule* (*EntryFn)();
+        void* library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        EntryFn entry = library ? reinterpret_cast<EntryFn>(dlsym(library, "chip8_aot_module")) : nullptr;
+        module = entry ? entry() : nullptr;
+
+        if (!module)
+            printChip8Error("\"" + path + "\" is not a recompiled ROM" + (library ? "" : std::string(": ") + dlerror()));
+        else if (module->abi != AOT_ABI_VERSION || module->stateSize != sizeof(Chip8State) || module->imageHash != hash)
+        {
+            printChip8Error("\"" + path + "\" was recompiled for a different build, run chip8-aot again");
+            module = nullptr;
+        }
+    }
+#endif
+    opened[hash] = module;
+    return module;
+}
+
+}
+
+/*
+ * IN:  (const Chip8State&) a machine with a program loaded
+ * OUT: (uint64_t) hash of everything a program can be loaded into
+ */
+uint64_t programImageHash(const Chip8State& s)
+{
+    return hashBytes(s.memory + START_PROG_MEM, sizeof(s.memory) - START_PROG_MEM);
+}
+
+/*
+ * Default Constructor
+ *
+ * IN: void
+ *     Not attached to anything.
+ */
+Aot::Aot() : module(nullptr)
+{
+}
+
+/*
+ * IN:  void
+ * OUT: (string) $CHIP8_AOT_DIR, or "aot" if it isn't set
+ */
+std::string Aot::directory()
+{
+    const char* dir = std::getenv("CHIP8_AOT_DIR");
+    return (dir && *dir) ? dir : "aot";
+}
+
+/*
+ * IN:  (uint64_t) programImageHash of the program just loaded
+ * OUT: (bool) false if nothing was recompiled from it
+ */
+bool Aot::attach(uint64_t hash)
+{
+    detach();
+    module = findModule(hash);
+    if (!module)
+        return false;
+
+    dead.assign(module->blocks, 0);
+    covered.assign(4096, false);
+    for (uint32_t b = 0; b < module->blocks; ++b)
+        for (uint32_t a = module->start[b]; a < module->end[b] && a < 4096; ++a)
+            covered[a] = true;
+    return true;
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ */
+void Aot::detach()
+{
+    module = nullptr;
+    dead.clear();
+    covered.clear();
+}
+
+/*
+ * IN:  (uint32_t) first address that was written
+ *      (uint32_t) number of bytes written
+ * OUT: void
+ *      Any block holding one of the bytes no longer matches the program
+ *      and is never run again by this machine.
+ */
+void Aot::invalidate(uint32_t addr, uint32_t len)
+{
+    if (!module)
+        return;
+
+    uint32_t last = std::min<uint32_t>(addr + len, 4096);
+    bool hit = false;
+    for (uint32_t a = addr; a < last && !hit; ++a)
+        hit = covered[a];
+    if (!hit)
+        return;
+
+    for (uint32_t b = 0; b < module->blocks; ++b)
+        if (module->start[b] < last && module->end[b] > addr)
+            dead[b] = 1;
+}
+
+/*
+ * IN:  (uint32_t) the most instructions to execute
+ * OUT: (uint32_t) the number executed
+ *      Runs recompiled code for as long as it has some, and the
+ *      interpreter for one instruction whenever it doesn't.
+ */
+uint32_t Chip8::runAot(uint32_t n)
+{
+    uint32_t executed = 0;
+
+    while (running && executed < n)
+    {
+        uint32_t ran = aot.run(state(), n - executed);
+        executed += ran;
+        if (ran == 0)
+        {
+            runCycle();
+            ++executed;
+        }
+    }
+    return executed;
+}
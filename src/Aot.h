@@ -0,0 +1,84 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Aot.h contains the interface between the core and ROMs recompiled
+ * ahead of time by chip8-aot (see Recompiler.h), and the Aot class that
+ * runs them.
+ *
+ * A recompiled ROM is a shared object exporting chip8_aot_module(). It
+ * is found by the hash of the program image it was made from, as
+ * <dir>/<hash>.so, where dir is $CHIP8_AOT_DIR or "aot". Its code runs
+ * directly on a Chip8State. Anything it couldn't translate, and any
+ * block a program has since written over, is left to the interpreter.
+ */
+
+#ifndef CHIP8_AOT_H_
+#define CHIP8_AOT_H_
+
+#include "Chip8State.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CHIP8_AOT 1
+#else
+#define CHIP8_AOT 0
+#endif
+
+static const uint32_t AOT_ABI_VERSION = 2; // 2: the stack and memory through I wrap around
+
+/*
+ * Runs recompiled blocks starting at s->pc until it reaches an address
+ * it has no code for, a dead block, or a block that doesn't fit in the
+ * instruction budget. Stores pc and returns the instructions executed.
+ * `dead` has one flag per block, set for blocks that must not run.
+ */
+typedef uint32_t (*AotRunFn)(Chip8State* s, uint32_t budget, const uint8_t* dead);
+
+/*
+ * What a recompiled ROM exports. Blocks are in address order.
+ */
+struct AotModule
+{
+    uint32_t        abi;              // AOT_ABI_VERSION it was generated for
+    uint32_t        stateSize;        // sizeof(Chip8State) it was compiled against
+    uint64_t        imageHash;        // programImageHash of the program it was made from
+    uint32_t        blocks;
+    const uint16_t* start;            // Address of each block's first instruction
+    const uint16_t* end;              // One past each block's last byte
+    AotRunFn        run;
+};
+
+uint64_t programImageHash(const Chip8State&); // Hash of program memory, 0x200 - 0xFFF
+
+/*
+ * The recompiled code for one machine's program, with its own record of
+ * which blocks the program has written over.
+ */
+class Aot
+{
+    public:
+        Aot();
+
+        static bool available() { return CHIP8_AOT != 0; }
+        static std::string directory();             // Where modules are looked for
+
+        bool attach(uint64_t);                      // Use the module for this image hash, false if there is none
+        void detach();
+        bool attached() const { return module != nullptr; }
+        uint32_t run(Chip8State& s, uint32_t n) { return module->run(&s, n, dead.data()); }
+        void invalidate(uint32_t, uint32_t);        // Memory in [addr, addr + len) was written
+    private:
+        const AotModule*     module;
+        std::vector<uint8_t> dead;                  // One flag per block of the module
+        std::vector<bool>    covered;               // Bytes inside some block
+};
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Audio.cpp contains the implementation of the beep. Everything below
+ * fill() runs on SDL's audio thread and touches nothing the emulation
+ * loop writes except the one atomic.
+ */
+
+#include "Audio.h"
+#include "Chip8State.h"
+#include "error.h"
+
+/*
+ * Default Constructor
+ *
+ * IN: void
+ *     Closed and silent.
+ */
+Audio::Audio() : device(0), latest(0), ticks(0), seen(0), remaining(0), phase(0), step(0), perTick(0)
+{
+}
+
+/*
+ * Destructor
+ *
+ *     Stops the callback before anything it uses goes away.
+ */
+Audio::~Audio()
+{
+    close();
+}
+
+/*
+ * IN:  (uint16_t) samples per callback, smaller is lower latency
+ * OUT: (bool) false if the audio device couldn't be opened
+ *      A machine without sound still runs, so failing here is reported
+ *      and not fatal.
+ */
+bool Audio::open(uint16_t samples)
+{
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0)
+    {
+        printChip8Error(std::string("SDL2 failed to initialize audio, playing without sound. . . ") + SDL_GetError());
+        return false;
+    }
+
+    SDL_AudioSpec want = {};
+    SDL_AudioSpec have = {};
+    want.freq = SAMPLE_RATE;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = samples;
+    want.callback = &Audio::callback;
+    want.userdata = this;
+
+    device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+    if (device == 0)
+    {
+        printChip8Error(std::string("SDL2 failed to open an audio device, playing without sound. . . ") + SDL_GetError());
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return false;
+    }
+
+    // Set up before the callback first runs, it owns these from then on
+    step = static_cast<uint32_t>((static_cast<uint64_t>(TONE_HZ) << 32) / have.freq);
+    perTick = static_cast<uint32_t>(have.freq / FRAME_RATE);
+    seen = latest.load(std::memory_order_relaxed);
+    SDL_PauseAudioDevice(device, 0);
+    return true;
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      Stops the callback and closes the device, if it is open.
+ */
+void Audio::close()
+{
+    if (device == 0)
+        return;
+
+    SDL_CloseAudioDevice(device);
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    device = 0;
+}
+
+/*
+ * IN:  (uint8_t) the sound timer at the end of a tick
+ * OUT: void
+ *      Every tick is published even if the timer didn't change, so the
+ *      callback can tell a timer that was set again from one that is
+ *      still counting down.
+ */
+void Audio::publish(uint8_t soundTimer)
+{
+    ++ticks;
+    latest.store(ticks << 8 | soundTimer, std::memory_order_release);
+}
+
+/*
+ * IN:  (void*) the Audio
+ *      (Uint8*) the buffer SDL wants filled
+ *      (int) its length in bytes
+ * OUT: void
+ */
+void Audio::callback(void* userdata, Uint8* stream, int len)
+{
+    static_cast<Audio*>(userdata)->fill(reinterpret_cast<int16_t*>(stream), len / static_cast<int>(sizeof(int16_t)));
+}
+
+/*
+ * IN:  (int16_t*) samples to fill
+ *      (int) how many
+ * OUT: void
+ *      A new tick restarts the tone for as many ticks as its timer has
+ *      left. A square wave is the high bit of the phase.
+ */
+void Audio::fill(int16_t* out, int count)
+{
+    uint32_t now = latest.load(std::memory_order_acquire);
+    if (now != seen)
+    {
+        seen = now;
+        remaining = (now & 0xFF) * perTick;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (remaining == 0)
+        {
+            out[i] = 0;
+            phase = 0;
+            continue;
+        }
+        out[i] = (phase & 0x80000000u) ? -VOLUME : VOLUME;
+        phase += step;
+        --remaining;
+    }
+}
@@ -0,0 +1,60 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Audio.h contains the class definition for the Audio class, the beep.
+ * The emulation loop publishes the sound timer once per 60 Hz tick into
+ * a single atomic word, and SDL's audio callback turns it into a square
+ * wave. Neither side ever waits for the other: the callback only loads
+ * the word, and keeps the tone going for as long as the last published
+ * timer says even if no new tick arrives, which is what the timer would
+ * have done.
+ *
+ * The callback is asked for one buffer at a time, so the latency is the
+ * buffer size: the default of 512 samples is under 12 ms at 44.1 kHz,
+ * less than one frame.
+ */
+
+#ifndef CHIP8_AUDIO_H_
+#define CHIP8_AUDIO_H_
+
+#include <SDL2/SDL.h>
+#include <atomic>
+#include <cstdint>
+
+class Audio
+{
+    public:
+        static const int      SAMPLE_RATE     = 44100;
+        static const int      TONE_HZ         = 440;
+        static const uint16_t DEFAULT_SAMPLES = 512;  // Samples per callback
+        static const int16_t  VOLUME          = 3000;
+
+        Audio();
+        ~Audio();
+
+        bool open(uint16_t samples);      // Start the device, false if there is no sound
+        void close();
+        void publish(uint8_t soundTimer); // One 60 Hz tick, from the emulation loop
+        void silence() { publish(0); }
+    private:
+        static void callback(void*, Uint8*, int);
+        void fill(int16_t*, int);         // Runs on SDL's audio thread
+
+        SDL_AudioDeviceID     device;     // 0 if closed
+        std::atomic<uint32_t> latest;     // Tick count << 8 | sound timer, the only shared state
+        uint32_t              ticks;      // Ticks published, emulation loop only
+        /* AUDIO THREAD ONLY */
+        uint32_t              seen;       // The last value of latest acted on
+        uint32_t              remaining;  // Samples of tone left
+        uint32_t              phase;      // Position in the wave, a full turn is 2^32
+        uint32_t              step;       // Phase advanced per sample
+        uint32_t              perTick;    // Samples in one 60 Hz tick
+};
+
+#endif
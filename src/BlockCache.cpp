@@ -0,0 +1,448 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * BlockCache.cpp contains the implementation of the BlockCache class and
+ * of Chip8::runBlocks, the execution engine that runs out of it. The
+ * handlers in runBlocks mirror the cases of Chip8::runCycle one for one;
+ * runCycle is the reference and the two must always agree.
+ */
+
+#include "BlockCache.h"
+#include "Chip8.h"
+
+// Computed goto is a GCC/clang extension, everyone else gets a switch.
+#if defined(__GNUC__)
+#define CHIP8_COMPUTED_GOTO 1
+#else
+#define CHIP8_COMPUTED_GOTO 0
+#endif
+
+// Blocks are dropped wholesale once this many ops have been decoded.
+static const uint32_t MAX_POOL_OPS = 1 << 16;
+
+/*
+ * IN:  (uint16_t) the opcode
+ *      (uint16_t) the address it was fetched from
+ * OUT: (DecodedOp) the handler and operands for the opcode
+ */
+DecodedOp decodeOp(uint16_t opcode, uint16_t pc)
+{
+    DecodedOp op;
+    op.x = (opcode & 0x0F00) >> 8;
+    op.y = (opcode & 0x00F0) >> 4;
+    op.n = opcode & 0x000F;
+    op.kk = opcode & 0x00FF;
+    op.len = 0;
+    op.nnn = opcode & 0x0FFF;
+    op.pc = pc;
+
+    switch (opcode & 0xF000)
+    {
+        case 0x0000:
+            switch (op.kk)
+            {
+                case 0x00: op.kind = OP_SYS; break;
+                case 0xE0: op.kind = OP_CLS; break;
+                case 0xEE: op.kind = OP_RET; break;
+                default:   op.kind = OP_BAD_0; break;
+            }
+            break;
+        case 0x1000: op.kind = OP_JP; break;
+        case 0x2000: op.kind = OP_CALL; break;
+        case 0x3000: op.kind = OP_SE_KK; break;
+        case 0x4000: op.kind = OP_SNE_KK; break;
+        case 0x5000: op.kind = OP_SE_XY; break;
+        case 0x6000: op.kind = OP_LD_KK; break;
+        case 0x7000: op.kind = OP_ADD_KK; break;
+        case 0x8000:
+            switch (op.n)
+            {
+                case 0x0: op.kind = OP_LD_XY; break;
+                case 0x1: op.kind = OP_OR; break;
+                case 0x2: op.kind = OP_AND; break;
+                case 0x3: op.kind = OP_XOR; break;
+                case 0x4: op.kind = OP_ADD_XY; break;
+                case 0x5: op.kind = OP_SUB; break;
+                case 0x6: op.kind = OP_SHR; break;
+                case 0x7: op.kind = OP_SUBN; break;
+                case 0xE: op.kind = OP_SHL; break;
+                default:  op.kind = OP_BAD_8; break;
+            }
+            break;
+        case 0x9000: op.kind = OP_SNE_XY; break;
+        case 0xA000: op.kind = OP_LD_I; break;
+        case 0xB000: op.kind = OP_JP_V0; break;
+        case 0xC000: op.kind = OP_RND; break;
+        case 0xD000: op.kind = OP_DRW; break;
+        case 0xE000:
+            switch (op.kk)
+            {
+                case 0x9E: op.kind = OP_SKP; break;
+                case 0xA1: op.kind = OP_SKNP; break;
+                default:   op.kind = OP_BAD_E; break;
+            }
+            break;
+        default:
+            switch (op.kk)
+            {
+                case 0x07: op.kind = OP_LD_VX_DT; break;
+                case 0x0A: op.kind = OP_LD_VX_K; break;
+                case 0x15: op.kind = OP_LD_DT; break;
+                case 0x18: op.kind = OP_LD_ST; break;
+                case 0x1E: op.kind = OP_ADD_I; break;
+                case 0x29: op.kind = OP_LD_F; break;
+                case 0x33: op.kind = OP_LD_B; break;
+                case 0x55: op.kind = OP_LD_I_VX; break;
+                case 0x65: op.kind = OP_LD_VX_I; break;
+                default:   op.kind = OP_BAD_F; break;
+            }
+            break;
+    }
+    return op;
+}
+
+/*
+ * IN:  (uint8_t) an OpKind
+ * OUT: (bool) true if the instruction has to be the last one in a block,
+ *      either because it sets pc or because it writes to memory that
+ *      might hold decoded instructions.
+ */
+bool endsBlock(uint8_t kind)
+{
+    switch (kind)
+    {
+        case OP_RET:
+        case OP_JP:
+        case OP_CALL:
+        case OP_SE_KK:
+        case OP_SNE_KK:
+        case OP_SE_XY:
+        case OP_SNE_XY:
+        case OP_JP_V0:
+        case OP_SKP:
+        case OP_SKNP:
+        case OP_LD_VX_K:
+        case OP_LD_B:
+        case OP_LD_I_VX:
+        case OP_EXIT:
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Default Constructor
+ *
+ * IN: void
+ *     Starts out with nothing decoded.
+ */
+BlockCache::BlockCache() : entry(4096, 0), ends(4096, 0), code(4096, false)
+{
+}
+
+/*
+ * IN:  (uint16_t) address of the first instruction
+ *      (const uint8_t*) the 4 KB of Chip8 memory
+ * OUT: (const DecodedOp*) the first op of the newly decoded block
+ *      Decodes instructions until one of them ends the block, the block
+ *      is full, or the next instruction would run off the end of memory.
+ */
+const DecodedOp* BlockCache::decode(uint16_t start, const uint8_t* memory)
+{
+    if (pool.size() >= MAX_POOL_OPS)
+        flush();
+
+    uint32_t first = pool.size();
+    uint8_t count = 0;
+    uint16_t pc = start;
+    while (true)
+    {
+        if (count == MAX_BLOCK_OPS || pc >= END_PROG_MEM)
+        {
+            DecodedOp exit = decodeOp(0, pc);
+            exit.kind = OP_EXIT;
+            pool.push_back(exit);
+            break;
+        }
+
+        DecodedOp op = decodeOp(memory[pc] << 8 | memory[pc + 1], pc);
+        pool.push_back(op);
+        ++count;
+        pc += 2;
+        if (endsBlock(op.kind))
+            break;
+    }
+    pool[first].len = count;
+
+    for (uint16_t addr = start; addr < pc; ++addr)
+        code[addr] = true;
+
+    entry[start] = first + 1;
+    ends[start] = pc;
+    return &pool[first];
+}
+
+/*
+ * IN:  (uint32_t) first address that was written
+ *      (uint32_t) number of bytes written
+ * OUT: void
+ *      Drops every block that was decoded from any of the written bytes
+ *      so that self-modifying programs get their new code decoded. This
+ *      is cheap when the write did not land on code, which is the usual
+ *      case.
+ */
+void BlockCache::invalidate(uint32_t addr, uint32_t len)
+{
+    for (uint32_t a = addr; a < addr + len && a < code.size(); ++a)
+    {
+        if (!code[a])
+            continue;
+
+        // A block covering `a` has to start at most MAX_BLOCK_OPS instructions before it
+        uint32_t lowest = a >= 2 * MAX_BLOCK_OPS ? a - 2 * MAX_BLOCK_OPS : 0;
+        for (uint32_t s = lowest; s <= a; ++s)
+        {
+            if (entry[s] != 0 && a < ends[s])
+                entry[s] = 0;
+        }
+        code[a] = false;
+    }
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      Forgets every decoded block, used when a whole new program is
+ *      loaded or when the pool has filled up with dropped blocks.
+ */
+void BlockCache::flush()
+{
+    pool.clear();
+    entry.assign(entry.size(), 0);
+    code.assign(code.size(), false);
+}
+
+/*
+ * IN:  (uint32_t) the most instructions to execute
+ * OUT: (uint32_t) the number of instructions executed
+ *      Runs whole blocks out of the block cache. Every handler below does
+ *      exactly what the matching case in runCycle does, then jumps
+ *      straight to the next handler. Only the last op of a block
+ *      touches pc, and pc is kept in a local until control goes back to
+ *      runCycle so that going from one block to the next is just the
+ *      lookup. When the budget can't fit a whole block, or pc isn't
+ *      somewhere a block can be decoded from, runCycle takes over for a
+ *      single instruction.
+ */
+uint32_t Chip8::runBlocks(uint32_t n)
+{
+    uint32_t executed = 0;
+    uint16_t nextPC = pc;
+
+#if CHIP8_COMPUTED_GOTO
+    static void* const handlers[OP_COUNT] =
+    {
+        &&OP_SYS, &&OP_CLS, &&OP_RET, &&OP_BAD_0, &&OP_JP, &&OP_CALL,
+        &&OP_SE_KK, &&OP_SNE_KK, &&OP_SE_XY, &&OP_LD_KK, &&OP_ADD_KK,
+        &&OP_LD_XY, &&OP_OR, &&OP_AND, &&OP_XOR, &&OP_ADD_XY, &&OP_SUB,
+        &&OP_SHR, &&OP_SUBN, &&OP_SHL, &&OP_BAD_8, &&OP_SNE_XY, &&OP_LD_I,
+        &&OP_JP_V0, &&OP_RND, &&OP_DRW, &&OP_SKP, &&OP_SKNP, &&OP_BAD_E,
+        &&OP_LD_VX_DT, &&OP_LD_VX_K, &&OP_LD_DT, &&OP_LD_ST, &&OP_ADD_I,
+        &&OP_LD_F, &&OP_LD_B, &&OP_LD_I_VX, &&OP_LD_VX_I, &&OP_BAD_F,
+        &&OP_EXIT
+    };
+#define HANDLER(kind) kind:
+#define DISPATCH()    goto *handlers[op->kind]
+#define NEXT()        { ++op; DISPATCH(); }
+#else
+#define HANDLER(kind) case kind:
+#define DISPATCH()    continue
+#define NEXT()        { ++op; DISPATCH(); }
+#endif
+#define END_BLOCK()   goto blockEnd
+
+    while (executed < n)
+    {
+        const DecodedOp* op = blocks.lookup(nextPC, memory);
+        if (!op || op->len > n - executed)
+        {
+            pc = nextPC;
+            runCycle();
+            nextPC = pc;
+            ++executed;
+            if (!running)
+                break;
+            continue;
+        }
+
+        executed += op->len;
+
+#if CHIP8_COMPUTED_GOTO
+        DISPATCH();
+        {
+#else
+        for (;;)
+        {
+            switch (op->kind)
+            {
+#endif
+        HANDLER(OP_SYS)
+            diag.report(DiagKind::SysCall, op->pc, memory[op->pc] << 8 | memory[op->pc + 1]);
+            NEXT();
+        HANDLER(OP_CLS)
+            clearScreen();
+            NEXT();
+        HANDLER(OP_RET)
+            nextPC = stack[sp & 0xF] + 2;
+            sp = (sp - 1) & 0xF;
+            END_BLOCK();
+        HANDLER(OP_BAD_0)
+            diag.report(DiagKind::Unknown0, op->pc, memory[op->pc] << 8 | memory[op->pc + 1]);
+            NEXT();
+        HANDLER(OP_JP)
+            nextPC = op->nnn;
+            END_BLOCK();
+        HANDLER(OP_CALL)
+            sp = (sp + 1) & 0xF;
+            stack[sp] = op->pc;
+            nextPC = op->nnn;
+            END_BLOCK();
+        HANDLER(OP_SE_KK)
+            nextPC = op->pc + (V[op->x] == op->kk ? 4 : 2);
+            END_BLOCK();
+        HANDLER(OP_SNE_KK)
+            nextPC = op->pc + (V[op->x] != op->kk ? 4 : 2);
+            END_BLOCK();
+        HANDLER(OP_SE_XY)
+            nextPC = op->pc + (V[op->x] == V[op->y] ? 4 : 2);
+            END_BLOCK();
+        HANDLER(OP_LD_KK)
+            V[op->x] = op->kk;
+            NEXT();
+        HANDLER(OP_ADD_KK)
+            V[op->x] += op->kk;
+            NEXT();
+        HANDLER(OP_LD_XY)
+            V[op->x] = V[op->y];
+            NEXT();
+        HANDLER(OP_OR)
+            V[op->x] |= V[op->y];
+            NEXT();
+        HANDLER(OP_AND)
+            V[op->x] &= V[op->y];
+            NEXT();
+        HANDLER(OP_XOR)
+            V[op->x] ^= V[op->y];
+            NEXT();
+        HANDLER(OP_ADD_XY)
+            // VF is written before the sum is taken, exactly like runCycle
+            V[0xF] = V[op->y] > 0xFF - V[op->x] ? 1 : 0;
+            V[op->x] = (V[op->x] + V[op->y]) & 0x00FF;
+            NEXT();
+        HANDLER(OP_SUB)
+            V[0xF] = V[op->x] > V[op->y] ? 1 : 0;
+            V[op->x] -= V[op->y];
+            NEXT();
+        HANDLER(OP_SHR)
+            V[0xF] = V[op->x] & 0x1;
+            V[op->x] >>= 1;
+            NEXT();
+        HANDLER(OP_SUBN)
+            V[0xF] = V[op->y] > V[op->x] ? 1 : 0;
+            V[op->x] = V[op->y] - V[op->x];
+            NEXT();
+        HANDLER(OP_SHL)
+            V[0xF] = V[op->x] >> 7;
+            V[op->x] <<= 1;
+            NEXT();
+        HANDLER(OP_BAD_8)
+            diag.report(DiagKind::Unknown8, op->pc, memory[op->pc] << 8 | memory[op->pc + 1]);
+            NEXT();
+        HANDLER(OP_SNE_XY)
+            nextPC = op->pc + (V[op->x] != V[op->y] ? 4 : 2);
+            END_BLOCK();
+        HANDLER(OP_LD_I)
+            I = op->nnn;
+            NEXT();
+        HANDLER(OP_JP_V0)
+            nextPC = op->nnn + V[0];
+            END_BLOCK();
+        HANDLER(OP_RND)
+            V[op->x] = (random() % 0xFF) & op->kk;
+            NEXT();
+        HANDLER(OP_DRW)
+            drawSprite(V[op->x], V[op->y], op->n);
+            NEXT();
+        HANDLER(OP_SKP)
+            nextPC = op->pc + (key[V[op->x] & 0xF] != 0 ? 4 : 2);
+            END_BLOCK();
+        HANDLER(OP_SKNP)
+            nextPC = op->pc + (key[V[op->x] & 0xF] == 0 ? 4 : 2);
+            END_BLOCK();
+        HANDLER(OP_BAD_E)
+            diag.report(DiagKind::UnknownE, op->pc, memory[op->pc] << 8 | memory[op->pc + 1]);
+            NEXT();
+        HANDLER(OP_LD_VX_DT)
+            V[op->x] = delayTimer;
+            NEXT();
+        HANDLER(OP_LD_VX_K)
+            // No key means no progress, like runCycle
+            if (!waitForKey(op->x))
+            {
+                nextPC = op->pc;
+                END_BLOCK();
+            }
+            nextPC = op->pc + 2;
+            END_BLOCK();
+        HANDLER(OP_LD_DT)
+            delayTimer = V[op->x];
+            NEXT();
+        HANDLER(OP_LD_ST)
+            soundTimer = V[op->x];
+            NEXT();
+        HANDLER(OP_ADD_I)
+            V[0xF] = I + V[op->x] > 0x0FFF ? 1 : 0;
+            I += V[op->x];
+            NEXT();
+        HANDLER(OP_LD_F)
+            I = V[op->x] * 0x5;
+            NEXT();
+        HANDLER(OP_LD_B)
+            storeBCD(op->x);
+            nextPC = op->pc + 2;
+            END_BLOCK();
+        HANDLER(OP_LD_I_VX)
+            storeRegisters(op->x);
+            nextPC = op->pc + 2;
+            END_BLOCK();
+        HANDLER(OP_LD_VX_I)
+            for (int i = 0; i <= op->x; ++i)
+                V[i] = memory[(I + i) & 0xFFF];
+            NEXT();
+        HANDLER(OP_BAD_F)
+            diag.report(DiagKind::UnknownF, op->pc, memory[op->pc] << 8 | memory[op->pc + 1]);
+            NEXT();
+        HANDLER(OP_EXIT)
+            nextPC = op->pc;
+            END_BLOCK();
+#if !CHIP8_COMPUTED_GOTO
+            }
+#endif
+        }
+blockEnd:
+        ;
+    }
+    pc = nextPC;
+
+#undef HANDLER
+#undef DISPATCH
+#undef NEXT
+#undef END_BLOCK
+    return executed;
+}
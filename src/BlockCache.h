@@ -0,0 +1,138 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * BlockCache.h contains the class definition for the BlockCache class.
+ * The cache decodes a program image once into basic blocks: runs of
+ * instructions that end at the first jump, call, return, skip or memory
+ * write. Every instruction in a block has its operands already pulled
+ * out of the opcode, so executing it is a single indirect jump to its
+ * handler instead of two memory reads and a walk through nested switches.
+ */
+
+#ifndef CHIP8_BLOCKCACHE_H_
+#define CHIP8_BLOCKCACHE_H_
+
+#include "Chip8State.h"
+#include <cstdint>
+#include <vector>
+
+/*
+ * One handler per Chip8 instruction. The order matters: Chip8::runBlocks
+ * keeps a jump table indexed by these values.
+ */
+enum OpKind : uint8_t
+{
+    OP_SYS,      // 0NNN with a 0x00 low byte
+    OP_CLS,      // 00E0
+    OP_RET,      // 00EE
+    OP_BAD_0,    // any other 0NNN
+    OP_JP,       // 1NNN
+    OP_CALL,     // 2NNN
+    OP_SE_KK,    // 3XKK
+    OP_SNE_KK,   // 4XKK
+    OP_SE_XY,    // 5XY0
+    OP_LD_KK,    // 6XKK
+    OP_ADD_KK,   // 7XKK
+    OP_LD_XY,    // 8XY0
+    OP_OR,       // 8XY1
+    OP_AND,      // 8XY2
+    OP_XOR,      // 8XY3
+    OP_ADD_XY,   // 8XY4
+    OP_SUB,      // 8XY5
+    OP_SHR,      // 8XY6
+    OP_SUBN,     // 8XY7
+    OP_SHL,      // 8XYE
+    OP_BAD_8,    // any other 8XYN
+    OP_SNE_XY,   // 9XY0
+    OP_LD_I,     // ANNN
+    OP_JP_V0,    // BNNN
+    OP_RND,      // CXKK
+    OP_DRW,      // DXYN
+    OP_SKP,      // EX9E
+    OP_SKNP,     // EXA1
+    OP_BAD_E,    // any other EXKK
+    OP_LD_VX_DT, // FX07
+    OP_LD_VX_K,  // FX0A
+    OP_LD_DT,    // FX15
+    OP_LD_ST,    // FX18
+    OP_ADD_I,    // FX1E
+    OP_LD_F,     // FX29
+    OP_LD_B,     // FX33
+    OP_LD_I_VX,  // FX55
+    OP_LD_VX_I,  // FX65
+    OP_BAD_F,    // any other FXKK
+    OP_EXIT,     // Not an instruction: ends a block that ran out of room
+    OP_COUNT
+};
+
+/*
+ * A single instruction with its operands already extracted.
+ */
+struct DecodedOp
+{
+    uint8_t  kind;                    // OpKind, selects the handler
+    uint8_t  x;                       // Register index from bits 8-11
+    uint8_t  y;                       // Register index from bits 4-7
+    uint8_t  n;                       // Low nibble
+    uint8_t  kk;                      // Low byte
+    uint8_t  len;                     // First op of a block only: instructions in the block
+    uint16_t nnn;                     // Low 12 bits
+    uint16_t pc;                      // Address the instruction was decoded from
+};
+
+DecodedOp decodeOp(uint16_t, uint16_t);  // Split an opcode fetched from pc into its parts
+bool endsBlock(uint8_t);                 // True if an OpKind can change pc or write memory
+
+/*
+ * A block is a straight line of ops in the pool. Only the last one may
+ * change pc in any way other than stepping to the next instruction. A
+ * block that runs out of room ends with an OP_EXIT, which is not counted
+ * in the block's `len`.
+ */
+class BlockCache
+{
+    public:
+        static const int MAX_BLOCK_OPS = 64;
+
+        BlockCache();
+
+        const DecodedOp* lookup(uint16_t, const uint8_t*); // Find or decode the block starting at pc
+        void invalidate(uint32_t, uint32_t);           // Memory in [addr, addr + len) was written
+        void flush();                                  // Forget every block
+    private:
+        const DecodedOp* decode(uint16_t, const uint8_t*);
+
+        std::vector<DecodedOp> pool;  // Ops of every block, back to back
+        std::vector<uint32_t>  entry; // 1 + pool index of the block starting at each address, 0 if none
+        std::vector<uint16_t>  ends;  // One past the last byte of the block starting at each address
+        std::vector<bool>      code;  // Bytes that were decoded into some block
+};
+
+/*
+ * IN:  (uint16_t) address of the first instruction
+ *      (const uint8_t*) the 4 KB of Chip8 memory
+ * OUT: (const DecodedOp*) the first op of the block starting at pc, or
+ *      nullptr if pc is outside of program space. The pointer stays
+ *      valid until the next call to lookup.
+ *
+ *      This is on the path between every two blocks, so the hit case is
+ *      kept down to a single table read.
+ */
+inline const DecodedOp* BlockCache::lookup(uint16_t pc, const uint8_t* memory)
+{
+    if (pc < START_PROG_MEM || pc >= END_PROG_MEM)
+        return nullptr;
+
+    uint32_t index = entry[pc];
+    if (index != 0)
+        return &pool[index - 1];
+    return decode(pc, memory);
+}
+
+#endif
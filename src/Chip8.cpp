@@ -9,137 +9,472 @@
  *
  * Chip8.cpp contains the implementation of Chip8 member functions. The Chip8
  * class is modelled after the Chip8 Virtual Machine as described by technical 
- * specifications on Wikipedia and other resources. The Chip8 class has two 
- * public-facing member functions: loadROM and play. Chip8::loadROM must be
- * called before Chip8::play. Chip8 will error out if they are called incorrectly.
+ * specifications on Wikipedia and other resources. Chip8::loadROM must be
+ * called before the machine is driven with Chip8::step or Chip8::runFrames.
+ * Nothing in here talks to SDL; Frontend.cpp is what puts the machine on
+ * screen.
  */
 
 #include "Chip8.h"
 #include "error.h"
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <vector>
 
 /*
  * Default Constructor
  * 
  * IN: void
  *     Zeroes out all data members and then loads the fontset into the Chip8 RAM.
- *     Seeds the RNG for `RND` (0xCXNN) instruction.
+ *     Seeds the RNG for `RND` (0xCXNN) instruction. Every machine has its
+ *     own generator, so two machines never share any state.
  */
-Chip8::Chip8() : opcode(0), I(0), pc(START_PROG_MEM), sp(0), stack{0}, V{0}, memory{0}, pixels{0}, delayTimer(0), soundTimer(0), key{0}, updatedPixels(true), running(true), window(nullptr), renderer(nullptr)
+Chip8::Chip8() : Chip8State(), opcode(0), cyclesPerFrame(CYCLES_PER_FRAME), updatedPixels(true), dirtyRows(ALL_ROWS), dirtyMemory(0), waitingForKey(false), running(true), idleSkipping(true), engine(Engine::Cached), platform(Platform::Chip8), jitMismatches(0), programHash(0), aotSearched(false), profiler(nullptr), debugger(nullptr)
 {
+    pc = START_PROG_MEM;
+
     // load font set into memory
     for (int i = 0; i < 80; ++i)
         memory[i] = chip8Font[i];
 
-    std::srand(0);
+    seed(0);
 }
 
 /*
- * Destructor, duh
- *
- *     Cleans up SDL and shuts down the graphic systems.
+ * IN:  (uint64_t) any number
+ * OUT: void
+ *      Restarts the RND generator. Machines seeded alike produce the same
+ *      random numbers.
  */
-Chip8::~Chip8()
+void Chip8::seed(uint64_t s)
 {
-    if (renderer)
-        SDL_DestroyRenderer(renderer);
-    if (window)
-        SDL_DestroyWindow(window);
+    rng = seedRandom(s);
+}
 
-    SDL_Quit();
+/*
+ * IN:  (string) an engine name as given on the command line
+ *      (Engine&) set to the matching engine
+ * OUT: (bool) false if the name is not an engine
+ */
+bool engineFromName(const std::string& name, Engine& engine)
+{
+    if (name == "interpreter")
+        engine = Engine::Interpreter;
+    else if (name == "cached")
+        engine = Engine::Cached;
+    else if (name == "jit")
+        engine = Engine::Jit;
+    else if (name == "jit-checked")
+        engine = Engine::JitChecked;
+    else if (name == "aot")
+        engine = Engine::Aot;
+    else
+        return false;
+    return true;
 }
 
 /*
  * IN:  (string) path to the ROM file to play
- * OUT: void
+ * OUT: (bool) true if the ROM was loaded
  *      Attempts to load the contents of the ROM into the designated
  *      program space in Chip8 memory (0x200 to 0xFFF). This function
- *      will print an error message and abort the program if the ROM
- *      is too large for the program space. If it succeeds, it will
- *      pass control to a member function to initialize SDL data members.
+ *      will print an error message and return false if the ROM can't
+ *      be opened or is too large for the program space. The platform
+ *      is switched to the one the file name points to (see
+ *      platformForROM).
  */
-void Chip8::loadROM(const std::string& romFile)
+bool Chip8::loadROM(const std::string& romFile)
 {
     using std::ifstream;
 
-    ifstream fin(romFile, std::ios::binary);
+    ifstream fin(romFile, std::ios::binary | std::ios::ate);
+    if (!fin.is_open())
+    {
+        printChip8Error("Failed to open \"" + romFile + "\"");
+        return false;
+    }
+
+    // The whole file is read at once, and has to fit in 0x200 - 0xFFF
+    std::streamoff size = fin.tellg();
+    if (size < 0 || size > END_PROG_MEM + 1 - START_PROG_MEM)
+    {
+        printChip8Error("ROM is too large for program memory space.");
+        return false;
+    }
+    std::vector<char> image(static_cast<size_t>(size));
+    fin.seekg(0);
+    if (!fin.read(image.data(), size))
+    {
+        printChip8Error("Failed to read \"" + romFile + "\"");
+        return false;
+    }
+
+    if (!loadProgram(reinterpret_cast<const uint8_t*>(image.data()), image.size(), romFile))
+        return false;
+    setPlatform(platformForROM(romFile));
+    return true;
+}
+
+/*
+ * IN:  (const RomEntry&) a ROM in a RomCatalog
+ * OUT: (bool) false if it doesn't fit in program memory
+ *      One copy straight out of the catalog's mapping. The machine takes
+ *      the entry's platform; its preferred speed is left to the caller.
+ */
+bool Chip8::loadROM(const RomEntry& rom)
+{
+    if (!loadProgram(rom.data, rom.size, rom.path))
+        return false;
+    setPlatform(rom.platform);
+    return true;
+}
+
+/*
+ * IN:  (Platform) the platform whose quirks to follow from now on
+ * OUT: void
+ *      SUPER-CHIP's big digits are put in memory for FX30 to point at,
+ *      unless they are there already, so the engines keep what they
+ *      decoded. Call it after loadROM, which picks a platform of its own.
+ */
+void Chip8::setPlatform(Platform p)
+{
+    platform = p;
+    if (p == Platform::SuperChip && std::memcmp(memory + BIG_FONT_START, superChipFont, sizeof(superChipFont)) != 0)
+    {
+        std::memcpy(memory + BIG_FONT_START, superChipFont, sizeof(superChipFont));
+        wroteMemory(BIG_FONT_START, sizeof(superChipFont));
+    }
+}
+
+/*
+ * IN:  (const uint8_t*) a Chip8 program
+ *      (size_t) its size in bytes
+ *      (string) a name for it, as romName() will report it
+ * OUT: (bool) false if it doesn't fit in program memory
+ *      For programs that don't live in a file, such as the ones the
+ *      benchmarks put together.
+ */
+bool Chip8::loadProgram(const uint8_t* program, size_t size, const std::string& name)
+{
+    if (size > END_PROG_MEM + 1 - START_PROG_MEM)
+    {
+        printChip8Error("Program is too large for program memory space.");
+        return false;
+    }
+
+    std::memcpy(memory + START_PROG_MEM, program, size);
+    blocks.flush();
+    jit.flush();
+    aot.detach();
+    programHash = programImageHash(state());
+    aotSearched = false;
+    currentROM = name;
+    diag.restart(name);
+    return true;
+}
+
+/*
+ * IN:  (uint32_t) the most instructions to execute
+ * OUT: (StepResult) what happened while running
+ *      Runs instructions back to back without touching any outside
+ *      systems, using whichever execution engine is selected. It stops
+ *      early only if the machine halts, or an attached debugger pauses
+ *      it. The timers are left alone, they belong to frames (see
+ *      runFrames and tickTimers).
+ *
+ *      With idle skipping on, every IDLE_SLICE instructions (and so at
+ *      the start of every frame) it looks for an idle loop at pc, and
+ *      skips what is left of the batch if there is one (see skipIdle).
+ */
+StepResult Chip8::step(uint32_t n)
+{
+    StepResult result = {};
 
-    // Read the ROM into memory, stopping when end of file or end of program space is reached
-    if (fin.is_open())
+    updatedPixels = false;
+    // The other engines only know the default platform
+    Engine e = (platform == Platform::Chip8) ? engine : Engine::Interpreter;
+    bool skipping = idleSkipping;
+#if CHIP8_PROFILE
+    // Only the interpreter sees instructions one at a time, and every one
+    // of them has to be seen
+    if (profiler)
+    {
+        e = Engine::Interpreter;
+        skipping = false;
+    }
+#endif
+    if (debugger)
     {
-        currentROM = romFile;
-        fin.peek();
-        for (int i = 0; !fin.eof() && (i + START_PROG_MEM < END_PROG_MEM); ++i)
-            memory[i + START_PROG_MEM] = fin.get();
-
-        // If this peek does not trigger EOF, then the file is too large.
-        if (fin.peek() != EOF)
-            abortChip8("ROM is too large for program memory space.");
-        fin.close();
+        result.cycles = runDebugged(n);
+        result.stopped = debugger->paused();
     }
+    else if (!skipping)
+        result.cycles = runEngine(e, n);
     else
-        abortChip8("Failed to open \"" + romFile + "\"");
+    {
+        while (running && result.cycles < n)
+        {
+            result.cycles += skipIdle(n - result.cycles, result.idle);
+            if (result.idle)
+            {
+                // Less than one lap is left, it has to end up where it would have
+                result.cycles += runEngine(e, n - result.cycles);
+                break;
+            }
+            if (running && result.cycles < n)
+                result.cycles += runEngine(e, std::min(n - result.cycles, IDLE_SLICE));
+        }
+    }
 
-    // ROM is good, boot up display
-    initVideo();
+    result.drawn = updatedPixels;
+    result.sound = soundTimer > 0;
+    result.waitingForKey = waitingForKey;
+    result.halted = !running;
+    return result;
 }
 
 /*
- * IN:  void
+ * IN:  (Engine) how to execute them
+ *      (uint32_t) the most instructions to execute
+ * OUT: (uint32_t) the number executed
+ */
+uint32_t Chip8::runEngine(Engine e, uint32_t n)
+{
+    uint32_t cycles = 0;
+    switch (e)
+    {
+        case Engine::Interpreter:
+            cycles = runInterpreter(n);
+            break;
+        case Engine::Cached:
+            cycles = runBlocks(n);
+            break;
+        case Engine::Jit:
+        case Engine::JitChecked:
+            // Without a code generator for this host the block cache is the next best thing
+            if (Jit::available())
+                cycles = runJit(n, e == Engine::JitChecked);
+            else
+                cycles = runBlocks(n);
+            break;
+        case Engine::Aot:
+            // The module is looked for on first use, so the engine can be
+            // picked before or after the ROM is loaded
+            if (!aotSearched)
+            {
+                aot.attach(programHash);
+                aotSearched = true;
+            }
+            cycles = aot.attached() ? runAot(n) : runBlocks(n);
+            break;
+    }
+    return cycles;
+}
+
+/*
+ * IN:  (uint8_t) an OpKind
+ * OUT: (bool) true if it reads and writes nothing but registers, timers
+ *      and keys, and reads memory without writing it, so running it twice
+ *      from the same state does the same thing twice
+ */
+static bool idleSafe(uint8_t kind)
+{
+    switch (kind)
+    {
+        case OP_JP:
+        case OP_SE_KK:
+        case OP_SNE_KK:
+        case OP_SE_XY:
+        case OP_LD_KK:
+        case OP_ADD_KK:
+        case OP_LD_XY:
+        case OP_OR:
+        case OP_AND:
+        case OP_XOR:
+        case OP_ADD_XY:
+        case OP_SUB:
+        case OP_SHR:
+        case OP_SUBN:
+        case OP_SHL:
+        case OP_SNE_XY:
+        case OP_LD_I:
+        case OP_JP_V0:
+        case OP_SKP:
+        case OP_SKNP:
+        case OP_LD_VX_DT:
+        case OP_LD_VX_K:
+        case OP_LD_DT:
+        case OP_LD_ST:
+        case OP_ADD_I:
+        case OP_LD_F:
+        case OP_LD_VX_I:
+            return true;
+    }
+    return false;
+}
+
+/*
+ * IN:  (uint32_t) the most instructions to execute
+ *      (bool&) set if the machine is in an idle loop
+ * OUT: (uint32_t) the number executed or skipped
+ *      Runs the interpreter from pc for at most IDLE_PROBE instructions,
+ *      stopping before anything that draws, writes memory, calls,
+ *      returns, takes a random number or prints. If that comes back to
+ *      the same pc with the registers, I and the timers as they were,
+ *      the loop can only go round the same way until a key changes or a
+ *      timer ticks, and neither happens inside step(). That covers a
+ *      jump to itself, FX0A with no key down and polling the delay timer
+ *      or the keys. All the whole laps that fit in what is left of n are
+ *      then counted as executed without running them; the part of a lap
+ *      left over is left to the caller so pc ends up exactly where
+ *      running every instruction would have left it.
+ */
+uint32_t Chip8::skipIdle(uint32_t n, bool& idle)
+{
+    uint16_t start = pc;
+    uint16_t startI = I;
+    uint8_t startV[16];
+    uint8_t startDelay = delayTimer;
+    uint8_t startSound = soundTimer;
+    std::memcpy(startV, V, sizeof(startV));
+
+    uint32_t lap = 0;
+    uint32_t limit = std::min(n, IDLE_PROBE);
+    idle = false;
+    while (lap < limit)
+    {
+        if (pc < START_PROG_MEM || pc >= END_PROG_MEM)
+            return lap;
+        if (!idleSafe(decodeOp(static_cast<uint16_t>(memory[pc] << 8 | memory[pc + 1]), pc).kind))
+            return lap;
+        runCycle();
+        ++lap;
+        if (pc == start)
+            break;
+    }
+
+    if (lap == 0 || pc != start || I != startI || delayTimer != startDelay || soundTimer != startSound ||
+        std::memcmp(startV, V, sizeof(startV)) != 0)
+        return lap;
+
+    idle = true;
+    return lap + (n - lap) / lap * lap;
+}
+
+/*
+ * IN:  (uint32_t) the most instructions to execute
+ * OUT: (uint32_t) the number executed
+ *      The interpreter loop with the debugger asked before and after
+ *      every instruction. Only a machine with a debugger attached ever
+ *      comes through here.
+ */
+uint32_t Chip8::runDebugged(uint32_t n)
+{
+    uint32_t cycles = 0;
+    while (running && cycles < n && debugger->before(pc))
+    {
+        runCycle();
+        ++cycles;
+        if (!debugger->after(*this, running))
+            break;
+    }
+    return cycles;
+}
+
+/*
+ * IN:  (uint32_t) the number of frames to run
+ * OUT: (StepResult) what happened while running, summed over every frame
+ *      A frame is `cyclesPerFrame` instructions followed by one tick of
+ *      the delay and sound timers, so the timers run at exactly 60 Hz of
+ *      emulated time no matter how many instructions a frame holds.
+ *      A frame a debugger paused in the middle of is not finished, so
+ *      its timers don't tick; drive the machine with step() to resume it
+ *      part way.
+ */
+StepResult Chip8::runFrames(uint32_t frames)
+{
+    StepResult total = {};
+
+    for (uint32_t f = 0; f < frames && running; ++f)
+    {
+        StepResult frame = step(cyclesPerFrame);
+        if (!frame.stopped)
+            tickTimers();
+        frame.sound = soundTimer > 0;
+        total.cycles += frame.cycles;
+        total.drawn = total.drawn || frame.drawn;
+        total.sound = frame.sound;
+        total.waitingForKey = frame.waitingForKey;
+        total.halted = frame.halted;
+        total.stopped = frame.stopped;
+        total.idle = frame.idle;
+        if (frame.stopped)
+            break;
+    }
+    return total;
+}
+
+/*
+ * IN:  (int) the Chip8 key, 0x0 - 0xF
+ *      (bool) true if the key is down
  * OUT: void
- *      Attempts to open a window and attach a renderer onto it using
- *      SDL. If either of these operations fail, the Chip8 will display
- *      its own error alongside SDL's provided error message.
  */
-void Chip8::initVideo()
+void Chip8::setKey(int k, bool pressed)
 {
-    // set up SDL
-    if (SDL_Init(SDL_INIT_VIDEO) < 0)
-        abortChip8(std::string("SDL2 failed to initialize. . . ") + SDL_GetError());
-
-    // set up window
-    std::string winTitle = PROG_NAME + std::string(" ") + currentROM;
-    window = SDL_CreateWindow(winTitle.c_str(), SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, (X_RES * SCALE), (Y_RES * SCALE), SDL_WINDOW_SHOWN);
-    if (!window)
-        abortChip8(std::string("SDL2 failed to create window. . . ") + SDL_GetError());
-
-    //set up renderer
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-    if (!renderer)
-        abortChip8(std::string("SDL2 failed to create renderer. . . ") + SDL_GetError());
-    SDL_RenderSetScale(renderer, SCALE, SCALE);
+    key[k & 0xF] = pressed ? 1 : 0;
 }
 
 /*
  * IN:  void
  * OUT: void
- *      The main life-cycle loop. While the CPU is in a running state,
- *      it will run a cycle (fetch, decode, & execute instruction), if
- *      a DRW instruction was recently executed, it will call a draw method
- *      to use SDL to update the display, and finally it will handle user
- *      input.
+ *      Fetches, decodes and executes one instruction the way this
+ *      machine's platform would. Everything that goes one instruction at
+ *      a time (the debugger, idle skipping, the other engines when they
+ *      have nothing decoded) comes through here; runInterpreter picks the
+ *      platform once for a whole batch instead.
  */
-void Chip8::play()
+void Chip8::runCycle()
 {
-    if (currentROM.empty())
-        abortChip8("No ROM file has been loaded, nothing to do.");
-    uint32_t lastUpdate = 0, currentTime;
-    while (running)
+    switch (platform)
     {
-        currentTime = SDL_GetTicks();
-
-        // Only cycle 60 times per second
-        if (currentTime - lastUpdate >= REFRESH_RATE)
-            runCycle();
-        else
-            SDL_Delay(2);
+        case Platform::Chip8:     execute<Platform::Chip8>();     break;
+        case Platform::Cosmac:    execute<Platform::Cosmac>();    break;
+        case Platform::Chip48:    execute<Platform::Chip48>();    break;
+        case Platform::SuperChip: execute<Platform::SuperChip>(); break;
+    }
+}
 
-        if (updatedPixels)
-            draw();
-        interact();
+/*
+ * IN:  (uint32_t) the most instructions to execute
+ * OUT: (uint32_t) the number executed
+ */
+uint32_t Chip8::runInterpreter(uint32_t n)
+{
+    switch (platform)
+    {
+        case Platform::Chip8:     return runAs<Platform::Chip8>(n);
+        case Platform::Cosmac:    return runAs<Platform::Cosmac>(n);
+        case Platform::Chip48:    return runAs<Platform::Chip48>(n);
+        case Platform::SuperChip: return runAs<Platform::SuperChip>(n);
+    }
+    return 0;
+}
 
-        lastUpdate = currentTime;
+/*
+ * IN:  (uint32_t) the most instructions to execute
+ * OUT: (uint32_t) the number executed
+ */
+template <Platform P>
+uint32_t Chip8::runAs(uint32_t n)
+{
+    uint32_t cycles = 0;
+    while (running && cycles < n)
+    {
+        execute<P>();
+        ++cycles;
     }
+    return cycles;
 }
 
 /*
@@ -150,14 +485,29 @@ void Chip8::play()
  *      kind of operation it is and then executing that instruction.
  *      The Program Counter is then adjusted appropriately to be
  *      ready for the next cycle.
+ *
+ *      Where the platforms disagree it asks Quirks<P>, which is known
+ *      when this is compiled, so each platform gets a copy of its own
+ *      with only its side of every quirk left in.
  */
-void Chip8::runCycle()
+template <Platform P>
+void Chip8::execute()
 {
+    typedef Quirks<P> Q;
+
     if (pc > END_PROG_MEM || pc < START_PROG_MEM)
-        abortChip8("Seg fault!");
+    {
+        diag.report(DiagKind::SegFault, pc, 0);
+        running = false;
+        return;
+    }
 
-    // Load the two byte quantity for decoding
-    opcode = memory[pc] << 8 | memory[pc + 1];
+    // Load the two byte quantity for decoding, at 0xFFF the second byte wraps to 0x000
+    opcode = memory[pc] << 8 | memory[(pc + 1) & 0xFFF];
+#if CHIP8_PROFILE
+    if (profiler)
+        profiler->enter(pc, opcode);
+#endif
 
     // Isolate highest 4 bits which contain opcode
     switch (opcode & 0xF000)
@@ -172,23 +522,24 @@ void Chip8::runCycle()
             {
                 // 0x0NNN - SYS - call unused, this is a chip8 system call
                 case 0x0000:
-                    printChip8Error("RCA 1802 system call is not supported. :(");
+                    diag.report(DiagKind::SysCall, pc, opcode);
                     pc += 2;
                     break;
                 // 0x00E0 - CLS - clears the screen
                 case 0x00E0:
-                    for (int i = 0; i < (X_RES * Y_RES); ++i)
-                        pixels[i] = 0;
-                    updatedPixels = true;
+                    clearScreen();
                     pc += 2;
                     break;
                 // 0x00EE - RET - return from a function call
                 case 0x00EE: 
-                    pc = stack[sp--];
+                    pc = stack[sp & 0xF];
+                    sp = (sp - 1) & 0xF;
                     pc += 2;
                     break;
+                // 0x00CN, 0x00FB - 0x00FF - SUPER-CHIP scrolling, exit and resolution
                 default:
-                    printChip8Error("Encountered unknown (mangled?) opcode for 0x0. Skipping.");
+                    if (!Q::superChip || !superChipSystem())
+                        diag.report(DiagKind::Unknown0, pc, opcode);
                     pc += 2;
                     break;
             }
@@ -199,7 +550,8 @@ void Chip8::runCycle()
             break;
         // 0x2NNN - CAL - call subroutine at address `NNN`
         case 0x2000:
-            stack[++sp] = pc;
+            sp = (sp + 1) & 0xF;
+            stack[sp] = pc;
             pc = NNN;
             break;
         // 0x3XKK - SE  - skip next instruction if VX == `KK`
@@ -242,20 +594,33 @@ void Chip8::runCycle()
                 // 0x8XY1 - SET - VX = VX | VY
                 case 0x0001:
                     VX |= VY;
+                    if (Q::logicResetsVF)
+                        V[0xF] = 0;
                     pc += 2;
                     break;
                 // 0x8XY2 - SET - VX = VX & VY
                 case 0x0002:
                     VX &= VY;
+                    if (Q::logicResetsVF)
+                        V[0xF] = 0;
                     pc += 2;
                     break;
                 // 0x8XY3 - SET - VX = VX ^ VY
                 case 0x0003:
                     VX ^= VY;
+                    if (Q::logicResetsVF)
+                        V[0xF] = 0;
                     pc += 2;
                     break;
                 // 0x8XY4 - SET - VX += VY (VF is set to 1 if there's a carry, 0 if not)
                 case 0x0004:
+                    if (Q::exactFlags)
+                    {
+                        uint16_t sum = VX + VY;
+                        VX = sum & 0x00FF;
+                        V[0xF] = sum >> 8;
+                    }
+                    else
                     {
                         if (VY > 0xFF - VX)
                             V[0xF] = 1;
@@ -264,42 +629,78 @@ void Chip8::runCycle()
 
                         uint16_t temp = VX + VY;
                         VX = temp & 0x00FF;
-                        pc += 2;
-                        break;
                     }
+                    pc += 2;
+                    break;
                 // 0x8XY5 - SET - VX -= VY (VF is set to 0 if there's a borrow, 1 if not)
                 case 0x0005:
-                    if (VX > VY)
-                        V[0xF] = 1;
+                    if (Q::exactFlags)
+                    {
+                        uint8_t noBorrow = VX >= VY;
+                        VX -= VY;
+                        V[0xF] = noBorrow;
+                    }
                     else
-                        V[0xF] = 0;
+                    {
+                        if (VX > VY)
+                            V[0xF] = 1;
+                        else
+                            V[0xF] = 0;
 
-                    VX -= VY;
+                        VX -= VY;
+                    }
                     pc += 2;
                     break;
                 // 0x8XY6 - SET - VX = VX >> 1 (VF is LSB of VX prior to shift)
                 case 0x0006:
-                    V[0xF] = VX & 0x1;
-                    VX >>= 1;
+                    if (Q::exactFlags)
+                    {
+                        uint8_t source = Q::shiftReadsVY ? VY : VX;
+                        VX = source >> 1;
+                        V[0xF] = source & 0x1;
+                    }
+                    else
+                    {
+                        V[0xF] = (Q::shiftReadsVY ? VY : VX) & 0x1;
+                        VX = (Q::shiftReadsVY ? VY : VX) >> 1;
+                    }
                     pc += 2;
                     break;
                 // 0x8XY7 - SET - VX = VY - VX (VF is set to 0 if there's a borrow, 1 if not)
                 case 0x0007:
-                    if (VY > VX)
-                        V[0xF] = 1;
+                    if (Q::exactFlags)
+                    {
+                        uint8_t noBorrow = VY >= VX;
+                        VX = VY - VX;
+                        V[0xF] = noBorrow;
+                    }
                     else
-                        V[0xF] = 0;
-                    VX = VY - VX;
+                    {
+                        if (VY > VX)
+                            V[0xF] = 1;
+                        else
+                            V[0xF] = 0;
+                        VX = VY - VX;
+                    }
                     pc += 2;
                     break;
                 // 0x8XYE - SET - VX = VX << 1 (VF is MSB of VX prior to shift)
                 case 0x000E:
-                    V[0xF] = VX >> 7;
-                    VX <<= 1;
+                    if (Q::exactFlags)
+                    {
+                        uint8_t source = Q::shiftReadsVY ? VY : VX;
+                        VX = source << 1;
+                        V[0xF] = source >> 7;
+                    }
+                    else
+                    {
+                        V[0xF] = (Q::shiftReadsVY ? VY : VX) >> 7;
+                        VX = (Q::shiftReadsVY ? VY : VX) << 1;
+                    }
                     pc += 2;
                     break;
                 default:
-                    printChip8Error("Encountered unknown (mangled?) opcode for 0x8. Skipping.");
+                    diag.report(DiagKind::Unknown8, pc, opcode);
                     pc += 2;
                     break;
             }
@@ -315,58 +716,42 @@ void Chip8::runCycle()
             I = NNN;
             pc += 2;
             break;
-        // 0xBNNN - JMP - jump to address `NNN` + V0
+        // 0xBNNN - JMP - jump to address `NNN` + V0 (CHIP-48 reads it as BXNN, XNN + VX)
         case 0xB000:
-            pc = NNN + V[0];
+            pc = NNN + (Q::jumpUsesVX ? VX : V[0]);
             break;
         // 0xCXKK - SET - VX = randomNum & KK
         case 0xC000:
-            VX = (std::rand() % 0xFF) & KK;
+            VX = (random() % 0xFF) & KK;
             pc += 2;
             break;
         // 0xDXYN - DRW - draw sprite at coordinates
         case 0xD000:
-            {
-                uint16_t height = opcode & 0x000F;
-                uint16_t pixel;
-
-                V[0xF] = 0;
-                for (uint8_t row = 0; row < height; ++row)
-                {
-                    // load pixel
-                    pixel = memory[I + row];
-                    for (uint8_t col = 0; col < 8; ++col)
-                    {
-                        if ((pixel & (0x80 >> col)) != 0)
-                        {
-                            if (pixels[(VX + col + ((VY + row) * X_RES))] == 1)
-                                V[0xF] = 1;
-                            pixels[VX + col + ((VY + row) * X_RES)] ^= 1;
-                        }
-                    }
-                }
-                updatedPixels = true;
-                pc += 2;
-                break;
-            }
+            if (Q::superChip)
+                drawSuperSprite(VX, VY, opcode & 0x000F);
+            else
+                drawSprite(VX, VY, opcode & 0x000F);
+            pc += 2;
+            break;
         // Special case: multiple opcodes start with 0xE as highest 4 bits
         case 0xE000:
             switch (opcode & 0x00FF)
             {
-                // 0xEX9E - SIP - skip next instruction if key stored in VX is pressed
+                // 0xEX9E - SIP - skip next instruction if key stored in VX is pressed (only the
+                //               low nibble of VX names a key, the keypad has 16 of them)
                 case 0x009E: 
-                    if (key[VX] != 0)
+                    if (key[VX & 0xF] != 0)
                         pc += 2;
                     pc += 2;
                     break;
                 // 0xEXA1 - SNP - skip next instruction if key stored in VX ISN'T pressed
                 case 0x00A1:
-                    if (key[VX] == 0)
+                    if (key[VX & 0xF] == 0)
                         pc += 2;
                     pc += 2;
                     break;
                 default:
-                    printChip8Error("Encountered unknown (mangled?) opcode for 0xE. Skipping.");
+                    diag.report(DiagKind::UnknownE, pc, opcode);
                     pc += 2;
                     break;
             }
@@ -382,21 +767,9 @@ void Chip8::runCycle()
                     break;
                 // 0xFX0A - SET - wait for keypress, then store it in VX
                 case 0x000A:  
-                    {
-                        bool keyPressed = false;
-                        for (int i = 0; i < 16; ++i)
-                        {
-                            if (key[i] != 0)
-                            {
-                                VX = i;
-                                keyPressed = true;
-                            }
-                        }
-                        if (!keyPressed)
-                            return;
+                    if (waitForKey((opcode & 0x0F00) >> 8))
                         pc += 2;
-                        break;
-                    }
+                    break;
                 // 0xFX15 - SET - delay timer to VX
                 case 0x0015:
                     delayTimer = VX;
@@ -409,10 +782,13 @@ void Chip8::runCycle()
                     break;
                 // 0xFX1E - SET - I += VX
                 case 0x001E:
-                    if (I + VX > 0x0FFF)
-                        V[0xF] = 1;
-                    else
-                        V[0xF] = 0;
+                    if (Q::addIndexFlags)
+                    {
+                        if (I + VX > 0x0FFF)
+                            V[0xF] = 1;
+                        else
+                            V[0xF] = 0;
+                    }
 
                     I += VX;
                     pc += 2;
@@ -422,183 +798,397 @@ void Chip8::runCycle()
                     I = VX * 0x5;
                     pc += 2;
                     break;
+                // 0xFX30 - SET - I to location of the SUPER-CHIP 8x10 sprite for the digit in VX
+                case 0x0030:
+                    if (Q::superChip)
+                        I = BIG_FONT_START + (VX & 0xF) * 10;
+                    else
+                        diag.report(DiagKind::UnknownF, pc, opcode);
+                    pc += 2;
+                    break;
                 // 0xFX33 - SET - Store decimal representation of VX in I.
                 case 0x0033:    
-                    {
-                        // The value in register X is at MOST 255 (0xFF)
-                        memory[I] = VX / 100;
-                        memory[I + 1] = (VX / 10) % 10;
-                        memory[I + 2] = (VX % 100) % 10;
-                        pc += 2;
-                        break;
-                    }
+                    storeBCD((opcode & 0x0F00) >> 8);
+                    pc += 2;
+                    break;
                 // 0xFX55 - SET - Stores V0 through VX in memory starting at address I
                 case 0x0055:
-                    for (int i = 0; i <= ((opcode & 0x0F00) >> 8); ++i)
-                        memory[I + i] = V[i];   // maybe I should change `i` to `k`
+                    storeRegisters((opcode & 0x0F00) >> 8);
+                    if (Q::indexAdvance != KeepI)
+                        I += ((opcode & 0x0F00) >> 8) + (Q::indexAdvance == AdvanceXPlus1);
                     pc += 2;
                     break; 
                 // 0xFX65 - SET - Fills V0 through VX with values in memory starting at I
                 case 0x0065:
                     for (int i = 0; i <= ((opcode & 0x0F00) >> 8); ++i)
-                        V[i] = memory[I + i];
+                        V[i] = memory[(I + i) & 0xFFF];
+                    if (Q::indexAdvance != KeepI)
+                        I += ((opcode & 0x0F00) >> 8) + (Q::indexAdvance == AdvanceXPlus1);
+                    pc += 2;
+                    break;
+                // 0xFX75 - SET - Stores V0 through VX (X < 8) in the SUPER-CHIP flag registers
+                case 0x0075:
+                    if (Q::superChip)
+                    {
+                        for (int i = 0; i <= ((opcode & 0x0700) >> 8); ++i)
+                            flags[i] = V[i];
+                    }
+                    else
+                        diag.report(DiagKind::UnknownF, pc, opcode);
+                    pc += 2;
+                    break;
+                // 0xFX85 - SET - Fills V0 through VX (X < 8) from the SUPER-CHIP flag registers
+                case 0x0085:
+                    if (Q::superChip)
+                    {
+                        for (int i = 0; i <= ((opcode & 0x0700) >> 8); ++i)
+                            V[i] = flags[i];
+                    }
+                    else
+                        diag.report(DiagKind::UnknownF, pc, opcode);
+                    pc += 2;
+                    break;
+                default:
+                    diag.report(DiagKind::UnknownF, pc, opcode);
                     pc += 2;
                     break;
             }
             break;
-        default:
-            printChip8Error("Unknown Opcode. Skipping.");
-            pc += 2;
-            break;
     }
+#if CHIP8_PROFILE
+    if (profiler)
+        profiler->leave();
+#endif
+}
 
-    if (delayTimer > 0)
-        --delayTimer;
+/*
+ * IN:  (uint8_t) x coordinate of the sprite's top left corner
+ *      (uint8_t) y coordinate of the sprite's top left corner
+ *      (uint8_t) height of the sprite in rows, the sprite data starts at I
+ * OUT: void
+ *      XORs an 8 pixel wide sprite onto the screen. VF is set to 1 if
+ *      any lit pixel was turned off (a collision) and 0 otherwise.
+ *      Each sprite row is a single shift, AND and XOR against the packed
+ *      row of the screen.
+ */
+void Chip8::drawSprite(uint8_t x, uint8_t y, uint8_t height)
+{
+    uint64_t collided = 0;
 
-    if (soundTimer > 0)
+    // the starting corner wraps around the screen, the sprite itself is
+    // clipped at the right and bottom edges
+    x %= X_RES;
+    y %= Y_RES;
+    if (height > Y_RES - y)
+        height = Y_RES - y;
+
+    for (uint8_t row = 0; row < height; ++row)
     {
-        if (soundTimer == 1)
-            // TODO PLAY SOUND
-            --soundTimer;
+        // the sprite row lands in the top byte and is shifted over to
+        // column x, anything pushed past column 63 falls off the end
+        uint64_t bits = (static_cast<uint64_t>(memory[(I + row) & 0xFFF]) << 56) >> x;
+        collided |= pixels[y + row] & bits;
+        pixels[y + row] ^= bits;
     }
+    V[0xF] = (collided != 0);
+    dirtyRows |= ((1ULL << height) - 1) << y;
+    updatedPixels = true;
 }
 
 /*
- * IN:  void
+ * IN:  (uint8_t) x coordinate of the sprite's top left corner
+ *      (uint8_t) y coordinate of the sprite's top left corner
+ *      (uint8_t) height of the sprite in rows, 0 for a 16x16 sprite
  * OUT: void
- *      Iterates through the pixels data member which indicates which
- *      pixels should be turned on or off. If the pixel is active, SDL
- *      will draw the pixel on the renderer and reset the pixelsUpdated
- *      flag to indicate that a draw was completed and there's no more work
- *      to be done.
+ *      drawSprite for SUPER-CHIP, onto whichever screen is showing. A
+ *      16x16 sprite is two bytes per row. A row of the 128x64 screen is
+ *      two words, so a sprite row is shifted across both of them.
  */
-void Chip8::draw()
+void Chip8::drawSuperSprite(uint8_t x, uint8_t y, uint8_t height)
 {
-    SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xFF);
-    SDL_RenderClear(renderer);
-    SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
-    for (int y = 0; y < Y_RES; ++y)
+    uint64_t collided = 0;
+    bool wide = (height == 0);
+    int columns = hires ? HI_X_RES : X_RES;
+    int rows = hires ? HI_Y_RES : Y_RES;
+
+    if (wide)
+        height = 16;
+    x %= columns;
+    y %= rows;
+    if (height > rows - y)
+        height = rows - y;
+
+    for (uint8_t row = 0; row < height; ++row)
     {
-        for (int x = 0; x < X_RES; ++x)
+        uint64_t sprite = wide ? (static_cast<uint64_t>(memory[(I + 2 * row) & 0xFFF]) << 56 | static_cast<uint64_t>(memory[(I + 2 * row + 1) & 0xFFF]) << 48)
+                               : static_cast<uint64_t>(memory[(I + row) & 0xFFF]) << 56;
+        if (!hires)
         {
-            if (pixels[(y * X_RES) + x] != 0)
-                SDL_RenderDrawPoint(renderer, x, y);
+            uint64_t bits = sprite >> x;
+            collided |= pixels[y + row] & bits;
+            pixels[y + row] ^= bits;
+            continue;
         }
+
+        uint64_t* line = hiPixels[y + row];
+        uint64_t left = (x < 64) ? sprite >> x : 0;
+        uint64_t right = (x == 0) ? 0 : ((x < 64) ? sprite << (64 - x) : sprite >> (x - 64));
+        collided |= (line[0] & left) | (line[1] & right);
+        line[0] ^= left;
+        line[1] ^= right;
     }
-    SDL_RenderPresent(renderer);
-    updatedPixels = false;
-    //SDL_Delay(5);
+    V[0xF] = (collided != 0);
+    dirtyRows |= ((1ULL << height) - 1) << y;
+    updatedPixels = true;
+}
+
+/*
+ * IN:  void
+ * OUT: (bool) false if the opcode isn't one of SUPER-CHIP's 0x0 opcodes
+ *      00CN scrolls down N rows, 00FB and 00FC scroll right and left 4
+ *      columns, 00FD stops the machine and 00FE and 00FF switch to the
+ *      64x32 and 128x64 screens. Scrolling moves whichever screen is
+ *      showing by its own pixels, and switching clears both.
+ */
+bool Chip8::superChipSystem()
+{
+    int rows = hires ? HI_Y_RES : Y_RES;
+    int n = opcode & 0x000F;
+
+    if ((opcode & 0xFFF0) == 0x00C0)
+    {
+        if (n > rows)
+            n = rows;
+        if (hires)
+        {
+            std::memmove(hiPixels[n], hiPixels[0], (rows - n) * sizeof(hiPixels[0]));
+            std::memset(hiPixels[0], 0, n * sizeof(hiPixels[0]));
+        }
+        else
+        {
+            std::memmove(pixels + n, pixels, (rows - n) * sizeof(pixels[0]));
+            std::memset(pixels, 0, n * sizeof(pixels[0]));
+        }
+    }
+    else if (opcode == 0x00FB || opcode == 0x00FC)
+    {
+        bool right = (opcode == 0x00FB);
+        for (int row = 0; row < rows; ++row)
+        {
+            if (!hires)
+                pixels[row] = right ? pixels[row] >> 4 : pixels[row] << 4;
+            else if (right)
+            {
+                hiPixels[row][1] = (hiPixels[row][1] >> 4) | (hiPixels[row][0] << 60);
+                hiPixels[row][0] >>= 4;
+            }
+            else
+            {
+                hiPixels[row][0] = (hiPixels[row][0] << 4) | (hiPixels[row][1] >> 60);
+                hiPixels[row][1] <<= 4;
+            }
+        }
+    }
+    else if (opcode == 0x00FD)
+        running = false;
+    else if (opcode == 0x00FE || opcode == 0x00FF)
+    {
+        hires = (opcode == 0x00FF);
+        clearScreen();
+    }
+    else
+        return false;
+
+    dirtyRows = hires ? HI_ALL_ROWS : ALL_ROWS;
+    updatedPixels = true;
+    return true;
 }
 
 /*
  * IN:  void
  * OUT: void
- *      Processes the input queue and tests to see if the user exited
- *      the window or if a Chip8 key has been pressed. If the key was
- *      pressed, it will update the `key` data member and set it to 1.
- *      If the key was released, the `key` data member will be reset to
- *      0.
- *
- *      Since the Chip8 originally operated under a hex keypad (left),
- *      the keybindings are set to be more comfortable bindings on a
- *      regular QWERTY keyboard. So pressing '4' will send the signal
- *      to the Chip8 that 'C' was pressed.
- *
- *      CHIP8 Keypad          Modern Keyboard
- *       |1|2|3|C|              |1|2|3|4|
- *       |4|5|6|D|      ->      |Q|W|E|R|
- *       |7|8|9|E|              |A|S|D|F|
- *       |A|0|B|F|              |Z|X|C|V|
+ *      00E0, turns every pixel off, on both screens.
+ */
+void Chip8::clearScreen()
+{
+    std::memset(pixels, 0, sizeof(pixels));
+    std::memset(hiPixels, 0, sizeof(hiPixels));
+    dirtyRows = hires ? HI_ALL_ROWS : ALL_ROWS;
+    updatedPixels = true;
+}
+
+/*
+ * IN:  void
+ * OUT: (uint64_t) the rows drawn to since the last call, bit n is row n
+ *      A front end can use this to only re-upload the rows that changed.
  */
-void Chip8::interact()
+uint64_t Chip8::takeDirtyRows()
 {
-    SDL_Event event;
+    uint64_t rows = dirtyRows;
+    dirtyRows = 0;
+    return rows;
+}
 
-    while (SDL_PollEvent(&event) != 0)
+/*
+ * IN:  void
+ * OUT: (uint64_t) bit n set if the program (FX33, FX55) or loadState
+ *      wrote to memory[64n .. 64n + 63] since the last call
+ */
+uint64_t Chip8::takeDirtyMemory()
+{
+    uint64_t lines = dirtyMemory;
+    dirtyMemory = 0;
+    return lines;
+}
+
+/*
+ * IN:  (const Chip8State&) the state to go back to
+ *      (uint64_t) bit n set for each 64-byte line of memory to copy from
+ *      it, every other line has to match it already
+ * OUT: void
+ *      loadState for callers that know which memory changed: the
+ *      registers, stack, timers, keys and screens are copied whole and
+ *      only the given lines of memory, so code in the lines left alone
+ *      stays decoded and compiled. A given line that holds the same bytes
+ *      already is left alone too. The machine is running again and
+ *      nothing is left marked as written.
+ */
+void Chip8::resetTo(const Chip8State& s, uint64_t lines)
+{
+    const size_t memoryStart = offsetof(Chip8State, memory);
+    const size_t memoryEnd = memoryStart + sizeof(memory);
+    Chip8State& self = *this;
+    std::memcpy(&self, &s, memoryStart);
+    std::memcpy(reinterpret_cast<uint8_t*>(&self) + memoryEnd, reinterpret_cast<const uint8_t*>(&s) + memoryEnd, sizeof(Chip8State) - memoryEnd);
+
+    for (uint32_t line = 0; line < 64; ++line)
     {
-        switch (event.type)
+        if ((lines >> line & 1) == 0 || std::memcmp(memory + line * 64, s.memory + line * 64, 64) == 0)
+            continue;
+        std::memcpy(memory + line * 64, s.memory + line * 64, 64);
+        wroteMemory(line * 64, 64);
+    }
+
+    running = true;
+    waitingForKey = false;
+    updatedPixels = true;
+    dirtyRows = hires ? HI_ALL_ROWS : ALL_ROWS;
+    dirtyMemory = 0;
+}
+
+/*
+ * IN:  (Savestate&) filled in with the whole machine
+ * OUT: void
+ *      Along with Chip8State this records whether the machine is still
+ *      running, how many instructions it runs per frame and its platform. The engine
+ *      and whatever it has cached are not part of the machine.
+ */
+void Chip8::saveState(Savestate& s) const
+{
+    std::memset(&s.header, 0, sizeof(s.header));
+    std::memcpy(s.header.magic, SAVESTATE_MAGIC, sizeof(s.header.magic));
+    s.header.version = SAVESTATE_VERSION;
+    s.header.headerSize = sizeof(SavestateHeader);
+    s.header.stateSize = sizeof(Chip8State);
+    s.header.flags = (running ? SAVESTATE_RUNNING : 0) | (waitingForKey ? SAVESTATE_WAITING : 0);
+    s.header.cyclesPerFrame = cyclesPerFrame;
+    s.header.platform = static_cast<uint32_t>(platform);
+
+    std::memcpy(&s.state, static_cast<const Chip8State*>(this), sizeof(Chip8State));
+    s.header.hash = hashState(s.state);
+}
+
+/*
+ * IN:  (const Savestate&) a savestate from saveState, a file or a Rewind
+ * OUT: (bool) false if the savestate is bad, the machine is untouched
+ *      The whole screen is marked as changed.
+ */
+bool Chip8::loadState(const Savestate& s)
+{
+    if (!checkSavestate(s))
+        return false;
+
+    // Only code that really changed is thrown away, so stepping through a
+    // Rewind doesn't make the engines start over every frame
+    for (uint32_t a = 0; a < sizeof(memory); a += 8)
+        if (std::memcmp(memory + a, s.state.memory + a, 8) != 0)
+            wroteMemory(a, 8);
+
+    std::memcpy(static_cast<Chip8State*>(this), &s.state, sizeof(Chip8State));
+    running = (s.header.flags & SAVESTATE_RUNNING) != 0;
+    waitingForKey = (s.header.flags & SAVESTATE_WAITING) != 0;
+    if (s.header.cyclesPerFrame > 0)
+        cyclesPerFrame = s.header.cyclesPerFrame;
+    platform = static_cast<Platform>(s.header.platform);
+
+    updatedPixels = true;
+    dirtyRows = hires ? HI_ALL_ROWS : ALL_ROWS;
+    return true;
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      Counts the delay and sound timers down by one, if they are not
+ *      already at zero. This is the 60 Hz tick; runFrames does it once
+ *      per frame.
+ */
+void Chip8::tickTimers()
+{
+    if (delayTimer > 0)
+        --delayTimer;
+    if (soundTimer > 0)
+        --soundTimer;
+}
+
+/*
+ * IN:  (uint8_t) index of the register that receives the key
+ * OUT: (bool) true if a key was down and stored in V[x]
+ *      If more than one key is down the highest one wins.
+ */
+bool Chip8::waitForKey(uint8_t x)
+{
+    bool keyPressed = false;
+    for (int i = 0; i < 16; ++i)
+    {
+        if (key[i] != 0)
         {
-            case SDL_QUIT:
-                running = false;
-                break;
-            case SDL_KEYDOWN:
-                {
-                    switch (event.key.keysym.sym)
-                    {
-                        case SDLK_1: key[0x1] = 1;
-                                     break;
-                        case SDLK_2: key[0x2] = 1;
-                                     break;
-                        case SDLK_3: key[0x3] = 1;
-                                     break;
-                        case SDLK_4: key[0xC] = 1;
-                                     break;
-                        case SDLK_q: key[0x4] = 1;
-                                     break;
-                        case SDLK_w: key[0x5] = 1;
-                                     break;
-                        case SDLK_e: key[0x6] = 1;
-                                     break;
-                        case SDLK_r: key[0xD] = 1;
-                                     break;
-                        case SDLK_a: key[0x7] = 1;
-                                     break;
-                        case SDLK_s: key[0x8] = 1;
-                                     break;
-                        case SDLK_d: key[0x9] = 1;
-                                     break;
-                        case SDLK_f: key[0xE] = 1;
-                                     break;
-                        case SDLK_z: key[0xA] = 1;
-                                     break;
-                        case SDLK_x: key[0x0] = 1;
-                                     break;
-                        case SDLK_c: key[0xB] = 1;
-                                     break;
-                        case SDLK_v: key[0xF] = 1;
-                                     break;
-                    }
-                    break;
-                    case SDL_KEYUP:
-                    {
-                        switch (event.key.keysym.sym)
-                        {
-                            case SDLK_1: key[0x1] = 0;
-                                         break;
-                            case SDLK_2: key[0x2] = 0;
-                                         break;
-                            case SDLK_3: key[0x3] = 0;
-                                         break;
-                            case SDLK_4: key[0xC] = 0;
-                                         break;
-                            case SDLK_q: key[0x4] = 0;
-                                         break;
-                            case SDLK_w: key[0x5] = 0;
-                                         break;
-                            case SDLK_e: key[0x6] = 0;
-                                         break;
-                            case SDLK_r: key[0xD] = 0;
-                                         break;
-                            case SDLK_a: key[0x7] = 0;
-                                         break;
-                            case SDLK_s: key[0x8] = 0;
-                                         break;
-                            case SDLK_d: key[0x9] = 0;
-                                         break;
-                            case SDLK_f: key[0xE] = 0;
-                                         break;
-                            case SDLK_z: key[0xA] = 0;
-                                         break;
-                            case SDLK_x: key[0x0] = 0;
-                                         break;
-                            case SDLK_c: key[0xB] = 0;
-                                         break;
-                            case SDLK_v: key[0xF] = 0;
-                                         break;
-                        }
-                        break;
-                    }
-                }
+            V[x] = i;
+            keyPressed = true;
         }
     }
+    waitingForKey = !keyPressed;
+    return keyPressed;
+}
+
+/*
+ * IN:  (uint8_t) index of the register to convert
+ * OUT: void
+ *      Stores the decimal digits of V[x] at I, I + 1 and I + 2, wrapping
+ *      around the end of memory.
+ */
+void Chip8::storeBCD(uint8_t x)
+{
+    // The value in register X is at MOST 255 (0xFF)
+    memory[I & 0xFFF] = V[x] / 100;
+    memory[(I + 1) & 0xFFF] = (V[x] / 10) % 10;
+    memory[(I + 2) & 0xFFF] = (V[x] % 100) % 10;
+    wroteMemory(I, 3);
+    if (debugger)
+        debugger->wrote(I, 3, pc);
+}
+
+/*
+ * IN:  (uint8_t) index of the last register to store
+ * OUT: void
+ *      Stores V0 through V[x] in memory starting at address I, wrapping
+ *      around the end of memory.
+ */
+void Chip8::storeRegisters(uint8_t x)
+{
+    for (int i = 0; i <= x; ++i)
+        memory[(I + i) & 0xFFF] = V[i];   // maybe I should change `i` to `k`
+    wroteMemory(I, x + 1);
+    if (debugger)
+        debugger->wrote(I, x + 1, pc);
 }
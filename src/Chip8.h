@@ -8,20 +8,40 @@
  * instructions.
  *
  * Chip8.h contains the class definition for the Chip8 class. It also
- * includes useful global constants and C pre processor macros to
- * improve legibility of the dissection of Chip8 instructions. This
- * header file also contains the HEX representation of the fontset
- * used by the Chip8.
+ * includes useful C pre processor macros to improve legibility of the
+ * dissection of Chip8 instructions. The machine state and the global
+ * constants (including the fontset) live in Chip8State.h.
+ *
+ * The Chip8 class is only the core: CPU, memory and timers. It knows
+ * nothing about windows or keyboards, so it can be built into libchip8.a
+ * and driven headlessly. See Frontend.h for the SDL2 front end.
+ *
+ * Problems the program runs into, such as unknown opcodes, are reported
+ * to the machine's Diagnostics rather than printed where they happen.
+ *
+ * The machine behaves like one of the platforms in Quirks.h, picked from
+ * the ROM's file name when it is loaded or set with setPlatform. Only the
+ * interpreter knows the platforms besides the default one, so a machine
+ * running any of them always runs on the interpreter.
  *
  * I tried to keep this implementation of the Chip8 interpreter as close
- * to the technical specifications in terms of stack size, register and 
+ * to the technical specifications in terms of stack size, register and
  * other variable sizes.
  */
 
 #ifndef CHIP8_H_
 #define CHIP8_H_
 
-#include <SDL2/SDL.h>
+#include "Chip8State.h"
+#include "Aot.h"
+#include "BlockCache.h"
+#include "Debugger.h"
+#include "Diagnostics.h"
+#include "Jit.h"
+#include "Profiler.h"
+#include "Quirks.h"
+#include "RomCatalog.h"
+#include "Savestate.h"
 #include <string>
 #include <cstdint>
 #include <cstdlib>
@@ -31,66 +51,153 @@
 #define NNN (opcode & 0x0FFF)
 #define KK (opcode & 0x00FF)
 
-static const std::string&   PROG_NAME = "Chip8";
-static const int   START_PROG_MEM = 0x200;
-static const int   END_PROG_MEM   = 0xFFF;
-static const int   X_RES          = 64;
-static const int   Y_RES          = 32;
-static const int   SCALE          = 10;
-static const float REFRESH_RATE   = 1.f/10.f;
-
-static uint8_t chip8Font[80] =
-{ 
-    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-    0x20, 0x60, 0x20, 0x20, 0x70, // 1
-    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+/*
+ * What happened during a call to Chip8::step or Chip8::runFrames.
+ */
+struct StepResult
+{
+    uint32_t cycles;                  // Instructions actually executed
+    bool     drawn;                   // The framebuffer changed (CLS or DRW)
+    bool     sound;                   // The sound timer was active at the end of the batch
+    bool     waitingForKey;           // Blocked on FX0A at the end of the batch
+    bool     halted;                  // The machine stopped and will not run any further
+    bool     stopped;                 // An attached Debugger paused the machine
+    bool     idle;                    // Ended spinning in a loop only a key or a timer tick can end
 };
 
-class Chip8
+/*
+ * The ways the core can execute instructions. They behave identically;
+ * Interpreter is the plain fetch/decode/execute loop in runCycle and is
+ * kept around as the reference for A/B comparisons.
+ */
+enum class Engine
+{
+    Interpreter,                      // Decode every instruction every time it runs
+    Cached,                           // Run pre-decoded basic blocks out of a BlockCache
+    Jit,                              // Compile hot blocks to x86-64, interpret the rest
+    JitChecked,                       // Jit, re-running every compiled block on the interpreter
+    Aot                               // Code chip8-aot recompiled for this ROM, the block cache if none
+};
+
+bool engineFromName(const std::string&, Engine&); // "interpreter", "cached", "jit", "jit-checked" or "aot"
+
+static const uint64_t ALL_ROWS = (Y_RES < 64) ? ((1ULL << Y_RES) - 1) : ~0ULL;
+static const uint64_t HI_ALL_ROWS = ~0ULL; // Every row of the 128x64 screen
+
+static const uint32_t IDLE_PROBE = 8;    // Longest loop step() recognises as idle
+static const uint32_t IDLE_SLICE = 1024; // Instructions run between looks for an idle loop
+
+class Chip8 : private Chip8State
 {
     public:
         Chip8();
-        ~Chip8();
 
-        void loadROM(const std::string&); // Load a Chip8 ROM file into Program data memory space
-        void play();                      // The 'run' loop. 
+        bool loadROM(const std::string&); // Load a Chip8 ROM file into Program data memory space
+        bool loadROM(const RomEntry&);    // Same, from a RomCatalog
+        bool loadProgram(const uint8_t*, size_t, const std::string&); // Same, from memory
+        StepResult step(uint32_t);        // Run up to n instructions
+        StepResult runFrames(uint32_t);   // Run n frames worth of instructions
+
+        void setKey(int, bool);           // Press or release a key on the hex keypad
+        void tickTimers();                // One 60 Hz tick of the delay and sound timers
+        void seed(uint64_t);              // Restart the RND generator
+        void setCyclesPerFrame(uint32_t n) { cyclesPerFrame = n; }
+        uint32_t getCyclesPerFrame() const { return cyclesPerFrame; }
+        void setEngine(Engine e) { engine = e; }
+        Engine getEngine() const { return engine; }
+        uint64_t getJitMismatches() const { return jitMismatches; }
+        const Diagnostics& diagnostics() const { return diag; }
+        void setProfiler(Profiler* p) { profiler = p; } // Only does anything when built with CHIP8_PROFILE
+        void setDebugger(Debugger* d) { debugger = d; } // Null to detach
+        void setIdleSkipping(bool on) { idleSkipping = on; } // On by default
+        void setPlatform(Platform);       // Behave like another platform, after loadROM has picked one
+        Platform getPlatform() const { return platform; }
+
+        const uint64_t* framebuffer() const { return pixels; } // Y_RES rows, bit 63 of a row is column 0
+        const uint64_t* hiresFramebuffer() const { return hiPixels[0]; } // HI_Y_RES rows of two words each
+        bool hiresMode() const { return hires != 0; } // SUPER-CHIP's 128x64 screen is showing, not framebuffer()
+        uint64_t takeDirtyRows();         // Rows changed since the last call, then forget them
+        uint64_t takeDirtyMemory();       // 64-byte lines of memory written since the last call, then forget them
+        void resetTo(const Chip8State&, uint64_t); // Back to a state, copying only the given lines of memory
+        void saveState(Savestate&) const; // Snapshot the whole machine
+        bool loadState(const Savestate&); // Put the machine back as it was, false if the savestate is bad
+        bool isRunning() const { return running; }
+        bool soundActive() const { return soundTimer > 0; }
+        const std::string& romName() const { return currentROM; }
+
+        const Chip8State& state() const { return *this; }
+        Chip8State& state() { return *this; }
     private:
-        void initVideo();                 // Set up SDL2 systems
         void runCycle();                  // Fetch, decode, and execute opcode
-        void draw();                      // Draw to the screen
-        void interact();                  // Keyboard state and user input
+        template <Platform P>
+        void execute();                   // runCycle with P's quirks built in
+        template <Platform P>
+        uint32_t runAs(uint32_t);         // Execute up to n instructions as P
+        uint32_t runInterpreter(uint32_t); // Execute up to n instructions as this machine's platform
+        uint32_t runEngine(Engine, uint32_t); // Execute up to n instructions with an engine
+        uint32_t skipIdle(uint32_t, bool&); // Execute or skip up to n instructions of an idle loop
+        uint32_t runBlocks(uint32_t);     // Execute up to n instructions from the block cache
+        uint32_t runDebugged(uint32_t);   // Execute up to n instructions until the debugger says stop
+        uint32_t runJit(uint32_t, bool);  // Execute up to n instructions, hot ones compiled
+        uint32_t runAot(uint32_t);        // Execute up to n instructions, recompiled ones natively
+        void runJitChecked(const JitBlock&); // Run a compiled block and check it on the interpreter
+        void wroteMemory(uint32_t, uint32_t); // Tell the engines code may have been overwritten
+        void drawSprite(uint8_t, uint8_t, uint8_t); // DXYN
+        void drawSuperSprite(uint8_t, uint8_t, uint8_t); // DXYN and DXY0 on SUPER-CHIP, in either resolution
+        bool superChipSystem();           // 00CN and 00FB - 00FF, false if the opcode is none of them
+        void clearScreen();               // 00E0
+        uint8_t random();                 // Next byte from this machine's RND generator
+        bool waitForKey(uint8_t);         // FX0A, false if no key is down
+        void storeBCD(uint8_t);           // FX33
+        void storeRegisters(uint8_t);     // FX55
 
         uint16_t    opcode;
-        uint16_t    I;                    // Address Register
-        uint16_t    pc;                   // Program Counter, program space: 0x200 - 0xFFF
-        uint8_t     sp;                   // Stack Pointer
-        uint16_t    stack[16];            // Program Stack
-        uint8_t     V[16];                // Chip8 has 16 8-bit registers
-        uint8_t     memory[4096];         // RAM
-        uint8_t     pixels[X_RES*Y_RES];  // Makes up the drawable screen
-        uint8_t     delayTimer;           // Refresh rate of the screen
-        uint8_t     soundTimer;           // Play a sound after counting down from 60
-        uint8_t     key[16];              // Key press, Chip8 keyboard is 0x0 - 0xF
-        bool        updatedPixels;        // Flag, if true we need to redraw the pixels
+        uint32_t    cyclesPerFrame;       // Instructions executed per call to runFrames(1)
+        bool        updatedPixels;        // Flag, if true the pixels changed since the last step
+        uint64_t    dirtyRows;            // Bit n set if row n changed since takeDirtyRows()
+        uint64_t    dirtyMemory;          // Bit n set if memory[64n .. 64n + 63] was written since takeDirtyMemory()
+        bool        waitingForKey;        // Flag, set while FX0A is blocking
         bool        running;              // Used to determine if the machine is on and running
+        bool        idleSkipping;         // step() skips over idle loops
+        Engine      engine;               // How step() executes instructions
+        Platform    platform;             // Whose quirks the interpreter follows
+        BlockCache  blocks;               // Decoded program, used by Engine::Cached
+        Jit         jit;                  // Compiled program, used by Engine::Jit
+        uint64_t    jitMismatches;        // Blocks Engine::JitChecked caught disagreeing
+        Aot         aot;                  // Recompiled program, used by Engine::Aot
+        uint64_t    programHash;          // programImageHash right after loading
+        bool        aotSearched;          // Engine::Aot has looked for a module for this program
+        Profiler*   profiler;             // Sees every instruction runCycle executes, may be null
+        Debugger*   debugger;             // Decides when to stop, may be null
+        Diagnostics diag;                 // Unknown opcodes and the like, printed off the hot path
         std::string currentROM;
-        /* GRAPHICS */
-        SDL_Window* window;               // To display a window
-        SDL_Renderer* renderer;           // To render color and the texture that holds pixels
 };
 
-#endif
+/*
+ * IN:  (uint32_t) first address that was written, I for writes through it
+ *      (uint32_t) number of bytes written
+ * OUT: void
+ *      Writes through I wrap around the end of memory. What wraps lands
+ *      below 0x200, where there is never any code, so the engines only
+ *      need telling about the part up to 0xFFF.
+ */
+inline void Chip8::wroteMemory(uint32_t addr, uint32_t len)
+{
+    addr &= 0xFFF;
+    for (uint32_t line = addr >> 6; line <= (addr + len - 1) >> 6; ++line)
+        dirtyMemory |= 1ULL << (line & 63);
+    blocks.invalidate(addr, len);
+    jit.invalidate(addr, len);
+    aot.invalidate(addr, len);
+}
+
+/*
+ * IN:  void
+ * OUT: (uint8_t) the next pseudo-random byte
+ */
+inline uint8_t Chip8::random()
+{
+    return nextRandom(rng);
+}
 
+#endif
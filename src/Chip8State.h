@@ -0,0 +1,203 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Chip8State.h contains the plain machine state of the Chip8 (RAM,
+ * registers, stack, timers, display and keypad) along with the global
+ * constants that describe the machine. It deliberately has no
+ * dependencies besides the standard library so that anything which only
+ * needs to look at or copy a machine (the core, tools, front ends) can
+ * include it without dragging in SDL.
+ */
+
+#ifndef CHIP8_STATE_H_
+#define CHIP8_STATE_H_
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+static const std::string&   PROG_NAME = "Chip8";
+static const int   START_PROG_MEM = 0x200;
+static const int   END_PROG_MEM   = 0xFFF;
+static const int   X_RES          = 64;
+static const int   Y_RES          = 32;
+static const int   HI_X_RES       = 128; // SUPER-CHIP's high resolution screen
+static const int   HI_Y_RES       = 64;
+static const int   BIG_FONT_START = 0x50; // SUPER-CHIP's 8x10 digits, right after the small ones
+static const int   SCALE          = 10;
+static const int   FRAME_RATE     = 60;  // Frames (and timer ticks) per second
+static const int   CYCLES_PER_FRAME = 10; // Default instructions executed per frame
+
+static_assert(X_RES == 64, "Each row of the screen is packed into one uint64_t");
+static_assert(HI_X_RES == 128, "Each row of the high resolution screen is packed into two uint64_t");
+
+static const uint8_t chip8Font[80] =
+{
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
+/*
+ * SUPER-CHIP 1.1's 8x10 digits, as its ROM holds them. SUPER-CHIP 1.1 only
+ * has 0-9; A-F are the big letters from Octo, which most emulators that
+ * support FX30 on A-F use.
+ */
+static const uint8_t superChipFont[160] =
+{
+    0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+    0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+    0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+    0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+    0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+    0x3E, 0x7C, 0xE0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+    0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+
+/*
+ * Everything that makes up a running Chip8 machine. This is a plain
+ * struct on purpose: it can be copied, compared and written out as-is.
+ */
+struct Chip8State
+{
+    uint16_t    I;                    // Address Register
+    uint16_t    pc;                   // Program Counter, program space: 0x200 - 0xFFF
+    uint8_t     sp;                   // Stack Pointer
+    uint16_t    stack[16];            // Program Stack
+    uint8_t     V[16];                // Chip8 has 16 8-bit registers
+    uint8_t     memory[4096];         // RAM
+    uint64_t    pixels[Y_RES];        // The screen, one word per row, bit 63 is column 0
+    uint8_t     delayTimer;           // Refresh rate of the screen
+    uint8_t     soundTimer;           // Play a sound after counting down from 60
+    uint8_t     key[16];              // Key press, Chip8 keyboard is 0x0 - 0xF
+    uint64_t    rng;                  // Xorshift state behind RND, never 0 once seeded
+    uint8_t     hires;                // SUPER-CHIP: nonzero while the 128x64 screen is showing
+    uint8_t     flags[8];             // SUPER-CHIP: the HP-48 flag registers FX75 and FX85 use
+    uint64_t    hiPixels[HI_Y_RES][2]; // SUPER-CHIP's 128x64 screen, bit 63 of a row's first word is column 0
+};
+
+/*
+ * IN:  (uint64_t) any number
+ * OUT: (uint64_t) a starting state for nextRandom
+ *      The seed is scrambled with a splitmix64 step so that nearby seeds
+ *      give unrelated sequences and the xorshift state is never 0.
+ */
+inline uint64_t seedRandom(uint64_t seed)
+{
+    uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return (z != 0) ? z : 0x9E3779B97F4A7C15ULL;
+}
+
+/*
+ * IN:  (uint64_t&) generator state, advanced
+ * OUT: (uint8_t) the next pseudo-random byte
+ *      xorshift64*, the top byte of the output is the best mixed one.
+ */
+inline uint8_t nextRandom(uint64_t& state)
+{
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return static_cast<uint8_t>((state * 0x2545F4914F6CDD1DULL) >> 56);
+}
+
+/*
+ * IN:  (uint32_t) 32 pixels, bit 31 is the leftmost
+ * OUT: (uint64_t) the same pixels twice as wide, bit 63 is the leftmost
+ *      Spreads bit n out to bit 2n, then copies every bit into the gap
+ *      next to it.
+ */
+inline uint64_t doubleWidth(uint32_t half)
+{
+    uint64_t x = half;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+    x = (x | (x << 8)) & 0x00FF00FF00FF00FFULL;
+    x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    x = (x | (x << 2)) & 0x3333333333333333ULL;
+    x = (x | (x << 1)) & 0x5555555555555555ULL;
+    return x | (x << 1);
+}
+
+/*
+ * IN:  (const void*) bytes to hash
+ *      (size_t) number of bytes
+ *      (uint64_t) hash to continue from
+ * OUT: (uint64_t) 64-bit hash of the bytes
+ *      FNV-1a, but fed eight bytes at a time (with a shift to fold the
+ *      high bits back down) so that hashing a whole machine is cheap
+ *      enough to do after every block.
+ */
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    const uint64_t prime = 1099511628211ULL;
+
+    for (; size >= 8; size -= 8, bytes += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, bytes, 8);
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 32;
+    }
+    for (; size > 0; --size, ++bytes)
+        hash = (hash ^ *bytes) * prime;
+    return hash;
+}
+
+/*
+ * IN:  (const Chip8State&) a machine
+ * OUT: (uint64_t) hash of every field, two machines with the same hash
+ *      are (for all practical purposes) in the same state. Fields are
+ *      hashed one at a time so padding never leaks in.
+ */
+inline uint64_t hashState(const Chip8State& s)
+{
+    uint64_t h = hashBytes(&s.I, sizeof(s.I));
+    h = hashBytes(&s.pc, sizeof(s.pc), h);
+    h = hashBytes(&s.sp, sizeof(s.sp), h);
+    h = hashBytes(s.stack, sizeof(s.stack), h);
+    h = hashBytes(s.V, sizeof(s.V), h);
+    h = hashBytes(s.memory, sizeof(s.memory), h);
+    h = hashBytes(s.pixels, sizeof(s.pixels), h);
+    h = hashBytes(&s.delayTimer, sizeof(s.delayTimer), h);
+    h = hashBytes(&s.soundTimer, sizeof(s.soundTimer), h);
+    h = hashBytes(s.key, sizeof(s.key), h);
+    h = hashBytes(&s.rng, sizeof(s.rng), h);
+    h = hashBytes(&s.hires, sizeof(s.hires), h);
+    h = hashBytes(s.flags, sizeof(s.flags), h);
+    return hashBytes(s.hiPixels, sizeof(s.hiPixels), h);
+}
+
+#endif
@@ -0,0 +1,232 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Debugger.cpp contains the implementation of Debugger member functions
+ * that aren't on the path of every instruction, and a disassembler that
+ * uses the mnemonics from Cowgod's technical reference.
+ */
+
+#include "Debugger.h"
+#include <algorithm>
+#include <cstdio>
+
+/*
+ * Constructor
+ *
+ * IN: void
+ *     No breakpoints or watchpoints, and paused: nothing runs until the
+ *     debugger is told to resume or step.
+ */
+Debugger::Debugger() : mode(Mode::Paused), why(StopReason::Attached), leaving(false), watchHit(false), watchAddr(0),
+                       watchPc(0), remaining(0), returnPc(0), returnSp(0), interruptRequested(false)
+{
+    std::fill(breakBits, breakBits + 64, 0);
+    std::fill(watchBits, watchBits + 64, 0);
+}
+
+/*
+ * IN:  (uint16_t) address of an instruction
+ *      (bool) true to set the breakpoint, false to clear it
+ * OUT: void
+ */
+void Debugger::setBreakpoint(uint16_t addr, bool on)
+{
+    uint64_t bit = 1ULL << (addr & 63);
+    if (on)
+        breakBits[(addr & 0xFFF) >> 6] |= bit;
+    else
+        breakBits[(addr & 0xFFF) >> 6] &= ~bit;
+}
+
+/*
+ * IN:  (uint16_t) first address to watch
+ *      (uint16_t) number of bytes to watch
+ *      (bool) true to set the watchpoints, false to clear them
+ * OUT: void
+ */
+void Debugger::setWatchpoint(uint16_t addr, uint16_t len, bool on)
+{
+    for (uint32_t i = 0; i < len; ++i)
+    {
+        uint16_t a = static_cast<uint16_t>((addr + i) & 0xFFF);
+        uint64_t bit = 1ULL << (a & 63);
+        if (on)
+            watchBits[a >> 6] |= bit;
+        else
+            watchBits[a >> 6] &= ~bit;
+    }
+}
+
+/*
+ * IN:  void
+ * OUT: (vector<uint16_t>) every address with a breakpoint, in order
+ */
+std::vector<uint16_t> Debugger::breakpoints() const
+{
+    std::vector<uint16_t> found;
+    for (uint16_t a = 0; a < 4096; ++a)
+        if (isBreakpoint(a))
+            found.push_back(a);
+    return found;
+}
+
+/*
+ * IN:  void
+ * OUT: (vector<uint16_t>) every watched address, in order
+ */
+std::vector<uint16_t> Debugger::watchpoints() const
+{
+    std::vector<uint16_t> found;
+    for (uint16_t a = 0; a < 4096; ++a)
+        if (isWatchpoint(a))
+            found.push_back(a);
+    return found;
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ */
+void Debugger::resume()
+{
+    start(Mode::Running);
+}
+
+/*
+ * IN:  (uint32_t) instructions to run, at least one
+ * OUT: void
+ */
+void Debugger::step(uint32_t n)
+{
+    remaining = std::max<uint32_t>(n, 1);
+    start(Mode::Stepping);
+}
+
+/*
+ * IN:  (const Chip8State&) the machine, paused
+ * OUT: void
+ *      On a CALL, runs until the subroutine returns to the instruction
+ *      after it with the stack as it is now, so recursion doesn't stop
+ *      early. A breakpoint or watchpoint inside still stops it.
+ */
+void Debugger::stepOver(const Chip8State& s)
+{
+    uint16_t pc = s.pc & 0xFFF;
+    uint16_t opcode = static_cast<uint16_t>(s.memory[pc] << 8 | s.memory[(pc + 1) & 0xFFF]);
+    if ((opcode & 0xF000) != 0x2000)
+    {
+        step(1);
+        return;
+    }
+
+    returnPc = static_cast<uint16_t>(s.pc + 2);
+    returnSp = s.sp;
+    start(Mode::SteppingOver);
+}
+
+/*
+ * IN:  (StopReason) why
+ * OUT: void
+ */
+void Debugger::pause(StopReason reason)
+{
+    mode = Mode::Paused;
+    why = reason;
+}
+
+/*
+ * IN:  (Mode) how to run
+ * OUT: void
+ *      The instruction the machine stopped at is allowed to run even if
+ *      it has a breakpoint, otherwise nothing could ever get past one.
+ *      An interrupt that came in while paused is stale and dropped.
+ */
+void Debugger::start(Mode m)
+{
+    mode = m;
+    leaving = true;
+    watchHit = false;
+    interruptRequested.store(false, std::memory_order_relaxed);
+}
+
+/*
+ * IN:  (uint16_t) an opcode
+ * OUT: (string) its mnemonic and operands
+ */
+std::string disassemble(uint16_t opcode)
+{
+    unsigned x = (opcode >> 8) & 0xF;
+    unsigned y = (opcode >> 4) & 0xF;
+    unsigned n = opcode & 0xF;
+    unsigned kk = opcode & 0xFF;
+    unsigned nnn = opcode & 0xFFF;
+    char text[32];
+
+    switch (opcode & 0xF000)
+    {
+        case 0x0000:
+            if (opcode == 0x00E0)
+                return "CLS";
+            if (opcode == 0x00EE)
+                return "RET";
+            std::snprintf(text, sizeof(text), "SYS 0x%03X", nnn);
+            break;
+        case 0x1000: std::snprintf(text, sizeof(text), "JP 0x%03X", nnn); break;
+        case 0x2000: std::snprintf(text, sizeof(text), "CALL 0x%03X", nnn); break;
+        case 0x3000: std::snprintf(text, sizeof(text), "SE V%X, 0x%02X", x, kk); break;
+        case 0x4000: std::snprintf(text, sizeof(text), "SNE V%X, 0x%02X", x, kk); break;
+        case 0x5000: std::snprintf(text, sizeof(text), "SE V%X, V%X", x, y); break;
+        case 0x6000: std::snprintf(text, sizeof(text), "LD V%X, 0x%02X", x, kk); break;
+        case 0x7000: std::snprintf(text, sizeof(text), "ADD V%X, 0x%02X", x, kk); break;
+        case 0x8000:
+            {
+                static const char* const ALU[16] =
+                {
+                    "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+                    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL", nullptr
+                };
+                if (!ALU[n])
+                    std::snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+                else if (n == 0x6 || n == 0xE)
+                    std::snprintf(text, sizeof(text), "%s V%X", ALU[n], x);
+                else
+                    std::snprintf(text, sizeof(text), "%s V%X, V%X", ALU[n], x, y);
+                break;
+            }
+        case 0x9000: std::snprintf(text, sizeof(text), "SNE V%X, V%X", x, y); break;
+        case 0xA000: std::snprintf(text, sizeof(text), "LD I, 0x%03X", nnn); break;
+        case 0xB000: std::snprintf(text, sizeof(text), "JP V0, 0x%03X", nnn); break;
+        case 0xC000: std::snprintf(text, sizeof(text), "RND V%X, 0x%02X", x, kk); break;
+        case 0xD000: std::snprintf(text, sizeof(text), "DRW V%X, V%X, %u", x, y, n); break;
+        case 0xE000:
+            if (kk == 0x9E)
+                std::snprintf(text, sizeof(text), "SKP V%X", x);
+            else if (kk == 0xA1)
+                std::snprintf(text, sizeof(text), "SKNP V%X", x);
+            else
+                std::snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+            break;
+        default:
+            switch (kk)
+            {
+                case 0x07: std::snprintf(text, sizeof(text), "LD V%X, DT", x); break;
+                case 0x0A: std::snprintf(text, sizeof(text), "LD V%X, K", x); break;
+                case 0x15: std::snprintf(text, sizeof(text), "LD DT, V%X", x); break;
+                case 0x18: std::snprintf(text, sizeof(text), "LD ST, V%X", x); break;
+                case 0x1E: std::snprintf(text, sizeof(text), "ADD I, V%X", x); break;
+                case 0x29: std::snprintf(text, sizeof(text), "LD F, V%X", x); break;
+                case 0x33: std::snprintf(text, sizeof(text), "LD B, V%X", x); break;
+                case 0x55: std::snprintf(text, sizeof(text), "LD [I], V%X", x); break;
+                case 0x65: std::snprintf(text, sizeof(text), "LD V%X, [I]", x); break;
+                default:   std::snprintf(text, sizeof(text), "DW 0x%04X", opcode); break;
+            }
+            break;
+    }
+    return text;
+}
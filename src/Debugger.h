@@ -0,0 +1,160 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Debugger.h contains the class definition for the Debugger class, which
+ * pauses, single-steps and resumes one Chip8 it is attached to (see
+ * Chip8::setDebugger) and stops it at breakpoints and watchpoints.
+ *
+ * Breakpoints (on the pc) and write watchpoints (on memory) are bitmaps
+ * with one bit per address, so checking an instruction is one load and
+ * one test no matter how many are set. A machine without a debugger
+ * attached doesn't check anything at all: only the debugged machine
+ * drops to the interpreter and pays for the checks, the rest of a batch
+ * keeps its engine.
+ */
+
+#ifndef CHIP8_DEBUGGER_H_
+#define CHIP8_DEBUGGER_H_
+
+#include "Chip8State.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Why the debugged machine last stopped.
+ */
+enum class StopReason
+{
+    Attached,                         // Hasn't run since the debugger was made
+    Breakpoint,                       // About to execute an instruction with a breakpoint
+    Watchpoint,                       // An instruction wrote to a watched address
+    Step,                             // Finished a step, a step over or a set number of frames
+    Interrupted,                      // interrupt() was called, e.g. from a SIGINT handler
+    Halted                            // The machine stopped running
+};
+
+class Debugger
+{
+    public:
+        Debugger();
+
+        void setBreakpoint(uint16_t, bool);          // Break before the instruction at addr runs
+        void setWatchpoint(uint16_t, uint16_t, bool); // Break after anything writes addr..addr+len-1
+        bool isBreakpoint(uint16_t a) const { return test(breakBits, a); }
+        bool isWatchpoint(uint16_t a) const { return test(watchBits, a); }
+        std::vector<uint16_t> breakpoints() const;
+        std::vector<uint16_t> watchpoints() const;
+
+        void resume();                               // Run until something stops the machine
+        void step(uint32_t);                         // Run n instructions
+        void stepOver(const Chip8State&);            // Like step(1), but a CALL runs until it returns
+        void pause(StopReason);                      // Stop now, from the thread running the machine
+        void interrupt() { interruptRequested.store(true, std::memory_order_relaxed); } // Stop soon, from anywhere
+
+        bool paused() const { return mode == Mode::Paused; }
+        StopReason reason() const { return why; }
+        uint16_t watchAddress() const { return watchAddr; } // Address whose write last stopped the machine
+        uint16_t watchWriter() const { return watchPc; } // ...and the instruction that wrote it
+
+        bool before(uint16_t);                       // Called with the pc, false to stop before it runs
+        bool after(const Chip8State&, bool);         // Called after it ran, false to stop now
+        void wrote(uint16_t, uint32_t, uint16_t);    // Memory addr..addr+len-1 written by the instruction at pc
+    private:
+        enum class Mode
+        {
+            Paused,
+            Running,
+            Stepping,                                // `remaining` instructions left
+            SteppingOver                             // Until pc and sp are back to `returnPc` and `returnSp`
+        };
+
+        static bool test(const uint64_t* bits, uint16_t a) { return (bits[(a & 0xFFF) >> 6] >> (a & 63)) & 1; }
+        void start(Mode);
+
+        uint64_t   breakBits[64];                    // One bit per address of the 4 KB address space
+        uint64_t   watchBits[64];
+        Mode       mode;
+        StopReason why;
+        bool       leaving;                          // The next instruction is where we stopped, don't break on it
+        bool       watchHit;                         // The instruction that just ran wrote to a watched address
+        uint16_t   watchAddr;
+        uint16_t   watchPc;
+        uint32_t   remaining;
+        uint16_t   returnPc;
+        uint8_t    returnSp;
+        std::atomic<bool> interruptRequested;
+};
+
+std::string disassemble(uint16_t);                   // "LD V1, 0x05" and so on
+
+/*
+ * IN:  (uint16_t) pc of the instruction about to run
+ * OUT: (bool) false if the machine has to stop before running it
+ */
+inline bool Debugger::before(uint16_t pc)
+{
+    if (mode == Mode::Paused)
+        return false;
+    if (interruptRequested.load(std::memory_order_relaxed))
+    {
+        interruptRequested.store(false, std::memory_order_relaxed);
+        pause(StopReason::Interrupted);
+        return false;
+    }
+    if (test(breakBits, pc) && !leaving)
+    {
+        pause(StopReason::Breakpoint);
+        return false;
+    }
+    leaving = false;
+    return true;
+}
+
+/*
+ * IN:  (const Chip8State&) the machine after the instruction
+ *      (bool) whether it is still running
+ * OUT: (bool) false if the machine has to stop here
+ */
+inline bool Debugger::after(const Chip8State& s, bool running)
+{
+    if (!running)
+        pause(StopReason::Halted);
+    else if (watchHit)
+        pause(StopReason::Watchpoint);
+    else if (mode == Mode::Stepping && --remaining == 0)
+        pause(StopReason::Step);
+    else if (mode == Mode::SteppingOver && s.pc == returnPc && s.sp == returnSp)
+        pause(StopReason::Step);
+    return mode != Mode::Paused;
+}
+
+/*
+ * IN:  (uint16_t) first address written
+ *      (uint32_t) number of bytes written
+ *      (uint16_t) pc of the instruction that wrote them
+ * OUT: void
+ */
+inline void Debugger::wrote(uint16_t addr, uint32_t len, uint16_t pc)
+{
+    for (uint32_t i = 0; i < len; ++i)
+    {
+        uint16_t a = static_cast<uint16_t>((addr + i) & 0xFFF);
+        if (test(watchBits, a))
+        {
+            watchHit = true;
+            watchAddr = a;
+            watchPc = pc;
+            return;
+        }
+    }
+}
+
+#endif
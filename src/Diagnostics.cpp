@@ -0,0 +1,298 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Diagnostics.cpp contains the implementation of the Diagnostics class
+ * and of the DiagnosticWriter, the one thread per process that prints
+ * what every machine reported.
+ *
+ * The writer is created on the first report and never destroyed, so a
+ * machine can go away at any point, even while the program exits. At
+ * exit it is stopped and whatever the machines still alive have reported
+ * is printed, summaries included.
+ */
+
+#include "Diagnostics.h"
+#include "error.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// milliseconds() takes it by reference, so it needs a definition
+const int Diagnostics::FLUSH_MS;
+
+/*
+ * The thread that drains every machine's queue. Machines add themselves
+ * the first time they report something and remove themselves when they
+ * are destroyed; both take the lock the writer holds while it drains, so
+ * a machine is never drained and destroyed at the same time.
+ */
+class DiagnosticWriter
+{
+    public:
+        static DiagnosticWriter& instance();
+
+        void add(Diagnostics*);           // Start draining a machine, and the thread if it isn't running
+        void remove(Diagnostics*);        // Stop draining a machine, after printing what it has left
+
+        std::mutex lock;                  // Held while anything is printed
+    private:
+        DiagnosticWriter() : stopping(false) {}
+
+        void run();                       // The writer thread
+        static void stopAtExit();
+
+        std::vector<Diagnostics*> sources;
+        std::thread             thread;
+        std::condition_variable wake;     // Only used to stop the thread early
+        bool                    stopping;
+};
+
+/*
+ * IN:  void
+ * OUT: (DiagnosticWriter&) the process's writer, created on first use
+ */
+DiagnosticWriter& DiagnosticWriter::instance()
+{
+    static DiagnosticWriter* writer = new DiagnosticWriter();
+    return *writer;
+}
+
+/*
+ * IN:  (Diagnostics*) a machine's diagnostics, not yet added
+ * OUT: void
+ */
+void DiagnosticWriter::add(Diagnostics* source)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    sources.push_back(source);
+    source->registered = true;
+    if (!thread.joinable() && !stopping)
+    {
+        thread = std::thread(&DiagnosticWriter::run, this);
+        std::atexit(stopAtExit);
+    }
+}
+
+/*
+ * IN:  (Diagnostics*) a machine's diagnostics, added before
+ * OUT: void
+ */
+void DiagnosticWriter::remove(Diagnostics* source)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    source->drain();
+    source->summarize();
+    sources.erase(std::remove(sources.begin(), sources.end(), source), sources.end());
+    source->registered = false;
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      Drains every queue FLUSH_MS apart until the program exits. The
+ *      machines are never told that something is waiting; they only
+ *      push, and the writer comes by often enough to keep up.
+ */
+void DiagnosticWriter::run()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (!stopping)
+    {
+        for (size_t i = 0; i < sources.size(); ++i)
+            sources[i]->drain();
+        wake.wait_for(guard, std::chrono::milliseconds(Diagnostics::FLUSH_MS));
+    }
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      Registered with atexit by the first add. Stops the thread, then
+ *      prints everything the machines still alive have left, so a program
+ *      that exits without destroying its machines still gets their
+ *      summaries. By then the threads that ran them are gone.
+ */
+void DiagnosticWriter::stopAtExit()
+{
+    DiagnosticWriter& writer = instance();
+    {
+        std::lock_guard<std::mutex> guard(writer.lock);
+        writer.stopping = true;
+    }
+    writer.wake.notify_one();
+    writer.thread.join();
+
+    std::lock_guard<std::mutex> guard(writer.lock);
+    for (size_t i = 0; i < writer.sources.size(); ++i)
+    {
+        writer.sources[i]->drain();
+        writer.sources[i]->summarize();
+        writer.sources[i]->registered = false;
+    }
+    writer.sources.clear();
+}
+
+/*
+ * IN:  (DiagKind) a kind of problem
+ * OUT: (const char*) the message printed for it
+ */
+const char* diagMessage(DiagKind kind)
+{
+    switch (kind)
+    {
+        case DiagKind::SegFault: return "Seg fault!";
+        case DiagKind::SysCall:  return "RCA 1802 system call is not supported. :(";
+        case DiagKind::Unknown0: return "Encountered unknown (mangled?) opcode for 0x0. Skipping.";
+        case DiagKind::Unknown8: return "Encountered unknown (mangled?) opcode for 0x8. Skipping.";
+        case DiagKind::UnknownE: return "Encountered unknown (mangled?) opcode for 0xE. Skipping.";
+        case DiagKind::UnknownF: return "Encountered unknown (mangled?) opcode for 0xF. Skipping.";
+    }
+    return "Unknown problem.";
+}
+
+/*
+ * Constructor
+ */
+Diagnostics::Diagnostics() : sites(), others(0), reports(0), dropped(0), registered(false)
+{
+}
+
+/*
+ * Destructor
+ */
+Diagnostics::~Diagnostics()
+{
+    if (registered)
+        DiagnosticWriter::instance().remove(this);
+}
+
+/*
+ * IN:  (string) name of the program about to run
+ * OUT: void
+ *      Called whenever a machine loads a program. The old program's
+ *      reports are printed and summed up first.
+ */
+void Diagnostics::restart(const std::string& name)
+{
+    if (registered)
+    {
+        DiagnosticWriter& writer = DiagnosticWriter::instance();
+        std::lock_guard<std::mutex> guard(writer.lock);
+        drain();
+        summarize();
+    }
+
+    std::fill(sites, sites + SITES, Site());
+    others = 0;
+    reports = 0;
+    dropped = 0;
+    program = name;
+}
+
+/*
+ * IN:  void
+ * OUT: (uint64_t) reports since restart that were counted but never printed
+ */
+uint64_t Diagnostics::unprinted() const
+{
+    uint64_t n = dropped + (others > SITE_LIMIT ? others - SITE_LIMIT : 0);
+    for (uint32_t i = 0; i < SITES; ++i)
+        if (sites[i].count > SITE_LIMIT)
+            n += sites[i].count - SITE_LIMIT;
+    return n;
+}
+
+/*
+ * IN:  (DiagKind) what went wrong
+ *      (uint16_t) address of the instruction
+ *      (uint16_t) the instruction
+ * OUT: void
+ *      Every site in the table is taken. The report is counted with the
+ *      other sites that didn't fit, which share one SITE_LIMIT.
+ */
+void Diagnostics::overflow(DiagKind kind, uint16_t pc, uint16_t opcode)
+{
+    if (++others <= SITE_LIMIT)
+        enqueue({ pc, opcode, kind, others == SITE_LIMIT });
+}
+
+/*
+ * IN:  (const DiagEvent&) a report to print
+ * OUT: void
+ *      Only ever runs SITE_LIMIT times a site, so it can afford to meet
+ *      the writer the first time.
+ */
+void Diagnostics::enqueue(const DiagEvent& event)
+{
+    if (!registered)
+        DiagnosticWriter::instance().add(this);
+    if (!events.push(event))
+        ++dropped;
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ */
+void Diagnostics::drain()
+{
+    DiagEvent event;
+    while (events.pop(event))
+    {
+        std::ostringstream msg;
+        msg << diagMessage(event.kind) << " (0x" << std::hex << std::uppercase << std::setfill('0')
+            << std::setw(4) << event.opcode << " at 0x" << std::setw(3) << event.pc;
+        if (event.last)
+            msg << ", any more from here are only counted";
+        msg << ")";
+        printChip8Error(msg.str());
+    }
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      One line per site that reported more than was printed, the
+ *      busiest first, so nothing that happened goes unmentioned.
+ */
+void Diagnostics::summarize()
+{
+    uint64_t hidden = unprinted();
+    if (hidden == 0)
+        return;
+
+    std::vector<const Site*> busy;
+    for (uint32_t i = 0; i < SITES; ++i)
+        if (sites[i].count > SITE_LIMIT)
+            busy.push_back(&sites[i]);
+    std::sort(busy.begin(), busy.end(), [](const Site* a, const Site* b) { return a->count != b->count ? a->count > b->count : a->key < b->key; });
+
+    std::ostringstream msg;
+    msg << (program.empty() ? std::string("The program") : "\"" + program + "\"") << " made " << reports
+        << " reports, " << hidden << " of them not printed";
+    for (size_t i = 0; i < busy.size(); ++i)
+    {
+        const Site& site = *busy[i];
+        msg << "\n    0x" << std::hex << std::uppercase << std::setfill('0') << std::setw(3) << ((site.key - 1) & 0xFFF)
+            << "  0x" << std::setw(4) << site.opcode << std::dec << std::setfill(' ') << std::setw(12) << site.count
+            << "  " << diagMessage(static_cast<DiagKind>((site.key - 1) >> 12));
+    }
+    if (others > 0)
+        msg << "\n    " << std::setfill(' ') << std::setw(25) << others << "  at other sites";
+    if (dropped > 0)
+        msg << "\n    " << std::setfill(' ') << std::setw(25) << dropped << "  lost waiting to be printed";
+    printChip8Error(msg.str());
+}
@@ -0,0 +1,136 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Diagnostics.h contains the class definition for Diagnostics, which
+ * collects the problems a machine runs into while executing: unknown
+ * opcodes, system calls and running off the end of memory. A ROM that
+ * runs into data can hit one of those on every instruction, so reporting
+ * one has to cost next to nothing.
+ *
+ * Each report is counted against its site, the address and kind of the
+ * problem, in a small table owned by the machine. Only the first
+ * SITE_LIMIT reports from a site go any further: they are pushed as
+ * events into the machine's own SpscQueue, and a writer thread shared by
+ * every machine in the process drains the queues and prints them. The
+ * thread that runs the machine never writes to a stream, takes a lock or
+ * waits. When the machine is done, or loads another program, whatever
+ * was counted but not printed is summed up site by site.
+ *
+ * A machine that never reports anything never meets the writer thread;
+ * it is started by the first report in the process.
+ */
+
+#ifndef CHIP8_DIAGNOSTICS_H_
+#define CHIP8_DIAGNOSTICS_H_
+
+#include "SpscQueue.h"
+#include <cstdint>
+#include <string>
+
+enum class DiagKind : uint8_t
+{
+    SegFault,                         // pc left program memory, the machine stops
+    SysCall,                          // 0NNN, RCA 1802 machine code
+    Unknown0,                         // 0x0 opcode that isn't CLS, RET or SYS
+    Unknown8,                         // 0x8 opcode with no ALU operation
+    UnknownE,                         // 0xE opcode that isn't SKP or SKNP
+    UnknownF                          // 0xF opcode that isn't one of the FXKK instructions
+};
+
+const char* diagMessage(DiagKind);    // What printChip8Error used to say for it
+
+/* One problem, going from a machine to the writer thread */
+struct DiagEvent
+{
+    uint16_t pc;
+    uint16_t opcode;
+    DiagKind kind;
+    bool     last;                    // The site's last report to be printed, later ones are only counted
+};
+
+class Diagnostics
+{
+    public:
+        static const uint32_t SITE_LIMIT = 4;    // Reports printed per site, the rest are counted
+        static const uint32_t SITES      = 64;   // Sites counted one by one, the rest together
+        static const uint32_t QUEUE_SIZE = 256;  // Events waiting for the writer thread
+        static const int      FLUSH_MS   = 50;   // How often the writer thread drains the queues
+
+        Diagnostics();
+        ~Diagnostics();                   // Prints anything still queued, then the summary
+
+        void report(DiagKind, uint16_t pc, uint16_t opcode); // Hot path, never blocks
+        void restart(const std::string&); // Print the summary, forget everything and name the next program
+        uint64_t total() const { return reports; }    // Reports since restart
+        uint64_t unprinted() const;       // Reports that were only counted
+    private:
+        Diagnostics(const Diagnostics&);  // Not copyable
+        Diagnostics& operator=(const Diagnostics&);
+
+        /* Everything reported from one address as one kind */
+        struct Site
+        {
+            uint32_t key;                 // 0 while unused, else (kind << 12 | pc) + 1
+            uint16_t opcode;              // The first one reported there
+            uint64_t count;
+        };
+
+        void overflow(DiagKind, uint16_t, uint16_t); // Report from a site with no room in the table
+        void enqueue(const DiagEvent&);   // Hand an event to the writer thread
+        void drain();                     // Print what is queued, the writer's lock is held
+        void summarize();                 // Print the sites that went over SITE_LIMIT, the writer's lock is held
+
+        Site     sites[SITES];
+        uint64_t others;                  // Reports from sites the table had no room for
+        uint64_t reports;
+        uint64_t dropped;                 // Events that found the queue full
+        bool     registered;              // The writer thread knows about this one
+        std::string program;              // Named in the summary, only touched with the writer's lock held
+        SpscQueue<DiagEvent, QUEUE_SIZE> events;
+
+        friend class DiagnosticWriter;
+};
+
+static_assert(Diagnostics::SITES == 1 << 6, "report() hashes sites to 6 bits");
+
+/*
+ * IN:  (DiagKind) what went wrong
+ *      (uint16_t) address of the instruction
+ *      (uint16_t) the instruction
+ * OUT: void
+ *      Counts the report against its site and passes it on to be printed
+ *      if the site hasn't used up its SITE_LIMIT. A probe or two into the
+ *      table, no more.
+ */
+inline void Diagnostics::report(DiagKind kind, uint16_t pc, uint16_t opcode)
+{
+    ++reports;
+    uint32_t key = (static_cast<uint32_t>(kind) << 12 | (pc & 0xFFF)) + 1;
+    for (uint32_t i = key * 0x9E3779B1u >> 26, probes = 0; probes < SITES; i = (i + 1) & (SITES - 1), ++probes)
+    {
+        Site& site = sites[i];
+        if (site.key == key)
+        {
+            if (++site.count <= SITE_LIMIT)
+                enqueue({ pc, opcode, kind, site.count == SITE_LIMIT });
+            return;
+        }
+        if (site.key == 0)
+        {
+            site.key = key;
+            site.opcode = opcode;
+            site.count = 1;
+            enqueue({ pc, opcode, kind, SITE_LIMIT == 1 });
+            return;
+        }
+    }
+    overflow(kind, pc, opcode);
+}
+
+#endif
@@ -0,0 +1,418 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Environment.cpp contains the implementation of EnvConfig, reading the
+ * settings files, and of Environment: booting the ROM once, resetting
+ * instances to that snapshot and stepping the whole batch.
+ */
+
+#include "Environment.h"
+#include "RomCatalog.h"
+#include "error.h"
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+/*
+ * IN:  (string) a location as written in a settings file: V0 - VF, or a
+ *      memory address in hex
+ *      (EnvLocation&) set to it
+ * OUT: (bool) false if it is neither
+ */
+static bool parseLocation(const std::string& text, EnvLocation& at)
+{
+    char* end = nullptr;
+    if (text.size() == 2 && (text[0] == 'V' || text[0] == 'v'))
+    {
+        unsigned long x = std::strtoul(text.c_str() + 1, &end, 16);
+        at.reg = true;
+        at.index = static_cast<uint16_t>(x);
+        return *end == '\0';
+    }
+
+    unsigned long addr = std::strtoul(text.c_str(), &end, 16);
+    at.reg = false;
+    at.index = static_cast<uint16_t>(addr);
+    return !text.empty() && *end == '\0' && addr <= END_PROG_MEM;
+}
+
+/*
+ * IN:  (string) keys held by an action: hex digits, or "-" for none
+ *      (uint16_t&) set to them, bit k for key k
+ * OUT: (bool) false if it isn't that
+ */
+static bool parseKeys(const std::string& text, uint16_t& keys)
+{
+    keys = 0;
+    if (text == "-")
+        return true;
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        char c = static_cast<char>(std::toupper(static_cast<unsigned char>(text[i])));
+        if (c >= '0' && c <= '9')
+            keys |= static_cast<uint16_t>(1 << (c - '0'));
+        else if (c >= 'A' && c <= 'F')
+            keys |= static_cast<uint16_t>(1 << (c - 'A' + 10));
+        else
+            return false;
+    }
+    return !text.empty();
+}
+
+/*
+ * Constructor
+ *      Every key on its own and no key at all, observing the screen.
+ */
+EnvConfig::EnvConfig() : engine(Engine::Jit), cyclesPerFrame(0), frameSkip(4), sticky(0), startFrames(0), maxFrames(0), screen(false)
+{
+}
+
+/*
+ * IN:  (string) path to a settings file, as laid out in Environment.h
+ * OUT: (bool) false if it can't be read or a line doesn't parse
+ *      Blank lines and lines starting with '#' are skipped. Settings not
+ *      in the file keep what they were.
+ */
+bool EnvConfig::load(const std::string& path)
+{
+    std::ifstream in(path.c_str());
+    if (!in)
+    {
+        printChip8Error("Unable to open environment settings " + path);
+        return false;
+    }
+
+    std::string line;
+    for (int number = 1; std::getline(in, line); ++number)
+    {
+        std::istringstream fields(line);
+        std::string name;
+        if (!(fields >> name) || name[0] == '#')
+            continue;
+
+        bool ok = true;
+        std::string word;
+        if (name == "rom")
+            ok = static_cast<bool>(fields >> rom);
+        else if (name == "engine")
+            ok = (fields >> word) && engineFromName(word, engine);
+        else if (name == "ipf")
+            ok = static_cast<bool>(fields >> cyclesPerFrame);
+        else if (name == "frameskip")
+            ok = (fields >> frameSkip) && frameSkip > 0;
+        else if (name == "sticky")
+            ok = (fields >> sticky) && sticky >= 0 && sticky <= 1;
+        else if (name == "start-frames")
+            ok = static_cast<bool>(fields >> startFrames);
+        else if (name == "max-frames")
+            ok = static_cast<bool>(fields >> maxFrames);
+        else if (name == "actions")
+        {
+            actions.clear();
+            uint16_t keys;
+            while (ok && fields >> word && (ok = parseKeys(word, keys)))
+                actions.push_back(keys);
+            ok = ok && !actions.empty();
+        }
+        else if (name == "observe")
+        {
+            EnvLocation at;
+            while (ok && fields >> word)
+            {
+                if (word == "screen")
+                    screen = true;
+                else if ((ok = parseLocation(word, at)))
+                    observe.push_back(at);
+            }
+        }
+        else if (name == "reward")
+        {
+            EnvCounter c;
+            unsigned length;
+            c.weight = 1;
+            ok = fields >> word >> length && parseLocation(word, c.at) && length >= 1 && length <= 4;
+            c.length = static_cast<uint8_t>(length);
+            ok = ok && fields >> word && (word == "bcd" || word == "byte");
+            c.bcd = (word == "bcd");
+            if (ok && fields >> word)
+                c.weight = std::strtof(word.c_str(), nullptr);
+            if (ok)
+                rewards.push_back(c);
+        }
+        else if (name == "done")
+        {
+            EnvCondition c;
+            std::string op;
+            ok = fields >> word >> op && parseLocation(word, c.at);
+            c.op = (op == "==") ? '=' : (op == "!=") ? '!' : (op == "<") ? '<' : (op == ">=") ? '>' : 0;
+            ok = ok && c.op != 0 && fields >> word;
+            c.value = static_cast<uint8_t>(std::strtoul(word.c_str(), nullptr, 0));
+            if (ok)
+                done.push_back(c);
+        }
+        else
+            ok = false;
+
+        if (!ok)
+        {
+            printChip8Error(path + ":" + std::to_string(number) + ": can't make sense of \"" + line + "\"");
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Constructor
+ */
+Environment::Environment(size_t n) : obsSize(0), frames(0), stickyBelow(0), machines(n), episode(n), reward(n), done(n), truncated(n)
+{
+}
+
+/*
+ * IN:  (const EnvConfig&) the ROM and how to play it
+ * OUT: (bool) false if the ROM can't be loaded or halts before the
+ *      snapshot is taken
+ *      The ROM is booted once, on a machine of its own. Every instance
+ *      loads it from the same mapping and then takes the whole snapshot;
+ *      after that, resets copy only what an episode wrote.
+ */
+bool Environment::load(const EnvConfig& c)
+{
+    config = c;
+    if (config.actions.empty())
+    {
+        config.actions.push_back(0);
+        for (int k = 0; k < 16; ++k)
+            config.actions.push_back(static_cast<uint16_t>(1 << k));
+    }
+    if (!config.screen && config.observe.empty())
+        config.screen = true;
+
+    RomCatalog catalog;
+    const RomEntry* rom = catalog.add(config.rom);
+    Chip8 first;
+    if (!rom || !first.loadROM(*rom))
+        return false;
+    if (config.cyclesPerFrame != 0)
+        first.setCyclesPerFrame(config.cyclesPerFrame);
+    first.setEngine(config.engine);
+    if (config.startFrames > 0)
+        first.runFrames(config.startFrames);
+    if (!first.isRunning())
+    {
+        printChip8Error(config.rom + " halted before its start frames were over");
+        return false;
+    }
+    boot = first.state();
+
+    for (size_t i = 0; i < machines.size(); ++i)
+    {
+        machines[i].reset(new Chip8());
+        Chip8& m = *machines[i];
+        m.loadROM(*rom);
+        m.setCyclesPerFrame(first.getCyclesPerFrame());
+        m.setEngine(config.engine);
+        m.resetTo(boot, ~0ULL);
+    }
+
+    obsSize = (config.screen ? ENV_SCREEN_BYTES : 0) + config.observe.size();
+    obs.assign(machines.size() * obsSize, 0);
+    stickyBelow = static_cast<uint32_t>(config.sticky * 256 + 0.5f);
+    frames = 0;
+    seed(0);
+    return true;
+}
+
+/*
+ * IN:  (uint64_t) seed for the first instance, the next gets one more
+ * OUT: void
+ */
+void Environment::seed(uint64_t s)
+{
+    for (size_t i = 0; i < machines.size(); ++i)
+    {
+        episode[i].rng = seedRandom(s + i);
+        reset(i);
+    }
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ */
+void Environment::reset()
+{
+    for (size_t i = 0; i < machines.size(); ++i)
+        reset(i);
+}
+
+/*
+ * IN:  (size_t) instance
+ * OUT: void
+ *      Only the lines of memory the episode wrote are copied back, and
+ *      each episode gets its own RND seed from the instance's generator.
+ */
+void Environment::reset(size_t i)
+{
+    Chip8& m = *machines[i];
+    Episode& e = episode[i];
+    m.resetTo(boot, m.takeDirtyMemory());
+    m.seed(e.rng);
+    nextRandom(e.rng);
+
+    e.held = 0;
+    e.last = 0;
+    e.frames = 0;
+    e.score = score(m.state());
+    e.total = 0;
+    e.over = false;
+    reward[i] = 0;
+    done[i] = 0;
+    truncated[i] = 0;
+    observe(i);
+}
+
+/*
+ * IN:  (const uint8_t*) an index into the config's actions per instance
+ * OUT: void
+ *      Runs frameskip frames on every instance, or until its episode
+ *      ends, then fills in observations(), rewards() and dones().
+ *      Instances whose episode ended on the last step are reset instead.
+ */
+void Environment::step(const uint8_t* actions)
+{
+    for (size_t i = 0; i < machines.size(); ++i)
+    {
+        Chip8& m = *machines[i];
+        Episode& e = episode[i];
+        if (e.over)
+        {
+            reset(i);
+            continue;
+        }
+
+        uint16_t keys = config.actions[actions[i] % config.actions.size()];
+        done[i] = 0;
+        truncated[i] = 0;
+        for (uint32_t f = 0; f < config.frameSkip; ++f)
+        {
+            uint16_t now = (stickyBelow != 0 && nextRandom(e.rng) < stickyBelow) ? e.last : keys;
+            hold(i, now);
+            e.last = now;
+            m.runFrames(1);
+            ++e.frames;
+            ++frames;
+
+            if (finished(m))
+            {
+                done[i] = 1;
+                break;
+            }
+            if (config.maxFrames != 0 && e.frames >= config.maxFrames)
+            {
+                done[i] = 1;
+                truncated[i] = 1;
+                break;
+            }
+        }
+
+        float s = score(m.state());
+        reward[i] = s - e.score;
+        e.score = s;
+        e.total += reward[i];
+        e.over = (done[i] != 0);
+        observe(i);
+    }
+}
+
+/*
+ * IN:  (const Chip8State&) a machine
+ *      (const EnvLocation&) one of its bytes
+ * OUT: (uint8_t) the byte
+ */
+uint8_t Environment::read(const Chip8State& s, const EnvLocation& at) const
+{
+    return at.reg ? s.V[at.index & 0xF] : s.memory[at.index & 0xFFF];
+}
+
+/*
+ * IN:  (const Chip8State&) a machine
+ * OUT: (float) the weighted sum of its reward locations
+ */
+float Environment::score(const Chip8State& s) const
+{
+    float sum = 0;
+    for (size_t r = 0; r < config.rewards.size(); ++r)
+    {
+        const EnvCounter& c = config.rewards[r];
+        uint32_t value = 0;
+        EnvLocation at = c.at;
+        for (uint8_t k = 0; k < c.length; ++k, ++at.index)
+            value = c.bcd ? value * 10 + read(s, at) : value << 8 | read(s, at);
+        sum += c.weight * value;
+    }
+    return sum;
+}
+
+/*
+ * IN:  (const Chip8&) a machine, after a frame
+ * OUT: (bool) true if it halted or any done condition holds
+ */
+bool Environment::finished(const Chip8& m) const
+{
+    if (!m.isRunning())
+        return true;
+    for (size_t d = 0; d < config.done.size(); ++d)
+    {
+        const EnvCondition& c = config.done[d];
+        uint8_t b = read(m.state(), c.at);
+        bool holds = (c.op == '=') ? b == c.value : (c.op == '!') ? b != c.value : (c.op == '<') ? b < c.value : b >= c.value;
+        if (holds)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * IN:  (size_t) instance
+ *      (uint16_t) keys that should be down, bit k for key k
+ * OUT: void
+ *      Only keys that change are pressed or let go.
+ */
+void Environment::hold(size_t i, uint16_t keys)
+{
+    uint16_t changed = keys ^ episode[i].held;
+    for (int k = 0; changed != 0; ++k, changed >>= 1)
+        if (changed & 1)
+            machines[i]->setKey(k, (keys >> k & 1) != 0);
+    episode[i].held = keys;
+}
+
+/*
+ * IN:  (size_t) instance
+ * OUT: void
+ *      The screen goes in as 8 bytes a row with the leftmost pixel in
+ *      bit 7 of the first, the same whatever the host's byte order.
+ */
+void Environment::observe(size_t i)
+{
+    uint8_t* out = &obs[i * obsSize];
+    const Chip8& m = *machines[i];
+    if (config.screen)
+    {
+        const uint64_t* rows = m.framebuffer();
+        for (int y = 0; y < Y_RES; ++y)
+            for (int b = 0; b < X_RES / 8; ++b)
+                *out++ = static_cast<uint8_t>(rows[y] >> (56 - 8 * b));
+    }
+    for (size_t l = 0; l < config.observe.size(); ++l)
+        *out++ = read(m.state(), config.observe[l]);
+}
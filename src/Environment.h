@@ -0,0 +1,166 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Environment.h contains the class definitions for EnvConfig and
+ * Environment, which turn a ROM into a batch of reinforcement-learning
+ * environments: reset() and step(actions) over many copies of the game
+ * at once, with observations, rewards and done flags laid out in flat
+ * arrays, one slot per instance, ready to be handed to a trainer.
+ *
+ * What the game's score and game over look like is different for every
+ * ROM, so an EnvConfig, usually read from a small text file (env/BRIX.env,
+ * say), names the bytes to watch. A location is a memory address in hex
+ * or a register, V0 to VF:
+ *
+ *   rom          rom/BRIX        the ROM to play
+ *   engine       jit             any engine --engine takes
+ *   ipf          10              instructions per frame
+ *   frameskip    4               frames per step, the action held for all of them
+ *   sticky       0.25            chance a frame repeats the last frame's action
+ *   start-frames 0               frames run with no keys before the snapshot
+ *   max-frames   18000           episode length before it is cut short, 0 for none
+ *   actions      - 4 6 46        keys held by each action, "-" for none
+ *   observe      screen          the 64x32 screen, 8 bytes a row, bit 7 leftmost
+ *   observe      314 315 V5      and/or these bytes, in this order
+ *   reward       314 3 bcd 1     FX33 digits, most significant first, times a weight
+ *   reward       VE 1 byte -1    or big-endian bytes
+ *   done         VE == 0         any condition that holds ends the episode
+ *
+ * A step's reward is how much the weighted sum of every reward location
+ * went up during it. An episode ends when a done condition holds after
+ * any frame, or the machine halts; that frame ends the step early.
+ * Running into max-frames is reported as truncated as well as done.
+ *
+ * Each instance is a Chip8 of its own, on whichever engine the config
+ * names. The ROM is booted once, start-frames run, and the state is kept
+ * as a snapshot; an instance resets with Chip8::resetTo, which copies
+ * back only the 64-byte lines of memory the episode wrote, so the
+ * engines keep the code they have decoded or compiled. An instance that
+ * finishes an episode is reset by the next step(), which ignores its
+ * action and reports its first observation with no reward.
+ *
+ * Everything runs on the calling thread. For more cores, run one
+ * Environment per core; the instances share nothing.
+ */
+
+#ifndef CHIP8_ENVIRONMENT_H_
+#define CHIP8_ENVIRONMENT_H_
+
+#include "Chip8.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+static const size_t ENV_SCREEN_BYTES = X_RES / 8 * Y_RES; // Packed 64x32 screen in an observation
+
+/* A byte of the machine: memory, or one of the V registers */
+struct EnvLocation
+{
+    bool        reg;                  // index is a V register, not an address
+    uint16_t    index;
+};
+
+/* Part of the score */
+struct EnvCounter
+{
+    EnvLocation at;                   // First byte, the most significant
+    uint8_t     length;               // Bytes it spans
+    bool        bcd;                  // One decimal digit a byte, as FX33 writes them
+    float       weight;               // What a point of it is worth
+};
+
+/* A way for an episode to end */
+struct EnvCondition
+{
+    EnvLocation at;
+    uint8_t     op;                   // One of '=', '!', '<', '>' for ==, !=, < and >=
+    uint8_t     value;
+};
+
+struct EnvConfig
+{
+    EnvConfig();
+
+    bool load(const std::string&);    // Read settings from a file, false if it can't be read or a line doesn't parse
+
+    std::string rom;
+    Engine      engine;
+    uint32_t    cyclesPerFrame;       // 0 for the ROM's own
+    uint32_t    frameSkip;            // Frames per step
+    float       sticky;               // Chance a frame keeps the previous frame's action
+    uint32_t    startFrames;          // Run before the snapshot every reset goes back to
+    uint32_t    maxFrames;            // Frames before an episode is truncated, 0 for never
+    std::vector<uint16_t> actions;    // Keys held by each action, bit k is key k
+    bool        screen;               // The observation starts with the packed screen
+    std::vector<EnvLocation>  observe;  // Then these bytes
+    std::vector<EnvCounter>   rewards;
+    std::vector<EnvCondition> done;
+};
+
+class Environment
+{
+    public:
+        explicit Environment(size_t);
+
+        bool load(const EnvConfig&);      // Boot the ROM, take the snapshot and reset every instance
+        void seed(uint64_t);              // Instance i draws RND and sticky actions from seed + i, then resets
+        void reset();                     // Every instance back to the snapshot
+        void reset(size_t);
+        void step(const uint8_t*);        // One action index per instance
+
+        size_t size() const { return machines.size(); }
+        size_t actionCount() const { return config.actions.size(); }
+        size_t observationSize() const { return obsSize; }
+        const uint8_t* observations() const { return obs.data(); } // observationSize() bytes per instance
+        const float* rewards() const { return reward.data(); }
+        const uint8_t* dones() const { return done.data(); }        // Nonzero when the last step ended an episode
+        const uint8_t* truncations() const { return truncated.data(); } // Nonzero when that was max-frames
+        uint64_t framesRun() const { return frames; }                // By every instance, since load
+        uint32_t episodeFrames(size_t i) const { return episode[i].frames; }
+        float episodeReturn(size_t i) const { return episode[i].total; }
+        const Chip8& machine(size_t i) const { return *machines[i]; }
+    private:
+        Environment(const Environment&);  // Not copyable
+        Environment& operator=(const Environment&);
+
+        /* The episode an instance is in */
+        struct Episode
+        {
+            uint64_t rng;                 // Sticky actions and the next episode's RND seed
+            uint16_t held;                // Keys down on the machine
+            uint16_t last;                // Keys the last frame ran with
+            uint32_t frames;
+            float    score;               // Weighted sum of the reward locations
+            float    total;               // Rewards so far
+            bool     over;                // Reset on the next step
+        };
+
+        uint8_t read(const Chip8State&, const EnvLocation&) const;
+        float score(const Chip8State&) const;
+        bool finished(const Chip8&) const;
+        void hold(size_t, uint16_t);      // Make the machine's keys these
+        void observe(size_t);             // Write the instance's observation
+
+        EnvConfig  config;
+        Chip8State boot;                  // What every episode starts from
+        size_t     obsSize;
+        uint64_t   frames;
+        uint32_t   stickyBelow;           // A random byte under this repeats the action
+
+        std::vector<std::unique_ptr<Chip8> > machines;
+        std::vector<Episode> episode;
+        std::vector<uint8_t> obs;
+        std::vector<float>   reward;
+        std::vector<uint8_t> done;
+        std::vector<uint8_t> truncated;
+};
+
+#endif
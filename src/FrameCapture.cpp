@@ -0,0 +1,648 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * FrameCapture.cpp contains the implementation of the FrameCapture
+ * class.
+ *
+ * The PNGs are written without a compression library. Each image is a
+ * 1-bit greyscale picture of at most 64 rows of 17 bytes, and the zlib
+ * stream around it uses stored (uncompressed) deflate blocks; squeezing
+ * a kilobyte would cost more time than it saves space.
+ */
+
+#include "FrameCapture.h"
+#include "error.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CHIP8_POPEN 1
+#include <csignal>
+#else
+#define CHIP8_POPEN 0
+#endif
+
+// milliseconds() takes it by reference, so it needs a definition
+const int FrameCapture::POLL_MS;
+
+/*
+ * IN:  (string) a format name as given on the command line
+ *      (CaptureFormat&) set to the matching format
+ * OUT: (bool) false if the name is not a format
+ */
+bool captureFormatFromName(const std::string& name, CaptureFormat& format)
+{
+    if (name == "y4m")
+        format = CaptureFormat::Y4M;
+    else if (name == "apng")
+        format = CaptureFormat::APNG;
+    else
+        return false;
+    return true;
+}
+
+/*
+ * IN:  (const uint8_t*) bytes
+ *      (size_t) number of bytes
+ *      (uint32_t) CRC to continue from, already inverted
+ * OUT: (uint32_t) the CRC-32 PNG chunks end with, not yet inverted
+ *      Slicing-by-8: eight tables let it take eight bytes per step
+ *      instead of one, which is most of what writing a frame costs.
+ */
+static uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc)
+{
+    static const std::vector<uint32_t> table = []
+    {
+        std::vector<uint32_t> t(8 * 256);
+        for (uint32_t n = 0; n < 256; ++n)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        for (uint32_t n = 0; n < 256; ++n)
+            for (int slice = 1; slice < 8; ++slice)
+                t[slice * 256 + n] = t[(slice - 1) * 256 + n] >> 8 ^ t[t[(slice - 1) * 256 + n] & 0xFF];
+        return t;
+    }();
+    const uint32_t* t = table.data();
+
+    for (; size >= 8; size -= 8, data += 8)
+    {
+        uint32_t lo = crc ^ (data[0] | data[1] << 8 | data[2] << 16 | static_cast<uint32_t>(data[3]) << 24);
+        uint32_t hi = data[4] | data[5] << 8 | data[6] << 16 | static_cast<uint32_t>(data[7]) << 24;
+        crc = t[7 * 256 + (lo & 0xFF)] ^ t[6 * 256 + (lo >> 8 & 0xFF)] ^ t[5 * 256 + (lo >> 16 & 0xFF)] ^ t[4 * 256 + (lo >> 24)]
+            ^ t[3 * 256 + (hi & 0xFF)] ^ t[2 * 256 + (hi >> 8 & 0xFF)] ^ t[1 * 256 + (hi >> 16 & 0xFF)] ^ t[hi >> 24];
+    }
+    for (; size > 0; --size, ++data)
+        crc = t[(crc ^ *data) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+/*
+ * IN:  (uint8_t*) where to put it
+ *      (uint32_t) a number
+ * OUT: void
+ *      PNG stores every number big-endian.
+ */
+static void storeBE32(uint8_t* out, uint32_t n)
+{
+    out[0] = n >> 24;
+    out[1] = n >> 16;
+    out[2] = n >> 8;
+    out[3] = n;
+}
+
+static void storeBE16(uint8_t* out, uint16_t n)
+{
+    out[0] = n >> 8;
+    out[1] = n;
+}
+
+/*
+ * Constructor
+ */
+FrameCapture::FrameCapture() : format(CaptureFormat::Y4M), width(X_RES), height(Y_RES), output(nullptr), piped(false), filling(nullptr), added(0), changes(0), closing(false), canvas(), sequence(0), written(0), actlOffset(0), failed(false)
+{
+}
+
+/*
+ * Destructor
+ */
+FrameCapture::~FrameCapture()
+{
+    if (output)
+        close();
+}
+
+/*
+ * IN:  (string) file to write, "-" for standard output or "|command" to
+ *      pipe into a command (Y4M only)
+ *      (CaptureFormat) what to write
+ *      (Platform) the machine's platform, SUPER-CHIP is captured at 128x64
+ * OUT: (bool) false if the output can't be opened
+ */
+bool FrameCapture::open(const std::string& path, CaptureFormat f, Platform platform)
+{
+    if (output)
+        close();
+
+    format = f;
+    width = (platform == Platform::SuperChip) ? HI_X_RES : X_RES;
+    height = (platform == Platform::SuperChip) ? HI_Y_RES : Y_RES;
+    bool stream = (path == "-" || (!path.empty() && path[0] == '|'));
+    if (format == CaptureFormat::APNG && stream)
+    {
+        printChip8Error("An APNG capture has to go to a file");
+        return false;
+    }
+
+    piped = !path.empty() && path[0] == '|';
+    if (path == "-")
+        output = stdout;
+#if CHIP8_POPEN
+    else if (piped)
+    {
+        // A command that exits early should fail the capture, not kill the program
+        std::signal(SIGPIPE, SIG_IGN);
+        output = popen(path.c_str() + 1, "w");
+    }
+#endif
+    else if (!piped)
+        output = std::fopen(path.c_str(), "wb");
+    if (!output)
+    {
+        printChip8Error("Failed to open \"" + path + "\" for capturing");
+        return false;
+    }
+    // stdout may outlive this capture, so it keeps its own buffer
+    if (output != stdout)
+    {
+        buffer.resize(BUFFER_SIZE);
+        std::setvbuf(output, buffer.data(), _IOFBF, buffer.size());
+    }
+
+    // Allocated with the first capture; a close leaves every batch spare
+    if (batches.empty())
+    {
+        batches.resize(BATCHES);
+        for (size_t i = 0; i < batches.size(); ++i)
+            spare.push(&batches[i]);
+    }
+
+    filling = nullptr;
+    added = 0;
+    changes = 0;
+    sequence = 0;
+    written = 0;
+    failed = false;
+    closing.store(false, std::memory_order_relaxed);
+    encoded.clear();
+
+    if (format == CaptureFormat::Y4M)
+    {
+        failed = std::fprintf(output, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, FRAME_RATE) < 0;
+    }
+    else
+    {
+        static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        failed = std::fwrite(signature, 1, sizeof(signature), output) != sizeof(signature);
+
+        uint8_t* header = startChunk("IHDR", 13);
+        storeBE32(header, width);
+        storeBE32(header + 4, height);
+        header[8] = 1;                // Bit depth
+        header[9] = 0;                // Greyscale
+        header[10] = 0;               // Deflate
+        header[11] = 0;               // Filter method 0
+        header[12] = 0;               // Not interlaced
+        endChunk(13);
+
+        uint8_t control[8];
+        storeBE32(control, 0);        // Frames, patched on close
+        storeBE32(control + 4, 0);    // Loop forever
+        actlOffset = std::ftell(output) + chunks.size();
+        writeChunk("acTL", control, sizeof(control));
+        flushChunks();
+    }
+
+    thread = std::thread(&FrameCapture::writer, this);
+    return !failed;
+}
+
+/*
+ * IN:  (const Chip8&) the machine, right after it ran a frame
+ * OUT: void
+ *      The only work on the machine's thread: a compare with the last
+ *      frame in the batch, and a copy of the screen into the batch when
+ *      it changed. If the writer thread has fallen BATCHES batches
+ *      behind, this waits for it rather than lose a frame.
+ */
+void FrameCapture::add(const Chip8& chip8)
+{
+    if (!output)
+        return;
+    ++added;
+
+    bool hires = chip8.hiresMode();
+    if (filling && unchanged(chip8, hires))
+    {
+        ++filling->shown[filling->count - 1];
+        return;
+    }
+
+    // The frame before this one is finished, so a full batch can go
+    if (filling && filling->count == BATCH_FRAMES)
+        submit();
+    if (!filling)
+    {
+        while (!spare.pop(filling))
+        {
+            wake.notify_one();
+            std::this_thread::yield();
+        }
+        filling->count = filling->words = 0;
+    }
+
+    Batch& b = *filling;
+    b.shown[b.count] = 1;
+    b.hires[b.count] = hires;
+    ++b.count;
+    if (hires)
+    {
+        std::memcpy(&b.rows[b.words], chip8.hiresFramebuffer(), HI_Y_RES * 2 * sizeof(uint64_t));
+        b.words += HI_Y_RES * 2;
+    }
+    else
+    {
+        std::memcpy(&b.rows[b.words], chip8.framebuffer(), Y_RES * sizeof(uint64_t));
+        b.words += Y_RES;
+    }
+    ++changes;
+}
+
+/*
+ * IN:  (const Chip8&) the machine
+ *      (bool) its hiresMode()
+ * OUT: (bool) true if its screen is the last frame in the batch
+ */
+bool FrameCapture::unchanged(const Chip8& chip8, bool hires) const
+{
+    const Batch& b = *filling;
+    if (hires != b.hires[b.count - 1])
+        return false;
+    if (hires)
+        return std::memcmp(&b.rows[b.words - HI_Y_RES * 2], chip8.hiresFramebuffer(), HI_Y_RES * 2 * sizeof(uint64_t)) == 0;
+    return std::memcmp(&b.rows[b.words - Y_RES], chip8.framebuffer(), Y_RES * sizeof(uint64_t)) == 0;
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      There is always room in the queue: it holds every batch there is.
+ */
+void FrameCapture::submit()
+{
+    queue.push(filling);
+    filling = nullptr;
+}
+
+/*
+ * IN:  void
+ * OUT: (bool) false if anything failed to write
+ *      Hands over the last frame, waits for the writer thread to write
+ *      everything, finishes the file and closes it.
+ */
+bool FrameCapture::close()
+{
+    if (!output)
+        return true;
+
+    if (filling)
+        submit();
+    closing.store(true, std::memory_order_release);
+    wake.notify_one();
+    thread.join();
+
+    if (format == CaptureFormat::APNG)
+    {
+        writeChunk("IEND", nullptr, 0);
+
+        uint8_t control[8];
+        storeBE32(control, written);
+        storeBE32(control + 4, 0);
+        flushChunks();
+        if (std::fseek(output, actlOffset, SEEK_SET) == 0)
+        {
+            writeChunk("acTL", control, sizeof(control));
+            flushChunks();
+        }
+        else
+            failed = true;
+    }
+
+    failed |= std::fflush(output) != 0;
+#if CHIP8_POPEN
+    if (piped)
+        failed |= pclose(output) != 0;
+    else
+#endif
+    if (output != stdout)
+        failed |= std::fclose(output) != 0;
+    output = nullptr;
+
+    if (failed)
+        printChip8Error("Failed to write the capture");
+    return !failed;
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      Writes batches as they come, and sleeps up to POLL_MS when there
+ *      are none. The machine's thread only wakes it early when it has no
+ *      spare batch or the capture is closing, so a frame costs it no
+ *      system call.
+ */
+void FrameCapture::writer()
+{
+    Batch* b;
+    std::unique_lock<std::mutex> guard(sleeping);
+    for (;;)
+    {
+        if (queue.pop(b))
+        {
+            writeBatch(*b);
+            spare.push(b);
+            continue;
+        }
+        if (closing.load(std::memory_order_acquire))
+        {
+            // Anything pushed before closing was set is visible now
+            while (queue.pop(b))
+            {
+                writeBatch(*b);
+                spare.push(b);
+            }
+            return;
+        }
+        wake.wait_for(guard, std::chrono::milliseconds(POLL_MS));
+    }
+}
+
+/*
+ * IN:  (const Batch&) frames and how long each was shown
+ * OUT: void
+ *      The APNG chunks of the whole batch go out in one write.
+ */
+void FrameCapture::writeBatch(const Batch& b)
+{
+    Frame frame;
+    const uint64_t* rows = b.rows;
+    for (uint32_t i = 0; i < b.count; ++i)
+    {
+        frame.shown = b.shown[i];
+        frame.hires = b.hires[i];
+        if (frame.hires)
+        {
+            std::memcpy(frame.rows, rows, sizeof(frame.rows));
+            rows += HI_Y_RES * 2;
+        }
+        else
+        {
+            for (int row = 0; row < Y_RES; ++row)
+                frame.rows[row][0] = rows[row];
+            rows += Y_RES;
+        }
+        write(frame);
+    }
+    flushChunks();
+}
+
+/*
+ * IN:  (const Frame&) a frame and how long it was shown
+ * OUT: void
+ */
+void FrameCapture::write(const Frame& frame)
+{
+    if (format == CaptureFormat::Y4M)
+        writeY4M(frame);
+    else
+        writeAPNG(frame);
+}
+
+/*
+ * IN:  (const Frame&) a frame
+ *      (int) a row of the output
+ *      (uint64_t[2]) receives the row, bit 63 of the first word is column 0
+ * OUT: void
+ *      A 64x32 screen captured at 128x64 has every pixel doubled, like the
+ *      window shows it.
+ */
+void FrameCapture::scanline(const Frame& frame, int y, uint64_t row[2]) const
+{
+    if (width == X_RES)
+    {
+        row[0] = frame.rows[y][0];
+        row[1] = 0;
+    }
+    else if (frame.hires)
+    {
+        row[0] = frame.rows[y][0];
+        row[1] = frame.rows[y][1];
+    }
+    else
+    {
+        uint64_t half = frame.rows[y / 2][0];
+        row[0] = doubleWidth(static_cast<uint32_t>(half >> 32));
+        row[1] = doubleWidth(static_cast<uint32_t>(half));
+    }
+}
+
+/*
+ * IN:  (const Frame&) a frame and how long it was shown
+ * OUT: void
+ *      Converts the frame to video range luma once, eight pixels at a time
+ *      out of a table, then writes it as many times as it was shown. The
+ *      chroma planes are all grey.
+ */
+void FrameCapture::writeY4M(const Frame& frame)
+{
+    static const std::vector<uint64_t> spread = []
+    {
+        std::vector<uint64_t> t(256);
+        for (int bits = 0; bits < 256; ++bits)
+        {
+            uint8_t luma[8];
+            for (int i = 0; i < 8; ++i)
+                luma[i] = (bits >> (7 - i) & 1) ? 235 : 16;
+            std::memcpy(&t[bits], luma, 8);
+        }
+        return t;
+    }();
+
+    static const char header[] = "FRAME\n";
+    size_t luma = static_cast<size_t>(width) * height;
+    if (encoded.size() != sizeof(header) - 1 + luma + luma / 2)
+    {
+        encoded.assign(header, header + sizeof(header) - 1);
+        encoded.resize(encoded.size() + luma + luma / 2, 128);
+    }
+
+    uint8_t* out = &encoded[sizeof(header) - 1];
+    for (int y = 0; y < height; ++y)
+    {
+        uint64_t row[2];
+        scanline(frame, y, row);
+        for (int x = 0; x < width; x += 8, out += 8)
+            std::memcpy(out, &spread[static_cast<uint8_t>(row[x >> 6] >> (56 - (x & 63)))], 8);
+    }
+
+    for (uint32_t n = 0; n < frame.shown && !failed; ++n)
+        failed = std::fwrite(encoded.data(), 1, encoded.size(), output) != encoded.size();
+}
+
+/*
+ * IN:  (uint8_t*) where the band's zlib stream goes, zlibSize bytes
+ *      (const uint64_t[][2]) the frame's rows
+ *      (int, int) the band, from the top row to the one after the bottom
+ *      (int) width of the image
+ * OUT: void
+ *      The band's scanlines with filter type 0, in a zlib stream of one
+ *      stored block.
+ */
+static void storeBand(uint8_t* out, const uint64_t lines[][2], int top, int bottom, int width)
+{
+    size_t raw = (width / 8 + 1) * static_cast<size_t>(bottom - top);
+    *out++ = 0x78;
+    *out++ = 0x01;
+    *out++ = 1;                       // Final block, stored
+    *out++ = raw & 0xFF;
+    *out++ = raw >> 8;
+    *out++ = ~raw & 0xFF;
+    *out++ = (~raw >> 8) & 0xFF;
+
+    // At most 64 rows of 17 bytes, Adler-32's sums can't overflow before the end
+    uint32_t a = 1, b = 0;
+    for (int y = top; y < bottom; ++y)
+    {
+        *out++ = 0;
+        b += a;
+        for (int x = 0; x < width; x += 8)
+        {
+            uint8_t bits = static_cast<uint8_t>(lines[y][x >> 6] >> (56 - (x & 63)));
+            *out++ = bits;
+            a += bits;
+            b += a;
+        }
+    }
+    a %= 65521;
+    b %= 65521;
+    storeBE32(out, b << 16 | a);
+}
+
+/*
+ * IN:  (const Frame&) a frame and how long it was shown
+ * OUT: void
+ *      One fcTL and its image data per frame, the first frame's image in
+ *      IDAT so that viewers without APNG show it. After the first frame
+ *      only the band of rows that changed is written, drawn over what was
+ *      there, which is usually a few rows. A frame shown for longer than
+ *      the 16-bit delay allows is written again for the rest. Both chunks
+ *      are built where they will be written from, in `chunks`.
+ */
+void FrameCapture::writeAPNG(const Frame& frame)
+{
+    uint64_t lines[HI_Y_RES][2];
+    int top = height, bottom = 0;
+    for (int y = 0; y < height; ++y)
+    {
+        scanline(frame, y, lines[y]);
+        if (written == 0 || lines[y][0] != canvas[y][0] || lines[y][1] != canvas[y][1])
+        {
+            top = std::min(top, y);
+            bottom = y + 1;
+        }
+    }
+    if (top == height)
+    {
+        // Different to the machine, the same once captured
+        top = 0;
+        bottom = 1;
+    }
+    std::memcpy(canvas, lines, sizeof(lines[0]) * height);
+
+    size_t zlibSize = 7 + (width / 8 + 1) * static_cast<size_t>(bottom - top) + 4;
+    for (uint32_t left = frame.shown; left > 0; )
+    {
+        uint16_t delay = static_cast<uint16_t>(left > 0xFFFF ? 0xFFFF : left);
+        left -= delay;
+
+        uint8_t* control = startChunk("fcTL", 26);
+        storeBE32(control, sequence++);
+        storeBE32(control + 4, width);
+        storeBE32(control + 8, bottom - top);
+        storeBE32(control + 12, 0);   // x offset
+        storeBE32(control + 16, top); // y offset
+        storeBE16(control + 20, delay);
+        storeBE16(control + 22, FRAME_RATE);
+        control[24] = 0;              // Leave it when done
+        control[25] = 0;              // Replace what was there
+        endChunk(26);
+
+        if (written == 0)
+        {
+            storeBand(startChunk("IDAT", zlibSize), lines, top, bottom, width);
+            endChunk(zlibSize);
+        }
+        else
+        {
+            uint8_t* data = startChunk("fdAT", 4 + zlibSize);
+            storeBE32(data, sequence++);
+            storeBand(data + 4, lines, top, bottom, width);
+            endChunk(4 + zlibSize);
+        }
+        ++written;
+    }
+}
+
+/*
+ * IN:  (const char*) the four letter chunk type
+ *      (const uint8_t*) its data
+ *      (size_t) bytes of data
+ * OUT: void
+ *      Appends the chunk to `chunks`; flushChunks writes them out in one
+ *      go.
+ */
+void FrameCapture::writeChunk(const char* type, const uint8_t* data, size_t size)
+{
+    uint8_t* out = startChunk(type, size);
+    if (size > 0)
+        std::memcpy(out, data, size);
+    endChunk(size);
+}
+
+/*
+ * IN:  (const char*) the four letter chunk type
+ *      (size_t) bytes of data it will have
+ * OUT: (uint8_t*) where to put the data, until `chunks` next grows
+ *      Appends the chunk's length and type and room for the rest; fill
+ *      the data in, then call endChunk.
+ */
+uint8_t* FrameCapture::startChunk(const char* type, size_t size)
+{
+    size_t at = chunks.size();
+    chunks.resize(at + 8 + size + 4);
+    storeBE32(&chunks[at], static_cast<uint32_t>(size));
+    std::memcpy(&chunks[at + 4], type, 4);
+    return &chunks[at + 8];
+}
+
+/*
+ * IN:  (size_t) bytes of data in the last chunk
+ * OUT: void
+ *      Fills in the CRC of the last chunk's type and data.
+ */
+void FrameCapture::endChunk(size_t size)
+{
+    uint8_t* end = &chunks[chunks.size() - 4];
+    storeBE32(end, ~crc32(end - size - 4, size + 4, 0xFFFFFFFFu));
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ */
+void FrameCapture::flushChunks()
+{
+    failed |= !chunks.empty() && std::fwrite(chunks.data(), 1, chunks.size(), output) != chunks.size();
+    chunks.clear();
+}
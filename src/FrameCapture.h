@@ -0,0 +1,139 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * FrameCapture.h contains the class definition for FrameCapture, which
+ * records what a machine's screen showed, one picture per emulated
+ * frame, without a window. It writes either of:
+ *
+ *  - Y4M, uncompressed video at 60 fps that ffmpeg and most players read
+ *    directly. It can go to a file, to standard output ("-") or to a
+ *    command's standard input ("|ffmpeg -i - out.mp4") where there is
+ *    popen.
+ *  - APNG, an animated PNG any browser plays, one 1-bit image of the
+ *    rows that changed per distinct frame. It has to go to a file, since
+ *    the frame count at its start is only known at the end.
+ *
+ * The screen is captured at 64x32, or at 128x64 for SUPER-CHIP, where a
+ * 64x32 screen is doubled.
+ *
+ * The thread running the machine only compares the screen with the one
+ * it saw last frame. A frame that is the same is counted as a repeat of
+ * the one before. A different one is copied into a batch, 32 words for a
+ * 64x32 screen, and counts its own repeats there. Only a full batch of
+ * BATCH_FRAMES distinct frames is handed over through an SpscQueue, and
+ * empty batches come back the same way, so the machine's thread touches
+ * an atomic once per batch rather than once per frame. A thread of the
+ * capture's own encodes each batch and writes it through a large stdio
+ * buffer with one fwrite. Repeats cost nothing to encode: APNG stretches
+ * the frame's delay and Y4M writes the frame it already converted again.
+ */
+
+#ifndef CHIP8_FRAMECAPTURE_H_
+#define CHIP8_FRAMECAPTURE_H_
+
+#include "Chip8.h"
+#include "SpscQueue.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class CaptureFormat
+{
+    Y4M,                              // Raw 4:2:0 video
+    APNG                              // Animated PNG
+};
+
+bool captureFormatFromName(const std::string&, CaptureFormat&); // "y4m" or "apng"
+
+class FrameCapture
+{
+    public:
+        static const uint32_t BATCH_FRAMES = 32;      // Distinct frames handed to the writer thread at a time
+        static const uint32_t BATCHES      = 16;      // Batches between the threads, the most it can fall behind
+        static const int      POLL_MS      = 2;       // How long the writer thread sleeps when there is nothing to write
+        static const size_t   BUFFER_SIZE  = 1 << 20; // stdio buffer behind the output
+
+        FrameCapture();
+        ~FrameCapture();                  // Closes the capture if it is open
+
+        bool open(const std::string&, CaptureFormat, Platform); // Start writing, false if the output can't be opened
+        void add(const Chip8&);           // One emulated frame of the machine's screen
+        bool close();                     // Finish the output, false if anything failed to write
+        bool isOpen() const { return output != nullptr; }
+        uint64_t frames() const { return added; }      // Frames added
+        uint64_t distinct() const { return changes; }  // Frames that differed from the one before
+    private:
+        FrameCapture(const FrameCapture&); // Not copyable
+        FrameCapture& operator=(const FrameCapture&);
+
+        /* A screen, as the machine had it, that was shown for `shown` frames in a row */
+        struct Frame
+        {
+            uint64_t rows[HI_Y_RES][2];   // 128x64 if hires, else 64x32 in the rows' first words
+            uint32_t shown;
+            bool     hires;
+        };
+
+        /* Distinct frames in the order they were shown, each only as many words as its screen has */
+        struct Batch
+        {
+            uint32_t count;
+            uint32_t words;               // Of rows in use
+            uint32_t shown[BATCH_FRAMES];
+            bool     hires[BATCH_FRAMES];
+            uint64_t rows[BATCH_FRAMES * HI_Y_RES * 2]; // Y_RES words for a 64x32 frame, HI_Y_RES * 2 for 128x64
+        };
+
+        void writer();                    // The writer thread
+        void writeBatch(const Batch&);    // Encode and write a batch, on the writer thread
+        void write(const Frame&);         // Encode one frame, on the writer thread
+        void writeY4M(const Frame&);
+        void writeAPNG(const Frame&);
+        void writeChunk(const char*, const uint8_t*, size_t); // Queue a PNG chunk with its length and CRC
+        uint8_t* startChunk(const char*, size_t); // Queue a PNG chunk's header, return where its data goes
+        void endChunk(size_t);            // Add the CRC of the chunk just queued
+        void flushChunks();               // Write the queued chunks
+        bool unchanged(const Chip8&, bool) const; // The machine's screen is still the batch's last frame
+        void submit();                    // Hand the batch being filled to the writer thread
+        void scanline(const Frame&, int, uint64_t[2]) const; // One row of the output, doubled if it has to be
+
+        CaptureFormat format;
+        int           width;              // 64 or 128
+        int           height;             // 32 or 64
+        FILE*         output;             // Null while closed
+        bool          piped;              // output came from popen
+        std::vector<char> buffer;         // BUFFER_SIZE bytes for setvbuf
+        /* MACHINE'S THREAD */
+        Batch*        filling;            // Its last frame is the one being shown, null before the first
+        uint64_t      added;
+        uint64_t      changes;
+        /* BETWEEN THE THREADS */
+        std::vector<Batch> batches;       // BATCHES of them, each either free, filling, queued or being written
+        SpscQueue<Batch*, BATCHES> queue; // Full batches for the writer thread
+        SpscQueue<Batch*, BATCHES> spare; // Written batches for the machine's thread
+        std::atomic<bool> closing;        // Nothing more will be queued
+        std::mutex    sleeping;           // Only for waiting on wake
+        std::condition_variable wake;     // No batch is spare, or closing was set
+        std::thread   thread;
+        /* WRITER THREAD */
+        std::vector<uint8_t> encoded;     // Y4M: the last frame converted
+        std::vector<uint8_t> chunks;      // APNG: chunks not written yet
+        uint64_t      canvas[HI_Y_RES][2]; // APNG: what a viewer shows after the frames so far
+        uint32_t      sequence;           // APNG: next fcTL/fdAT sequence number
+        uint32_t      written;            // APNG: frames written
+        long          actlOffset;         // APNG: where the frame count is, patched on close
+        bool          failed;             // A write failed
+};
+
+#endif
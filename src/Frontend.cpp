@@ -0,0 +1,613 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Frontend.cpp contains the implementation of the SDL2 front end. It is
+ * the only part of the program that talks to SDL: it opens the window,
+ * runs the Chip8 core a frame's worth of instructions at a time on the
+ * emulation thread, draws the frames it publishes and feeds keyboard
+ * state back into it.
+ */
+
+#include "Frontend.h"
+#include "error.h"
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+
+/*
+ * Constructor
+ *
+ * IN: (Chip8&) a core that already has a ROM loaded
+ *     (bool) lock presentation to the display's vertical refresh
+ *     (InputRecorder*) records the session, or nullptr
+ *     (uint16_t) samples per audio callback, 0 to play without sound
+ *     Boots up the display and the sound.
+ */
+Frontend::Frontend(Chip8& c, bool vsync, InputRecorder* recorder, uint16_t audioSamples) : chip8(c), recorder(recorder), vsync(vsync), quit(false), finished(false), fastForward(false),
+                                                                                          rewinding(false), latency(), dropped(0), turboSpeed(0), sinceShown(0), frameCost(0), shared(nullptr),
+                                                                                          keyboardKeys(0), framesPublished(0), framesRun(0),
+                                                                                          instructionsRun(0), renderCost(0), exposed(true), titled(false), shown(), titleFrames(0),
+                                                                                          titleInstructions(0), window(nullptr), renderer(nullptr), texture(nullptr)
+{
+    initVideo();
+    if (audioSamples > 0)
+        audio.open(audioSamples);
+}
+
+/*
+ * Destructor, duh
+ *
+ *     Cleans up SDL and shuts down the sound and graphic systems.
+ */
+Frontend::~Frontend()
+{
+    audio.close();
+    if (texture)
+        SDL_DestroyTexture(texture);
+    if (renderer)
+        SDL_DestroyRenderer(renderer);
+    if (window)
+        SDL_DestroyWindow(window);
+
+    SDL_Quit();
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      Attempts to open a window, attach a renderer onto it and create
+ *      the texture the screen is drawn into using SDL. If any of these
+ *      operations fail, the Chip8 will display its own error alongside
+ *      SDL's provided error message.
+ */
+void Frontend::initVideo()
+{
+    // set up SDL
+    if (SDL_Init(SDL_INIT_VIDEO) < 0)
+        abortChip8(std::string("SDL2 failed to initialize. . . ") + SDL_GetError());
+
+    // set up window
+    std::string winTitle = PROG_NAME + std::string(" ") + chip8.romName();
+    window = SDL_CreateWindow(winTitle.c_str(), SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, (X_RES * SCALE), (Y_RES * SCALE), SDL_WINDOW_SHOWN);
+    if (!window)
+        abortChip8(std::string("SDL2 failed to create window. . . ") + SDL_GetError());
+
+    //set up renderer
+    uint32_t flags = SDL_RENDERER_ACCELERATED;
+    if (vsync)
+        flags |= SDL_RENDERER_PRESENTVSYNC;
+    renderer = SDL_CreateRenderer(window, -1, flags);
+    if (!renderer)
+        abortChip8(std::string("SDL2 failed to create renderer. . . ") + SDL_GetError());
+
+    // set up the screen texture, SDL_RenderCopy does the scaling
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, HI_X_RES, HI_Y_RES);
+    if (!texture)
+        abortChip8(std::string("SDL2 failed to create texture. . . ") + SDL_GetError());
+}
+
+/*
+ * IN:  (bool) start out fast-forwarding
+ *      (uint32_t) times faster than real time to fast-forward, 0 for as
+ *      fast as the machine will go
+ * OUT: void
+ *      Only before play(), the emulation thread owns these once it runs.
+ */
+void Frontend::setFastForward(bool on, uint32_t speed)
+{
+    turboSpeed = speed;
+    fastForward.store(on, std::memory_order_relaxed);
+    scheduler.setSpeed(on ? speed : 1);
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      The main life-cycle loop, on the SDL thread. It starts the
+ *      emulation thread and then only shows frames and reads input until
+ *      the window is closed or the machine stops. Whenever a new frame
+ *      has been published it uploads the rows that changed and presents
+ *      once. With vsync on, presenting blocks until the next refresh, so
+ *      every pass presents and the display does the waiting; otherwise
+ *      it sleeps until there is an event. The emulation thread sends one
+ *      whenever it publishes a frame or stops, so a machine that isn't
+ *      drawing (waiting for a key, say) doesn't wake it at all.
+ */
+void Frontend::play()
+{
+    Frame first;
+    capture(first);
+    showFrame(first, HI_ALL_ROWS);
+
+    std::thread emulation(&Frontend::emulate, this);
+    while (!quit.load(std::memory_order_relaxed) && !finished.load(std::memory_order_acquire))
+    {
+        bool fresh = frames.update();
+        if (fresh || exposed || vsync)
+        {
+            Scheduler::Clock::time_point start = Scheduler::Clock::now();
+            if (fresh)
+                showFrame(frames.readSlot());
+            present();
+
+            // A running average, so one slow present doesn't swing N about
+            uint64_t took = std::chrono::duration_cast<std::chrono::nanoseconds>(Scheduler::Clock::now() - start).count();
+            uint64_t average = renderCost.load(std::memory_order_relaxed);
+            renderCost.store(average ? (average * 7 + took) / 8 : took, std::memory_order_relaxed);
+        }
+
+        updateTitle();
+        interact();
+        if (!vsync)
+            SDL_WaitEventTimeout(nullptr, WAKE_TIMEOUT_MS);
+    }
+    quit.store(true, std::memory_order_relaxed);
+    emulation.join();
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      The emulation thread. Before each batch of frames it applies the
+ *      inputs the SDL thread queued, then asks the scheduler how many
+ *      frames are due and runs them (each is the configured number of
+ *      instructions plus a timer tick). If the screen changed it
+ *      publishes the framebuffer once, then sleeps until the next frame.
+ *      While fast-forwarding it only publishes once every framesPerShow()
+ *      frames, and with no speed limit it never sleeps.
+ *
+ *      Frames where the machine is only waiting (see Chip8::step) cost a
+ *      few instructions, so the thread spends nearly all its time asleep.
+ *
+ *      Each frame that runs is saved into the rewind history and its
+ *      sound timer is published to the audio callback. While rewinding,
+ *      each frame that is due steps back through the history instead of
+ *      running the machine, with no sound.
+ */
+void Frontend::emulate()
+{
+    chip8.saveState(snapshot);
+    history.push(snapshot);
+    scheduler.reset();
+    publish();
+
+    bool drawn = false;
+    while (!quit.load(std::memory_order_relaxed) && chip8.isRunning())
+    {
+        Input input;
+        while (inputs.pop(input))
+            drawn = apply(input) || drawn;
+
+        uint32_t due = scheduler.framesDue();
+        uint64_t cycles = 0;
+        Scheduler::Clock::time_point start = Scheduler::Clock::now();
+        for (uint32_t f = 0; f < due; ++f)
+        {
+            if (rewinding)
+            {
+                if (history.back(snapshot))
+                    drawn = chip8.loadState(snapshot) || drawn;
+                audio.silence();
+                publish();
+                continue;
+            }
+
+            mergeKeys();
+            StepResult frame = chip8.runFrames(1);
+            drawn = frame.drawn || drawn;
+            cycles += frame.cycles;
+            audio.publish(chip8.state().soundTimer);
+            if (recorder)
+                recorder->endFrame(chip8.state());
+            chip8.saveState(snapshot);
+            history.push(snapshot);
+            publish();
+        }
+
+        framesRun.store(framesRun.load(std::memory_order_relaxed) + due, std::memory_order_relaxed);
+        instructionsRun.store(instructionsRun.load(std::memory_order_relaxed) + cycles, std::memory_order_relaxed);
+        sinceShown += due;
+        if (due > 0 && fastForward.load(std::memory_order_relaxed))
+        {
+            double took = std::chrono::duration<double, std::nano>(Scheduler::Clock::now() - start).count() / due;
+            frameCost = frameCost > 0 ? (frameCost * 7 + took) / 8 : took;
+        }
+
+        if (drawn && sinceShown >= framesPerShow())
+        {
+            chip8.takeDirtyRows();
+            capture(frames.writeSlot());
+            frames.publish();
+            wake();
+            drawn = false;
+            sinceShown = 0;
+        }
+        scheduler.waitForNextFrame();
+    }
+
+    audio.silence();
+    publish();
+    dropped = scheduler.droppedFrames();
+    finished.store(true, std::memory_order_release);
+    wake();
+}
+
+/*
+ * IN:  void
+ * OUT: (uint32_t) frames to run for each one published
+ *      At normal speed every frame is worth showing. Fast-forwarding, a
+ *      frame is shown about as often as the SDL thread can show one, so
+ *      it is never left with a queue of frames it can't keep up with and
+ *      the emulation thread never spends longer publishing than running.
+ */
+uint32_t Frontend::framesPerShow() const
+{
+    if (!fastForward.load(std::memory_order_relaxed) || frameCost <= 0)
+        return 1;
+
+    double n = renderCost.load(std::memory_order_relaxed) / frameCost;
+    return n < 1 ? 1 : (n > MAX_SKIP ? MAX_SKIP : static_cast<uint32_t>(n));
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      Wakes the SDL thread up if it is waiting for an event. Safe to
+ *      call from any thread.
+ */
+void Frontend::wake()
+{
+    SDL_Event event = {};
+    event.type = SDL_USEREVENT;
+    SDL_PushEvent(&event);
+}
+
+/*
+ * IN:  (const Input&) something the user did
+ * OUT: (bool) true if the machine was replaced and has to be shown
+ *      Also counts how long the input waited to be applied.
+ */
+bool Frontend::apply(const Input& input)
+{
+    Scheduler::Clock::duration waited = Scheduler::Clock::now() - input.time;
+    switch (input.kind)
+    {
+        case Input::Key:
+            ++latency.events;
+            latency.total += waited;
+            latency.worst = std::max(latency.worst, waited);
+            if (input.down)
+                keyboardKeys |= static_cast<uint16_t>(1 << input.key);
+            else
+                keyboardKeys &= static_cast<uint16_t>(~(1 << input.key));
+            mergeKeys();
+            return false;
+        case Input::Rewind:
+            rewinding = input.down;
+            return false;
+        case Input::FastForward:
+            {
+                bool on = !fastForward.load(std::memory_order_relaxed);
+                fastForward.store(on, std::memory_order_relaxed);
+                scheduler.setSpeed(on ? turboSpeed : 1);
+                frameCost = 0;
+                return true;
+            }
+        case Input::Save:
+        case Input::Load:
+            return hotkey(input.kind);
+    }
+    return false;
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      A key is down if it is held on the keyboard or by anyone attached
+ *      to shared. Only keys that differ from the machine's are pressed or
+ *      released, so the recorder sees each change once, and a savestate
+ *      or rewind that put other keys into the machine is corrected on the
+ *      next frame. Runs on the emulation thread.
+ */
+void Frontend::mergeKeys()
+{
+    uint16_t held = keyboardKeys | (shared ? shared->heldKeys() : 0);
+    const uint8_t* machine = chip8.state().key;
+    for (int k = 0; k < 16; ++k)
+    {
+        bool down = (held >> k & 1) != 0;
+        if ((machine[k] != 0) == down)
+            continue;
+        chip8.setKey(k, down);
+        if (recorder)
+            recorder->setKey(k, down);
+    }
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      Runs on the emulation thread.
+ */
+void Frontend::publish()
+{
+    if (shared)
+        shared->publish(chip8, framesPublished++);
+}
+
+/*
+ * IN:  (Frame&) filled in with the screen that is showing
+ * OUT: void
+ *      The 128x64 screen is copied as it is. Each row of the 64x32 one
+ *      becomes two rows with every pixel doubled. Runs on the emulation
+ *      thread.
+ */
+void Frontend::capture(Frame& frame) const
+{
+    if (chip8.hiresMode())
+    {
+        const uint64_t* rows = chip8.hiresFramebuffer();
+        std::copy(rows, rows + 2 * HI_Y_RES, frame.rows[0]);
+        return;
+    }
+
+    const uint64_t* pixels = chip8.framebuffer();
+    for (int row = 0; row < Y_RES; ++row)
+    {
+        uint64_t* top = frame.rows[2 * row];
+        top[0] = doubleWidth(static_cast<uint32_t>(pixels[row] >> 32));
+        top[1] = doubleWidth(static_cast<uint32_t>(pixels[row]));
+        frame.rows[2 * row + 1][0] = top[0];
+        frame.rows[2 * row + 1][1] = top[1];
+    }
+}
+
+/*
+ * IN:  (const Frame&) a frame from the emulation thread
+ *      (uint64_t) rows to upload even if they look unchanged
+ * OUT: void
+ *      Copies the rows of the frame that differ from what the texture
+ *      holds into it, expanding each bit into a white or black pixel.
+ *      Each run of adjacent changed rows is locked and written as one
+ *      rectangle.
+ */
+void Frontend::showFrame(const Frame& frame, uint64_t force)
+{
+    uint64_t dirty = force;
+    for (int row = 0; row < HI_Y_RES; ++row)
+        if (frame.rows[row][0] != shown[row][0] || frame.rows[row][1] != shown[row][1])
+            dirty |= 1ULL << row;
+
+    int y = 0;
+    while (dirty != 0 && y < HI_Y_RES)
+    {
+        if ((dirty & (1ULL << y)) == 0)
+        {
+            ++y;
+            continue;
+        }
+
+        int first = y;
+        while (y < HI_Y_RES && (dirty & (1ULL << y)) != 0)
+            dirty &= ~(1ULL << y++);
+
+        SDL_Rect rect = { 0, first, HI_X_RES, y - first };
+        void* dest;
+        int pitch;
+        if (SDL_LockTexture(texture, &rect, &dest, &pitch) != 0)
+        {
+            printChip8Error(std::string("SDL2 failed to lock texture. . . ") + SDL_GetError());
+            return;
+        }
+        for (int row = first; row < y; ++row)
+        {
+            uint32_t* out = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(dest) + (row - first) * pitch);
+            shown[row][0] = frame.rows[row][0];
+            shown[row][1] = frame.rows[row][1];
+            for (int half = 0; half < 2; ++half)
+            {
+                uint64_t bits = frame.rows[row][half];
+                for (int x = 0; x < 64; ++x, bits <<= 1)
+                    *out++ = (bits >> 63) ? 0xFFFFFFFF : 0xFF000000;
+            }
+        }
+        SDL_UnlockTexture(texture);
+    }
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      While fast-forwarding, puts the speed relative to real time and
+ *      the emulated MIPS over the last TITLE_PERIOD_MS in the window
+ *      title. Puts the plain title back afterwards.
+ */
+void Frontend::updateTitle()
+{
+    std::string title = PROG_NAME + std::string(" ") + chip8.romName();
+    Scheduler::Clock::time_point now = Scheduler::Clock::now();
+
+    if (!fastForward.load(std::memory_order_relaxed))
+    {
+        if (titled)
+            SDL_SetWindowTitle(window, title.c_str());
+        titled = false;
+        return;
+    }
+    if (titled && now - titleSince < std::chrono::milliseconds(TITLE_PERIOD_MS))
+        return;
+
+    uint64_t framesNow = framesRun.load(std::memory_order_relaxed);
+    uint64_t instructionsNow = instructionsRun.load(std::memory_order_relaxed);
+    if (titled)
+    {
+        double seconds = std::chrono::duration<double>(now - titleSince).count();
+        char speed[64];
+        std::snprintf(speed, sizeof(speed), " - %.0fx, %.1f MIPS", (framesNow - titleFrames) / seconds / FRAME_RATE,
+                      (instructionsNow - titleInstructions) / seconds / 1e6);
+        SDL_SetWindowTitle(window, (title + speed).c_str());
+    }
+    titled = true;
+    titleSince = now;
+    titleFrames = framesNow;
+    titleInstructions = instructionsNow;
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      Stretches the texture over the whole window and presents it.
+ */
+void Frontend::present()
+{
+    SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+    SDL_RenderPresent(renderer);
+    exposed = false;
+}
+
+/*
+ * IN:  (SDL_Keycode) a key on the host keyboard
+ * OUT: (int) the Chip8 key it is bound to, or -1 if it is not bound
+ *
+ *      Since the Chip8 originally operated under a hex keypad (left),
+ *      the keybindings are set to be more comfortable bindings on a
+ *      regular QWERTY keyboard. So pressing '4' will send the signal
+ *      to the Chip8 that 'C' was pressed.
+ *
+ *      CHIP8 Keypad          Modern Keyboard
+ *       |1|2|3|C|              |1|2|3|4|
+ *       |4|5|6|D|      ->      |Q|W|E|R|
+ *       |7|8|9|E|              |A|S|D|F|
+ *       |A|0|B|F|              |Z|X|C|V|
+ */
+static int mapKey(SDL_Keycode sym)
+{
+    switch (sym)
+    {
+        case SDLK_1: return 0x1;
+        case SDLK_2: return 0x2;
+        case SDLK_3: return 0x3;
+        case SDLK_4: return 0xC;
+        case SDLK_q: return 0x4;
+        case SDLK_w: return 0x5;
+        case SDLK_e: return 0x6;
+        case SDLK_r: return 0xD;
+        case SDLK_a: return 0x7;
+        case SDLK_s: return 0x8;
+        case SDLK_d: return 0x9;
+        case SDLK_f: return 0xE;
+        case SDLK_z: return 0xA;
+        case SDLK_x: return 0x0;
+        case SDLK_c: return 0xB;
+        case SDLK_v: return 0xF;
+    }
+    return -1;
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      Processes the input queue and tests to see if the user exited
+ *      the window or if a Chip8 key has been pressed or released, and
+ *      passes key changes and hotkeys on to the emulation thread.
+ */
+void Frontend::interact()
+{
+    SDL_Event event;
+
+    while (SDL_PollEvent(&event) != 0)
+    {
+        Input input = { Input::Key, 0, event.type == SDL_KEYDOWN, Scheduler::Clock::now() };
+        switch (event.type)
+        {
+            case SDL_QUIT:
+                quit.store(true, std::memory_order_relaxed);
+                break;
+            case SDL_WINDOWEVENT:
+                if (event.window.event == SDL_WINDOWEVENT_EXPOSED)
+                    exposed = true;
+                break;
+            case SDL_KEYDOWN:
+            case SDL_KEYUP:
+                {
+                    int k = mapKey(event.key.keysym.sym);
+                    if (k >= 0)
+                    {
+                        input.key = static_cast<uint8_t>(k);
+                        send(input);
+                    }
+                    else if (event.key.keysym.sym == SDLK_BACKSPACE && !recorder)
+                    {
+                        input.kind = Input::Rewind;
+                        send(input);
+                    }
+                    else if (event.type == SDL_KEYDOWN && event.key.repeat == 0 && event.key.keysym.sym == SDLK_F5)
+                    {
+                        input.kind = Input::Save;
+                        send(input);
+                    }
+                    else if (event.type == SDL_KEYDOWN && event.key.repeat == 0 && event.key.keysym.sym == SDLK_F9)
+                    {
+                        input.kind = Input::Load;
+                        send(input);
+                    }
+                    else if (event.type == SDL_KEYDOWN && event.key.repeat == 0 && event.key.keysym.sym == SDLK_TAB)
+                    {
+                        input.kind = Input::FastForward;
+                        send(input);
+                    }
+                    break;
+                }
+        }
+    }
+}
+
+/*
+ * IN:  (const Input&) an input for the emulation thread
+ * OUT: void
+ *      The queue only fills up if the emulation thread has stopped
+ *      taking from it for hundreds of key changes, so the input is
+ *      reported and dropped rather than waited on.
+ */
+void Frontend::send(const Input& input)
+{
+    if (!inputs.push(input))
+        printChip8Error("Input queue is full, dropped a key change");
+}
+
+/*
+ * IN:  (Input::Kind) Save or Load, from F5 or F9
+ * OUT: (bool) true if a savestate was loaded and has to be shown
+ *      F5 saves the machine next to the ROM, F9 loads that savestate. A
+ *      loaded savestate becomes the start of a fresh rewind history.
+ *      Runs on the emulation thread.
+ */
+bool Frontend::hotkey(Input::Kind kind)
+{
+    std::string path = chip8.romName() + ".c8s";
+
+    if (kind == Input::Save)
+    {
+        chip8.saveState(snapshot);
+        writeSavestate(path, snapshot);
+    }
+    else if (recorder)
+        printChip8Error("Savestates can't be loaded while recording");
+    else
+    {
+        SavestateFile file;
+        if (file.open(path) && chip8.loadState(*file.get()))
+        {
+            history.clear();
+            history.push(*file.get());
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,162 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Frontend.h contains the class definition for the SDL2 front end. The
+ * front end owns the window, renderer and keyboard; it drives a Chip8
+ * core one frame at a time and shows the result. The screen lives in a
+ * single streaming texture at SUPER-CHIP's 128x64 that is stretched over
+ * the window when it is presented; the 64x32 screen is drawn into it
+ * with every pixel doubled, so switching resolution changes nothing on
+ * the SDL side.
+ *
+ * The machine runs on an emulation thread of its own, so presenting and
+ * pumping events can never make it miss a frame. The thread that called
+ * play() stays the SDL thread. Finished frames come to it through a
+ * TripleBuffer, and key changes and hotkeys go the other way through an
+ * SpscQueue stamped with the time they were read. The emulation thread
+ * owns the Chip8, the recorder and the rewind history; the SDL thread
+ * never touches them while it runs.
+ *
+ * Every frame is also pushed into a Rewind; holding Backspace plays the
+ * game backwards one frame at a time. F5 saves the machine to
+ * "<rom>.c8s" and F9 loads it back. When an InputRecorder is attached,
+ * every key change and frame goes to it, and rewinding and loading are
+ * turned off since they would make the recording impossible to replay.
+ *
+ * The sound timer goes to the Audio once per frame; rewinding is silent.
+ *
+ * Tab toggles fast-forward, which runs the machine a set number of times
+ * faster than real time or as fast as it will go. The timers still tick
+ * once per emulated frame. Only every Nth frame is published, with N
+ * worked out from how long the SDL thread takes to show one frame and
+ * how long the emulation thread takes to run one, so showing frames can
+ * never hold the machine back. The window title shows the speed and
+ * MIPS while it lasts.
+ *
+ * With a SharedState attached, every frame the machine runs (or rewinds
+ * to) is published into it, and the keys other processes hold down in it
+ * are merged with the keyboard's before every frame. The emulation
+ * thread does both; the machine sees a key as down while either holds
+ * it.
+ */
+
+#ifndef CHIP8_FRONTEND_H_
+#define CHIP8_FRONTEND_H_
+
+#include "Audio.h"
+#include "Chip8.h"
+#include "InputLog.h"
+#include "Rewind.h"
+#include "Scheduler.h"
+#include "SharedState.h"
+#include "SpscQueue.h"
+#include "TripleBuffer.h"
+#include <SDL2/SDL.h>
+#include <atomic>
+
+/*
+ * How long key changes took to reach the machine, from the moment the
+ * SDL thread read them to the start of the frame that saw them.
+ */
+struct InputLatency
+{
+    uint64_t                  events;   // Key changes applied
+    Scheduler::Clock::duration total;
+    Scheduler::Clock::duration worst;
+};
+
+class Frontend
+{
+    public:
+        static const int WAKE_TIMEOUT_MS  = 250;  // Longest the SDL thread sleeps without an event
+        static const int TITLE_PERIOD_MS  = 500;  // How often the speed in the title is updated
+        static const uint32_t MAX_SKIP    = 1 << 20; // Most frames run per frame shown
+
+        Frontend(Chip8&, bool vsync = false, InputRecorder* recorder = nullptr, uint16_t audioSamples = Audio::DEFAULT_SAMPLES);
+        ~Frontend();
+
+        void play();                      // The 'run' loop, returns once the window is closed
+        void setFastForward(bool on, uint32_t speed); // Before play(): start fast-forwarding, and Tab's speed (0 for no limit)
+        void setShared(SharedState* s) { shared = s; } // Before play(): publish every frame to s and take keys from it, null for none
+        const InputLatency& inputLatency() const { return latency; }
+        uint64_t droppedFrames() const { return dropped; }
+    private:
+        /* A completed frame, going from the emulation thread to the SDL thread */
+        struct Frame
+        {
+            uint64_t rows[HI_Y_RES][2];   // Always 128x64, bit 63 of a row's first word is column 0
+        };
+
+        /* Something the user did, going from the SDL thread to the emulation thread */
+        struct Input
+        {
+            enum Kind : uint8_t { Key, Rewind, Save, Load, FastForward };
+
+            Kind                         kind;
+            uint8_t                      key;    // Chip8 key for Key
+            bool                         down;   // Pressed, for Key and Rewind
+            Scheduler::Clock::time_point time;   // When the SDL thread read it
+        };
+
+        void initVideo();                 // Set up SDL2 systems
+        void emulate();                   // The emulation thread
+        bool apply(const Input&);         // Act on one input, true if the screen has to be shown again
+        bool hotkey(Input::Kind);         // Save or load a savestate
+        void mergeKeys();                 // Press and release the machine's keys to match the keyboard and shared
+        void publish();                   // The frame that just ran to shared, if there is one
+        void capture(Frame&) const;       // The machine's screen as a Frame
+        void showFrame(const Frame&, uint64_t force = 0); // Copy the rows that changed since the last frame shown into the texture
+        void present();                   // Show the texture
+        void interact();                  // Keyboard state and user input
+        void send(const Input&);          // Queue an input for the emulation thread
+        void wake();                      // Send the SDL thread an event
+        uint32_t framesPerShow() const;   // N, run this many frames for each one published
+        void updateTitle();               // Speed and MIPS while fast-forwarding
+
+        Chip8&        chip8;
+        InputRecorder* recorder;          // Told about every key change and frame, may be null
+        bool          vsync;              // Present in step with the display's refresh
+        std::atomic<bool> quit;           // The user closed the window
+        std::atomic<bool> finished;       // The machine stopped running
+        std::atomic<bool> fastForward;    // Running faster than real time, written by the emulation thread
+        /* EMULATION THREAD */
+        bool          rewinding;          // Backspace is held down
+        Rewind        history;            // The last few minutes, one savestate per frame
+        Savestate     snapshot;           // Scratch savestate going in and out of history
+        InputLatency  latency;
+        uint64_t      dropped;            // Frames the scheduler gave up on
+        Scheduler     scheduler;          // Paces frames, faster while fast-forwarding
+        uint32_t      turboSpeed;         // Speed to fast-forward at, 0 for no limit
+        uint32_t      sinceShown;         // Frames run since one was published
+        double        frameCost;          // Average ns to run one frame while fast-forwarding
+        SharedState*  shared;             // Other processes watching and pressing keys, may be null
+        uint16_t      keyboardKeys;       // Keys held on the keyboard, bit n is key n
+        uint64_t      framesPublished;    // Frames given to shared, the number it is told
+        /* BETWEEN THE THREADS */
+        TripleBuffer<Frame>     frames;
+        SpscQueue<Input, 256>   inputs;
+        std::atomic<uint64_t>   framesRun;       // Emulated frames so far
+        std::atomic<uint64_t>   instructionsRun; // Instructions executed so far
+        std::atomic<uint64_t>   renderCost;      // Average ns to show a frame, 0 until one has been
+        /* SDL THREAD */
+        bool          exposed;            // The window needs repainting even if nothing changed
+        bool          titled;             // The title shows the speed
+        uint64_t      shown[HI_Y_RES][2]; // The rows now in the texture
+        Scheduler::Clock::time_point titleSince; // When the speed in the title was last worked out
+        uint64_t      titleFrames;        // framesRun then
+        uint64_t      titleInstructions;  // instructionsRun then
+        /* GRAPHICS */
+        SDL_Window*   window;             // To display a window
+        SDL_Renderer* renderer;           // To render color and the texture that holds pixels
+        SDL_Texture*  texture;            // HI_X_RES x HI_Y_RES ARGB copy of the framebuffer
+        /* SOUND */
+        Audio         audio;              // The beep, fed the sound timer every frame
+};
+
+#endif
@@ -0,0 +1,496 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * InputLog.cpp contains the reading, writing, recording and replaying of
+ * input logs. See InputLog.h for the file layout.
+ */
+
+#include "InputLog.h"
+#include "Lockstep.h"
+#include "error.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <memory>
+
+namespace
+{
+
+const char INPUT_LOG_MAGIC[4] = { 'C', '8', 'I', 'L' };
+
+/*
+ * Little-endian writer for the fields of an input log.
+ */
+class LogWriter
+{
+    public:
+        void u8(uint8_t v) { bytes.push_back(static_cast<char>(v)); }
+        void u16(uint16_t v) { put(v, 2); }
+        void u32(uint32_t v) { put(v, 4); }
+        void u64(uint64_t v) { put(v, 8); }
+        void leb(uint32_t v)
+        {
+            for (; v >= 0x80; v >>= 7)
+                u8(static_cast<uint8_t>(v | 0x80));
+            u8(static_cast<uint8_t>(v));
+        }
+
+        std::string bytes;
+    private:
+        void put(uint64_t v, int n)
+        {
+            for (int i = 0; i < n; ++i, v >>= 8)
+                u8(static_cast<uint8_t>(v));
+        }
+};
+
+/*
+ * Little-endian reader for the fields of an input log. Reading past the
+ * end gives zeros and clears `good`, so a truncated file is noticed once
+ * at the end instead of after every field.
+ */
+class LogReader
+{
+    public:
+        LogReader(const std::vector<uint8_t>& b) : bytes(b), at(0), good(true) {}
+
+        uint8_t u8()
+        {
+            if (at >= bytes.size())
+            {
+                good = false;
+                return 0;
+            }
+            return bytes[at++];
+        }
+        uint16_t u16() { return static_cast<uint16_t>(get(2)); }
+        uint32_t u32() { return static_cast<uint32_t>(get(4)); }
+        uint64_t u64() { return get(8); }
+        uint32_t leb()
+        {
+            uint32_t v = 0;
+            for (int shift = 0; shift < 35; shift += 7)
+            {
+                uint8_t b = u8();
+                v |= static_cast<uint32_t>(b & 0x7F) << shift;
+                if ((b & 0x80) == 0)
+                    return v;
+            }
+            good = false;
+            return 0;
+        }
+        size_t left() const { return bytes.size() - at; }
+
+        const std::vector<uint8_t>& bytes;
+        size_t at;
+        bool   good;
+    private:
+        uint64_t get(int n)
+        {
+            uint64_t v = 0;
+            for (int i = 0; i < n; ++i)
+                v |= static_cast<uint64_t>(u8()) << (8 * i);
+            return v;
+        }
+};
+
+}
+
+/*
+ * IN:  (const Chip8State&) the machine after a frame
+ *      (uint64_t) the rolling hash before the frame
+ * OUT: (uint64_t) the rolling hash after the frame
+ *      Covers what a player could notice (the screen) and what decides
+ *      what happens next (the registers), not the whole of memory, so a
+ *      hash after every frame stays cheap. The 128x64 screen only counts
+ *      while it is showing, which leaves logs of machines that never show
+ *      it hashing as they always have.
+ */
+uint64_t rollFrameHash(const Chip8State& s, uint64_t rolling)
+{
+    uint64_t h = hashBytes(s.pixels, sizeof(s.pixels), rolling);
+    if (s.hires)
+        h = hashBytes(s.hiPixels, sizeof(s.hiPixels), h);
+    h = hashBytes(s.V, sizeof(s.V), h);
+    h = hashBytes(&s.I, sizeof(s.I), h);
+    h = hashBytes(&s.pc, sizeof(s.pc), h);
+    h = hashBytes(&s.sp, sizeof(s.sp), h);
+    h = hashBytes(&s.delayTimer, sizeof(s.delayTimer), h);
+    return hashBytes(&s.soundTimer, sizeof(s.soundTimer), h);
+}
+
+/*
+ * IN:  (string) any file
+ *      (uint64_t&) set to hashBytes of its contents
+ * OUT: (bool) false if the file can't be read
+ */
+bool hashFile(const std::string& path, uint64_t& hash)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        printChip8Error("Failed to open \"" + path + "\"");
+        return false;
+    }
+
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    hash = hashBytes(bytes.data(), bytes.size());
+    return true;
+}
+
+/*
+ * IN:  (string) input log file
+ *      (InputLog&) filled in from the file
+ * OUT: (bool) false if the file can't be read or isn't an input log
+ */
+bool readInputLog(const std::string& path, InputLog& log)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        printChip8Error("Failed to open \"" + path + "\"");
+        return false;
+    }
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    LogReader r(bytes);
+    char magic[4];
+    for (int i = 0; i < 4; ++i)
+        magic[i] = static_cast<char>(r.u8());
+    if (!r.good || !std::equal(magic, magic + 4, INPUT_LOG_MAGIC))
+    {
+        printChip8Error("\"" + path + "\" is not an input log");
+        return false;
+    }
+    // Logs from before there were platforms have a zero there, the default
+    uint16_t version = r.u16();
+    uint16_t platform = r.u16();
+    if (version != INPUT_LOG_VERSION || platform >= PLATFORM_COUNT)
+    {
+        printChip8Error("\"" + path + "\" was written by a different version of " + PROG_NAME);
+        return false;
+    }
+    log.platform = static_cast<Platform>(platform);
+
+    log.romHash = r.u64();
+    log.seed = r.u64();
+    log.cyclesPerFrame = r.u32();
+    log.frames = r.u32();
+    log.checkpointInterval = r.u32();
+    log.finalHash = r.u64();
+
+    uint16_t length = r.u16();
+    log.rom.clear();
+    for (uint16_t i = 0; i < length && r.good; ++i)
+        log.rom += static_cast<char>(r.u8());
+
+    // Every event takes at least two bytes and every checkpoint eight, so
+    // a bad count can't make us allocate more than the file could hold
+    uint32_t count = r.u32();
+    log.events.clear();
+    log.events.reserve(std::min<size_t>(count, r.left() / 2));
+    uint32_t frame = 0;
+    for (uint32_t i = 0; i < count && r.good; ++i)
+    {
+        InputEvent event;
+        frame += r.leb();
+        uint8_t key = r.u8();
+        event.frame = frame;
+        event.key = key & 0xF;
+        event.down = (key & 0x80) != 0;
+        log.events.push_back(event);
+    }
+
+    count = r.u32();
+    log.checkpoints.clear();
+    log.checkpoints.reserve(std::min<size_t>(count, r.left() / 8));
+    for (uint32_t i = 0; i < count && r.good; ++i)
+        log.checkpoints.push_back(r.u64());
+
+    if (!r.good || log.cyclesPerFrame == 0)
+    {
+        printChip8Error("\"" + path + "\" is truncated or damaged");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * IN:  (string) file to write, replaced if it exists
+ *      (const InputLog&) what to write, events sorted by frame
+ * OUT: (bool) false if the file couldn't be written
+ */
+bool writeInputLog(const std::string& path, const InputLog& log)
+{
+    LogWriter w;
+    for (int i = 0; i < 4; ++i)
+        w.u8(static_cast<uint8_t>(INPUT_LOG_MAGIC[i]));
+    w.u16(INPUT_LOG_VERSION);
+    w.u16(static_cast<uint16_t>(log.platform));
+    w.u64(log.romHash);
+    w.u64(log.seed);
+    w.u32(log.cyclesPerFrame);
+    w.u32(log.frames);
+    w.u32(log.checkpointInterval);
+    w.u64(log.finalHash);
+
+    w.u16(static_cast<uint16_t>(log.rom.size()));
+    w.bytes += log.rom.substr(0, 0xFFFF);
+
+    w.u32(static_cast<uint32_t>(log.events.size()));
+    uint32_t frame = 0;
+    for (size_t i = 0; i < log.events.size(); ++i)
+    {
+        w.leb(log.events[i].frame - frame);
+        w.u8((log.events[i].key & 0xF) | (log.events[i].down ? 0x80 : 0));
+        frame = log.events[i].frame;
+    }
+
+    w.u32(static_cast<uint32_t>(log.checkpoints.size()));
+    for (size_t i = 0; i < log.checkpoints.size(); ++i)
+        w.u64(log.checkpoints[i]);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (out)
+        out.write(w.bytes.data(), w.bytes.size());
+    if (!out)
+    {
+        printChip8Error("Failed to write input log \"" + path + "\"");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * IN:  (const InputLog&) a recording
+ * OUT: (bool) true if its ROM is still there and unchanged
+ */
+static bool romMatches(const InputLog& log)
+{
+    uint64_t romHash;
+    if (!hashFile(log.rom, romHash))
+        return false;
+    if (romHash != log.romHash)
+    {
+        printChip8Error("\"" + log.rom + "\" is not the ROM the input log was recorded with");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * IN:  (const InputLog&) a recording
+ *      (uint32_t) frames replayed so far
+ *      (uint64_t) the replay's rolling hash after them
+ * OUT: (uint64_t) what the log says the rolling hash should be, or the
+ *      replay's own when the log has no checkpoint for that frame
+ */
+static uint64_t expectedHash(const InputLog& log, uint32_t frames, uint64_t rolling)
+{
+    uint32_t n = log.checkpointInterval ? frames / log.checkpointInterval : 0;
+    if (frames == log.frames)
+        return log.finalHash;
+    if (n > 0 && n <= log.checkpoints.size() && frames % log.checkpointInterval == 0)
+        return log.checkpoints[n - 1];
+    return rolling;
+}
+
+/*
+ * IN:  (const InputLog&) a recording
+ *      (Engine) how to run it, any engine must give the same hashes
+ *      (ReplayResult&) how it went
+ *      (Profiler*) watches the replay, may be null
+ * OUT: (bool) false if the replay couldn't start because the ROM is
+ *      missing or isn't the one the log was recorded with
+ *      Runs a fresh machine through the log and stops at the first
+ *      checkpoint that doesn't match.
+ */
+bool replayInputLog(const InputLog& log, Engine engine, ReplayResult& result, Profiler* profiler)
+{
+    result = ReplayResult();
+    result.ok = true;
+    if (!romMatches(log))
+        return false;
+
+    Chip8 chip8;
+    chip8.setEngine(engine);
+    chip8.setCyclesPerFrame(log.cyclesPerFrame);
+    chip8.seed(log.seed);
+    chip8.setProfiler(profiler);
+    if (!chip8.loadROM(log.rom))
+        return false;
+    chip8.setPlatform(log.platform);
+
+    uint64_t rolling = hashBytes(nullptr, 0);
+    size_t next = 0;
+    while (result.frames < log.frames)
+    {
+        for (; next < log.events.size() && log.events[next].frame <= result.frames; ++next)
+            chip8.setKey(log.events[next].key, log.events[next].down);
+
+        result.instructions += chip8.runFrames(1).cycles;
+        rolling = rollFrameHash(chip8.state(), rolling);
+        ++result.frames;
+
+        uint64_t expected = expectedHash(log, result.frames, rolling);
+        if (expected != rolling)
+        {
+            result.ok = false;
+            result.badFrame = result.frames;
+            result.expected = expected;
+            result.actual = rolling;
+            break;
+        }
+    }
+    return true;
+}
+
+/*
+ * IN:  (const InputLog&) a recording of a chip8 program
+ *      (size_t) lanes to run it on
+ *      (ReplayResult&) how it went
+ * OUT: (bool) false if the replay couldn't start: the ROM is missing,
+ *      changed or not one lanes can run
+ *      Runs the log on a Lockstep and checks it against the interpreter.
+ *      Lane 0 replays the log itself and is held to its checkpoints.
+ *      Lane n gets the log's keys n % 8 frames late and the seed plus
+ *      n / 8, so the lanes split up and meet again, and every lane is
+ *      compared with a Chip8 fed the same on the interpreter once per
+ *      checkpoint interval and after the last frame. When a lane
+ *      differs, badFrame is the frame it was caught on and expected
+ *      and actual are hashState of the Chip8 and of the lane.
+ */
+bool replayLockstep(const InputLog& log, size_t lanes, ReplayResult& result)
+{
+    result = ReplayResult();
+    result.ok = true;
+    if (lanes == 0 || !romMatches(log))
+        return false;
+
+    Lockstep lockstep(lanes);
+    lockstep.setCyclesPerFrame(log.cyclesPerFrame);
+    if (!lockstep.loadROM(log.rom))
+        return false;
+
+    std::vector<std::unique_ptr<Chip8> > reference(lanes);
+    for (size_t lane = 0; lane < lanes; ++lane)
+    {
+        lockstep.seed(lane, log.seed + lane / 8);
+        reference[lane].reset(new Chip8());
+        reference[lane]->setEngine(Engine::Interpreter);
+        reference[lane]->setCyclesPerFrame(log.cyclesPerFrame);
+        reference[lane]->seed(log.seed + lane / 8);
+        if (!reference[lane]->loadROM(log.rom))
+            return false;
+    }
+
+    Chip8State s;
+    uint64_t rolling = hashBytes(nullptr, 0);
+    std::vector<size_t> next(lanes, 0);
+    while (result.frames < log.frames)
+    {
+        for (size_t lane = 0; lane < lanes; ++lane)
+        {
+            uint32_t late = lane % 8;
+            for (; next[lane] < log.events.size() && log.events[next[lane]].frame + late <= result.frames; ++next[lane])
+            {
+                const InputEvent& e = log.events[next[lane]];
+                lockstep.setKey(lane, e.key, e.down);
+                reference[lane]->setKey(e.key, e.down);
+            }
+        }
+
+        result.instructions += lockstep.runFrames(1);
+        for (size_t lane = 0; lane < lanes; ++lane)
+            reference[lane]->runFrames(1);
+        lockstep.getState(0, s);
+        rolling = rollFrameHash(s, rolling);
+        ++result.frames;
+
+        uint64_t expected = expectedHash(log, result.frames, rolling);
+        if (expected != rolling)
+        {
+            result.ok = false;
+            result.badFrame = result.frames;
+            result.expected = expected;
+            result.actual = rolling;
+            break;
+        }
+
+        if (result.frames != log.frames && (log.checkpointInterval == 0 || result.frames % log.checkpointInterval != 0))
+            continue;
+        for (size_t lane = 0; lane < lanes && result.ok; ++lane)
+        {
+            uint64_t want = hashState(reference[lane]->state());
+            uint64_t got = lockstep.hash(lane);
+            if (want != got)
+            {
+                result.ok = false;
+                result.badFrame = result.frames;
+                result.badLane = static_cast<uint32_t>(lane);
+                result.expected = want;
+                result.actual = got;
+            }
+        }
+        if (!result.ok)
+            break;
+    }
+    return true;
+}
+
+/*
+ * Constructor
+ *
+ * IN: (const Chip8&) a machine with its ROM loaded that hasn't run yet
+ *     (uint64_t) the seed it was given
+ *     (uint32_t) frames between checkpoints
+ */
+InputRecorder::InputRecorder(const Chip8& chip8, uint64_t seed, uint32_t interval) : recording(), rolling(hashBytes(nullptr, 0)), keys(0)
+{
+    recording.rom = chip8.romName();
+    recording.romHash = 0;
+    hashFile(recording.rom, recording.romHash);
+    recording.seed = seed;
+    recording.platform = chip8.getPlatform();
+    recording.cyclesPerFrame = chip8.getCyclesPerFrame();
+    recording.frames = 0;
+    recording.checkpointInterval = interval;
+    recording.finalHash = rolling;
+}
+
+/*
+ * IN:  (int) Chip8 key, 0x0 - 0xF
+ *      (bool) true if it went down
+ * OUT: void
+ *      Keys that are already in that state (keyboard auto-repeat) are not
+ *      recorded.
+ */
+void InputRecorder::setKey(int k, bool down)
+{
+    uint16_t bit = static_cast<uint16_t>(1 << (k & 0xF));
+    if (((keys & bit) != 0) == down)
+        return;
+    keys ^= bit;
+
+    InputEvent event = { recording.frames, static_cast<uint8_t>(k & 0xF), down };
+    recording.events.push_back(event);
+}
+
+/*
+ * IN:  (const Chip8State&) the machine after the frame
+ * OUT: void
+ */
+void InputRecorder::endFrame(const Chip8State& s)
+{
+    rolling = rollFrameHash(s, rolling);
+    ++recording.frames;
+    recording.finalHash = rolling;
+    if (recording.checkpointInterval > 0 && recording.frames % recording.checkpointInterval == 0)
+        recording.checkpoints.push_back(rolling);
+}
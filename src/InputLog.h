@@ -0,0 +1,106 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * InputLog.h contains the input log format, the InputRecorder that writes
+ * one while a game is played, and replayInputLog that plays one back
+ * headlessly. replayLockstep plays one on the lanes of a Lockstep, which
+ * is how `make check` keeps the lanes honest.
+ *
+ * Given the ROM, the RND seed and the instructions per frame, a Chip8 is
+ * completely determined by which keys change on which frames, so that is
+ * all a log stores. To notice when a replay stops matching the recording,
+ * a rolling hash of the screen and registers is folded in after every
+ * frame and written down every CHECKPOINT_INTERVAL frames.
+ *
+ * The file is little-endian regardless of the host:
+ *
+ *     "C8IL", u16 version, u16 platform, u64 ROM hash, u64 seed,
+ *     u32 instructions per frame, u32 frames, u32 checkpoint interval,
+ *     u64 final hash, u16 length + ROM path,
+ *     u32 count + events (LEB128 frames since the previous event, then
+ *                         the key in the low nibble and 0x80 if down),
+ *     u32 count + u64 checkpoints
+ */
+
+#ifndef CHIP8_INPUTLOG_H_
+#define CHIP8_INPUTLOG_H_
+
+#include "Chip8.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+static const uint16_t INPUT_LOG_VERSION   = 1;
+static const uint32_t CHECKPOINT_INTERVAL = 60; // Frames between checkpoints, one a second
+
+/*
+ * A key going down or up on the keypad.
+ */
+struct InputEvent
+{
+    uint32_t frame;                   // Applied before this frame runs
+    uint8_t  key;                     // 0x0 - 0xF
+    bool     down;
+};
+
+struct InputLog
+{
+    std::string rom;                  // Path of the ROM, as it was loaded
+    uint64_t    romHash;              // hashBytes of the ROM file
+    uint64_t    seed;                 // RND seed
+    Platform    platform;             // Whose quirks the machine followed
+    uint32_t    cyclesPerFrame;
+    uint32_t    frames;               // Frames recorded
+    uint32_t    checkpointInterval;
+    uint64_t    finalHash;            // Rolling hash after the last frame
+    std::vector<InputEvent> events;   // Sorted by frame
+    std::vector<uint64_t> checkpoints; // Rolling hash after frame (n + 1) * checkpointInterval
+};
+
+/*
+ * How a replay went.
+ */
+struct ReplayResult
+{
+    bool     ok;                      // Every checkpoint and the final hash matched
+    uint32_t frames;                  // Frames replayed before stopping
+    uint64_t instructions;
+    uint32_t badFrame;                // When !ok, the frame whose hash didn't match
+    uint32_t badLane;                 // When !ok after replayLockstep, the lane that didn't
+    uint64_t expected;                // When !ok, the hash the log has for badFrame
+    uint64_t actual;                  // When !ok, the hash the replay got
+};
+
+uint64_t rollFrameHash(const Chip8State&, uint64_t); // Fold the screen and registers into a rolling hash
+bool hashFile(const std::string&, uint64_t&);        // hashBytes of a whole file
+bool readInputLog(const std::string&, InputLog&);
+bool writeInputLog(const std::string&, const InputLog&);
+bool replayInputLog(const InputLog&, Engine, ReplayResult&, Profiler* = nullptr); // False if the ROM is missing or changed
+bool replayLockstep(const InputLog&, size_t, ReplayResult&); // The same on lanes, each checked against its own Chip8
+
+/*
+ * Builds an InputLog while something else drives the machine. Tell it
+ * about every key change as it happens and about every frame after it
+ * has run.
+ */
+class InputRecorder
+{
+    public:
+        InputRecorder(const Chip8&, uint64_t, uint32_t = CHECKPOINT_INTERVAL); // A machine that hasn't run yet, its seed
+
+        void setKey(int, bool);           // A key changed, before the next frame
+        void endFrame(const Chip8State&); // A frame just ran
+        const InputLog& log() const { return recording; }
+    private:
+        InputLog recording;
+        uint64_t rolling;                 // Rolling hash so far
+        uint16_t keys;                    // Bit k set while key k is down, to drop repeats
+};
+
+#endif
@@ -0,0 +1,651 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Jit.cpp contains the implementation of the Jit class and of
+ * Chip8::runJit, the execution engine that uses it. The code generator
+ * follows the System V calling convention: the state pointer arrives in
+ * rdi and stays there, rax and rcx are scratch, rsi holds I and the V
+ * registers a block uses are spread over the remaining eleven general
+ * purpose registers. Every value is kept zero-extended in a 32-bit
+ * register and masked back to 8 (or 16) bits after arithmetic.
+ */
+
+#include "Jit.h"
+#include "BlockCache.h"
+#include "Chip8.h"
+#include "error.h"
+#include <cstddef>
+#include <cstring>
+#include <sstream>
+
+#if CHIP8_JIT
+#include <sys/mman.h>
+#endif
+
+#if CHIP8_JIT
+namespace
+{
+    enum Reg { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+    // Host registers handed out to V registers, in the order they are used
+    const int V_POOL[] = { RDX, RBX, RBP, R8, R9, R10, R11, R12, R13, R14, R15 };
+    const int V_POOL_SIZE = sizeof(V_POOL) / sizeof(V_POOL[0]);
+    const int REG_I = RSI;
+    const int REG_STATE = RDI;
+
+    const int32_t OFF_V      = offsetof(Chip8State, V);
+    const int32_t OFF_I      = offsetof(Chip8State, I);
+    const int32_t OFF_PC     = offsetof(Chip8State, pc);
+    const int32_t OFF_MEMORY = offsetof(Chip8State, memory);
+    const int32_t OFF_KEY    = offsetof(Chip8State, key);
+
+    // Two-operand ALU opcodes in their `op r/m32, r32` form
+    enum Alu { ALU_ADD = 0x01, ALU_OR = 0x09, ALU_AND = 0x21, ALU_SUB = 0x29, ALU_XOR = 0x31, ALU_CMP = 0x39, ALU_MOV = 0x89 };
+    // The /digit of the `op r/m32, imm32` (0x81) and shift (0xC1) forms
+    enum AluImm { IMM_ADD = 0, IMM_OR = 1, IMM_AND = 4, IMM_SUB = 5, IMM_XOR = 6, IMM_CMP = 7 };
+    enum Shift { SHIFT_SHL = 4, SHIFT_SHR = 5 };
+    enum Cond { CC_E = 0x4, CC_NE = 0x5 };
+
+    /*
+     * A tiny x86-64 assembler, just the handful of instruction forms the
+     * code generator needs.
+     */
+    class Emitter
+    {
+        public:
+            std::vector<uint8_t> out;
+
+            void byte(uint8_t b) { out.push_back(b); }
+            void dword(uint32_t d)
+            {
+                for (int i = 0; i < 4; ++i)
+                    byte((d >> (8 * i)) & 0xFF);
+            }
+            void rex(int reg, int index, int base, bool force)
+            {
+                uint8_t r = 0x40 | ((reg & 8) >> 1) | ((index & 8) >> 2) | ((base & 8) >> 3);
+                if (r != 0x40 || force)
+                    byte(r);
+            }
+            void modrmReg(int reg, int rm) { byte(0xC0 | ((reg & 7) << 3) | (rm & 7)); }
+            void modrmState(int reg, int32_t disp)  // [rdi + disp32]
+            {
+                byte(0x80 | ((reg & 7) << 3) | (REG_STATE & 7));
+                dword(disp);
+            }
+            void modrmIndexed(int reg, int index, int32_t disp)  // [rdi + index + disp32]
+            {
+                byte(0x84 | ((reg & 7) << 3));
+                byte(((index & 7) << 3) | (REG_STATE & 7));
+                dword(disp);
+            }
+
+            void push(int r) { rex(0, 0, r, false); byte(0x50 | (r & 7)); }
+            void pop(int r)  { rex(0, 0, r, false); byte(0x58 | (r & 7)); }
+            void ret()       { byte(0xC3); }
+
+            void movImm(int r, uint32_t imm) { rex(0, 0, r, false); byte(0xB8 | (r & 7)); dword(imm); }
+            void alu(int op, int dst, int src) { rex(src, 0, dst, false); byte(op); modrmReg(src, dst); }
+            void aluImm(int ext, int dst, uint32_t imm) { rex(0, 0, dst, false); byte(0x81); modrmReg(ext, dst); dword(imm); }
+            void shiftImm(int ext, int r, uint8_t n) { rex(0, 0, r, false); byte(0xC1); modrmReg(ext, r); byte(n); }
+            void imulImm(int dst, int src, int8_t imm) { rex(dst, 0, src, false); byte(0x6B); modrmReg(dst, src); byte(imm); }
+            void cmov(int cc, int dst, int src) { rex(dst, 0, src, false); byte(0x0F); byte(0x40 | cc); modrmReg(dst, src); }
+
+            // movzx r32, byte [rdi + disp]
+            void loadByte(int r, int32_t disp) { rex(r, 0, 0, false); byte(0x0F); byte(0xB6); modrmState(r, disp); }
+            // movzx r32, byte [rdi + index + disp]
+            void loadByteIndexed(int r, int index, int32_t disp) { rex(r, index, 0, false); byte(0x0F); byte(0xB6); modrmIndexed(r, index, disp); }
+            // movzx r32, word [rdi + disp]
+            void loadWord(int r, int32_t disp) { rex(r, 0, 0, false); byte(0x0F); byte(0xB7); modrmState(r, disp); }
+            // mov byte [rdi + disp], r8 -- always with a REX so that 4-7 mean spl..dil
+            void storeByte(int r, int32_t disp) { rex(r, 0, 0, true); byte(0x88); modrmState(r, disp); }
+            // mov word [rdi + disp], r16
+            void storeWord(int r, int32_t disp) { byte(0x66); rex(r, 0, 0, false); byte(0x89); modrmState(r, disp); }
+            // mov word [rdi + disp], imm16
+            void storeWordImm(uint16_t imm, int32_t disp) { byte(0x66); byte(0xC7); modrmState(0, disp); byte(imm & 0xFF); byte(imm >> 8); }
+    };
+
+    /*
+     * IN:  (uint8_t) an OpKind
+     * OUT: (bool) true if the code generator knows how to compile it
+     */
+    bool compilable(uint8_t kind)
+    {
+        switch (kind)
+        {
+            case OP_JP:
+            case OP_SE_KK:
+            case OP_SNE_KK:
+            case OP_SE_XY:
+            case OP_LD_KK:
+            case OP_ADD_KK:
+            case OP_LD_XY:
+            case OP_OR:
+            case OP_AND:
+            case OP_XOR:
+            case OP_ADD_XY:
+            case OP_SUB:
+            case OP_SHR:
+            case OP_SUBN:
+            case OP_SHL:
+            case OP_SNE_XY:
+            case OP_LD_I:
+            case OP_SKP:
+            case OP_SKNP:
+            case OP_ADD_I:
+            case OP_LD_F:
+            case OP_LD_VX_I:
+                return true;
+        }
+        return false;
+    }
+
+    /*
+     * IN:  (const DecodedOp&) an instruction the code generator supports
+     * OUT: (uint16_t) bitmask of the V registers it reads or writes
+     */
+    uint16_t registersUsed(const DecodedOp& op)
+    {
+        switch (op.kind)
+        {
+            case OP_JP:
+            case OP_LD_I:
+                return 0;
+            case OP_SE_KK:
+            case OP_SNE_KK:
+            case OP_LD_KK:
+            case OP_ADD_KK:
+            case OP_SKP:
+            case OP_SKNP:
+            case OP_LD_F:
+                return 1 << op.x;
+            case OP_SE_XY:
+            case OP_SNE_XY:
+            case OP_LD_XY:
+            case OP_OR:
+            case OP_AND:
+            case OP_XOR:
+                return (1 << op.x) | (1 << op.y);
+            case OP_ADD_I:
+                return (1 << op.x) | (1 << 0xF);
+            case OP_LD_VX_I:
+                return (2 << op.x) - 1;
+        }
+        // The 8XYN arithmetic all writes VF
+        return (1 << op.x) | (1 << op.y) | (1 << 0xF);
+    }
+
+    int popcount(uint16_t mask)
+    {
+        int n = 0;
+        for (; mask; mask &= mask - 1)
+            ++n;
+        return n;
+    }
+}
+#endif
+
+/*
+ * Default Constructor
+ *
+ * IN: void
+ *     Nothing is allocated until something gets hot.
+ */
+Jit::Jit() : code(nullptr), codeUsed(0)
+{
+}
+
+/*
+ * Destructor
+ *
+ *     Releases the machine code buffer.
+ */
+Jit::~Jit()
+{
+#if CHIP8_JIT
+    if (code)
+        munmap(code, CODE_SIZE);
+#endif
+}
+
+/*
+ * Copy Constructor
+ *
+ * IN: (const Jit&) ignored
+ *     Compiled code belongs to one machine, so a copy starts out cold.
+ */
+Jit::Jit(const Jit&) : code(nullptr), codeUsed(0)
+{
+}
+
+Jit& Jit::operator=(const Jit& other)
+{
+    if (this != &other)
+        flush();
+    return *this;
+}
+
+/*
+ * IN:  (uint16_t) program counter of an instruction the interpreter ran
+ * OUT: (bool) true exactly once, when pc has run often enough to be
+ *      worth compiling
+ */
+bool Jit::heat(uint16_t pc)
+{
+    if (!available() || pc < START_PROG_MEM || pc >= END_PROG_MEM)
+        return false;
+    if (heatMap.empty())
+        heatMap.assign(4096, 0);
+
+    if (heatMap[pc] == COLD_FOREVER)
+        return false;
+    return ++heatMap[pc] == HOT_THRESHOLD;
+}
+
+/*
+ * IN:  (uint16_t) program counter
+ * OUT: void
+ *      Drops the block at pc, if any, and stops it from being compiled
+ *      again until the memory it came from is written.
+ */
+void Jit::reject(uint16_t pc)
+{
+    if (heatMap.empty())
+        heatMap.assign(4096, 0);
+    if (pc < entry.size())
+        entry[pc] = 0;
+    heatMap[pc] = COLD_FOREVER;
+}
+
+/*
+ * IN:  (uint32_t) first address that was written
+ *      (uint32_t) number of bytes written
+ * OUT: void
+ *      Drops every block compiled from the written bytes. Their machine
+ *      code is left where it is until the buffer is flushed.
+ */
+void Jit::invalidate(uint32_t addr, uint32_t len)
+{
+    for (uint32_t a = addr; a < addr + len && a < covered.size(); ++a)
+    {
+        if (!covered[a])
+            continue;
+
+        uint32_t lowest = a >= 2 * BlockCache::MAX_BLOCK_OPS ? a - 2 * BlockCache::MAX_BLOCK_OPS : 0;
+        for (uint32_t s = lowest; s <= a; ++s)
+        {
+            if (entry[s] != 0 && a < blocks[entry[s] - 1].end)
+            {
+                entry[s] = 0;
+                heatMap[s] = 0;
+            }
+        }
+        covered[a] = false;
+    }
+
+    // Rewritten code deserves another chance at being compiled
+    for (uint32_t a = addr; a < addr + len && a < heatMap.size(); ++a)
+    {
+        if (heatMap[a] == COLD_FOREVER)
+            heatMap[a] = 0;
+    }
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      Forgets every compiled block and every heat count.
+ */
+void Jit::flush()
+{
+    codeUsed = 0;
+    blocks.clear();
+    entry.clear();
+    heatMap.clear();
+    covered.clear();
+}
+
+#if CHIP8_JIT
+/*
+ * IN:  (uint16_t) address of the first instruction
+ *      (const Chip8State&) the machine, only its memory is read
+ * OUT: (const JitBlock*) the compiled block, or nullptr if the first
+ *      instruction can't be compiled
+ *      Compiles instructions until one that can't be compiled, one that
+ *      changes pc, or one that needs more V registers than there are
+ *      host registers left.
+ */
+const JitBlock* Jit::compile(uint16_t start, const Chip8State& state)
+{
+    // Pick the instructions and give each V register a host register
+    std::vector<DecodedOp> ops;
+    int hostReg[16];
+    uint16_t allocated = 0, written = 0;
+    bool usesI = false, writesI = false, terminated = false;
+
+    for (int i = 0; i < 16; ++i)
+        hostReg[i] = -1;
+
+    uint16_t pc = start;
+    while (!terminated && ops.size() < (size_t)BlockCache::MAX_BLOCK_OPS && pc < END_PROG_MEM)
+    {
+        DecodedOp op = decodeOp(state.memory[pc] << 8 | state.memory[pc + 1], pc);
+        if (!compilable(op.kind))
+            break;
+
+        uint16_t used = registersUsed(op);
+        if (popcount(allocated | used) > V_POOL_SIZE)
+            break;
+        for (int v = 0; v < 16; ++v)
+        {
+            if ((used & (1 << v)) && hostReg[v] < 0)
+            {
+                hostReg[v] = V_POOL[popcount(allocated)];
+                allocated |= 1 << v;
+            }
+        }
+
+        switch (op.kind)
+        {
+            case OP_SE_KK: case OP_SNE_KK: case OP_SE_XY: case OP_SNE_XY:
+            case OP_SKP: case OP_SKNP:
+                break;
+            case OP_LD_I: case OP_LD_F:
+                usesI = writesI = true;
+                break;
+            case OP_ADD_I:
+                usesI = writesI = true;
+                written |= 1 << 0xF;
+                break;
+            case OP_LD_VX_I:
+                usesI = true;
+                written |= used;
+                break;
+            default:
+                written |= used & ((1 << op.x) | (1 << 0xF));
+                break;
+        }
+
+        terminated = endsBlock(op.kind);
+        ops.push_back(op);
+        pc += 2;
+    }
+
+    if (ops.empty())
+    {
+        reject(start);
+        return nullptr;
+    }
+
+    // Generate the code
+    Emitter e;
+    static const int SAVED[] = { RBX, RBP, R12, R13, R14, R15 };
+    for (int r : SAVED)
+        e.push(r);
+    for (int v = 0; v < 16; ++v)
+    {
+        if (hostReg[v] >= 0)
+            e.loadByte(hostReg[v], OFF_V + v);
+    }
+    if (usesI)
+        e.loadWord(REG_I, OFF_I);
+
+    for (const DecodedOp& op : ops)
+    {
+        int X = hostReg[op.x], Y = hostReg[op.y], F = hostReg[0xF];
+        switch (op.kind)
+        {
+            case OP_LD_KK:
+                e.movImm(X, op.kk);
+                break;
+            case OP_ADD_KK:
+                e.aluImm(IMM_ADD, X, op.kk);
+                e.aluImm(IMM_AND, X, 0xFF);
+                break;
+            case OP_LD_XY:
+                e.alu(ALU_MOV, X, Y);
+                break;
+            case OP_OR:
+                e.alu(ALU_OR, X, Y);
+                break;
+            case OP_AND:
+                e.alu(ALU_AND, X, Y);
+                break;
+            case OP_XOR:
+                e.alu(ALU_XOR, X, Y);
+                break;
+            // The flag ops write VF first and then read VX and VY again,
+            // exactly like runCycle, which matters when X or Y is F.
+            case OP_ADD_XY:
+                e.alu(ALU_MOV, RAX, X);
+                e.alu(ALU_ADD, RAX, Y);
+                e.shiftImm(SHIFT_SHR, RAX, 8);
+                e.alu(ALU_MOV, F, RAX);
+                e.alu(ALU_ADD, X, Y);
+                e.aluImm(IMM_AND, X, 0xFF);
+                break;
+            case OP_SUB:
+                e.alu(ALU_MOV, RAX, Y);
+                e.alu(ALU_SUB, RAX, X);
+                e.shiftImm(SHIFT_SHR, RAX, 31);
+                e.alu(ALU_MOV, F, RAX);
+                e.alu(ALU_SUB, X, Y);
+                e.aluImm(IMM_AND, X, 0xFF);
+                break;
+            case OP_SHR:
+                e.alu(ALU_MOV, RAX, X);
+                e.aluImm(IMM_AND, RAX, 1);
+                e.alu(ALU_MOV, F, RAX);
+                e.shiftImm(SHIFT_SHR, X, 1);
+                break;
+            case OP_SUBN:
+                e.alu(ALU_MOV, RAX, X);
+                e.alu(ALU_SUB, RAX, Y);
+                e.shiftImm(SHIFT_SHR, RAX, 31);
+                e.alu(ALU_MOV, F, RAX);
+                e.alu(ALU_MOV, RAX, Y);
+                e.alu(ALU_SUB, RAX, X);
+                e.aluImm(IMM_AND, RAX, 0xFF);
+                e.alu(ALU_MOV, X, RAX);
+                break;
+            case OP_SHL:
+                e.alu(ALU_MOV, RAX, X);
+                e.shiftImm(SHIFT_SHR, RAX, 7);
+                e.alu(ALU_MOV, F, RAX);
+                e.shiftImm(SHIFT_SHL, X, 1);
+                e.aluImm(IMM_AND, X, 0xFF);
+                break;
+            case OP_LD_I:
+                e.movImm(REG_I, op.nnn);
+                break;
+            case OP_ADD_I:
+                // VF = I + VX > 0xFFF, computed as the sign of 0xFFF - (I + VX)
+                e.movImm(RCX, 0x0FFF);
+                e.alu(ALU_SUB, RCX, REG_I);
+                e.alu(ALU_SUB, RCX, X);
+                e.shiftImm(SHIFT_SHR, RCX, 31);
+                e.alu(ALU_MOV, F, RCX);
+                e.alu(ALU_ADD, REG_I, X);
+                e.aluImm(IMM_AND, REG_I, 0xFFFF);
+                break;
+            case OP_LD_F:
+                e.imulImm(REG_I, X, 5);
+                break;
+            case OP_LD_VX_I:
+                // rcx = (I + i) & 0xFFF, memory wraps around like it does in runCycle
+                for (int i = 0; i <= op.x; ++i)
+                {
+                    e.alu(ALU_MOV, RCX, REG_I);
+                    if (i > 0)
+                        e.aluImm(IMM_ADD, RCX, i);
+                    e.aluImm(IMM_AND, RCX, 0xFFF);
+                    e.loadByteIndexed(hostReg[i], RCX, OFF_MEMORY);
+                }
+                break;
+            case OP_JP:
+                e.storeWordImm(op.nnn, OFF_PC);
+                break;
+            default:
+                // The skips: pc = pc + 2, or pc + 4 if the condition holds
+                e.movImm(RAX, op.pc + 2);
+                e.movImm(RCX, op.pc + 4);
+                int cc = CC_E;
+                switch (op.kind)
+                {
+                    case OP_SE_KK:  e.aluImm(IMM_CMP, X, op.kk); cc = CC_E; break;
+                    case OP_SNE_KK: e.aluImm(IMM_CMP, X, op.kk); cc = CC_NE; break;
+                    case OP_SE_XY:  e.alu(ALU_CMP, X, Y); cc = CC_E; break;
+                    case OP_SNE_XY: e.alu(ALU_CMP, X, Y); cc = CC_NE; break;
+                    case OP_SKP:
+                    case OP_SKNP:
+                        // Only the low nibble of VX picks a key, like runCycle
+                        e.alu(ALU_MOV, RCX, X);
+                        e.aluImm(IMM_AND, RCX, 0xF);
+                        e.loadByteIndexed(RCX, RCX, OFF_KEY);
+                        e.aluImm(IMM_CMP, RCX, 0);
+                        e.movImm(RCX, op.pc + 4);
+                        cc = op.kind == OP_SKP ? CC_NE : CC_E;
+                        break;
+                }
+                e.cmov(cc, RAX, RCX);
+                e.storeWord(RAX, OFF_PC);
+                break;
+        }
+    }
+    if (!terminated)
+        e.storeWordImm(pc, OFF_PC);
+
+    for (int v = 0; v < 16; ++v)
+    {
+        if (written & (1 << v))
+            e.storeByte(hostReg[v], OFF_V + v);
+    }
+    if (writesI)
+        e.storeWord(REG_I, OFF_I);
+    for (int r = 5; r >= 0; --r)
+        e.pop(SAVED[r]);
+    e.ret();
+
+    // Copy it into executable memory, flushing everything if it doesn't fit
+    if (!code)
+    {
+        void* mem = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+        {
+            reject(start);
+            return nullptr;
+        }
+        code = static_cast<uint8_t*>(mem);
+    }
+    if (codeUsed + e.out.size() > CODE_SIZE)
+    {
+        std::vector<uint8_t> keepHeat = heatMap;
+        flush();
+        heatMap = keepHeat;
+
+        // Blocks that were compiled sit at the threshold or past it, and
+        // heat only compiles on reaching it, so they would never come back
+        for (size_t a = 0; a < heatMap.size(); ++a)
+        {
+            if (heatMap[a] >= HOT_THRESHOLD && heatMap[a] != COLD_FOREVER)
+                heatMap[a] = HOT_THRESHOLD - 1;
+        }
+    }
+    if (entry.empty())
+    {
+        entry.assign(4096, 0);
+        covered.assign(4096, false);
+    }
+
+    mprotect(code, CODE_SIZE, PROT_READ | PROT_WRITE);
+    std::memcpy(code + codeUsed, e.out.data(), e.out.size());
+    mprotect(code, CODE_SIZE, PROT_READ | PROT_EXEC);
+
+    JitBlock block;
+    block.fn = reinterpret_cast<JitFn>(code + codeUsed);
+    block.start = start;
+    block.end = pc;
+    block.len = ops.size();
+    codeUsed += (e.out.size() + 15) & ~static_cast<size_t>(15);
+
+    for (uint16_t a = start; a < pc; ++a)
+        covered[a] = true;
+    blocks.push_back(block);
+    entry[start] = blocks.size();
+    return &blocks.back();
+}
+#else
+const JitBlock* Jit::compile(uint16_t, const Chip8State&)
+{
+    return nullptr;
+}
+#endif
+
+/*
+ * IN:  (uint32_t) the most instructions to execute
+ *      (bool) true to re-run every compiled block on the interpreter and
+ *      compare the results
+ * OUT: (uint32_t) the number of instructions executed
+ *      Runs compiled blocks where there are any, and runCycle everywhere
+ *      else. Instructions the interpreter runs warm up their address
+ *      until it is compiled.
+ */
+uint32_t Chip8::runJit(uint32_t n, bool checked)
+{
+    uint32_t executed = 0;
+
+    while (running && executed < n)
+    {
+        const JitBlock* block = jit.lookup(pc);
+        if (!block && jit.heat(pc))
+            block = jit.compile(pc, state());
+        if (!block || block->len > n - executed)
+        {
+            runCycle();
+            ++executed;
+            continue;
+        }
+
+        if (checked)
+            runJitChecked(*block);
+        else
+            block->fn(&state());
+        executed += block->len;
+    }
+    return executed;
+}
+
+/*
+ * IN:  (const JitBlock&) a compiled block starting at pc
+ * OUT: void
+ *      Runs the block natively, then rewinds and runs the same
+ *      instructions on the interpreter. If the two disagree the
+ *      interpreter's result is kept, the block is thrown away and the
+ *      mismatch is reported.
+ */
+void Chip8::runJitChecked(const JitBlock& block)
+{
+    Chip8State before = state();
+
+    block.fn(&state());
+    uint64_t jitHash = hashState(state());
+
+    state() = before;
+    for (uint16_t i = 0; i < block.len; ++i)
+        runCycle();
+
+    if (hashState(state()) != jitHash)
+    {
+        std::ostringstream msg;
+        msg << "JIT mismatch in block 0x" << std::hex << block.start << "-0x" << block.end << ", using the interpreter there";
+        printChip8Error(msg.str());
+        jit.reject(block.start);
+        ++jitMismatches;
+    }
+}
@@ -0,0 +1,92 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Jit.h contains the class definition for the Jit class, a dynamic
+ * recompiler that turns hot straight-line runs of Chip8 instructions into
+ * x86-64 machine code. A compiled block loads the V registers it uses
+ * and I into host registers, runs, and writes them back once at the end;
+ * pc is a constant until the block's last instruction stores it.
+ *
+ * Only instructions with simple, local effects are compiled. Anything
+ * else (DXYN, FX0A, the timers, RND, calls, memory writes...) ends a
+ * block and is left to the interpreter, as does any code that is not
+ * hot yet. On hosts that are not x86-64 Jit::available() is false and
+ * the core falls back to the block cache.
+ */
+
+#ifndef CHIP8_JIT_H_
+#define CHIP8_JIT_H_
+
+#include "Chip8State.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define CHIP8_JIT 1
+#else
+#define CHIP8_JIT 0
+#endif
+
+typedef void (*JitFn)(Chip8State*);
+
+/*
+ * A compiled block. Running it always executes exactly `len`
+ * instructions.
+ */
+struct JitBlock
+{
+    JitFn    fn;                      // Native code, takes the state to run on
+    uint16_t start;                   // Address of the first instruction
+    uint16_t end;                     // One past the last byte compiled
+    uint16_t len;                     // Instructions in the block
+};
+
+class Jit
+{
+    public:
+        static const int HOT_THRESHOLD = 8;         // Interpreted runs of an address before it is compiled
+        static const size_t CODE_SIZE = 256 * 1024; // Bytes of machine code per instance
+
+        Jit();
+        ~Jit();
+        Jit(const Jit&);                            // Copies start out with nothing compiled
+        Jit& operator=(const Jit&);
+
+        static bool available() { return CHIP8_JIT != 0; }
+
+        const JitBlock* lookup(uint16_t) const;     // The compiled block starting at pc, if any
+        bool heat(uint16_t);                        // Note a run of pc, true when it just became hot
+        const JitBlock* compile(uint16_t, const Chip8State&); // nullptr if pc can't be compiled
+        void reject(uint16_t);                      // Never compile pc again (until it is rewritten)
+        void invalidate(uint32_t, uint32_t);        // Memory in [addr, addr + len) was written
+        void flush();                               // Forget all compiled code
+    private:
+        static const uint8_t COLD_FOREVER = 0xFF;   // Heat of an address that failed to compile
+
+        uint8_t* code;                              // mmap'd buffer, nullptr until the first compile
+        size_t   codeUsed;
+        std::vector<JitBlock> blocks;
+        std::vector<uint32_t> entry;                // 1 + index into `blocks` per start address, 0 if none
+        std::vector<uint8_t>  heatMap;              // Interpreted runs of each address
+        std::vector<bool>     covered;              // Bytes compiled into some block
+};
+
+/*
+ * IN:  (uint16_t) program counter
+ * OUT: (const JitBlock*) the compiled block starting at pc or nullptr
+ */
+inline const JitBlock* Jit::lookup(uint16_t pc) const
+{
+    if (pc >= entry.size() || entry[pc] == 0)
+        return nullptr;
+    return &blocks[entry[pc] - 1];
+}
+
+#endif
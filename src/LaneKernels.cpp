@@ -0,0 +1,253 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * LaneKernels.cpp contains the plain C++ and SSE2 lane kernels and picks
+ * the best set for the CPU at run time. The plain versions spell out what
+ * every kernel does; the vector versions must match them bit for bit.
+ */
+
+#include "LaneKernels.h"
+
+#if CHIP8_LANE_SIMD
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+void scalarMovImm(uint8_t* x, uint8_t kk, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        if (mask[i])
+            x[i] = kk;
+}
+
+void scalarAddImm(uint8_t* x, uint8_t kk, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        if (mask[i])
+            x[i] += kk;
+}
+
+void scalarMov(uint8_t* x, const uint8_t* y, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        if (mask[i])
+            x[i] = y[i];
+}
+
+void scalarOr(uint8_t* x, const uint8_t* y, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        if (mask[i])
+            x[i] |= y[i];
+}
+
+void scalarAnd(uint8_t* x, const uint8_t* y, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        if (mask[i])
+            x[i] &= y[i];
+}
+
+void scalarXor(uint8_t* x, const uint8_t* y, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        if (mask[i])
+            x[i] ^= y[i];
+}
+
+void scalarAdd(uint8_t* x, const uint8_t* y, uint8_t* f, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (mask[i])
+        {
+            f[i] = y[i] > 0xFF - x[i] ? 1 : 0;
+            x[i] += y[i];
+        }
+    }
+}
+
+void scalarSub(uint8_t* x, const uint8_t* y, uint8_t* f, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (mask[i])
+        {
+            f[i] = x[i] > y[i] ? 1 : 0;
+            x[i] -= y[i];
+        }
+    }
+}
+
+void scalarSubn(uint8_t* x, const uint8_t* y, uint8_t* f, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (mask[i])
+        {
+            f[i] = y[i] > x[i] ? 1 : 0;
+            x[i] = y[i] - x[i];
+        }
+    }
+}
+
+void scalarShr(uint8_t* x, uint8_t* f, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (mask[i])
+        {
+            f[i] = x[i] & 0x1;
+            x[i] >>= 1;
+        }
+    }
+}
+
+void scalarShl(uint8_t* x, uint8_t* f, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (mask[i])
+        {
+            f[i] = x[i] >> 7;
+            x[i] <<= 1;
+        }
+    }
+}
+
+void scalarSkipImm(uint16_t* pc, const uint8_t* x, uint8_t kk, bool equal, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        if (mask[i])
+            pc[i] += ((x[i] == kk) == equal) ? 4 : 2;
+}
+
+void scalarSkipReg(uint16_t* pc, const uint8_t* x, const uint8_t* y, bool equal, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        if (mask[i])
+            pc[i] += ((x[i] == y[i]) == equal) ? 4 : 2;
+}
+
+void scalarSetWord(uint16_t* w, uint16_t nnn, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        if (mask[i])
+            w[i] = nnn;
+}
+
+void scalarStepWord(uint16_t* w, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        if (mask[i])
+            w[i] += 2;
+}
+
+void scalarAddIndex(uint16_t* index, const uint8_t* x, uint8_t* f, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (mask[i])
+        {
+            f[i] = index[i] + x[i] > 0x0FFF ? 1 : 0;
+            index[i] += x[i];
+        }
+    }
+}
+
+void scalarFontIndex(uint16_t* index, const uint8_t* x, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        if (mask[i])
+            index[i] = x[i] * 0x5;
+}
+
+#if CHIP8_LANE_SIMD
+#define LANE_TARGET __attribute__((target("sse2")))
+
+/*
+ * SSE2 is part of x86-64, so these need no run time check.
+ */
+struct Sse2
+{
+    typedef __m128i Vec;
+    static const size_t W = 16;
+
+    static Vec load(const uint8_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    static void store(uint8_t* p, Vec v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+    static Vec set1(uint8_t b) { return _mm_set1_epi8(static_cast<char>(b)); }
+    static Vec set1w(uint16_t w) { return _mm_set1_epi16(static_cast<short>(w)); }
+    static Vec add(Vec a, Vec b) { return _mm_add_epi8(a, b); }
+    static Vec sub(Vec a, Vec b) { return _mm_sub_epi8(a, b); }
+    static Vec addw(Vec a, Vec b) { return _mm_add_epi16(a, b); }
+    static Vec and_(Vec a, Vec b) { return _mm_and_si128(a, b); }
+    static Vec or_(Vec a, Vec b) { return _mm_or_si128(a, b); }
+    static Vec xor_(Vec a, Vec b) { return _mm_xor_si128(a, b); }
+    static Vec andnot(Vec a, Vec b) { return _mm_andnot_si128(a, b); } // ~a & b
+    static Vec eq(Vec a, Vec b) { return _mm_cmpeq_epi8(a, b); }
+    static Vec eqw(Vec a, Vec b) { return _mm_cmpeq_epi16(a, b); }
+    static Vec max(Vec a, Vec b) { return _mm_max_epu8(a, b); }
+    static Vec srlw(Vec a, int n) { return _mm_srl_epi16(a, _mm_cvtsi32_si128(n)); }
+    static Vec sllw(Vec a, int n) { return _mm_sll_epi16(a, _mm_cvtsi32_si128(n)); }
+    static Vec widenLo(Vec a) { return _mm_unpacklo_epi8(a, _mm_setzero_si128()); }
+    static Vec widenHi(Vec a) { return _mm_unpackhi_epi8(a, _mm_setzero_si128()); }
+    static Vec narrow(Vec lo, Vec hi) { return _mm_packs_epi16(lo, hi); }
+};
+
+#include "LaneKernelsSimd.h"
+#endif
+
+}
+
+const LaneKernels scalarLaneKernels =
+{
+    "scalar", scalarMovImm, scalarAddImm, scalarMov, scalarOr, scalarAnd, scalarXor,
+    scalarAdd, scalarSub, scalarSubn, scalarShr, scalarShl,
+    scalarSkipImm, scalarSkipReg, scalarSetWord, scalarStepWord, scalarAddIndex, scalarFontIndex
+};
+
+#if CHIP8_LANE_SIMD
+const LaneKernels sse2LaneKernels = LANE_KERNEL_TABLE("sse2", Sse2);
+#endif
+
+/*
+ * IN:  void
+ * OUT: (const LaneKernels&) AVX2 if the CPU has it, otherwise SSE2 on
+ *      x86-64 and the plain versions everywhere else
+ */
+const LaneKernels& bestLaneKernels()
+{
+#if CHIP8_LANE_SIMD
+    if (__builtin_cpu_supports("avx2"))
+        return avx2LaneKernels;
+    return sse2LaneKernels;
+#else
+    return scalarLaneKernels;
+#endif
+}
+
+/*
+ * IN:  (string) "scalar", "sse2" or "avx2"
+ * OUT: (const LaneKernels*) that set, or nullptr if it doesn't exist or
+ *      this CPU can't run it
+ */
+const LaneKernels* findLaneKernels(const std::string& name)
+{
+    if (name == scalarLaneKernels.name)
+        return &scalarLaneKernels;
+#if CHIP8_LANE_SIMD
+    if (name == sse2LaneKernels.name)
+        return &sse2LaneKernels;
+    if (name == avx2LaneKernels.name && __builtin_cpu_supports("avx2"))
+        return &avx2LaneKernels;
+#endif
+    return nullptr;
+}
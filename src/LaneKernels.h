@@ -0,0 +1,73 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * LaneKernels.h contains the kernels the Lockstep engine uses to run one
+ * instruction across many machines at once. Every kernel works on
+ * structure-of-arrays registers (one array per register, one element per
+ * machine, or "lane") and only changes lanes whose byte in `mask` is
+ * 0xFF; every other lane is left exactly as it was.
+ *
+ * There is a plain C++ version of every kernel plus SSE2 and AVX2
+ * versions on x86-64. The AVX2 ones are only picked when the CPU running
+ * the program has AVX2, so the core still runs on any x86-64.
+ *
+ * Lane counts passed to the kernels are always a multiple of LANE_ALIGN.
+ */
+
+#ifndef CHIP8_LANEKERNELS_H_
+#define CHIP8_LANEKERNELS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CHIP8_LANE_SIMD 1
+#else
+#define CHIP8_LANE_SIMD 0
+#endif
+
+static const size_t LANE_ALIGN = 32;  // Lanes per AVX2 register of bytes
+
+struct LaneKernels
+{
+    const char* name;
+
+    /* 8-bit registers (V, timers) */
+    void (*movImm)(uint8_t*, uint8_t, const uint8_t*, size_t);           // 6XKK: x = kk
+    void (*addImm)(uint8_t*, uint8_t, const uint8_t*, size_t);           // 7XKK: x += kk
+    void (*mov)(uint8_t*, const uint8_t*, const uint8_t*, size_t);       // 8XY0: x = y
+    void (*orr)(uint8_t*, const uint8_t*, const uint8_t*, size_t);       // 8XY1: x |= y
+    void (*andr)(uint8_t*, const uint8_t*, const uint8_t*, size_t);      // 8XY2: x &= y
+    void (*xorr)(uint8_t*, const uint8_t*, const uint8_t*, size_t);      // 8XY3: x ^= y
+    void (*add)(uint8_t*, const uint8_t*, uint8_t*, const uint8_t*, size_t);  // 8XY4: x += y, f = carry
+    void (*sub)(uint8_t*, const uint8_t*, uint8_t*, const uint8_t*, size_t);  // 8XY5: x -= y, f = x > y
+    void (*subn)(uint8_t*, const uint8_t*, uint8_t*, const uint8_t*, size_t); // 8XY7: x = y - x, f = y > x
+    void (*shr)(uint8_t*, uint8_t*, const uint8_t*, size_t);             // 8XY6: f = x & 1, x >>= 1
+    void (*shl)(uint8_t*, uint8_t*, const uint8_t*, size_t);             // 8XYE: f = x >> 7, x <<= 1
+
+    /* 16-bit registers (pc, I), the mask still has one byte per lane */
+    void (*skipImm)(uint16_t*, const uint8_t*, uint8_t, bool, const uint8_t*, size_t);        // 3XKK/4XKK
+    void (*skipReg)(uint16_t*, const uint8_t*, const uint8_t*, bool, const uint8_t*, size_t); // 5XY0/9XY0
+    void (*setWord)(uint16_t*, uint16_t, const uint8_t*, size_t);        // 1NNN, ANNN: w = nnn
+    void (*stepWord)(uint16_t*, const uint8_t*, size_t);                 // pc += 2
+    void (*addIndex)(uint16_t*, const uint8_t*, uint8_t*, const uint8_t*, size_t); // FX1E: I += x, f = I > 0xFFF
+    void (*fontIndex)(uint16_t*, const uint8_t*, const uint8_t*, size_t); // FX29: I = x * 5
+};
+
+extern const LaneKernels scalarLaneKernels;
+#if CHIP8_LANE_SIMD
+extern const LaneKernels sse2LaneKernels;
+extern const LaneKernels avx2LaneKernels;
+#endif
+
+const LaneKernels& bestLaneKernels();                     // Fastest set this CPU can run
+const LaneKernels* findLaneKernels(const std::string&);   // By name, nullptr if unknown or unsupported
+
+#endif
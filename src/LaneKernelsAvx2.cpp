@@ -0,0 +1,71 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * LaneKernelsAvx2.cpp contains the AVX2 lane kernels. Only the functions
+ * in this file are compiled for AVX2 (through the target attribute, not
+ * a compiler flag), and bestLaneKernels only hands them out after asking
+ * the CPU, so the rest of the program still runs on any x86-64.
+ */
+
+#include "LaneKernels.h"
+
+#if CHIP8_LANE_SIMD
+#include <immintrin.h>
+
+namespace
+{
+
+#define LANE_TARGET __attribute__((target("avx2")))
+
+/*
+ * AVX2 byte and word operations work on two independent 128-bit halves,
+ * so widening and narrowing shuffle 64-bit quarters around to keep lanes
+ * in order.
+ */
+struct Avx2
+{
+    typedef __m256i Vec;
+    static const size_t W = 32;
+
+    LANE_TARGET static Vec load(const uint8_t* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    LANE_TARGET static void store(uint8_t* p, Vec v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+    LANE_TARGET static Vec set1(uint8_t b) { return _mm256_set1_epi8(static_cast<char>(b)); }
+    LANE_TARGET static Vec set1w(uint16_t w) { return _mm256_set1_epi16(static_cast<short>(w)); }
+    LANE_TARGET static Vec add(Vec a, Vec b) { return _mm256_add_epi8(a, b); }
+    LANE_TARGET static Vec sub(Vec a, Vec b) { return _mm256_sub_epi8(a, b); }
+    LANE_TARGET static Vec addw(Vec a, Vec b) { return _mm256_add_epi16(a, b); }
+    LANE_TARGET static Vec and_(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+    LANE_TARGET static Vec or_(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+    LANE_TARGET static Vec xor_(Vec a, Vec b) { return _mm256_xor_si256(a, b); }
+    LANE_TARGET static Vec andnot(Vec a, Vec b) { return _mm256_andnot_si256(a, b); } // ~a & b
+    LANE_TARGET static Vec eq(Vec a, Vec b) { return _mm256_cmpeq_epi8(a, b); }
+    LANE_TARGET static Vec eqw(Vec a, Vec b) { return _mm256_cmpeq_epi16(a, b); }
+    LANE_TARGET static Vec max(Vec a, Vec b) { return _mm256_max_epu8(a, b); }
+    LANE_TARGET static Vec srlw(Vec a, int n) { return _mm256_srl_epi16(a, _mm_cvtsi32_si128(n)); }
+    LANE_TARGET static Vec sllw(Vec a, int n) { return _mm256_sll_epi16(a, _mm_cvtsi32_si128(n)); }
+    LANE_TARGET static Vec widenLo(Vec a)
+    {
+        return _mm256_unpacklo_epi8(_mm256_permute4x64_epi64(a, 0xD8), _mm256_setzero_si256());
+    }
+    LANE_TARGET static Vec widenHi(Vec a)
+    {
+        return _mm256_unpackhi_epi8(_mm256_permute4x64_epi64(a, 0xD8), _mm256_setzero_si256());
+    }
+    LANE_TARGET static Vec narrow(Vec lo, Vec hi)
+    {
+        return _mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), 0xD8);
+    }
+};
+
+#include "LaneKernelsSimd.h"
+
+}
+
+const LaneKernels avx2LaneKernels = LANE_KERNEL_TABLE("avx2", Avx2);
+#endif
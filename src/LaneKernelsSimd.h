@@ -0,0 +1,282 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * LaneKernelsSimd.h contains the vector versions of the lane kernels,
+ * written once against a small traits class that wraps one instruction
+ * set's intrinsics. A translation unit defines LANE_TARGET (the function
+ * attribute that enables its instruction set) and its traits class, then
+ * includes this file inside an anonymous namespace, so the SSE2 and AVX2
+ * copies never get mixed up at link time.
+ *
+ * A traits class T provides:
+ *      T::Vec                      a register of T::W bytes
+ *      load, store                 unaligned loads and stores
+ *      set1, set1w                 broadcast a byte / 16-bit word
+ *      add, sub, addw, and_, or_, xor_, andnot, eq, eqw, max
+ *      srlw, sllw                  shift 16-bit words by a count
+ *      widenLo, widenHi            zero-extend the low / high half of
+ *                                  the bytes (in lane order) to words
+ *      narrow                      pack two registers of 0/0xFFFF words
+ *                                  back into one of 0/0xFF bytes
+ *
+ * Sixteen-bit registers take two vectors per T::W lanes; the mask is
+ * widened to match.
+ */
+
+#ifndef CHIP8_LANEKERNELSSIMD_H_
+#define CHIP8_LANEKERNELSSIMD_H_
+
+/*
+ * IN:  mask of lanes to change, old value, new value
+ * OUT: new where the mask is set, old everywhere else
+ */
+template <class T>
+LANE_TARGET inline typename T::Vec blend(typename T::Vec m, typename T::Vec a, typename T::Vec b)
+{
+    return T::or_(T::andnot(m, a), T::and_(m, b));
+}
+
+/*
+ * IN:  a, b
+ * OUT: 0xFF in every byte where a > b (unsigned), 0 elsewhere
+ */
+template <class T>
+LANE_TARGET inline typename T::Vec greater(typename T::Vec a, typename T::Vec b)
+{
+    return T::andnot(T::eq(T::max(a, b), b), T::set1(0xFF));
+}
+
+template <class T>
+LANE_TARGET void simdMovImm(uint8_t* x, uint8_t kk, const uint8_t* mask, size_t n)
+{
+    typename T::Vec k = T::set1(kk);
+    for (size_t i = 0; i < n; i += T::W)
+        T::store(x + i, blend<T>(T::load(mask + i), T::load(x + i), k));
+}
+
+template <class T>
+LANE_TARGET void simdAddImm(uint8_t* x, uint8_t kk, const uint8_t* mask, size_t n)
+{
+    typename T::Vec k = T::set1(kk);
+    for (size_t i = 0; i < n; i += T::W)
+        T::store(x + i, T::add(T::load(x + i), T::and_(T::load(mask + i), k)));
+}
+
+template <class T>
+LANE_TARGET void simdMov(uint8_t* x, const uint8_t* y, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; i += T::W)
+        T::store(x + i, blend<T>(T::load(mask + i), T::load(x + i), T::load(y + i)));
+}
+
+template <class T>
+LANE_TARGET void simdOr(uint8_t* x, const uint8_t* y, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; i += T::W)
+        T::store(x + i, T::or_(T::load(x + i), T::and_(T::load(mask + i), T::load(y + i))));
+}
+
+template <class T>
+LANE_TARGET void simdAnd(uint8_t* x, const uint8_t* y, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; i += T::W)
+        T::store(x + i, T::and_(T::load(x + i), T::or_(T::andnot(T::load(mask + i), T::set1(0xFF)), T::load(y + i))));
+}
+
+template <class T>
+LANE_TARGET void simdXor(uint8_t* x, const uint8_t* y, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; i += T::W)
+        T::store(x + i, T::xor_(T::load(x + i), T::and_(T::load(mask + i), T::load(y + i))));
+}
+
+template <class T>
+LANE_TARGET void simdAdd(uint8_t* x, const uint8_t* y, uint8_t* f, const uint8_t* mask, size_t n)
+{
+    typename T::Vec one = T::set1(1);
+    typename T::Vec ones = T::set1(0xFF);
+    for (size_t i = 0; i < n; i += T::W)
+    {
+        typename T::Vec m = T::load(mask + i);
+        typename T::Vec vx = T::load(x + i);
+        typename T::Vec vy = T::load(y + i);
+        // a carry happens when y > 0xFF - x
+        typename T::Vec carry = greater<T>(vy, T::xor_(vx, ones));
+        T::store(f + i, blend<T>(m, T::load(f + i), T::and_(carry, one)));
+        T::store(x + i, blend<T>(m, vx, T::add(vx, vy)));
+    }
+}
+
+template <class T>
+LANE_TARGET void simdSub(uint8_t* x, const uint8_t* y, uint8_t* f, const uint8_t* mask, size_t n)
+{
+    typename T::Vec one = T::set1(1);
+    for (size_t i = 0; i < n; i += T::W)
+    {
+        typename T::Vec m = T::load(mask + i);
+        typename T::Vec vx = T::load(x + i);
+        typename T::Vec vy = T::load(y + i);
+        T::store(f + i, blend<T>(m, T::load(f + i), T::and_(greater<T>(vx, vy), one)));
+        T::store(x + i, blend<T>(m, vx, T::sub(vx, vy)));
+    }
+}
+
+template <class T>
+LANE_TARGET void simdSubn(uint8_t* x, const uint8_t* y, uint8_t* f, const uint8_t* mask, size_t n)
+{
+    typename T::Vec one = T::set1(1);
+    for (size_t i = 0; i < n; i += T::W)
+    {
+        typename T::Vec m = T::load(mask + i);
+        typename T::Vec vx = T::load(x + i);
+        typename T::Vec vy = T::load(y + i);
+        T::store(f + i, blend<T>(m, T::load(f + i), T::and_(greater<T>(vy, vx), one)));
+        T::store(x + i, blend<T>(m, vx, T::sub(vy, vx)));
+    }
+}
+
+template <class T>
+LANE_TARGET void simdShr(uint8_t* x, uint8_t* f, const uint8_t* mask, size_t n)
+{
+    typename T::Vec one = T::set1(1);
+    typename T::Vec low7 = T::set1(0x7F);
+    for (size_t i = 0; i < n; i += T::W)
+    {
+        typename T::Vec m = T::load(mask + i);
+        typename T::Vec vx = T::load(x + i);
+        T::store(f + i, blend<T>(m, T::load(f + i), T::and_(vx, one)));
+        // there is no byte shift, shift words and drop the bit that crossed over
+        T::store(x + i, blend<T>(m, vx, T::and_(T::srlw(vx, 1), low7)));
+    }
+}
+
+template <class T>
+LANE_TARGET void simdShl(uint8_t* x, uint8_t* f, const uint8_t* mask, size_t n)
+{
+    typename T::Vec one = T::set1(1);
+    for (size_t i = 0; i < n; i += T::W)
+    {
+        typename T::Vec m = T::load(mask + i);
+        typename T::Vec vx = T::load(x + i);
+        T::store(f + i, blend<T>(m, T::load(f + i), T::and_(T::srlw(vx, 7), one)));
+        T::store(x + i, blend<T>(m, vx, T::add(vx, vx)));
+    }
+}
+
+/*
+ * pc += 2 on every masked lane, plus 2 more where `skip` is set. Lanes
+ * outside the mask add 0, so no blend is needed.
+ */
+template <class T>
+LANE_TARGET inline void addSkip(uint16_t* pc, typename T::Vec m, typename T::Vec skip)
+{
+    typename T::Vec two = T::set1(2);
+    typename T::Vec delta = T::and_(m, T::add(two, T::and_(skip, two)));
+    T::store(reinterpret_cast<uint8_t*>(pc), T::addw(T::load(reinterpret_cast<uint8_t*>(pc)), T::widenLo(delta)));
+    T::store(reinterpret_cast<uint8_t*>(pc + T::W / 2), T::addw(T::load(reinterpret_cast<uint8_t*>(pc + T::W / 2)), T::widenHi(delta)));
+}
+
+template <class T>
+LANE_TARGET void simdSkipImm(uint16_t* pc, const uint8_t* x, uint8_t kk, bool equal, const uint8_t* mask, size_t n)
+{
+    typename T::Vec k = T::set1(kk);
+    typename T::Vec flip = T::set1(equal ? 0x00 : 0xFF);
+    for (size_t i = 0; i < n; i += T::W)
+        addSkip<T>(pc + i, T::load(mask + i), T::xor_(T::eq(T::load(x + i), k), flip));
+}
+
+template <class T>
+LANE_TARGET void simdSkipReg(uint16_t* pc, const uint8_t* x, const uint8_t* y, bool equal, const uint8_t* mask, size_t n)
+{
+    typename T::Vec flip = T::set1(equal ? 0x00 : 0xFF);
+    for (size_t i = 0; i < n; i += T::W)
+        addSkip<T>(pc + i, T::load(mask + i), T::xor_(T::eq(T::load(x + i), T::load(y + i)), flip));
+}
+
+template <class T>
+LANE_TARGET void simdStepWord(uint16_t* w, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; i += T::W)
+        addSkip<T>(w + i, T::load(mask + i), T::set1(0));
+}
+
+template <class T>
+LANE_TARGET void simdSetWord(uint16_t* w, uint16_t nnn, const uint8_t* mask, size_t n)
+{
+    typename T::Vec k = T::set1w(nnn);
+    for (size_t i = 0; i < n; i += T::W)
+    {
+        typename T::Vec m = T::load(mask + i);
+        uint8_t* lo = reinterpret_cast<uint8_t*>(w + i);
+        uint8_t* hi = reinterpret_cast<uint8_t*>(w + i + T::W / 2);
+        // a byte mask of 0xFF widens to 0x00FF, sign extend it by doubling up
+        T::store(lo, blend<T>(T::or_(T::widenLo(m), T::sllw(T::widenLo(m), 8)), T::load(lo), k));
+        T::store(hi, blend<T>(T::or_(T::widenHi(m), T::sllw(T::widenHi(m), 8)), T::load(hi), k));
+    }
+}
+
+template <class T>
+LANE_TARGET void simdAddIndex(uint16_t* index, const uint8_t* x, uint8_t* f, const uint8_t* mask, size_t n)
+{
+    typename T::Vec high = T::set1w(0xF000);
+    typename T::Vec zero = T::set1(0);
+    typename T::Vec one = T::set1(1);
+    for (size_t i = 0; i < n; i += T::W)
+    {
+        typename T::Vec m = T::load(mask + i);
+        typename T::Vec vx = T::load(x + i);
+        uint8_t* lo = reinterpret_cast<uint8_t*>(index + i);
+        uint8_t* hi = reinterpret_cast<uint8_t*>(index + i + T::W / 2);
+        typename T::Vec iLo = T::load(lo);
+        typename T::Vec iHi = T::load(hi);
+        typename T::Vec sumLo = T::addw(iLo, T::widenLo(vx));
+        typename T::Vec sumHi = T::addw(iHi, T::widenHi(vx));
+
+        // I + x can only pass 0xFFF if either I or the sum has bits above 0xFFF
+        typename T::Vec overLo = T::eqw(T::and_(T::or_(iLo, sumLo), high), zero);
+        typename T::Vec overHi = T::eqw(T::and_(T::or_(iHi, sumHi), high), zero);
+        typename T::Vec over = T::andnot(T::narrow(overLo, overHi), T::set1(0xFF));
+        T::store(f + i, blend<T>(m, T::load(f + i), T::and_(over, one)));
+
+        typename T::Vec mLo = T::or_(T::widenLo(m), T::sllw(T::widenLo(m), 8));
+        typename T::Vec mHi = T::or_(T::widenHi(m), T::sllw(T::widenHi(m), 8));
+        T::store(lo, blend<T>(mLo, iLo, sumLo));
+        T::store(hi, blend<T>(mHi, iHi, sumHi));
+    }
+}
+
+template <class T>
+LANE_TARGET void simdFontIndex(uint16_t* index, const uint8_t* x, const uint8_t* mask, size_t n)
+{
+    for (size_t i = 0; i < n; i += T::W)
+    {
+        typename T::Vec m = T::load(mask + i);
+        typename T::Vec vx = T::load(x + i);
+        uint8_t* lo = reinterpret_cast<uint8_t*>(index + i);
+        uint8_t* hi = reinterpret_cast<uint8_t*>(index + i + T::W / 2);
+        typename T::Vec xLo = T::widenLo(vx);
+        typename T::Vec xHi = T::widenHi(vx);
+        typename T::Vec mLo = T::or_(T::widenLo(m), T::sllw(T::widenLo(m), 8));
+        typename T::Vec mHi = T::or_(T::widenHi(m), T::sllw(T::widenHi(m), 8));
+        // x * 5 == (x << 2) + x
+        T::store(lo, blend<T>(mLo, T::load(lo), T::addw(T::sllw(xLo, 2), xLo)));
+        T::store(hi, blend<T>(mHi, T::load(hi), T::addw(T::sllw(xHi, 2), xHi)));
+    }
+}
+
+/*
+ * Every kernel above instantiated for one traits class, in the order
+ * LaneKernels lists them.
+ */
+#define LANE_KERNEL_TABLE(name, T) \
+    { name, simdMovImm<T>, simdAddImm<T>, simdMov<T>, simdOr<T>, simdAnd<T>, simdXor<T>, \
+      simdAdd<T>, simdSub<T>, simdSubn<T>, simdShr<T>, simdShl<T>, \
+      simdSkipImm<T>, simdSkipReg<T>, simdSetWord<T>, simdStepWord<T>, simdAddIndex<T>, simdFontIndex<T> }
+
+#endif
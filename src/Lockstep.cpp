@@ -0,0 +1,668 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Lockstep.cpp contains the implementation of the Lockstep class.
+ */
+
+#include "Lockstep.h"
+#include "Chip8.h"
+#include "error.h"
+#include <algorithm>
+#include <cstring>
+
+/*
+ * IN:  (uint16_t) opcode
+ * OUT: (bool) true if a LaneKernels kernel can run it for a whole group.
+ *      The kernels compute VF from the old registers and never re-read
+ *      anything, so instructions where VF is also an operand of the
+ *      flag-setting ops are left to runLane, which reproduces runCycle's
+ *      order exactly.
+ */
+static bool vectorisable(uint16_t opcode)
+{
+    int x = (opcode & 0x0F00) >> 8;
+    int y = (opcode & 0x00F0) >> 4;
+
+    switch (opcode & 0xF000)
+    {
+        case 0x1000:
+        case 0x3000:
+        case 0x4000:
+        case 0x5000:
+        case 0x6000:
+        case 0x7000:
+        case 0x9000:
+        case 0xA000:
+            return true;
+        case 0x8000:
+            switch (opcode & 0x000F)
+            {
+                case 0x0000:
+                case 0x0001:
+                case 0x0002:
+                case 0x0003:
+                    return true;
+                case 0x0004:
+                case 0x0005:
+                case 0x0007:
+                    return x != 0xF && y != 0xF;
+                case 0x0006:
+                case 0x000E:
+                    return x != 0xF;
+            }
+            return false;
+        case 0xF000:
+            switch (opcode & 0x00FF)
+            {
+                case 0x0007:
+                case 0x0015:
+                case 0x0018:
+                case 0x0029:
+                    return true;
+                case 0x001E:
+                    return x != 0xF;
+            }
+            return false;
+    }
+    return false;
+}
+
+/*
+ * Constructor
+ *
+ * IN: (size_t) number of lanes
+ *     Every lane starts out like a freshly constructed Chip8: font loaded,
+ *     pc at the start of program memory, RND seeded with 0.
+ */
+Lockstep::Lockstep(size_t lanes)
+    : count(lanes), width((lanes + LANE_ALIGN - 1) / LANE_ALIGN * LANE_ALIGN), cyclesPerFrame(CYCLES_PER_FRAME),
+      kernels(&bestLaneKernels()), V(16 * width), I(width), pc(width, START_PROG_MEM), sp(width),
+      stack(16 * width), delayTimer(width), soundTimer(width), keys(width), rng(width, seedRandom(0)),
+      pixels(width * Y_RES), running(width), image(4096), own(width), memory(width), written(4096),
+      groupAt(4096, -1), mask(width)
+{
+    for (int i = 0; i < 80; ++i)
+        image[i] = chip8Font[i];
+    for (size_t lane = 0; lane < width; ++lane)
+    {
+        running[lane] = lane < count;
+        memory[lane] = image.data();
+    }
+}
+
+/*
+ * IN:  (string) path to the ROM file to play
+ * OUT: (bool) true if the ROM was loaded
+ *      Loads the ROM the same way Chip8::loadROM does (and reports the
+ *      same errors), then puts every lane back at power on, apart from
+ *      their RND generators. Lanes only know the default platform, so a
+ *      ROM that loadROM would run as another one (a .sc8) is refused.
+ */
+bool Lockstep::loadROM(const std::string& romFile)
+{
+    Chip8 loader;
+    if (!loader.loadROM(romFile))
+        return false;
+    if (loader.getPlatform() != Platform::Chip8)
+    {
+        printChip8Error(romFile + " is a " + platformName(loader.getPlatform()) + " program, lanes only run chip8 ones");
+        return false;
+    }
+
+    const Chip8State& fresh = loader.state();
+    std::copy(fresh.memory, fresh.memory + 4096, image.begin());
+
+    std::fill(V.begin(), V.end(), 0);
+    std::fill(I.begin(), I.end(), 0);
+    std::fill(pc.begin(), pc.end(), START_PROG_MEM);
+    std::fill(sp.begin(), sp.end(), 0);
+    std::fill(stack.begin(), stack.end(), 0);
+    std::fill(delayTimer.begin(), delayTimer.end(), 0);
+    std::fill(soundTimer.begin(), soundTimer.end(), 0);
+    std::fill(keys.begin(), keys.end(), 0);
+    std::fill(pixels.begin(), pixels.end(), 0);
+    for (size_t lane = 0; lane < width; ++lane)
+    {
+        running[lane] = lane < count;
+        own[lane].reset();
+        memory[lane] = image.data();
+    }
+    std::fill(written.begin(), written.end(), 0);
+    diag.restart(romFile);
+    return true;
+}
+
+/*
+ * IN:  (string) name of a kernel set
+ * OUT: (bool) false if there is no such set or this CPU can't run it
+ */
+bool Lockstep::useKernels(const std::string& name)
+{
+    const LaneKernels* k = findLaneKernels(name);
+    if (!k)
+        return false;
+    kernels = k;
+    return true;
+}
+
+/*
+ * IN:  (size_t) lane
+ *      (uint64_t) any number
+ * OUT: void
+ *      Same as Chip8::seed for that lane.
+ */
+void Lockstep::seed(size_t lane, uint64_t s)
+{
+    rng[lane] = seedRandom(s);
+}
+
+/*
+ * IN:  (size_t) lane
+ *      (int) the Chip8 key, 0x0 - 0xF
+ *      (bool) true if the key is down
+ * OUT: void
+ */
+void Lockstep::setKey(size_t lane, int k, bool pressed)
+{
+    uint16_t bit = 1 << (k & 0xF);
+    keys[lane] = pressed ? (keys[lane] | bit) : (keys[lane] & ~bit);
+}
+
+/*
+ * IN:  (uint32_t) instructions to run
+ * OUT: (uint64_t) instructions executed, summed over every lane
+ */
+uint64_t Lockstep::step(uint32_t n)
+{
+    uint64_t executed = 0;
+
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        for (size_t lane = 0; lane < count; ++lane)
+            executed += running[lane];
+        stepOnce();
+    }
+    return executed;
+}
+
+/*
+ * IN:  (uint32_t) the number of frames to run
+ * OUT: (uint64_t) instructions executed, summed over every lane
+ *      Like Chip8::runFrames: each frame is `cyclesPerFrame` instructions
+ *      followed by one tick of the timers of every lane still running.
+ */
+uint64_t Lockstep::runFrames(uint32_t frames)
+{
+    uint64_t executed = 0;
+
+    for (uint32_t f = 0; f < frames; ++f)
+    {
+        executed += step(cyclesPerFrame);
+        for (size_t lane = 0; lane < count; ++lane)
+        {
+            if (!running[lane])
+                continue;
+            if (delayTimer[lane] > 0)
+                --delayTimer[lane];
+            if (soundTimer[lane] > 0)
+                --soundTimer[lane];
+        }
+    }
+    return executed;
+}
+
+/*
+ * IN:  (size_t) lane
+ *      (Chip8State&) receives the lane's machine
+ * OUT: void
+ */
+void Lockstep::getState(size_t lane, Chip8State& s) const
+{
+    s.I = I[lane];
+    s.pc = pc[lane];
+    s.sp = sp[lane];
+    for (int i = 0; i < 16; ++i)
+    {
+        s.stack[i] = stack[lane * 16 + i];
+        s.V[i] = V[i * width + lane];
+        s.key[i] = (keys[lane] >> i) & 1;
+    }
+    std::copy(memory[lane], memory[lane] + 4096, s.memory);
+    std::copy(framebuffer(lane), framebuffer(lane) + Y_RES, s.pixels);
+    s.delayTimer = delayTimer[lane];
+    s.soundTimer = soundTimer[lane];
+    s.rng = rng[lane];
+
+    // Lanes only run the default platform, which never leaves low resolution
+    s.hires = 0;
+    std::memset(s.flags, 0, sizeof(s.flags));
+    std::memset(s.hiPixels, 0, sizeof(s.hiPixels));
+}
+
+/*
+ * IN:  (size_t) lane
+ * OUT: (uint64_t) hashState of the lane's machine, comparable with the
+ *      hash of a Chip8 object
+ */
+uint64_t Lockstep::hash(size_t lane) const
+{
+    Chip8State s;
+    getState(lane, s);
+    return hashState(s);
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      Runs one instruction on every running lane. Lanes are bucketed by
+ *      pc with a counting sort, then each bucket runs either through the
+ *      kernels or lane by lane.
+ */
+void Lockstep::stepOnce()
+{
+    groups.clear();
+    for (size_t lane = 0; lane < count; ++lane)
+    {
+        if (!running[lane])
+            continue;
+
+        uint16_t addr = pc[lane];
+        if (addr > END_PROG_MEM || addr < START_PROG_MEM)
+        {
+            diag.report(DiagKind::SegFault, addr, 0);
+            running[lane] = 0;
+            continue;
+        }
+
+        int32_t g = groupAt[addr];
+        if (g < 0)
+        {
+            g = static_cast<int32_t>(groups.size());
+            groupAt[addr] = g;
+            Group fresh = { addr, 0, static_cast<uint32_t>(lane), 0, 0 };
+            groups.push_back(fresh);
+        }
+        ++groups[g].size;
+        groups[g].last = static_cast<uint32_t>(lane);
+    }
+
+    uint32_t offset = 0;
+    for (size_t g = 0; g < groups.size(); ++g)
+    {
+        groups[g].start = offset;
+        offset += groups[g].size;
+        groups[g].size = 0;
+    }
+    order.resize(offset);
+    for (size_t lane = 0; lane < count; ++lane)
+    {
+        if (!running[lane])
+            continue;
+        Group& g = groups[groupAt[pc[lane]]];
+        order[g.start + g.size++] = static_cast<uint32_t>(lane);
+    }
+
+    for (size_t g = 0; g < groups.size(); ++g)
+    {
+        const Group& group = groups[g];
+        groupAt[group.pc] = -1;
+        if (group.size >= MIN_VECTOR_LANES && runGroup(group))
+            continue;
+        for (uint32_t i = 0; i < group.size; ++i)
+        {
+            uint32_t lane = order[group.start + i];
+            runLane(lane, fetch(lane, group.pc));
+        }
+    }
+}
+
+/*
+ * IN:  (const Group&) lanes that are all at the same pc
+ * OUT: (bool) false if the instruction has no kernel, nothing was run
+ *      Runs the group's instruction through the kernels over the
+ *      LANE_ALIGN-rounded span from its first to its last lane. Lanes in
+ *      the span that belong to other groups are masked off. A lane that
+ *      has rewritten its own copy of the instruction runs by itself.
+ */
+bool Lockstep::runGroup(const Group& group)
+{
+    uint16_t opcode = fetch(order[group.start], group.pc);
+    if (!vectorisable(opcode))
+        return false;
+    bool mixed = written[group.pc & 0xFFF] || written[(group.pc + 1) & 0xFFF];
+
+    size_t from = group.first / LANE_ALIGN * LANE_ALIGN;
+    size_t n = (group.last / LANE_ALIGN + 1) * LANE_ALIGN - from;
+    std::fill(mask.begin() + from, mask.begin() + from + n, 0);
+    for (uint32_t i = 0; i < group.size; ++i)
+    {
+        uint32_t lane = order[group.start + i];
+        uint16_t mine = mixed ? fetch(lane, group.pc) : opcode;
+        if (mine == opcode)
+            mask[lane] = 0xFF;
+        else
+            runLane(lane, mine);
+    }
+
+    const uint8_t* m = &mask[from];
+    uint8_t* vx = &V[((opcode & 0x0F00) >> 8) * width + from];
+    uint8_t* vy = &V[((opcode & 0x00F0) >> 4) * width + from];
+    uint8_t* vf = &V[0xF * width + from];
+    uint16_t* p = &pc[from];
+    uint16_t nnn = opcode & 0x0FFF;
+    uint8_t kk = opcode & 0x00FF;
+
+    switch (opcode & 0xF000)
+    {
+        case 0x1000:
+            kernels->setWord(p, nnn, m, n);
+            return true;
+        case 0x3000:
+            kernels->skipImm(p, vx, kk, true, m, n);
+            return true;
+        case 0x4000:
+            kernels->skipImm(p, vx, kk, false, m, n);
+            return true;
+        case 0x5000:
+            kernels->skipReg(p, vx, vy, true, m, n);
+            return true;
+        case 0x9000:
+            kernels->skipReg(p, vx, vy, false, m, n);
+            return true;
+        case 0x6000:
+            kernels->movImm(vx, kk, m, n);
+            break;
+        case 0x7000:
+            kernels->addImm(vx, kk, m, n);
+            break;
+        case 0x8000:
+            switch (opcode & 0x000F)
+            {
+                case 0x0000: kernels->mov(vx, vy, m, n); break;
+                case 0x0001: kernels->orr(vx, vy, m, n); break;
+                case 0x0002: kernels->andr(vx, vy, m, n); break;
+                case 0x0003: kernels->xorr(vx, vy, m, n); break;
+                case 0x0004: kernels->add(vx, vy, vf, m, n); break;
+                case 0x0005: kernels->sub(vx, vy, vf, m, n); break;
+                case 0x0006: kernels->shr(vx, vf, m, n); break;
+                case 0x0007: kernels->subn(vx, vy, vf, m, n); break;
+                case 0x000E: kernels->shl(vx, vf, m, n); break;
+            }
+            break;
+        case 0xA000:
+            kernels->setWord(&I[from], nnn, m, n);
+            break;
+        case 0xF000:
+            switch (opcode & 0x00FF)
+            {
+                case 0x0007: kernels->mov(vx, &delayTimer[from], m, n); break;
+                case 0x0015: kernels->mov(&delayTimer[from], vx, m, n); break;
+                case 0x0018: kernels->mov(&soundTimer[from], vx, m, n); break;
+                case 0x001E: kernels->addIndex(&I[from], vx, vf, m, n); break;
+                case 0x0029: kernels->fontIndex(&I[from], vx, m, n); break;
+            }
+            break;
+    }
+    kernels->stepWord(p, m, n);
+    return true;
+}
+
+/*
+ * IN:  (size_t) lane
+ *      (uint16_t) the opcode at the lane's pc
+ * OUT: void
+ *      Chip8::runCycle, instruction for instruction, on one lane, stack
+ *      and memory wrapping around included.
+ */
+void Lockstep::runLane(size_t lane, uint16_t opcode)
+{
+    uint8_t& vx = reg((opcode & 0x0F00) >> 8, lane);
+    uint8_t& vy = reg((opcode & 0x00F0) >> 4, lane);
+    uint8_t& vf = reg(0xF, lane);
+    uint16_t& p = pc[lane];
+    uint16_t nnn = opcode & 0x0FFF;
+    uint8_t kk = opcode & 0x00FF;
+
+    switch (opcode & 0xF000)
+    {
+        case 0x0000:
+            switch (kk)
+            {
+                case 0x0000:
+                    diag.report(DiagKind::SysCall, p, opcode);
+                    break;
+                case 0x00E0:
+                    std::fill(&pixels[lane * Y_RES], &pixels[lane * Y_RES] + Y_RES, 0);
+                    break;
+                case 0x00EE:
+                    p = stack[lane * 16 + (sp[lane] & 0xF)];
+                    sp[lane] = (sp[lane] - 1) & 0xF;
+                    break;
+                default:
+                    diag.report(DiagKind::Unknown0, p, opcode);
+                    break;
+            }
+            p += 2;
+            break;
+        case 0x1000:
+            p = nnn;
+            break;
+        case 0x2000:
+            sp[lane] = (sp[lane] + 1) & 0xF;
+            stack[lane * 16 + sp[lane]] = p;
+            p = nnn;
+            break;
+        case 0x3000:
+            p += (vx == kk) ? 4 : 2;
+            break;
+        case 0x4000:
+            p += (vx != kk) ? 4 : 2;
+            break;
+        case 0x5000:
+            p += (vx == vy) ? 4 : 2;
+            break;
+        case 0x6000:
+            vx = kk;
+            p += 2;
+            break;
+        case 0x7000:
+            vx += kk;
+            p += 2;
+            break;
+        case 0x8000:
+            switch (opcode & 0x000F)
+            {
+                case 0x0000:
+                    vx = vy;
+                    break;
+                case 0x0001:
+                    vx |= vy;
+                    break;
+                case 0x0002:
+                    vx &= vy;
+                    break;
+                case 0x0003:
+                    vx ^= vy;
+                    break;
+                case 0x0004:
+                    // VF first, then the sum with whatever VX and VY are now
+                    vf = vy > 0xFF - vx ? 1 : 0;
+                    vx = (vx + vy) & 0x00FF;
+                    break;
+                case 0x0005:
+                    vf = vx > vy ? 1 : 0;
+                    vx -= vy;
+                    break;
+                case 0x0006:
+                    vf = vx & 0x1;
+                    vx >>= 1;
+                    break;
+                case 0x0007:
+                    vf = vy > vx ? 1 : 0;
+                    vx = vy - vx;
+                    break;
+                case 0x000E:
+                    vf = vx >> 7;
+                    vx <<= 1;
+                    break;
+                default:
+                    diag.report(DiagKind::Unknown8, p, opcode);
+                    break;
+            }
+            p += 2;
+            break;
+        case 0x9000:
+            p += (vx != vy) ? 4 : 2;
+            break;
+        case 0xA000:
+            I[lane] = nnn;
+            p += 2;
+            break;
+        case 0xB000:
+            p = nnn + reg(0, lane);
+            break;
+        case 0xC000:
+            vx = (nextRandom(rng[lane]) % 0xFF) & kk;
+            p += 2;
+            break;
+        case 0xD000:
+            {
+                // Chip8::drawSprite
+                uint8_t x = vx % X_RES;
+                uint8_t y = vy % Y_RES;
+                uint8_t height = opcode & 0x000F;
+                if (height > Y_RES - y)
+                    height = Y_RES - y;
+
+                uint64_t* rows = &pixels[lane * Y_RES];
+                uint64_t collided = 0;
+                for (uint8_t row = 0; row < height; ++row)
+                {
+                    uint64_t bits = (static_cast<uint64_t>(memory[lane][(I[lane] + row) & 0xFFF]) << 56) >> x;
+                    collided |= rows[y + row] & bits;
+                    rows[y + row] ^= bits;
+                }
+                vf = (collided != 0);
+                p += 2;
+                break;
+            }
+        case 0xE000:
+            switch (kk)
+            {
+                case 0x009E:
+                    p += ((keys[lane] >> (vx & 0xF)) & 1) ? 4 : 2;
+                    break;
+                case 0x00A1:
+                    p += ((keys[lane] >> (vx & 0xF)) & 1) ? 2 : 4;
+                    break;
+                default:
+                    diag.report(DiagKind::UnknownE, p, opcode);
+                    p += 2;
+                    break;
+            }
+            break;
+        case 0xF000:
+            switch (kk)
+            {
+                case 0x0007:
+                    vx = delayTimer[lane];
+                    p += 2;
+                    break;
+                case 0x000A:
+                    // Chip8::waitForKey, the highest key that is down wins
+                    if (keys[lane] == 0)
+                        return;
+                    for (int k = 15; k >= 0; --k)
+                    {
+                        if ((keys[lane] >> k) & 1)
+                        {
+                            vx = k;
+                            break;
+                        }
+                    }
+                    p += 2;
+                    break;
+                case 0x0015:
+                    delayTimer[lane] = vx;
+                    p += 2;
+                    break;
+                case 0x0018:
+                    soundTimer[lane] = vx;
+                    p += 2;
+                    break;
+                case 0x001E:
+                    vf = I[lane] + vx > 0x0FFF ? 1 : 0;
+                    I[lane] += vx;
+                    p += 2;
+                    break;
+                case 0x0029:
+                    I[lane] = vx * 0x5;
+                    p += 2;
+                    break;
+                case 0x0033:
+                    {
+                        uint8_t* mem = writable(lane, I[lane], 3);
+                        uint8_t value = vx;
+                        mem[I[lane] & 0xFFF] = value / 100;
+                        mem[(I[lane] + 1) & 0xFFF] = (value / 10) % 10;
+                        mem[(I[lane] + 2) & 0xFFF] = value % 10;
+                        p += 2;
+                        break;
+                    }
+                case 0x0055:
+                    {
+                        uint8_t* mem = writable(lane, I[lane], ((opcode & 0x0F00) >> 8) + 1);
+                        for (int i = 0; i <= ((opcode & 0x0F00) >> 8); ++i)
+                            mem[(I[lane] + i) & 0xFFF] = reg(i, lane);
+                        p += 2;
+                        break;
+                    }
+                case 0x0065:
+                    for (int i = 0; i <= ((opcode & 0x0F00) >> 8); ++i)
+                        reg(i, lane) = memory[lane][(I[lane] + i) & 0xFFF];
+                    p += 2;
+                    break;
+                default:
+                    diag.report(DiagKind::UnknownF, p, opcode);
+                    p += 2;
+                    break;
+            }
+            break;
+    }
+}
+
+/*
+ * IN:  (size_t) lane
+ *      (uint16_t) address
+ * OUT: (uint16_t) the big-endian opcode at that address in the lane's memory
+ */
+uint16_t Lockstep::fetch(size_t lane, uint16_t addr) const
+{
+    return memory[lane][addr & 0xFFF] << 8 | memory[lane][(addr + 1) & 0xFFF];
+}
+
+/*
+ * IN:  (size_t) lane
+ *      (uint32_t) first address about to be written
+ *      (uint32_t) number of bytes about to be written
+ * OUT: (uint8_t*) the lane's own 4 KB of memory, copied from the shared
+ *      image the first time the lane writes
+ */
+uint8_t* Lockstep::writable(size_t lane, uint32_t addr, uint32_t len)
+{
+    if (!own[lane])
+    {
+        own[lane].reset(new uint8_t[4096]);
+        std::copy(image.begin(), image.end(), own[lane].get());
+        memory[lane] = own[lane].get();
+    }
+    for (uint32_t i = 0; i < len; ++i)
+        written[(addr + i) & 0xFFF] = 1;
+    return own[lane].get();
+}
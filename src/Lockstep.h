@@ -0,0 +1,116 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Lockstep.h contains the class definition for the Lockstep class, which
+ * runs many copies ("lanes") of the same ROM side by side. Instead of one
+ * Chip8State per machine it keeps every register as an array with one
+ * element per lane, so one instruction can be applied to all lanes that
+ * are at the same pc with a handful of vector operations (see
+ * LaneKernels.h).
+ *
+ * Every step the lanes are grouped by pc. A large enough group running a
+ * simple instruction goes through a masked kernel that covers the span
+ * of lanes the group lives in; everything else (small groups, draws,
+ * calls, memory writes...) runs one lane at a time on a scalar copy of
+ * Chip8::runCycle. Lanes behave exactly like separate Chip8 objects
+ * running the interpreter, which is what they are tested against.
+ *
+ * ROM memory is shared until a lane writes to it (FX33, FX55); that lane
+ * then gets a private copy. Only instructions fetched from an address
+ * that some lane has written need their opcode checked lane by lane.
+ */
+
+#ifndef CHIP8_LOCKSTEP_H_
+#define CHIP8_LOCKSTEP_H_
+
+#include "Chip8State.h"
+#include "Diagnostics.h"
+#include "LaneKernels.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Lockstep
+{
+    public:
+        static const uint32_t MIN_VECTOR_LANES = 8; // Smaller groups run lane by lane
+
+        explicit Lockstep(size_t);
+
+        bool loadROM(const std::string&); // Load a ROM and reset every lane
+        bool useKernels(const std::string&); // "scalar", "sse2" or "avx2", false if unavailable
+        const char* kernelName() const { return kernels->name; }
+
+        void seed(size_t, uint64_t);      // Restart one lane's RND generator
+        void setKey(size_t, int, bool);   // Press or release a key on one lane's keypad
+        void setCyclesPerFrame(uint32_t n) { cyclesPerFrame = n; }
+        uint32_t getCyclesPerFrame() const { return cyclesPerFrame; }
+
+        uint64_t step(uint32_t);          // Run n instructions on every running lane
+        uint64_t runFrames(uint32_t);     // Run n frames: instructions, then a timer tick
+
+        size_t lanes() const { return count; }
+        bool isRunning(size_t lane) const { return running[lane] != 0; }
+        const uint64_t* framebuffer(size_t lane) const { return &pixels[lane * Y_RES]; }
+        void getState(size_t, Chip8State&) const; // Copy one lane out as a regular machine
+        uint64_t hash(size_t) const;      // hashState of one lane
+        const Diagnostics& diagnostics() const { return diag; } // Every lane's reports, by address
+    private:
+        struct Group
+        {
+            uint16_t pc;
+            uint32_t size;                // Lanes at this pc
+            uint32_t first;               // Lowest lane
+            uint32_t last;                // Highest lane
+            uint32_t start;               // Offset of its lanes in `order`
+        };
+
+        void stepOnce();
+        bool runGroup(const Group&);      // Vector path, false if it has to go lane by lane
+        void runLane(size_t, uint16_t);   // Scalar copy of Chip8::runCycle for one lane
+        uint16_t fetch(size_t lane, uint16_t addr) const;
+        uint8_t* writable(size_t, uint32_t, uint32_t); // The lane's memory, made private first
+        uint8_t& reg(int x, size_t lane) { return V[x * width + lane]; }
+
+        size_t   count;                   // Lanes in use
+        size_t   width;                   // count rounded up to LANE_ALIGN, the stride of V
+        uint32_t cyclesPerFrame;
+        const LaneKernels* kernels;
+
+        /* one element per lane */
+        std::vector<uint8_t>  V;          // 16 arrays of `width` lanes, V0 first
+        std::vector<uint16_t> I;
+        std::vector<uint16_t> pc;
+        std::vector<uint8_t>  sp;
+        std::vector<uint16_t> stack;      // 16 entries per lane, lane after lane
+        std::vector<uint8_t>  delayTimer;
+        std::vector<uint8_t>  soundTimer;
+        std::vector<uint16_t> keys;       // Bit k set while key k is down
+        std::vector<uint64_t> rng;
+        std::vector<uint64_t> pixels;     // Y_RES rows per lane, lane after lane
+        std::vector<uint8_t>  running;
+
+        /* memory */
+        std::vector<uint8_t> image;       // The loaded ROM, shared by every lane that hasn't written
+        std::vector<std::unique_ptr<uint8_t[]> > own; // Private copies, null while shared
+        std::vector<const uint8_t*> memory; // What each lane reads from
+        std::vector<uint8_t> written;     // Addresses some lane has written, where lanes may disagree
+
+        /* scratch for grouping lanes by pc */
+        std::vector<int32_t>  groupAt;    // Group index of each address, -1 when none
+        std::vector<Group>    groups;
+        std::vector<uint32_t> order;      // Lanes sorted by group
+        std::vector<uint8_t>  mask;       // 0xFF for lanes taking part in a kernel
+
+        Diagnostics diag;                 // Shared by the lanes, which all run the same program
+};
+
+#endif
@@ -0,0 +1,286 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Profiler.cpp contains the bookkeeping for calls and returns and the
+ * two ways of writing a profile out: a flat report for people and a
+ * folded stack file ("root;sub_2F0;DXYN DRW 1234" per line) that
+ * flamegraph.pl, speedscope and similar tools read directly.
+ */
+
+#include "Profiler.h"
+#include "error.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace
+{
+
+const char* const OP_NAMES[OP_COUNT] =
+{
+    "0000 SYS", "00E0 CLS", "00EE RET", "0NNN ???", "1NNN JP", "2NNN CALL",
+    "3XKK SE", "4XKK SNE", "5XY0 SE", "6XKK LD", "7XKK ADD",
+    "8XY0 LD", "8XY1 OR", "8XY2 AND", "8XY3 XOR", "8XY4 ADD", "8XY5 SUB",
+    "8XY6 SHR", "8XY7 SUBN", "8XYE SHL", "8XYN ???", "9XY0 SNE",
+    "ANNN LD I", "BNNN JP V0", "CXKK RND", "DXYN DRW", "EX9E SKP", "EXA1 SKNP", "EXKK ???",
+    "FX07 LD DT", "FX0A LD K", "FX15 LD DT", "FX18 LD ST", "FX1E ADD I", "FX29 LD F",
+    "FX33 LD B", "FX55 LD [I]", "FX65 LD [I]", "FXKK ???", "EXIT"
+};
+
+/*
+ * IN:  (uint64_t) part
+ *      (uint64_t) whole
+ * OUT: (double) part as a percentage of whole
+ */
+double percent(uint64_t part, uint64_t whole)
+{
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+}
+
+/*
+ * Constructor
+ *
+ * IN: void
+ *     Starts out empty, and measures how long reading the clock takes so
+ *     that it can be taken back out of the timed instructions.
+ */
+Profiler::Profiler()
+{
+    reset();
+
+    overhead = ~0ULL;
+    for (int i = 0; i < 1000; ++i)
+    {
+        Clock::time_point a = Clock::now();
+        Clock::time_point b = Clock::now();
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(b - a).count();
+        overhead = std::min(overhead, ns);
+    }
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ */
+void Profiler::reset()
+{
+    std::fill(pcCount, pcCount + 4096, 0);
+    std::fill(opAt, opAt + 4096, 0);
+    for (int pc = 0; pc < 4096; ++pc)
+        kindAt[pc] = decodeOp(0, pc).kind;
+    std::fill(kindCount, kindCount + OP_COUNT, 0);
+    std::fill(kindNanos, kindNanos + OP_COUNT, 0);
+    std::fill(kindSamples, kindSamples + OP_COUNT, 0);
+    std::fill(callCount, callCount + 4096, 0);
+    total = 0;
+    returns = 0;
+    depth = 0;
+    maxDepth = 0;
+
+    Frame root = { 0, 0 };
+    frames.assign(1, root);
+    selfCounts.assign(OP_COUNT, 0);
+    children.clear();
+    frame = 0;
+
+    current = OP_SYS;
+    target = 0;
+    timing = false;
+}
+
+/*
+ * IN:  (uint16_t) address that was called
+ * OUT: void
+ *      Moves into the frame for this address under the current one,
+ *      making it the first time this call path is seen. Programs that
+ *      call without ever returning would grow the tree forever, so past
+ *      MAX_FRAME_DEPTH calls are counted but stay in the deepest frame.
+ */
+void Profiler::call(uint16_t addr)
+{
+    ++callCount[addr & 0xFFF];
+    maxDepth = std::max(maxDepth, ++depth);
+    if (depth > MAX_FRAME_DEPTH)
+        return;
+
+    uint64_t key = static_cast<uint64_t>(frame) << 16 | addr;
+    std::unordered_map<uint64_t, uint32_t>::iterator child = children.find(key);
+    if (child != children.end())
+    {
+        frame = child->second;
+        return;
+    }
+
+    Frame f = { frame, addr };
+    frame = static_cast<uint32_t>(frames.size());
+    frames.push_back(f);
+    selfCounts.resize(selfCounts.size() + OP_COUNT, 0);
+    children[key] = frame;
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      A RET without a matching CALL (the program started somewhere odd,
+ *      or was loaded from a savestate) leaves us at the root.
+ */
+void Profiler::ret()
+{
+    ++returns;
+    if (depth == 0)
+        return;
+    if (depth <= MAX_FRAME_DEPTH)
+        frame = frames[frame].parent;
+    --depth;
+}
+
+/*
+ * IN:  (ostream&) where to write
+ *      (string) what was profiled, for the title
+ * OUT: void
+ *      Instruction kinds by count with their sampled host time, the
+ *      hottest addresses, and subroutines by the instructions spent in
+ *      them and everything they called.
+ */
+void Profiler::report(std::ostream& out, const std::string& name) const
+{
+    char line[160];
+
+    // Estimated host time per kind: its sampled average times its count
+    double estimated[OP_COUNT];
+    double totalTime = 0;
+    for (int k = 0; k < OP_COUNT; ++k)
+    {
+        estimated[k] = kindSamples[k] ? static_cast<double>(kindNanos[k]) / kindSamples[k] * kindCount[k] : 0;
+        totalTime += estimated[k];
+    }
+
+    uint64_t calls = 0;
+    for (int addr = 0; addr < 4096; ++addr)
+        calls += callCount[addr];
+
+    out << "Profile of " << name << ": " << total << " instructions, " << calls << " calls, "
+        << returns << " returns, deepest call stack " << maxDepth << "\n";
+    std::snprintf(line, sizeof(line), "Host time sampled on 1 in %llu instructions, %.1f ns per clock pair removed\n\n",
+            static_cast<unsigned long long>(SAMPLE_EVERY), static_cast<double>(overhead));
+    out << line;
+
+    std::vector<int> kinds;
+    for (int k = 0; k < OP_COUNT; ++k)
+        if (kindCount[k])
+            kinds.push_back(k);
+    std::sort(kinds.begin(), kinds.end(), [this](int a, int b) { return kindCount[a] > kindCount[b]; });
+
+    std::snprintf(line, sizeof(line), "%-14s %14s %7s %10s %7s\n", "instruction", "count", "%", "ns each", "% time");
+    out << line;
+    for (size_t i = 0; i < kinds.size(); ++i)
+    {
+        int k = kinds[i];
+        std::snprintf(line, sizeof(line), "%-14s %14llu %7.2f %10.1f %7.2f\n", OP_NAMES[k],
+                static_cast<unsigned long long>(kindCount[k]), percent(kindCount[k], total),
+                kindSamples[k] ? static_cast<double>(kindNanos[k]) / kindSamples[k] : 0.0,
+                totalTime > 0 ? 100.0 * estimated[k] / totalTime : 0.0);
+        out << line;
+    }
+
+    std::vector<int> pcs;
+    for (int pc = 0; pc < 4096; ++pc)
+        if (pcCount[pc])
+            pcs.push_back(pc);
+    std::sort(pcs.begin(), pcs.end(), [this](int a, int b) { return pcCount[a] > pcCount[b]; });
+    pcs.resize(std::min<size_t>(pcs.size(), 20));
+
+    std::snprintf(line, sizeof(line), "\n%-6s %-6s %-14s %14s %7s\n", "pc", "opcode", "instruction", "count", "%");
+    out << line;
+    for (size_t i = 0; i < pcs.size(); ++i)
+    {
+        int pc = pcs[i];
+        std::snprintf(line, sizeof(line), "0x%03X  %04X   %-14s %14llu %7.2f\n", pc, opAt[pc], OP_NAMES[kindAt[pc]],
+                static_cast<unsigned long long>(pcCount[pc]), percent(pcCount[pc], total));
+        out << line;
+    }
+
+    // Instructions spent inside each subroutine, counting whatever it
+    // called, but counting a recursive subroutine only once per path
+    std::vector<uint64_t> inclusive(4096, 0);
+    for (size_t f = 1; f < frames.size(); ++f)
+    {
+        uint64_t self = 0;
+        for (int k = 0; k < OP_COUNT; ++k)
+            self += selfCounts[f * OP_COUNT + k];
+
+        std::vector<uint16_t> seen;
+        for (uint32_t g = static_cast<uint32_t>(f); g != 0; g = frames[g].parent)
+        {
+            uint16_t addr = frames[g].addr & 0xFFF;
+            if (std::find(seen.begin(), seen.end(), addr) == seen.end())
+            {
+                seen.push_back(addr);
+                inclusive[addr] += self;
+            }
+        }
+    }
+
+    std::vector<int> subs;
+    for (int addr = 0; addr < 4096; ++addr)
+        if (callCount[addr])
+            subs.push_back(addr);
+    std::sort(subs.begin(), subs.end(), [&inclusive](int a, int b) { return inclusive[a] > inclusive[b]; });
+    subs.resize(std::min<size_t>(subs.size(), 20));
+
+    std::snprintf(line, sizeof(line), "\n%-10s %14s %14s %7s\n", "subroutine", "calls", "instructions", "%");
+    out << line;
+    for (size_t i = 0; i < subs.size(); ++i)
+    {
+        int addr = subs[i];
+        std::snprintf(line, sizeof(line), "0x%03X      %14llu %14llu %7.2f\n", addr, static_cast<unsigned long long>(callCount[addr]),
+                static_cast<unsigned long long>(inclusive[addr]), percent(inclusive[addr], total));
+        out << line;
+    }
+}
+
+/*
+ * IN:  (string) file to write
+ *      (string) name for the bottom of every stack, usually the ROM
+ * OUT: (bool) false if the file couldn't be written
+ *      One line per call path and instruction kind with the number of
+ *      instructions of that kind executed directly in that subroutine.
+ */
+bool Profiler::writeFolded(const std::string& path, const std::string& root) const
+{
+    std::ofstream out(path.c_str());
+    if (!out)
+    {
+        printChip8Error("Failed to write profile \"" + path + "\"");
+        return false;
+    }
+
+    std::string base = root.substr(root.find_last_of("/\\") + 1);
+    std::replace(base.begin(), base.end(), ';', '_');
+    std::replace(base.begin(), base.end(), ' ', '_');
+
+    std::vector<std::string> names(frames.size());
+    names[0] = base;
+    for (size_t f = 1; f < frames.size(); ++f)
+    {
+        // A frame's parent always comes before it
+        char sub[16];
+        std::snprintf(sub, sizeof(sub), ";sub_%03X", frames[f].addr & 0xFFF);
+        names[f] = names[frames[f].parent] + sub;
+    }
+
+    for (size_t f = 0; f < frames.size(); ++f)
+        for (int k = 0; k < OP_COUNT; ++k)
+            if (selfCounts[f * OP_COUNT + k])
+                out << names[f] << ';' << OP_NAMES[k] << ' ' << selfCounts[f * OP_COUNT + k] << '\n';
+
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,136 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Profiler.h contains the class definition for the Profiler class, which
+ * watches every instruction Chip8::runCycle executes. It counts
+ * instructions per kind (the OpKinds of BlockCache.h) and per address,
+ * follows CALL and RET to know which subroutine each instruction ran in,
+ * and times one instruction in every SAMPLE_EVERY on the host clock to
+ * estimate where the emulator's own time goes.
+ *
+ * The hooks in runCycle only exist when the program is compiled with
+ * CHIP8_PROFILE=1 (`make PROFILE=1`); otherwise there is nothing in the
+ * dispatch loop to pay for. While a profiler is attached every engine
+ * falls back to the interpreter, the only one that looks at instructions
+ * one at a time.
+ */
+
+#ifndef CHIP8_PROFILER_H_
+#define CHIP8_PROFILER_H_
+
+#include "BlockCache.h"
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef CHIP8_PROFILE
+#define CHIP8_PROFILE 0
+#endif
+
+class Profiler
+{
+    public:
+        static const uint64_t SAMPLE_EVERY = 64;    // One instruction in this many is timed, a power of 2
+        static const uint32_t MAX_FRAME_DEPTH = 64; // Deeper calls are folded into the frame at this depth
+
+        Profiler();
+
+        static bool available() { return CHIP8_PROFILE != 0; }
+
+        void enter(uint16_t, uint16_t);             // An instruction at pc is about to run
+        void leave();                               // ...and has finished
+        void reset();                               // Forget everything counted so far
+
+        uint64_t instructions() const { return total; }
+        void report(std::ostream&, const std::string&) const; // Human readable summary
+        bool writeFolded(const std::string&, const std::string&) const; // Stacks for flamegraph.pl and friends
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        struct Frame                                // A subroutine on a particular call path
+        {
+            uint32_t parent;                        // Index of the caller's frame, 0 is the root
+            uint16_t addr;                          // Address that was called
+        };
+
+        void call(uint16_t);                        // A CALL to addr completed
+        void ret();                                 // A RET completed
+
+        uint64_t pcCount[4096];                     // Instructions executed at each address
+        uint16_t opAt[4096];                        // Last opcode seen at each address
+        uint8_t  kindAt[4096];                      // Its OpKind
+        uint64_t kindCount[OP_COUNT];
+        uint64_t kindNanos[OP_COUNT];               // Host time of the timed instructions
+        uint64_t kindSamples[OP_COUNT];             // How many were timed
+        uint64_t callCount[4096];                   // CALLs to each address
+        uint64_t total;
+        uint64_t returns;
+        uint32_t depth;                             // Current depth of the call stack
+        uint32_t maxDepth;
+
+        std::vector<Frame>    frames;               // Every call path seen so far
+        std::vector<uint64_t> selfCounts;           // OP_COUNT counters per frame
+        std::unordered_map<uint64_t, uint32_t> children; // (frame, addr) -> frame
+        uint32_t frame;                             // Frame the machine is in now
+
+        uint8_t  current;                           // OpKind of the instruction that is running
+        uint16_t target;                            // NNN of the instruction that is running
+        bool     timing;                            // The running instruction is being timed
+        Clock::time_point started;
+        uint64_t overhead;                          // ns a pair of clock reads costs by itself
+};
+
+/*
+ * IN:  (uint16_t) pc the instruction was fetched from
+ *      (uint16_t) the opcode
+ * OUT: void
+ */
+inline void Profiler::enter(uint16_t pc, uint16_t opcode)
+{
+    pc &= 0xFFF;
+    if (opAt[pc] != opcode)
+    {
+        opAt[pc] = opcode;
+        kindAt[pc] = decodeOp(opcode, pc).kind;
+    }
+
+    current = kindAt[pc];
+    target = opcode & 0x0FFF;
+    ++pcCount[pc];
+    ++kindCount[current];
+    ++selfCounts[frame * OP_COUNT + current];
+
+    timing = (total++ & (SAMPLE_EVERY - 1)) == 0;
+    if (timing)
+        started = Clock::now();
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ */
+inline void Profiler::leave()
+{
+    if (timing)
+    {
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count();
+        kindNanos[current] += ns > overhead ? ns - overhead : 0;
+        ++kindSamples[current];
+    }
+
+    if (current == OP_CALL)
+        call(target);
+    else if (current == OP_RET)
+        ret();
+}
+
+#endif
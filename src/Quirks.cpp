@@ -0,0 +1,69 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Quirks.cpp contains the names of the platforms and how a ROM's platform
+ * is guessed from its file name.
+ */
+
+#include "Quirks.h"
+#include <cctype>
+
+/*
+ * IN:  (string) a platform name as given on the command line
+ *      (Platform&) set to the matching platform
+ * OUT: (bool) false if the name is not a platform
+ */
+bool platformFromName(const std::string& name, Platform& platform)
+{
+    for (uint8_t p = 0; p < PLATFORM_COUNT; ++p)
+    {
+        if (name == platformName(static_cast<Platform>(p)))
+        {
+            platform = static_cast<Platform>(p);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * IN:  (Platform) a platform
+ * OUT: (const char*) its name on the command line
+ */
+const char* platformName(Platform platform)
+{
+    switch (platform)
+    {
+        case Platform::Chip8:     return "chip8";
+        case Platform::Cosmac:    return "cosmac";
+        case Platform::Chip48:    return "chip48";
+        case Platform::SuperChip: return "schip";
+    }
+    return "unknown";
+}
+
+/*
+ * IN:  (string) path to a ROM file
+ * OUT: (Platform) SuperChip for ".sc8", the default for anything else
+ *      There is no header in a Chip8 program to say what it was written
+ *      for, so the extension is all there is to go on. The other
+ *      platforms share ".ch8" with plain Chip8 programs and have to be
+ *      asked for by name.
+ */
+Platform platformForROM(const std::string& path)
+{
+    size_t dot = path.find_last_of("./");
+    if (dot == std::string::npos || path[dot] != '.')
+        return Platform::Chip8;
+
+    std::string extension = path.substr(dot + 1);
+    for (size_t i = 0; i < extension.size(); ++i)
+        extension[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(extension[i])));
+    return extension == "sc8" ? Platform::SuperChip : Platform::Chip8;
+}
@@ -0,0 +1,103 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Quirks.h contains the platforms the interpreter can behave like and
+ * what sets them apart. The machines that ran Chip8 programs over the
+ * years disagree on a handful of instructions, and programs written for
+ * one often misbehave on another.
+ *
+ * Each platform is a Quirks specialization made of nothing but compile
+ * time constants. Chip8::execute is instantiated once per platform, so
+ * every `if (Q::something)` in it is decided by the compiler and the
+ * loop that runs a platform carries no checks for the others. Which
+ * instantiation runs is picked once per batch of instructions.
+ */
+
+#ifndef CHIP8_QUIRKS_H_
+#define CHIP8_QUIRKS_H_
+
+#include <cstdint>
+#include <string>
+
+enum class Platform : uint8_t
+{
+    Chip8,                            // How this interpreter has always behaved, the default
+    Cosmac,                           // The original interpreter on the COSMAC VIP
+    Chip48,                           // CHIP-48 on the HP-48 calculators
+    SuperChip                         // SUPER-CHIP 1.1, CHIP-48 plus a 128x64 screen
+};
+
+static const uint8_t PLATFORM_COUNT = 4; // For checking platforms read back from files
+
+/* What FX55 and FX65 do to I once they are done */
+enum IndexAdvance
+{
+    KeepI,                            // I is left alone
+    AdvanceX,                         // I += X
+    AdvanceXPlus1                     // I += X + 1, it ends up just past the last register
+};
+
+template <Platform P>
+struct Quirks;
+
+// FX1E's VF and writing VF before the result are this interpreter's own,
+// kept so that nothing recorded with it stops replaying
+template <>
+struct Quirks<Platform::Chip8>
+{
+    static const bool         shiftReadsVY  = false; // 8XY6 and 8XYE shift VY into VX, not VX in place
+    static const IndexAdvance indexAdvance  = KeepI;
+    static const bool         jumpUsesVX    = false; // BXNN jumps to VX + XNN, not V0 + XNN
+    static const bool         logicResetsVF = false; // 8XY1, 8XY2 and 8XY3 clear VF
+    static const bool         addIndexFlags = true;  // FX1E sets VF when I goes past 0xFFF
+    static const bool         exactFlags    = false; // VF is written after the result, and X - X doesn't borrow
+    static const bool         superChip     = false; // 00CN, 00FB - 00FF, DXY0, FX30, FX75 and FX85
+};
+
+template <>
+struct Quirks<Platform::Cosmac>
+{
+    static const bool         shiftReadsVY  = true;
+    static const IndexAdvance indexAdvance  = AdvanceXPlus1;
+    static const bool         jumpUsesVX    = false;
+    static const bool         logicResetsVF = true;
+    static const bool         addIndexFlags = false;
+    static const bool         exactFlags    = true;
+    static const bool         superChip     = false;
+};
+
+template <>
+struct Quirks<Platform::Chip48>
+{
+    static const bool         shiftReadsVY  = false;
+    static const IndexAdvance indexAdvance  = AdvanceX;
+    static const bool         jumpUsesVX    = true;
+    static const bool         logicResetsVF = false;
+    static const bool         addIndexFlags = false;
+    static const bool         exactFlags    = true;
+    static const bool         superChip     = false;
+};
+
+template <>
+struct Quirks<Platform::SuperChip>
+{
+    static const bool         shiftReadsVY  = false;
+    static const IndexAdvance indexAdvance  = KeepI;
+    static const bool         jumpUsesVX    = true;
+    static const bool         logicResetsVF = false;
+    static const bool         addIndexFlags = false;
+    static const bool         exactFlags    = true;
+    static const bool         superChip     = true;
+};
+
+bool platformFromName(const std::string&, Platform&); // "chip8", "cosmac", "chip48" or "schip"
+const char* platformName(Platform);
+Platform platformForROM(const std::string&); // The platform a ROM file's extension says it was written for
+
+#endif
@@ -0,0 +1,420 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Recompiler.cpp contains the tracing and the code generation of the
+ * static recompiler. The C++ it writes for each instruction mirrors the
+ * case of Chip8::runCycle for it statement for statement, including the
+ * order VF is written in, so recompiled code can't drift from the
+ * interpreter in corner cases like VF being the destination.
+ *
+ * Every instruction counts itself off the budget it was given and has a
+ * case in the dispatch switch, so running out of budget part way through
+ * a block, or coming back after the interpreter ran something, carries on
+ * in recompiled code at exactly the right instruction.
+ */
+
+#include "Recompiler.h"
+#include "Aot.h"
+#include <cstdio>
+
+namespace
+{
+
+/*
+ * IN:  (unsigned) register index
+ * OUT: (string) the name of the local that holds it
+ */
+std::string reg(unsigned x)
+{
+    static const char* const NAMES[16] =
+    {
+        "V0", "V1", "V2", "V3", "V4", "V5", "V6", "V7",
+        "V8", "V9", "VA", "VB", "VC", "VD", "VE", "VF"
+    };
+    return NAMES[x & 0xF];
+}
+
+/*
+ * IN:  (unsigned) a value
+ *      (int) digits to show, 3 for an address and 2 for a byte
+ * OUT: (string) it in hex, as a C++ literal
+ */
+std::string hex(unsigned value, int digits = 3)
+{
+    char text[16];
+    std::snprintf(text, sizeof(text), "0x%0*X", digits, value);
+    return text;
+}
+
+}
+
+/*
+ * Constructor
+ *
+ * IN: (const Chip8State&) a machine with its program loaded that hasn't
+ *     run yet
+ */
+Recompiler::Recompiler(const Chip8State& s) : memory(s.memory, s.memory + sizeof(s.memory)), hash(programImageHash(s)),
+                                              reached(4096, false), leader(4096, false), blockAt(4096, -1)
+{
+    trace();
+    split();
+}
+
+/*
+ * IN:  (uint8_t) an OpKind
+ * OUT: (bool) true if it only touches registers, timers, the stack and
+ *      reads memory, so it can be written as C++ over a Chip8State
+ */
+bool Recompiler::translatable(uint8_t kind)
+{
+    switch (kind)
+    {
+        case OP_RET:
+        case OP_JP:
+        case OP_CALL:
+        case OP_SE_KK:
+        case OP_SNE_KK:
+        case OP_SE_XY:
+        case OP_LD_KK:
+        case OP_ADD_KK:
+        case OP_LD_XY:
+        case OP_OR:
+        case OP_AND:
+        case OP_XOR:
+        case OP_ADD_XY:
+        case OP_SUB:
+        case OP_SHR:
+        case OP_SUBN:
+        case OP_SHL:
+        case OP_SNE_XY:
+        case OP_LD_I:
+        case OP_RND:
+        case OP_SKP:
+        case OP_SKNP:
+        case OP_LD_VX_DT:
+        case OP_LD_DT:
+        case OP_LD_ST:
+        case OP_ADD_I:
+        case OP_LD_F:
+        case OP_LD_VX_I:
+            return true;
+    }
+    return false;
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      Marks every instruction reachable from 0x200, and the ones that
+ *      start a block: jump and call targets, return addresses, both
+ *      sides of a skip, and whatever follows an instruction left to the
+ *      interpreter.
+ */
+void Recompiler::trace()
+{
+    std::vector<uint16_t> work;
+    auto mark = [&](uint32_t addr)
+    {
+        if (addr >= START_PROG_MEM && addr < END_PROG_MEM)
+        {
+            leader[addr] = true;
+            work.push_back(static_cast<uint16_t>(addr));
+        }
+    };
+
+    mark(START_PROG_MEM);
+    while (!work.empty())
+    {
+        uint16_t a = work.back();
+        work.pop_back();
+        if (a < START_PROG_MEM || a >= END_PROG_MEM || reached[a])
+            continue;
+        reached[a] = true;
+
+        DecodedOp op = decodeOp(static_cast<uint16_t>(memory[a] << 8 | memory[a + 1]), a);
+        switch (op.kind)
+        {
+            case OP_JP:
+                mark(op.nnn);
+                break;
+            case OP_CALL:
+                mark(op.nnn);
+                mark(a + 2);
+                break;
+            case OP_RET:
+            case OP_JP_V0:
+                break;
+            case OP_SE_KK:
+            case OP_SNE_KK:
+            case OP_SE_XY:
+            case OP_SNE_XY:
+            case OP_SKP:
+            case OP_SKNP:
+                mark(a + 2);
+                mark(a + 4);
+                break;
+            default:
+                if (translatable(op.kind))
+                    work.push_back(a + 2);
+                else
+                    mark(a + 2);
+                break;
+        }
+    }
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      A block runs from a leader up to and including the first
+ *      instruction that transfers control, stopping early before the
+ *      next leader or an instruction left to the interpreter.
+ */
+void Recompiler::split()
+{
+    for (uint32_t a = START_PROG_MEM; a < END_PROG_MEM; ++a)
+    {
+        if (!reached[a] || !leader[a])
+            continue;
+
+        Block b;
+        b.start = static_cast<uint16_t>(a);
+        uint32_t p = a;
+        while (p < END_PROG_MEM)
+        {
+            DecodedOp op = decodeOp(static_cast<uint16_t>(memory[p] << 8 | memory[p + 1]), static_cast<uint16_t>(p));
+            if (!translatable(op.kind))
+                break;
+            b.ops.push_back(op);
+            p += 2;
+            if (endsBlock(op.kind) || leader[p & 0xFFF])
+                break;
+        }
+        b.after = static_cast<uint16_t>(p);
+
+        if (!b.ops.empty())
+        {
+            blockAt[a] = static_cast<int>(blocks.size());
+            blocks.push_back(b);
+        }
+    }
+}
+
+/*
+ * IN:  void
+ * OUT: (size_t) instructions in all the blocks
+ */
+size_t Recompiler::instructionCount() const
+{
+    size_t n = 0;
+    for (size_t b = 0; b < blocks.size(); ++b)
+        n += blocks[b].ops.size();
+    return n;
+}
+
+/*
+ * IN:  void
+ * OUT: (size_t) reachable instructions that are not in any block
+ */
+size_t Recompiler::interpretedCount() const
+{
+    size_t n = 0;
+    for (uint32_t a = 0; a < reached.size(); ++a)
+        n += reached[a] ? 1 : 0;
+    return n - instructionCount();
+}
+
+/*
+ * IN:  (uint16_t) an address
+ * OUT: (string) a statement that goes on there, straight into its block
+ *      if it has one, otherwise back to the caller
+ */
+std::string Recompiler::jumpTo(uint16_t addr) const
+{
+    if (addr < blockAt.size() && blockAt[addr] >= 0)
+        return "goto b_" + hex(addr) + ";";
+    return "{ pc = " + hex(addr) + "; goto leave; }";
+}
+
+/*
+ * IN:  (ostream&) where to write
+ *      (const DecodedOp&) a translatable instruction
+ * OUT: void
+ */
+void Recompiler::writeOp(std::ostream& out, const DecodedOp& op) const
+{
+    std::string x = reg(op.x);
+    std::string y = reg(op.y);
+    std::string kk = hex(op.kk, 2);
+    std::string next = jumpTo(static_cast<uint16_t>(op.pc + 2));
+    std::string skip = jumpTo(static_cast<uint16_t>(op.pc + 4));
+
+    switch (op.kind)
+    {
+        case OP_RET:
+            out << "    pc = static_cast<uint16_t>(s->stack[s->sp & 0xF] + 2);\n    s->sp = (s->sp - 1) & 0xF;\n    goto dispatch;\n";
+            break;
+        case OP_JP:
+            out << "    " << jumpTo(op.nnn) << "\n";
+            break;
+        case OP_CALL:
+            out << "    s->sp = (s->sp + 1) & 0xF;\n    s->stack[s->sp] = " << hex(op.pc) << ";\n    " << jumpTo(op.nnn) << "\n";
+            break;
+        case OP_SE_KK:
+            out << "    if (" << x << " == " << kk << ") " << skip << "\n    " << next << "\n";
+            break;
+        case OP_SNE_KK:
+            out << "    if (" << x << " != " << kk << ") " << skip << "\n    " << next << "\n";
+            break;
+        case OP_SE_XY:
+            out << "    if (" << x << " == " << y << ") " << skip << "\n    " << next << "\n";
+            break;
+        case OP_SNE_XY:
+            out << "    if (" << x << " != " << y << ") " << skip << "\n    " << next << "\n";
+            break;
+        case OP_SKP:
+            out << "    if (s->key[" << x << " & 0xF] != 0) " << skip << "\n    " << next << "\n";
+            break;
+        case OP_SKNP:
+            out << "    if (s->key[" << x << " & 0xF] == 0) " << skip << "\n    " << next << "\n";
+            break;
+        case OP_LD_KK:
+            out << "    " << x << " = " << kk << ";\n";
+            break;
+        case OP_ADD_KK:
+            out << "    " << x << " += " << kk << ";\n";
+            break;
+        case OP_LD_XY:
+            out << "    " << x << " = " << y << ";\n";
+            break;
+        case OP_OR:
+            out << "    " << x << " |= " << y << ";\n";
+            break;
+        case OP_AND:
+            out << "    " << x << " &= " << y << ";\n";
+            break;
+        case OP_XOR:
+            out << "    " << x << " ^= " << y << ";\n";
+            break;
+        case OP_ADD_XY:
+            out << "    VF = " << y << " > 0xFF - " << x << " ? 1 : 0;\n";
+            out << "    " << x << " = (" << x << " + " << y << ") & 0x00FF;\n";
+            break;
+        case OP_SUB:
+            out << "    VF = " << x << " > " << y << " ? 1 : 0;\n";
+            out << "    " << x << " -= " << y << ";\n";
+            break;
+        case OP_SHR:
+            out << "    VF = " << x << " & 0x1;\n";
+            out << "    " << x << " >>= 1;\n";
+            break;
+        case OP_SUBN:
+            out << "    VF = " << y << " > " << x << " ? 1 : 0;\n";
+            out << "    " << x << " = " << y << " - " << x << ";\n";
+            break;
+        case OP_SHL:
+            out << "    VF = " << x << " >> 7;\n";
+            out << "    " << x << " <<= 1;\n";
+            break;
+        case OP_LD_I:
+            out << "    I = " << hex(op.nnn) << ";\n";
+            break;
+        case OP_RND:
+            out << "    " << x << " = (nextRandom(s->rng) % 0xFF) & " << kk << ";\n";
+            break;
+        case OP_LD_VX_DT:
+            out << "    " << x << " = s->delayTimer;\n";
+            break;
+        case OP_LD_DT:
+            out << "    s->delayTimer = " << x << ";\n";
+            break;
+        case OP_LD_ST:
+            out << "    s->soundTimer = " << x << ";\n";
+            break;
+        case OP_ADD_I:
+            out << "    VF = I + " << x << " > 0x0FFF ? 1 : 0;\n";
+            out << "    I += " << x << ";\n";
+            break;
+        case OP_LD_F:
+            out << "    I = " << x << " * 0x5;\n";
+            break;
+        case OP_LD_VX_I:
+            for (unsigned i = 0; i <= op.x; ++i)
+                out << "    " << reg(i) << " = s->memory[(I + " << i << ") & 0xFFF];\n";
+            break;
+    }
+}
+
+/*
+ * IN:  (ostream&) where to write
+ *      (string) the ROM, for the comment at the top
+ * OUT: void
+ */
+void Recompiler::write(std::ostream& out, const std::string& rom) const
+{
+    out << "// Recompiled from " << rom << " by chip8-aot. Don't edit it, run chip8-aot again.\n\n";
+    out << "#include \"Aot.h\"\n\nnamespace\n{\n\n";
+
+    // Zero length arrays aren't C++, a program with no blocks gets one unused entry
+    out << "const uint16_t START[] =\n{";
+    for (size_t b = 0; b < blocks.size(); ++b)
+        out << (b % 12 ? " " : "\n    ") << hex(blocks[b].start) << ",";
+    out << (blocks.empty() ? "\n    0" : "") << "\n};\n\n";
+    out << "const uint16_t END[] =\n{";
+    for (size_t b = 0; b < blocks.size(); ++b)
+        out << (b % 12 ? " " : "\n    ") << hex(blocks[b].after) << ",";
+    out << (blocks.empty() ? "\n    0" : "") << "\n};\n\n";
+
+    out << "uint32_t run(Chip8State* s, uint32_t budget, const uint8_t* dead)\n{\n";
+    for (unsigned i = 0; i < 16; ++i)
+        out << "    uint8_t " << reg(i) << " = s->V[" << i << "];\n";
+    out << "    uint16_t I = s->I;\n    uint16_t pc = s->pc;\n    uint32_t left = budget;\n\n";
+
+    out << "dispatch:\n    switch (pc)\n    {\n";
+    for (size_t b = 0; b < blocks.size(); ++b)
+    {
+        out << "        case " << hex(blocks[b].start) << ": goto b_" << hex(blocks[b].start) << ";\n";
+        for (size_t i = 1; i < blocks[b].ops.size(); ++i)
+            out << "        case " << hex(blocks[b].ops[i].pc) << ": if (dead[" << b << "]) break; goto i_"
+                << hex(blocks[b].ops[i].pc) << ";\n";
+    }
+    out << "        default: break;\n    }\n    goto leave;\n";
+
+    for (size_t b = 0; b < blocks.size(); ++b)
+    {
+        const Block& block = blocks[b];
+        out << "\nb_" << hex(block.start) << ":\n";
+        out << "    if (dead[" << b << "]) { pc = " << hex(block.start) << "; goto leave; }\n";
+        for (size_t i = 0; i < block.ops.size(); ++i)
+        {
+            const DecodedOp& op = block.ops[i];
+            unsigned opcode = memory[op.pc] << 8 | memory[op.pc + 1];
+            char comment[16];
+            std::snprintf(comment, sizeof(comment), "%04X", opcode);
+            if (i > 0)
+                out << "i_" << hex(op.pc) << ":\n";
+            out << "    if (left == 0) { pc = " << hex(op.pc) << "; goto leave; }\n    --left; // " << comment << "\n";
+            writeOp(out, op);
+        }
+        if (!endsBlock(block.ops.back().kind))
+            out << "    " << jumpTo(block.after) << "\n";
+    }
+
+    out << "\nleave:\n";
+    for (unsigned i = 0; i < 16; ++i)
+        out << "    s->V[" << i << "] = " << reg(i) << ";\n";
+    out << "    s->I = I;\n    s->pc = pc;\n    return budget - left;\n}\n\n";
+
+    char line[160];
+    std::snprintf(line, sizeof(line), "const AotModule MODULE = { AOT_ABI_VERSION, sizeof(Chip8State), 0x%016llxULL, %zu, START, END, run };\n",
+            static_cast<unsigned long long>(hash), blocks.size());
+    out << line << "\n}\n\n";
+    out << "extern \"C\" const AotModule* chip8_aot_module()\n{\n    return &MODULE;\n}\n";
+}
@@ -0,0 +1,66 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Recompiler.h contains the class definition for the Recompiler class,
+ * the static recompiler behind chip8-aot. It traces every instruction
+ * reachable from 0x200 through jumps, calls, returns to the instruction
+ * after a call and both sides of every skip, splits them into basic
+ * blocks and writes a C++ translation unit that runs them directly on a
+ * Chip8State (see Aot.h for how it is loaded).
+ *
+ * The V registers and I live in locals for as long as the generated code
+ * runs. Targets that can't be known ahead of time (BNNN, RET) go through
+ * a switch over every translated address. Instructions with effects
+ * outside of the state (DXYN, 00E0, FX0A), memory writes (FX33, FX55)
+ * and bad opcodes are left to the interpreter, as is any code the
+ * program writes later.
+ */
+
+#ifndef CHIP8_RECOMPILER_H_
+#define CHIP8_RECOMPILER_H_
+
+#include "BlockCache.h"
+#include "Chip8State.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+class Recompiler
+{
+    public:
+        Recompiler(const Chip8State&);              // Trace the program loaded in this machine
+
+        void write(std::ostream&, const std::string&) const; // The translation unit, named after the ROM
+        uint64_t imageHash() const { return hash; }
+        size_t blockCount() const { return blocks.size(); }
+        size_t instructionCount() const;            // Instructions translated to C++
+        size_t interpretedCount() const;            // Reachable instructions left to the interpreter
+    private:
+        struct Block
+        {
+            uint16_t start;
+            uint16_t after;                         // Address following the last op
+            std::vector<DecodedOp> ops;             // The last may transfer control, no other does
+        };
+
+        static bool translatable(uint8_t);          // Has C++ equivalent with no outside effects
+        void trace();
+        void split();
+        void writeOp(std::ostream&, const DecodedOp&) const;
+        std::string jumpTo(uint16_t) const;         // Code that continues at an address
+
+        std::vector<uint8_t> memory;                // The program as loaded
+        uint64_t hash;
+        std::vector<bool> reached;                  // An instruction starts here
+        std::vector<bool> leader;                   // A block starts here
+        std::vector<int>  blockAt;                  // Index of the block starting here, -1 if none
+        std::vector<Block> blocks;
+};
+
+#endif
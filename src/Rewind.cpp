@@ -0,0 +1,216 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Rewind.cpp contains the implementation of the Rewind class.
+ *
+ * An encoded delta is a list of runs, each a 2-byte count of bytes that
+ * didn't change, a 2-byte count of bytes that did, and then those bytes
+ * XORed together. Short stretches of unchanged bytes between changes are
+ * cheaper to copy than to start a new run for, so they are kept inside
+ * the run.
+ */
+
+#include "Rewind.h"
+#include <cstring>
+
+static const size_t STATE_BYTES = sizeof(Savestate);
+static const size_t RUN_HEADER  = 4;   // Unchanged count, changed count
+static const size_t MIN_GAP     = RUN_HEADER + 1; // Unchanged bytes that are worth ending a run for
+
+static_assert(STATE_BYTES < 0x10000, "Run lengths are stored in 16 bits");
+
+/*
+ * Constructor
+ *
+ * IN: (size_t) bytes of deltas to keep, the oldest frames are forgotten
+ *     once they no longer fit
+ */
+Rewind::Rewind(size_t bytes) : ring(bytes), scratch(STATE_BYTES + (STATE_BYTES / MIN_GAP + 1) * RUN_HEADER), used(0), haveLatest(false)
+{
+}
+
+/*
+ * IN:  (const Savestate&) the machine after another frame
+ * OUT: void
+ *      Stores how the previous frame differs from this one and keeps this
+ *      one whole.
+ */
+void Rewind::push(const Savestate& s)
+{
+    if (haveLatest)
+    {
+        size_t size = encode(reinterpret_cast<const uint8_t*>(&latest), reinterpret_cast<const uint8_t*>(&s), scratch.data());
+        if (size <= ring.size())
+        {
+            size_t at = reserve(size);
+            std::memcpy(ring.data() + at, scratch.data(), size);
+            Delta d = { at, size };
+            deltas.push_back(d);
+            used += size;
+        }
+        else
+        {
+            // Can't be undone, so nothing before it can be reached either
+            deltas.clear();
+            used = 0;
+        }
+    }
+
+    latest = s;
+    haveLatest = true;
+}
+
+/*
+ * IN:  (Savestate&) set to the frame before the newest one
+ * OUT: (bool) false if there is no older frame left, `s` is untouched
+ *      The newest frame is forgotten, so calling this again keeps going
+ *      back, and a push afterwards carries on from the restored frame.
+ */
+bool Rewind::back(Savestate& s)
+{
+    if (deltas.empty())
+        return false;
+
+    const Delta& d = deltas.back();
+    apply(ring.data() + d.offset, d.size, reinterpret_cast<uint8_t*>(&latest));
+    used -= d.size;
+    deltas.pop_back();
+
+    s = latest;
+    return true;
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ */
+void Rewind::clear()
+{
+    deltas.clear();
+    used = 0;
+    haveLatest = false;
+}
+
+/*
+ * IN:  (size_t) bytes needed
+ * OUT: (size_t) offset in the ring to write them at
+ *      Deltas go one after another and start over at the front when the
+ *      end is reached. Reading the ring from just past the newest delta
+ *      always meets the oldest deltas first, so making room only ever
+ *      forgets frames from the old end of the history.
+ */
+size_t Rewind::reserve(size_t size)
+{
+    size_t start = deltas.empty() ? 0 : deltas.back().offset + deltas.back().size;
+
+    if (start + size > ring.size())
+    {
+        // Whatever is still past `start` is left over from the last time around
+        while (!deltas.empty() && deltas.front().offset >= start)
+        {
+            used -= deltas.front().size;
+            deltas.pop_front();
+        }
+        start = 0;
+    }
+
+    while (!deltas.empty() && deltas.front().offset < start + size && deltas.front().offset + deltas.front().size > start)
+    {
+        used -= deltas.front().size;
+        deltas.pop_front();
+    }
+    return start;
+}
+
+/*
+ * IN:  (const uint8_t*) one savestate
+ *      (const uint8_t*) another savestate
+ *      (uint8_t*) the encoded delta, room for scratch.size() bytes
+ * OUT: (size_t) encoded size
+ *      Identical savestates still get one empty run, so every delta takes
+ *      up some room in the ring and reserve can tell them apart by offset.
+ */
+size_t Rewind::encode(const uint8_t* a, const uint8_t* b, uint8_t* out)
+{
+    uint8_t* o = out;
+    size_t i = 0;
+
+    while (i < STATE_BYTES)
+    {
+        size_t from = i;
+
+        // Unchanged bytes, eight at a time while possible
+        uint64_t wa, wb;
+        for (; i + 8 <= STATE_BYTES; i += 8)
+        {
+            std::memcpy(&wa, a + i, 8);
+            std::memcpy(&wb, b + i, 8);
+            if (wa != wb)
+                break;
+        }
+        while (i < STATE_BYTES && a[i] == b[i])
+            ++i;
+        if (i == STATE_BYTES && o != out)
+            break;
+
+        // Changed bytes, up to the next gap long enough to end the run on
+        size_t first = i;
+        size_t end = i;
+        while (end < STATE_BYTES)
+        {
+            if (a[end] != b[end])
+            {
+                ++end;
+                continue;
+            }
+            size_t same = end;
+            while (same < STATE_BYTES && same - end < MIN_GAP && a[same] == b[same])
+                ++same;
+            if (same == STATE_BYTES || same - end >= MIN_GAP)
+                break;
+            end = same;
+        }
+
+        uint16_t skip = static_cast<uint16_t>(first - from);
+        uint16_t len = static_cast<uint16_t>(end - first);
+        std::memcpy(o, &skip, 2);
+        std::memcpy(o + 2, &len, 2);
+        o += RUN_HEADER;
+        for (size_t k = first; k < end; ++k)
+            *o++ = a[k] ^ b[k];
+        i = end;
+    }
+    return o - out;
+}
+
+/*
+ * IN:  (const uint8_t*) an encoded delta
+ *      (size_t) its size
+ *      (uint8_t*) a savestate it was made from, turned into the other one
+ * OUT: void
+ */
+void Rewind::apply(const uint8_t* delta, size_t size, uint8_t* s)
+{
+    const uint8_t* end = delta + size;
+    size_t pos = 0;
+
+    while (delta < end)
+    {
+        uint16_t skip, len;
+        std::memcpy(&skip, delta, 2);
+        std::memcpy(&len, delta + 2, 2);
+        delta += RUN_HEADER;
+
+        pos += skip;
+        for (uint16_t k = 0; k < len; ++k)
+            s[pos + k] ^= delta[k];
+        pos += len;
+        delta += len;
+    }
+}
@@ -0,0 +1,65 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Rewind.h contains the class definition for the Rewind class, a fixed
+ * size history of savestates, one per frame, for stepping a machine
+ * backwards.
+ *
+ * Only the newest savestate is kept whole. Every older frame is stored
+ * as the XOR of itself and the frame after it, run length encoded: a
+ * frame usually changes a few registers, a timer and a couple of rows of
+ * the screen, so most of the XOR is zeros and a frame costs tens of bytes
+ * instead of 4.5 KB. Going back one frame XORs one delta into the newest
+ * savestate, which costs about as much as the delta is long. When the
+ * buffer is full the oldest frames are forgotten.
+ */
+
+#ifndef CHIP8_REWIND_H_
+#define CHIP8_REWIND_H_
+
+#include "Savestate.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+class Rewind
+{
+    public:
+        static const size_t DEFAULT_BYTES = 4 * 1024 * 1024; // 25 minutes or more of the bundled games
+
+        explicit Rewind(size_t bytes = DEFAULT_BYTES);
+
+        void push(const Savestate&);      // Remember a frame, after every frame so far
+        bool back(Savestate&);            // Forget the newest frame and hand back the one before it
+        void clear();                     // Forget everything
+
+        size_t frames() const { return haveLatest ? deltas.size() + 1 : 0; } // Frames remembered
+        size_t bytesUsed() const { return used; } // Ring bytes holding deltas
+        size_t capacity() const { return ring.size(); }
+    private:
+        struct Delta
+        {
+            size_t offset;                // Where it starts in the ring
+            size_t size;                  // Encoded bytes
+        };
+
+        size_t reserve(size_t);           // Make room for a delta, forgetting old ones
+        static size_t encode(const uint8_t*, const uint8_t*, uint8_t*); // XOR two savestates, run length encoded
+        static void apply(const uint8_t*, size_t, uint8_t*); // XOR an encoded delta into a savestate
+
+        std::vector<uint8_t> ring;        // Encoded deltas, never wrapping around the end
+        std::deque<Delta>    deltas;      // Oldest first; deltas.back() turns latest into the frame before
+        std::vector<uint8_t> scratch;     // Worst case encoding of one delta
+        size_t               used;        // Sum of the sizes in `deltas`
+        Savestate            latest;      // The newest frame, whole
+        bool                 haveLatest;
+};
+
+#endif
@@ -0,0 +1,251 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * RomCatalog.cpp contains the implementation of the RomCatalog: mapping
+ * ROM files, walking directories of them and matching golden input logs
+ * up with the ROMs they were recorded with.
+ */
+
+#include "RomCatalog.h"
+#include "InputLog.h"
+#include "error.h"
+#include <algorithm>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CHIP8_MMAP 1
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define CHIP8_MMAP 0
+#include <iterator>
+#endif
+
+static const size_t PROGRAM_SPACE = END_PROG_MEM + 1 - START_PROG_MEM; // Biggest ROM that fits
+
+/*
+ * IN:  (string) a directory
+ *      (string) only names ending in this, empty for all of them
+ * OUT: (vector<string>) the paths of the files in it, sorted, without
+ *      hidden ones
+ */
+static std::vector<std::string> listDirectory(const std::string& dir, const std::string& suffix)
+{
+    std::vector<std::string> paths;
+#if CHIP8_MMAP
+    DIR* d = opendir(dir.c_str());
+    if (!d)
+    {
+        printChip8Error("Unable to open directory " + dir);
+        return paths;
+    }
+    while (dirent* entry = readdir(d))
+    {
+        std::string name = entry->d_name;
+        if (name[0] == '.')
+            continue;
+        if (name.size() < suffix.size() || name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+            continue;
+        paths.push_back(dir + "/" + name);
+    }
+    closedir(d);
+    std::sort(paths.begin(), paths.end());
+#else
+    (void)suffix;
+    printChip8Error("Unable to list " + dir + ", add its ROMs one at a time");
+#endif
+    return paths;
+}
+
+/*
+ * Default Constructor
+ *
+ * IN: void
+ *     An empty catalog.
+ */
+RomCatalog::RomCatalog()
+{
+}
+
+/*
+ * Destructor
+ *
+ *     Unmaps every ROM. The entries go with it; machines loaded from
+ *     them keep their own copy.
+ */
+RomCatalog::~RomCatalog()
+{
+#if CHIP8_MMAP
+    for (size_t i = 0; i < mappings.size(); ++i)
+        munmap(mappings[i].address, mappings[i].length);
+#endif
+}
+
+/*
+ * IN:  (string) path to a ROM file
+ * OUT: (const RomEntry*) its entry, nullptr if the file can't be read or
+ *      doesn't fit in program memory
+ *      A file with the same contents as one already in the catalog is
+ *      not kept; its path becomes another name for the existing entry.
+ */
+const RomEntry* RomCatalog::add(const std::string& path)
+{
+    std::unordered_map<std::string, size_t>::const_iterator known = byPath.find(path);
+    if (known != byPath.end())
+        return &entries[known->second];
+
+#if CHIP8_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        if (fd >= 0)
+            ::close(fd);
+        printChip8Error("Failed to open \"" + path + "\"");
+        return nullptr;
+    }
+    size_t length = static_cast<size_t>(st.st_size);
+    if (length == 0 || length > PROGRAM_SPACE)
+    {
+        ::close(fd);
+        printChip8Error("\"" + path + "\" is " + (length == 0 ? "empty" : "too large for program memory space"));
+        return nullptr;
+    }
+
+    void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED)
+    {
+        printChip8Error("Failed to map \"" + path + "\"");
+        return nullptr;
+    }
+    const uint8_t* data = static_cast<const uint8_t*>(address);
+#else
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin.is_open())
+    {
+        printChip8Error("Failed to open \"" + path + "\"");
+        return nullptr;
+    }
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+    size_t length = bytes.size();
+    if (length == 0 || length > PROGRAM_SPACE)
+    {
+        printChip8Error("\"" + path + "\" is " + (length == 0 ? "empty" : "too large for program memory space"));
+        return nullptr;
+    }
+    const uint8_t* data = bytes.data();
+#endif
+
+    uint64_t hash = hashBytes(data, length);
+    std::unordered_map<uint64_t, size_t>::const_iterator same = byHash.find(hash);
+    if (same != byHash.end())
+    {
+#if CHIP8_MMAP
+        munmap(address, length);
+#endif
+        byPath[path] = same->second;
+        return &entries[same->second];
+    }
+
+#if CHIP8_MMAP
+    Mapping m = { address, length };
+    mappings.push_back(m);
+#else
+    copies.push_back(std::vector<uint8_t>());
+    copies.back().swap(bytes); // The buffer moves with it, so data stays good
+#endif
+
+    RomEntry entry;
+    entry.path = path;
+    entry.hash = hash;
+    entry.data = data;
+    entry.size = static_cast<uint32_t>(length);
+    entry.platform = platformForROM(path);
+    entry.cyclesPerFrame = 0;
+    entry.goldenFrames = 0;
+    entry.goldenHash = 0;
+
+    byHash[hash] = entries.size();
+    byPath[path] = entries.size();
+    entries.push_back(entry);
+    return &entries.back();
+}
+
+/*
+ * IN:  (string) a directory of ROMs, such as rom/
+ * OUT: (size_t) how many of its files are now in the catalog
+ *      Every file that isn't hidden is taken to be a ROM. Files that
+ *      can't be are reported and skipped.
+ */
+size_t RomCatalog::scan(const std::string& dir)
+{
+    std::vector<std::string> paths = listDirectory(dir, "");
+    size_t added = 0;
+    for (size_t i = 0; i < paths.size(); ++i)
+        if (add(paths[i]))
+            ++added;
+    return added;
+}
+
+/*
+ * IN:  (string) a directory of input logs, such as golden/
+ * OUT: (size_t) how many of the ".c8i" logs in it were recorded with a
+ *      ROM in the catalog
+ *      Each matching entry takes the log's platform and instructions per
+ *      frame, and remembers the log and the hash it ends on. Add the
+ *      ROMs first; logs for ROMs that aren't in the catalog are skipped.
+ */
+size_t RomCatalog::addGoldens(const std::string& dir)
+{
+    std::vector<std::string> paths = listDirectory(dir, ".c8i");
+    size_t matched = 0;
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        InputLog log;
+        if (!readInputLog(paths[i], log))
+            continue;
+
+        std::unordered_map<uint64_t, size_t>::const_iterator found = byHash.find(log.romHash);
+        if (found == byHash.end())
+            continue;
+
+        RomEntry& entry = entries[found->second];
+        entry.platform = log.platform;
+        entry.cyclesPerFrame = log.cyclesPerFrame;
+        entry.golden = paths[i];
+        entry.goldenFrames = log.frames;
+        entry.goldenHash = log.finalHash;
+        ++matched;
+    }
+    return matched;
+}
+
+/*
+ * IN:  (uint64_t) hashBytes of a ROM image
+ * OUT: (const RomEntry*) the ROM with those contents, or nullptr
+ */
+const RomEntry* RomCatalog::find(uint64_t hash) const
+{
+    std::unordered_map<uint64_t, size_t>::const_iterator found = byHash.find(hash);
+    return found == byHash.end() ? nullptr : &entries[found->second];
+}
+
+/*
+ * IN:  (string) a path exactly as it was given to add or found by scan
+ * OUT: (const RomEntry*) the ROM at that path, or nullptr
+ */
+const RomEntry* RomCatalog::find(const std::string& path) const
+{
+    std::unordered_map<std::string, size_t>::const_iterator found = byPath.find(path);
+    return found == byPath.end() ? nullptr : &entries[found->second];
+}
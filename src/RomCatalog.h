@@ -0,0 +1,81 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * RomCatalog.h contains the class definition for the RomCatalog, a set of
+ * ROM images mapped into memory once and shared by any number of
+ * machines. Each file is mapped read-only with mmap and indexed by the
+ * hashBytes of its contents, the same hash input logs record, so two
+ * copies of one ROM are one entry and a log can find its ROM whatever it
+ * is called. Loading an entry into a Chip8 is a single memcpy out of the
+ * page cache; nothing is read through iostreams after the catalog is
+ * built.
+ *
+ * Golden input logs added with addGoldens fill in what they know about
+ * their ROM: the platform it runs as, the instructions per frame it was
+ * recorded at and the hash it has to end on.
+ *
+ * A catalog is built on one thread and can then be read from any number
+ * of threads at once.
+ */
+
+#ifndef CHIP8_ROMCATALOG_H_
+#define CHIP8_ROMCATALOG_H_
+
+#include "Quirks.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct RomEntry
+{
+    std::string    path;              // Where it was first found
+    uint64_t       hash;              // hashBytes of the image, the catalog's key
+    const uint8_t* data;              // The image, in the catalog's mapping
+    uint32_t       size;              // Bytes in the image
+    Platform       platform;          // platformForROM, or a golden log's
+    uint32_t       cyclesPerFrame;    // Preferred speed from a golden log, 0 if there is none
+    std::string    golden;            // Golden input log for it, empty if there is none
+    uint32_t       goldenFrames;      // Frames the golden log runs for
+    uint64_t       goldenHash;        // Rolling hash the golden log ends on
+};
+
+class RomCatalog
+{
+    public:
+        RomCatalog();
+        ~RomCatalog();
+
+        const RomEntry* add(const std::string&); // Map one ROM file, nullptr if it can't be; good until the next add
+        size_t scan(const std::string&);  // Map every ROM in a directory, returns how many
+        size_t addGoldens(const std::string&); // Read every input log in a directory, returns how many matched a ROM
+        const RomEntry* find(uint64_t) const; // By content hash, nullptr if there is none
+        const RomEntry* find(const std::string&) const; // By any path it was added under
+        size_t size() const { return entries.size(); }
+        const RomEntry& operator[](size_t i) const { return entries[i]; }
+    private:
+        RomCatalog(const RomCatalog&);    // Not copyable
+        RomCatalog& operator=(const RomCatalog&);
+
+        /* One mapped file */
+        struct Mapping
+        {
+            void*  address;
+            size_t length;
+        };
+
+        std::vector<RomEntry> entries;    // In the order they were added
+        std::unordered_map<uint64_t, size_t> byHash; // Content hash to entry
+        std::unordered_map<std::string, size_t> byPath; // Every path added to entry, copies included
+        std::vector<Mapping> mappings;    // Unmapped in the destructor
+        std::vector<std::vector<uint8_t> > copies; // The files read into memory where there is no mmap
+};
+
+#endif
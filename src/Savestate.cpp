@@ -0,0 +1,193 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Savestate.cpp contains the checks, file writing and file mapping for
+ * savestates. Chip8::saveState and Chip8::loadState fill in and apply
+ * them.
+ */
+
+#include "Savestate.h"
+#include "Quirks.h"
+#include "error.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CHIP8_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define CHIP8_MMAP 0
+#include <iterator>
+#endif
+
+/*
+ * IN:  (const Savestate&) a savestate from anywhere (a file, a buffer)
+ * OUT: (bool) true if it was written by this version of the program and
+ *      its hash matches. The registers that index arrays are checked too
+ *      so a damaged file can't send the machine outside of its memory.
+ */
+bool checkSavestate(const Savestate& s)
+{
+    const SavestateHeader& h = s.header;
+    if (std::memcmp(h.magic, SAVESTATE_MAGIC, sizeof(h.magic)) != 0)
+    {
+        printChip8Error("Not a savestate");
+        return false;
+    }
+    if (h.version != SAVESTATE_VERSION || h.headerSize != sizeof(SavestateHeader) || h.stateSize != sizeof(Chip8State))
+    {
+        printChip8Error("Savestate was written by a different version of " + PROG_NAME);
+        return false;
+    }
+    if (h.hash != hashState(s.state))
+    {
+        printChip8Error("Savestate is damaged");
+        return false;
+    }
+    if (s.state.sp > 16 || s.state.pc > END_PROG_MEM - 1)
+    {
+        printChip8Error("Savestate has an impossible stack pointer or program counter");
+        return false;
+    }
+    if (h.platform >= PLATFORM_COUNT)
+    {
+        printChip8Error("Savestate is for a platform this version of " + PROG_NAME + " doesn't know");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * IN:  (const void*) bytes holding a savestate, aligned for a uint64_t
+ *      (size_t) number of bytes
+ * OUT: (const Savestate*) the savestate in place, or nullptr if the
+ *      buffer doesn't hold a good one
+ */
+const Savestate* viewSavestate(const void* data, size_t size)
+{
+    if (size < sizeof(Savestate) || reinterpret_cast<uintptr_t>(data) % alignof(Savestate) != 0)
+    {
+        printChip8Error("Savestate is truncated or misaligned");
+        return nullptr;
+    }
+
+    const Savestate* s = static_cast<const Savestate*>(data);
+    return checkSavestate(*s) ? s : nullptr;
+}
+
+/*
+ * IN:  (string) file to write, replaced if it exists
+ *      (const Savestate&) what to write
+ * OUT: (bool) false if the file couldn't be written
+ */
+bool writeSavestate(const std::string& path, const Savestate& s)
+{
+    std::ofstream fout(path, std::ios::binary | std::ios::trunc);
+    if (fout.is_open())
+        fout.write(reinterpret_cast<const char*>(&s), sizeof(s));
+    if (!fout.is_open() || !fout.good())
+    {
+        printChip8Error("Failed to write savestate \"" + path + "\"");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Constructor
+ *
+ * IN: void
+ *     Nothing is mapped until open.
+ */
+SavestateFile::SavestateFile() : mapping(nullptr), length(0), savestate(nullptr)
+{
+}
+
+/*
+ * Destructor
+ *
+ *     Unmaps the file.
+ */
+SavestateFile::~SavestateFile()
+{
+    close();
+}
+
+/*
+ * IN:  (string) savestate file
+ * OUT: (bool) false if the file can't be read or isn't a good savestate
+ *      Maps the file read-only and checks it. Whatever was open before is
+ *      closed first.
+ */
+bool SavestateFile::open(const std::string& path)
+{
+    close();
+
+#if CHIP8_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        if (fd >= 0)
+            ::close(fd);
+        printChip8Error("Failed to open \"" + path + "\"");
+        return false;
+    }
+
+    length = static_cast<size_t>(st.st_size);
+    if (length > 0)
+    {
+        mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED)
+            mapping = nullptr;
+    }
+    ::close(fd);
+    const void* data = mapping;
+#else
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin.is_open())
+    {
+        printChip8Error("Failed to open \"" + path + "\"");
+        return false;
+    }
+    copy.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+    length = copy.size();
+    const void* data = copy.data();
+#endif
+
+    if (data)
+        savestate = viewSavestate(data, length);
+    else
+        printChip8Error("Failed to map \"" + path + "\"");
+
+    if (!savestate)
+        close();
+    return savestate != nullptr;
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      Unmaps the file, get() returns nullptr afterwards.
+ */
+void SavestateFile::close()
+{
+#if CHIP8_MMAP
+    if (mapping)
+        munmap(mapping, length);
+#endif
+    mapping = nullptr;
+    length = 0;
+    copy.clear();
+    savestate = nullptr;
+}
@@ -0,0 +1,89 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Savestate.h contains the savestate format and the functions that read
+ * and write it. A savestate is a small fixed header followed by the raw
+ * Chip8State, exactly as it sits in memory, so saving is one copy and a
+ * file mapped with mmap can be used in place without parsing anything.
+ *
+ * Since the state is written raw, savestates are only portable between
+ * builds with the same byte order and struct layout. The header records
+ * the sizes so a mismatch is refused instead of misread, and any change
+ * to Chip8State must bump SAVESTATE_VERSION.
+ */
+
+#ifndef CHIP8_SAVESTATE_H_
+#define CHIP8_SAVESTATE_H_
+
+#include "Chip8State.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+static const char     SAVESTATE_MAGIC[4]  = { 'C', '8', 'S', 'S' };
+static const uint16_t SAVESTATE_VERSION   = 2;
+
+static const uint32_t SAVESTATE_RUNNING   = 0x1; // The machine had not halted
+static const uint32_t SAVESTATE_WAITING   = 0x2; // Blocked on FX0A
+
+struct SavestateHeader
+{
+    char        magic[4];             // SAVESTATE_MAGIC
+    uint16_t    version;              // SAVESTATE_VERSION
+    uint16_t    headerSize;           // sizeof(SavestateHeader)
+    uint32_t    stateSize;            // sizeof(Chip8State)
+    uint32_t    flags;                // SAVESTATE_RUNNING | SAVESTATE_WAITING
+    uint32_t    cyclesPerFrame;
+    uint32_t    platform;             // Platform the machine was running as
+    uint64_t    hash;                 // hashState of `state`, catches truncated or damaged files
+};
+
+/*
+ * Everything needed to put a Chip8 back where it was, and the exact bytes
+ * of a savestate file.
+ */
+struct Savestate
+{
+    SavestateHeader header;
+    Chip8State      state;
+};
+
+static_assert(sizeof(SavestateHeader) == 32, "The savestate header is part of the file format");
+static_assert(offsetof(Savestate, state) == sizeof(SavestateHeader), "The state follows the header directly");
+
+bool checkSavestate(const Savestate&);  // Right magic, version, sizes and hash
+const Savestate* viewSavestate(const void*, size_t); // The savestate in a buffer, or nullptr
+bool writeSavestate(const std::string&, const Savestate&); // Save to a file
+
+/*
+ * A savestate file mapped into memory read-only. The savestate is used
+ * straight out of the page cache; nothing is copied until it is loaded
+ * into a Chip8.
+ */
+class SavestateFile
+{
+    public:
+        SavestateFile();
+        ~SavestateFile();
+
+        bool open(const std::string&);    // Map and check a savestate file
+        void close();
+        const Savestate* get() const { return savestate; } // nullptr unless open succeeded
+    private:
+        SavestateFile(const SavestateFile&);           // Not copyable
+        SavestateFile& operator=(const SavestateFile&);
+
+        void*            mapping;         // The whole file
+        size_t           length;          // Bytes mapped
+        std::vector<uint8_t> copy;        // The file read into memory where there is no mmap
+        const Savestate* savestate;       // Points into mapping (or copy) once checked
+};
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Scheduler.cpp contains the implementation of the Scheduler class.
+ */
+
+#include "Scheduler.h"
+#include <thread>
+
+/*
+ * How close to a deadline the scheduler stops sleeping and starts
+ * yielding instead. OS sleeps tend to overshoot by a few tens of
+ * microseconds; yielding for the last stretch keeps frames on time
+ * while costing a couple of percent of a core at most.
+ */
+static const std::chrono::microseconds SLEEP_SLACK(250);
+
+/*
+ * Constructor
+ *
+ * IN: (uint32_t) frames per second
+ *     The first frame is due right away.
+ */
+Scheduler::Scheduler(uint32_t hz)
+    : hz(hz), speed(1), period(std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(1000000000 / hz))),
+      next(Clock::now()), dropped(0)
+{
+}
+
+/*
+ * IN:  void
+ * OUT: (uint32_t) the number of frames that are due, 0 if it is too early
+ *      Every frame returned is counted as done. After a stall (the window
+ *      being dragged, the machine sleeping...) at most MAX_CATCH_UP frames
+ *      worth of time are handed out and the rest are dropped, so a slow
+ *      host falls behind gracefully instead of spiralling into ever longer
+ *      catch up. With no speed limit it is always TURBO_BATCH.
+ */
+uint32_t Scheduler::framesDue()
+{
+    if (speed == 0)
+        return TURBO_BATCH;
+
+    Clock::time_point now = Clock::now();
+    if (now < next)
+        return 0;
+
+    uint64_t limit = static_cast<uint64_t>(MAX_CATCH_UP) * speed;
+    uint64_t due = (now - next) / period + 1;
+    if (due > limit)
+    {
+        dropped += due - limit;
+        next += period * (due - limit);
+        due = limit;
+    }
+    next += period * due;
+    return static_cast<uint32_t>(due);
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      Sleeps until the next frame is due. The bulk of the wait is a
+ *      regular sleep so an idle emulator costs no CPU time; only the
+ *      final SLEEP_SLACK is spent yielding. With no speed limit there is
+ *      never anything to wait for.
+ */
+void Scheduler::waitForNextFrame() const
+{
+    if (speed == 0)
+        return;
+
+    Clock::time_point now = Clock::now();
+    if (next - now > SLEEP_SLACK)
+        std::this_thread::sleep_until(next - SLEEP_SLACK);
+    while (Clock::now() < next)
+        std::this_thread::yield();
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      Forgets any frames that were due, the next one is due right away.
+ */
+void Scheduler::reset()
+{
+    next = Clock::now();
+}
+
+/*
+ * IN:  (uint32_t) how many times faster than real time to run, 1 for
+ *      normal speed or 0 for as fast as frames can be run
+ * OUT: void
+ *      Frames are counted from now at the new speed.
+ */
+void Scheduler::setSpeed(uint32_t multiplier)
+{
+    speed = multiplier;
+    uint64_t rate = static_cast<uint64_t>(hz) * (multiplier ? multiplier : 1);
+    period = std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(1000000000 / rate));
+    reset();
+}
@@ -0,0 +1,52 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * Scheduler.h contains the class definition for the Scheduler class, a
+ * fixed timestep clock. It says how many 60 Hz frames of emulated time
+ * are due according to a monotonic clock, and sleeps until the next one.
+ * Frames are scheduled against absolute deadlines, so small errors in
+ * sleeping never add up to drift.
+ *
+ * It can also run faster than real time for fast-forwarding, either a
+ * whole number of times faster or with no limit at all, when it hands
+ * out TURBO_BATCH frames at a time and never sleeps.
+ */
+
+#ifndef CHIP8_SCHEDULER_H_
+#define CHIP8_SCHEDULER_H_
+
+#include "Chip8State.h"
+#include <chrono>
+#include <cstdint>
+
+class Scheduler
+{
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        static const uint32_t MAX_CATCH_UP = 4;  // Most frames run back to back after a stall, at normal speed
+        static const uint32_t TURBO_BATCH  = 64; // Frames handed out at a time with no speed limit
+
+        explicit Scheduler(uint32_t hz = FRAME_RATE);
+
+        uint32_t framesDue();             // Frames to run now, and count them as done
+        void waitForNextFrame() const;    // Sleep until the next frame is due
+        void reset();                     // Start counting frames from now
+        void setSpeed(uint32_t);          // Times faster than real time, 0 for as fast as possible
+        uint32_t getSpeed() const { return speed; }
+        uint64_t droppedFrames() const { return dropped; }
+    private:
+        uint32_t          hz;             // Frames per second at normal speed
+        uint32_t          speed;          // Multiplier, 0 if unlimited
+        Clock::duration   period;         // Length of one frame
+        Clock::time_point next;           // When the next frame is due
+        uint64_t          dropped;        // Frames skipped because the host fell too far behind
+};
+
+#endif
@@ -0,0 +1,247 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * SharedState.cpp contains the implementation of the SharedState class:
+ * making, mapping and removing the shared memory segment, and both ends
+ * of its seqlock.
+ */
+
+#include "SharedState.h"
+#include "Chip8.h"
+#include "error.h"
+#include <cstring>
+#include <new>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CHIP8_SHM 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define CHIP8_SHM 0
+#endif
+
+/*
+ * IN:  (string) a segment name, with or without its leading slash
+ * OUT: (string) the name as shm_open wants it
+ */
+static std::string segmentName(const std::string& name)
+{
+    return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+
+/*
+ * Constructor
+ */
+SharedState::SharedState() : segment(nullptr), owner(false)
+{
+}
+
+/*
+ * Destructor
+ */
+SharedState::~SharedState()
+{
+    close();
+}
+
+/*
+ * IN:  (string) name of the segment, "chip8-brix" or "/chip8-brix"
+ * OUT: (bool) false if it can't be made
+ *      A segment of the same name left behind by an owner that crashed
+ *      is removed first; readers still mapping it keep the old one.
+ */
+bool SharedState::create(const std::string& path)
+{
+    close();
+#if CHIP8_SHM
+    std::string shm = segmentName(path);
+    shm_unlink(shm.c_str());
+    int fd = shm_open(shm.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 || ftruncate(fd, sizeof(SharedSegment)) != 0)
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+            shm_unlink(shm.c_str());
+        }
+        printChip8Error("Failed to make the shared memory segment \"" + shm + "\"");
+        return false;
+    }
+    void* address = mmap(nullptr, sizeof(SharedSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED)
+    {
+        shm_unlink(shm.c_str());
+        printChip8Error("Failed to map the shared memory segment \"" + shm + "\"");
+        return false;
+    }
+
+    // ftruncate zeroed it, which is also what the atomics start out as
+    segment = static_cast<SharedSegment*>(address);
+    segment->version = SHARED_VERSION;
+    segment->segmentSize = sizeof(SharedSegment);
+    segment->stateSize = sizeof(Chip8State);
+    segment->owner = static_cast<uint32_t>(getpid());
+    segment->generation.store(0, std::memory_order_relaxed);
+    segment->keys.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(segment->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC));
+
+    name = shm;
+    owner = true;
+    return true;
+#else
+    printChip8Error("Shared memory needs a POSIX system, can't make \"" + path + "\"");
+    return false;
+#endif
+}
+
+/*
+ * IN:  (string) name of a segment an owner made
+ * OUT: (bool) false if there is none, or it was made by a build whose
+ *      layout doesn't match this one
+ */
+bool SharedState::attach(const std::string& path)
+{
+    close();
+#if CHIP8_SHM
+    std::string shm = segmentName(path);
+    int fd = shm_open(shm.c_str(), O_RDWR, 0);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SharedSegment))
+    {
+        if (fd >= 0)
+            ::close(fd);
+        printChip8Error("No shared memory segment \"" + shm + "\" to attach to");
+        return false;
+    }
+    void* address = mmap(nullptr, sizeof(SharedSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED)
+    {
+        printChip8Error("Failed to map the shared memory segment \"" + shm + "\"");
+        return false;
+    }
+
+    SharedSegment* s = static_cast<SharedSegment*>(address);
+    bool known = std::memcmp(s->magic, SHARED_MAGIC, sizeof(SHARED_MAGIC)) == 0;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!known || s->version != SHARED_VERSION || s->segmentSize != sizeof(SharedSegment) || s->stateSize != sizeof(Chip8State))
+    {
+        munmap(address, sizeof(SharedSegment));
+        printChip8Error("Shared memory segment \"" + shm + "\" was made by a different version of " + PROG_NAME);
+        return false;
+    }
+
+    segment = s;
+    name = shm;
+    owner = false;
+    return true;
+#else
+    printChip8Error("Shared memory needs a POSIX system, can't attach to \"" + path + "\"");
+    return false;
+#endif
+}
+
+/*
+ * IN:  void
+ * OUT: void
+ *      The owner marks the last frame closed and removes the name, so no
+ *      one new can attach; readers that have it mapped can still read it.
+ */
+void SharedState::close()
+{
+    if (!segment)
+        return;
+#if CHIP8_SHM
+    if (owner)
+    {
+        uint64_t g = segment->generation.load(std::memory_order_relaxed);
+        segment->generation.store(g + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        segment->data.closed = 1;
+        segment->generation.store(g + 2, std::memory_order_release);
+        shm_unlink(name.c_str());
+    }
+    munmap(segment, sizeof(SharedSegment));
+#endif
+    segment = nullptr;
+    name.clear();
+    owner = false;
+}
+
+/*
+ * IN:  (const Chip8&) the machine, right after it ran a frame
+ *      (uint64_t) the number of that frame
+ * OUT: void
+ *      One copy of the state, about 5 KB, under the write side of the
+ *      seqlock. Only the owner calls this, so generation needs no
+ *      read-modify-write.
+ */
+void SharedState::publish(const Chip8& chip8, uint64_t frame)
+{
+    if (!segment)
+        return;
+
+    uint64_t g = segment->generation.load(std::memory_order_relaxed);
+    segment->generation.store(g + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    SharedFrame& data = segment->data;
+    data.frame = frame;
+    data.cyclesPerFrame = chip8.getCyclesPerFrame();
+    data.platform = static_cast<uint8_t>(chip8.getPlatform());
+    data.running = chip8.isRunning() ? 1 : 0;
+    data.closed = 0;
+    std::memcpy(&data.state, &chip8.state(), sizeof(Chip8State));
+
+    segment->generation.store(g + 2, std::memory_order_release);
+}
+
+/*
+ * IN:  (SharedFrame&) receives the last frame the owner published
+ * OUT: (uint64_t) the generation it was copied at, 0 if the owner has
+ *      never published one
+ *      Tries again for as long as the owner is in the middle of writing,
+ *      which only ever takes one copy's time.
+ */
+uint64_t SharedState::read(SharedFrame& out) const
+{
+    for (;;)
+    {
+        uint64_t before = segment->generation.load(std::memory_order_acquire);
+        if ((before & 1) == 0)
+        {
+            std::memcpy(&out, &segment->data, sizeof(SharedFrame));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (segment->generation.load(std::memory_order_relaxed) == before)
+                return before;
+        }
+        std::this_thread::yield();
+    }
+}
+
+/*
+ * IN:  (int) key on the hex keypad
+ *      (bool) true to hold it down, false to let go
+ * OUT: void
+ *      Only this key's bit changes, so readers pressing different keys
+ *      don't undo each other.
+ */
+void SharedState::setKey(int k, bool down)
+{
+    uint16_t bit = static_cast<uint16_t>(1 << (k & 0xF));
+    if (down)
+        segment->keys.fetch_or(bit, std::memory_order_relaxed);
+    else
+        segment->keys.fetch_and(static_cast<uint16_t>(~bit), std::memory_order_relaxed);
+}
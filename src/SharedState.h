@@ -0,0 +1,105 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * SharedState.h contains the class definition for SharedState, which
+ * puts a running machine where other processes on the same host can see
+ * it: a POSIX shared memory segment ("/chip8-brix", say) holding a copy
+ * of the whole Chip8State, screens, registers, timers and key[] included,
+ * as it was at the end of the last frame. A process that wants to watch
+ * maps the segment and reads the state in place; nothing is sent through
+ * a socket or a pipe and the machine never waits for anyone.
+ *
+ * The owner, the process running the machine, writes the state once per
+ * frame under a seqlock: `generation` is odd while it writes and goes up
+ * by two for every frame. A reader takes generation, copies what it
+ * wants, then takes it again; if either was odd or they differ, the
+ * owner wrote in between and it tries again. Watching generation is also
+ * how a reader waits for the next frame.
+ *
+ * The other way, readers press keys by setting bits in `keys`, which any
+ * number of them may change at once. The owner reads it before every
+ * frame and the machine sees a key as down if the owner's own keyboard
+ * or any reader holds it.
+ *
+ * The segment is the SharedSegment struct below, raw, so it is only
+ * readable by builds with the same byte order and struct layout; the
+ * header carries the sizes so a mismatch is refused instead of misread.
+ * Any change to SharedSegment or Chip8State must bump SHARED_VERSION.
+ */
+
+#ifndef CHIP8_SHAREDSTATE_H_
+#define CHIP8_SHAREDSTATE_H_
+
+#include "Chip8State.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class Chip8;
+
+static const char     SHARED_MAGIC[8] = { 'C', '8', 'S', 'H', 'A', 'R', 'E', 'D' };
+static const uint32_t SHARED_VERSION  = 1;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_SHORT_LOCK_FREE == 2, "The segment's atomics have to work between processes");
+
+/* What the owner writes every frame, between the two steps of generation */
+struct SharedFrame
+{
+    uint64_t    frame;                // Frames run since the owner started
+    uint32_t    cyclesPerFrame;
+    uint8_t     platform;             // The machine's Platform
+    uint8_t     running;              // Nonzero until the machine halts
+    uint8_t     closed;               // Nonzero once the owner has gone away
+    Chip8State  state;
+};
+
+/* The whole segment, exactly as it is mapped */
+struct SharedSegment
+{
+    char        magic[8];             // SHARED_MAGIC, written last when the segment is made
+    uint32_t    version;              // SHARED_VERSION
+    uint32_t    segmentSize;          // sizeof(SharedSegment)
+    uint32_t    stateSize;            // sizeof(Chip8State)
+    uint32_t    owner;                // Process ID of the owner
+    alignas(64) std::atomic<uint64_t> generation; // Odd while the owner writes, +2 per frame
+    alignas(64) std::atomic<uint16_t> keys;       // Keys readers hold down, bit n is key n
+    alignas(64) SharedFrame data;     // Only read under the seqlock
+};
+
+class SharedState
+{
+    public:
+        SharedState();
+        ~SharedState();                   // Closes the segment, removing it if this is the owner
+
+        bool create(const std::string&);  // Owner: make the segment, replacing one left behind
+        bool attach(const std::string&);  // Reader: map a segment an owner made
+        void close();
+        bool isOpen() const { return segment != nullptr; }
+
+        /* OWNER */
+        void publish(const Chip8&, uint64_t); // The machine after a frame, and that frame's number
+        uint16_t heldKeys() const { return segment ? segment->keys.load(std::memory_order_relaxed) : 0; }
+
+        /* READER */
+        uint64_t read(SharedFrame&) const; // Consistent copy of the last frame, returns its generation
+        uint64_t generation() const { return segment->generation.load(std::memory_order_acquire); }
+        void setKey(int, bool);           // Hold a key down or let go of it
+        const SharedSegment* get() const { return segment; } // Mapped in place, for reading without a copy
+    private:
+        SharedState(const SharedState&);  // Not copyable
+        SharedState& operator=(const SharedState&);
+
+        SharedSegment* segment;           // Null while closed
+        std::string    name;              // What shm_open was given
+        bool           owner;             // This side made the segment and removes it
+};
+
+#endif
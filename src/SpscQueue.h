@@ -0,0 +1,70 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * SpscQueue.h contains the SpscQueue class template, a fixed size ring
+ * for passing values from exactly one thread to exactly one other. Each
+ * side only ever stores its own index and loads the other's, so push
+ * and pop are wait-free: they finish in a fixed number of steps whatever
+ * the other thread is doing. A full queue refuses a push rather than
+ * waiting for room.
+ */
+
+#ifndef CHIP8_SPSCQUEUE_H_
+#define CHIP8_SPSCQUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+
+template <typename T, size_t N>
+class SpscQueue
+{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "The capacity has to be a power of two");
+
+    public:
+        SpscQueue() : head(0), tail(0) {}
+
+        bool push(const T&);              // Producer only, false if full
+        bool pop(T&);                     // Consumer only, false if empty
+    private:
+        T                   items[N];
+        std::atomic<size_t> head;         // Next to pop, written by the consumer
+        std::atomic<size_t> tail;         // Next to push, written by the producer
+};
+
+/*
+ * IN:  (const T&) value to add
+ * OUT: (bool) false if the queue is full and it wasn't added
+ */
+template <typename T, size_t N>
+bool SpscQueue<T, N>::push(const T& value)
+{
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == N)
+        return false;
+    items[t & (N - 1)] = value;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+}
+
+/*
+ * IN:  (T&) where to put the oldest value
+ * OUT: (bool) false if the queue is empty
+ */
+template <typename T, size_t N>
+bool SpscQueue<T, N>::pop(T& value)
+{
+    size_t h = head.load(std::memory_order_relaxed);
+    if (tail.load(std::memory_order_acquire) == h)
+        return false;
+    value = items[h & (N - 1)];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * ThreadPool.cpp contains the implementation of the ThreadPool class.
+ */
+
+#include "ThreadPool.h"
+#include <thread>
+
+/*
+ * Constructor
+ *
+ * IN: (unsigned) number of worker threads, 0 to match the hardware
+ */
+ThreadPool::ThreadPool(unsigned n) : threads(n)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+}
+
+/*
+ * IN:  (size_t) number of jobs
+ *      (function) called once with every job index in [0, jobs)
+ * OUT: void
+ *      Runs every job and returns once they have all finished. The calling
+ *      thread works too. Jobs are handed out in contiguous runs, one run
+ *      per worker, so neighbouring jobs usually stay on the same core.
+ *      The function must be safe to call from several threads at once.
+ */
+void ThreadPool::run(size_t jobs, const std::function<void(size_t)>& fn)
+{
+    std::vector<Queue> fresh(threads);
+    queues.swap(fresh);
+    for (unsigned t = 0; t < threads; ++t)
+    {
+        size_t first = jobs * t / threads;
+        size_t last = jobs * (t + 1) / threads;
+        for (size_t j = first; j < last; ++j)
+            queues[t].jobs.push_back(j);
+    }
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < threads; ++t)
+        workers.emplace_back(&ThreadPool::work, this, t, std::cref(fn));
+    work(0, fn);
+    for (size_t t = 0; t < workers.size(); ++t)
+        workers[t].join();
+}
+
+/*
+ * IN:  (unsigned) this worker's queue
+ *      (function) the job body
+ * OUT: void
+ *      Runs jobs until there are none left anywhere. No jobs are added
+ *      while the pool runs, so one empty pass over every queue means the
+ *      work is done.
+ */
+void ThreadPool::work(unsigned self, const std::function<void(size_t)>& fn)
+{
+    size_t job;
+    while (take(self, job))
+        fn(job);
+}
+
+/*
+ * IN:  (unsigned) the worker asking
+ *      (size_t&) receives the job index
+ * OUT: (bool) false if every queue is empty
+ */
+bool ThreadPool::take(unsigned self, size_t& job)
+{
+    {
+        std::lock_guard<std::mutex> guard(queues[self].lock);
+        if (!queues[self].jobs.empty())
+        {
+            job = queues[self].jobs.back();
+            queues[self].jobs.pop_back();
+            return true;
+        }
+    }
+
+    for (unsigned i = 1; i < threads; ++i)
+    {
+        Queue& victim = queues[(self + i) % threads];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.jobs.empty())
+        {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
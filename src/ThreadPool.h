@@ -0,0 +1,48 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * ThreadPool.h contains the class definition for the ThreadPool class, a
+ * small work-stealing pool for running many independent jobs (usually
+ * one Chip8 machine each) across every core. Each worker starts with its
+ * own share of the jobs and takes from the back of its own queue; a
+ * worker that runs dry steals from the front of somebody else's, so a
+ * few long jobs can't leave the other cores idle.
+ */
+
+#ifndef CHIP8_THREADPOOL_H_
+#define CHIP8_THREADPOOL_H_
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+class ThreadPool
+{
+    public:
+        explicit ThreadPool(unsigned threads = 0); // 0 means one per hardware thread
+
+        void run(size_t, const std::function<void(size_t)>&); // Call the function for every job index
+        unsigned size() const { return threads; }
+    private:
+        struct Queue
+        {
+            std::mutex         lock;
+            std::deque<size_t> jobs;
+        };
+
+        void work(unsigned, const std::function<void(size_t)>&);
+        bool take(unsigned, size_t&);     // Own job from the back, or a stolen one from the front
+
+        unsigned           threads;
+        std::vector<Queue> queues;        // One per worker
+};
+
+#endif
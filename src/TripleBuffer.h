@@ -0,0 +1,60 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * TripleBuffer.h contains the TripleBuffer class template, which hands
+ * the newest of a stream of values from one thread to another without a
+ * lock. The writer always has a slot of its own to fill and the reader
+ * always has a slot of its own to read; the third slot sits between them
+ * and is swapped with an atomic exchange. Neither side ever waits, and
+ * the reader skips straight to the newest value when it falls behind.
+ */
+
+#ifndef CHIP8_TRIPLEBUFFER_H_
+#define CHIP8_TRIPLEBUFFER_H_
+
+#include <atomic>
+#include <cstdint>
+
+template <typename T>
+class TripleBuffer
+{
+    public:
+        TripleBuffer() : middle(1), front(0), back(2) {}
+
+        /* WRITER */
+        T& writeSlot() { return slots[back]; }
+        void publish() { back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX; }
+
+        /* READER */
+        bool update();                    // Take the newest published value, false if there isn't one
+        const T& readSlot() const { return slots[front]; }
+    private:
+        static const uint8_t INDEX = 0x3;
+        static const uint8_t FRESH = 0x4; // The middle slot was published and not read yet
+
+        T                    slots[3];
+        std::atomic<uint8_t> middle;      // Index of the slot in between, and FRESH
+        uint8_t              front;       // Reader's slot
+        uint8_t              back;        // Writer's slot
+};
+
+/*
+ * IN:  void
+ * OUT: (bool) true if readSlot() now holds a value it didn't before
+ */
+template <typename T>
+bool TripleBuffer<T>::update()
+{
+    if ((middle.load(std::memory_order_relaxed) & FRESH) == 0)
+        return false;
+    front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+    return true;
+}
+
+#endif
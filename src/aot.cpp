@@ -0,0 +1,77 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * aot.cpp is the entry point for chip8-aot, the static recompiler. For
+ * each ROM it writes <dir>/<hash>.cpp, where hash is the hash of the
+ * program image (see Aot.h). Compiled into <dir>/<hash>.so with
+ *
+ *     c++ -std=c++11 -O2 -shared -fPIC -Isrc <dir>/<hash>.cpp -o <dir>/<hash>.so
+ *
+ * it is picked up by `--engine aot` whenever that ROM is loaded. `make
+ * aot` does both for every ROM in rom/.
+ */
+
+#include "Chip8.h"
+#include "Recompiler.h"
+#include "error.h"
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+static const char* USAGE = "Usage is chip8-aot [--out dir] <path_to_ROM>...";
+
+int main(int argc, char* argv[])
+{
+    std::string dir = Aot::directory();
+    std::vector<std::string> roms;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc)
+            dir = argv[++i];
+        else if (arg.compare(0, 2, "--") != 0)
+            roms.push_back(arg);
+        else
+            abortChip8(USAGE);
+    }
+    if (roms.empty())
+        abortChip8(USAGE);
+    if (dir.size() > 1 && dir[dir.size() - 1] == '/')
+        dir.erase(dir.size() - 1);
+
+    int failed = 0;
+    for (size_t r = 0; r < roms.size(); ++r)
+    {
+        Chip8 chip8;
+        if (!chip8.loadROM(roms[r]))
+        {
+            ++failed;
+            continue;
+        }
+
+        Recompiler recompiler(chip8.state());
+        char name[32];
+        std::snprintf(name, sizeof(name), "/%016llx.cpp", static_cast<unsigned long long>(recompiler.imageHash()));
+        std::string path = dir + name;
+
+        std::ofstream out(path.c_str());
+        recompiler.write(out, roms[r]);
+        if (!out)
+        {
+            printChip8Error("Failed to write \"" + path + "\"");
+            ++failed;
+            continue;
+        }
+        std::printf("%s\t%s\t%zu blocks\t%zu instructions recompiled\t%zu left to the interpreter\n", roms[r].c_str(),
+                path.c_str(), recompiler.blockCount(), recompiler.instructionCount(), recompiler.interpretedCount());
+    }
+    return failed ? 1 : 0;
+}
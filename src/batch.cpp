@@ -0,0 +1,289 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * batch.cpp is the entry point for chip8-batch, a headless runner for
+ * regression and analysis jobs. It reads a manifest of jobs, runs each
+ * one on its own Chip8 machine spread over a thread pool, and prints one
+ * line of results per job in manifest order. It exits with 1 if any job
+ * could not be loaded, so a regression run fails when a ROM is missing.
+ *
+ * Manifest lines are `<rom> <input_script|-> <cycles> [seed]`; blank
+ * lines and lines starting with '#' are skipped. A job runs whole frames
+ * until at least `cycles` instructions have executed or the machine
+ * halts. Input scripts hold `<frame> <key> <down|up>` lines, the key in
+ * hex; an event is applied right before its frame runs.
+ *
+ * Every ROM the manifest names is mapped once into a RomCatalog before
+ * any job starts, so a job's machine is loaded with one memcpy however
+ * many jobs share the ROM. With --goldens <dir> the input logs in it
+ * give each ROM its platform and, unless --ipf is given, its speed.
+ *
+ * With --save-states <dir> the final machine of job n (counting manifest
+ * jobs from 0) is written to <dir>/<n>.c8s, ready for a closer look with
+ * `chip8 --load-state`.
+ *
+ * With --capture <dir> every frame job n shows is recorded to
+ * <dir>/<n>.png as an animated PNG, or to <dir>/<n>.y4m with
+ * --capture-format y4m. Writing happens on a thread of its own per job.
+ */
+
+#include "Chip8.h"
+#include "FrameCapture.h"
+#include "InputLog.h"
+#include "ThreadPool.h"
+#include "error.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+static const char* USAGE = "Usage is chip8-batch [--threads n] [--engine interpreter|cached|jit|jit-checked|aot] [--ipf instructions_per_frame] [--goldens dir] [--save-states dir] [--capture dir] [--capture-format apng|y4m] <manifest>";
+
+struct Job
+{
+    std::string rom;
+    std::string script;               // "-" for no input
+    uint64_t    cycles;               // Instruction budget
+    uint64_t    seed;                 // RND seed
+    std::vector<InputEvent> inputs;   // Sorted by frame
+};
+
+struct JobResult
+{
+    bool     ok;                      // False if the ROM could not be loaded
+    uint64_t hash;                    // hashState of the final machine
+    uint64_t frames;
+    uint64_t instructions;
+    double   wallMs;                  // Time spent on this job alone
+};
+
+/*
+ * IN:  (string) path to an input script
+ *      (vector<InputEvent>&) receives the events, sorted by frame
+ * OUT: (bool) false if the file can't be read or a line doesn't parse
+ */
+static bool readScript(const std::string& path, std::vector<InputEvent>& events)
+{
+    std::ifstream in(path.c_str());
+    if (!in)
+    {
+        printChip8Error("Unable to open input script " + path);
+        return false;
+    }
+
+    std::string line;
+    for (int number = 1; std::getline(in, line); ++number)
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream fields(line);
+        InputEvent event;
+        unsigned key;
+        std::string action;
+        if (!(fields >> event.frame >> std::hex >> key >> action) || key > 0xF || (action != "down" && action != "up"))
+        {
+            printChip8Error(path + ":" + std::to_string(number) + ": expected <frame> <key> <down|up>");
+            return false;
+        }
+        event.key = static_cast<uint8_t>(key);
+        event.down = (action == "down");
+        events.push_back(event);
+    }
+
+    std::stable_sort(events.begin(), events.end(),
+            [](const InputEvent& a, const InputEvent& b) { return a.frame < b.frame; });
+    return true;
+}
+
+/*
+ * IN:  (string) path to the manifest
+ *      (vector<Job>&) receives the jobs in manifest order
+ * OUT: (bool) false if the manifest or any of its scripts can't be read
+ */
+static bool readManifest(const std::string& path, std::vector<Job>& jobs)
+{
+    std::ifstream in(path.c_str());
+    if (!in)
+    {
+        printChip8Error("Unable to open manifest " + path);
+        return false;
+    }
+
+    std::string line;
+    for (int number = 1; std::getline(in, line); ++number)
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream fields(line);
+        Job job;
+        job.seed = 0;
+        if (!(fields >> job.rom >> job.script >> job.cycles))
+        {
+            printChip8Error(path + ":" + std::to_string(number) + ": expected <rom> <input_script|-> <cycles> [seed]");
+            return false;
+        }
+        fields >> job.seed;
+        if (job.script != "-" && !readScript(job.script, job.inputs))
+            return false;
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+/*
+ * IN:  (const Job&) what to run
+ *      (const RomEntry*) its ROM, nullptr if it couldn't be mapped
+ *      (Engine) how to run it
+ *      (uint32_t) instructions per frame, 0 for the ROM's own
+ *      (string) file to save the final machine to, empty for none
+ *      (string) file to capture the frames to, empty for none
+ *      (CaptureFormat) what to capture them as
+ * OUT: (JobResult) the final state hash and counters
+ *      Everything the job touches lives on this thread's stack, so jobs
+ *      can run side by side without any locking. The catalog is only
+ *      read.
+ */
+static JobResult runJob(const Job& job, const RomEntry* rom, Engine engine, uint32_t ipf, const std::string& savePath,
+        const std::string& capturePath, CaptureFormat captureFormat)
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    JobResult result = {};
+
+    Chip8 chip8;
+    chip8.setEngine(engine);
+    chip8.seed(job.seed);
+    result.ok = rom && chip8.loadROM(*rom);
+    if (ipf == 0)
+        ipf = (rom && rom->cyclesPerFrame > 0) ? rom->cyclesPerFrame : CYCLES_PER_FRAME;
+    chip8.setCyclesPerFrame(ipf);
+
+    FrameCapture capture;
+    if (result.ok && !capturePath.empty())
+        capture.open(capturePath, captureFormat, chip8.getPlatform());
+
+    size_t next = 0;
+    while (result.ok && chip8.isRunning() && result.instructions < job.cycles)
+    {
+        for (; next < job.inputs.size() && job.inputs[next].frame <= result.frames; ++next)
+            chip8.setKey(job.inputs[next].key, job.inputs[next].down);
+
+        result.instructions += chip8.runFrames(1).cycles;
+        ++result.frames;
+        capture.add(chip8);
+    }
+    capture.close();
+
+    result.hash = hashState(chip8.state());
+    if (result.ok && !savePath.empty())
+    {
+        Savestate s;
+        chip8.saveState(s);
+        writeSavestate(savePath, s);
+    }
+    result.wallMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned threads = 0;
+    Engine engine = Engine::Cached;
+    uint32_t ipf = 0;
+    std::string manifest;
+    std::string saveDir;
+    std::string goldenDir;
+    std::string captureDir;
+    CaptureFormat captureFormat = CaptureFormat::APNG;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc)
+            threads = std::atoi(argv[++i]);
+        else if (arg == "--engine" && i + 1 < argc)
+        {
+            std::string name = argv[++i];
+            if (!engineFromName(name, engine))
+                abortChip8("Unknown engine \"" + name + "\"");
+        }
+        else if (arg == "--ipf" && i + 1 < argc)
+        {
+            int n = std::atoi(argv[++i]);
+            if (n <= 0)
+                abortChip8("--ipf needs a positive number of instructions");
+            ipf = n;
+        }
+        else if (arg == "--save-states" && i + 1 < argc)
+            saveDir = argv[++i];
+        else if (arg == "--goldens" && i + 1 < argc)
+            goldenDir = argv[++i];
+        else if (arg == "--capture" && i + 1 < argc)
+            captureDir = argv[++i];
+        else if (arg == "--capture-format" && i + 1 < argc)
+        {
+            std::string name = argv[++i];
+            if (!captureFormatFromName(name, captureFormat))
+                abortChip8("Unknown capture format \"" + name + "\"");
+        }
+        else if (manifest.empty() && arg.compare(0, 2, "--") != 0)
+            manifest = arg;
+        else
+            abortChip8(USAGE);
+    }
+    if (manifest.empty())
+        abortChip8(USAGE);
+
+    std::vector<Job> jobs;
+    if (!readManifest(manifest, jobs))
+        abortChip8("Unable to read the manifest");
+
+    RomCatalog catalog;
+    for (size_t j = 0; j < jobs.size(); ++j)
+        catalog.add(jobs[j].rom);
+    if (!goldenDir.empty())
+        catalog.addGoldens(goldenDir);
+
+    std::vector<JobResult> results(jobs.size());
+    ThreadPool pool(threads);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pool.run(jobs.size(), [&](size_t j)
+    {
+        std::string savePath = saveDir.empty() ? std::string() : saveDir + "/" + std::to_string(j) + ".c8s";
+        std::string capturePath = captureDir.empty() ? std::string()
+            : captureDir + "/" + std::to_string(j) + (captureFormat == CaptureFormat::Y4M ? ".y4m" : ".png");
+        results[j] = runJob(jobs[j], catalog.find(jobs[j].rom), engine, ipf, savePath, capturePath, captureFormat);
+    });
+    double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t instructions = 0;
+    int failed = 0;
+    std::printf("# rom\tstatus\thash\tframes\tinstructions\twall_ms\n");
+    for (size_t j = 0; j < jobs.size(); ++j)
+    {
+        const JobResult& r = results[j];
+        // A job that never loaded has no state worth a hash
+        char hash[17] = "-";
+        if (r.ok)
+            std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(r.hash));
+        std::printf("%s\t%s\t%s\t%llu\t%llu\t%.3f\n", jobs[j].rom.c_str(), r.ok ? "ok" : "error", hash,
+                static_cast<unsigned long long>(r.frames), static_cast<unsigned long long>(r.instructions), r.wallMs);
+        instructions += r.instructions;
+        failed += r.ok ? 0 : 1;
+    }
+    std::fprintf(stderr, "%zu jobs on %u threads in %.1f ms, %.1f million instructions per second\n",
+            jobs.size(), pool.size(), wallMs, wallMs > 0 ? instructions / (wallMs * 1000.0) : 0.0);
+
+    return failed ? 1 : 0;
+}
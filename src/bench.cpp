@@ -0,0 +1,490 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * bench.cpp is the entry point for chip8-bench, the headless benchmark
+ * that `make bench` builds (optimised, whatever CFLAGS says) and runs.
+ *
+ * It times every ROM in rom/ and a few small programs that each hammer
+ * one kind of instruction, on each engine. Every case runs a fixed number
+ * of instructions several times on a fresh machine after one untimed
+ * warm-up run, and reports the mean and standard deviation of the
+ * emulated MIPS and frames per second, and the mean ns per instruction.
+ * With --out the same numbers go to a tab-separated file, one line per
+ * case, headed by '#' lines describing the build, so results from
+ * different releases can be lined up.
+ *
+ * Idle skipping is off unless --idle-skipping is given. Skipped
+ * instructions count as executed, so with it on a ROM waiting for a key
+ * would measure how rarely the machine looks for idle loops rather than
+ * how fast an engine runs.
+ *
+ * With --env <settings> it times an Environment instead: --env-instances
+ * copies of the game stepped --env-steps times with random actions, on
+ * this one thread. It prints steps and emulated frames per second.
+ *
+ * With --lockstep n each ROM runs as n copies instead, seeded 0 to n - 1,
+ * that share --rom-cycles between them: once as the lanes of a Lockstep
+ * (engine "lockstep"), then as n separate Chip8 objects on each engine,
+ * one after the other on this thread. MIPS counts the instructions of
+ * every copy. Lockstep can't load the micro benchmarks, so they are left
+ * out.
+ */
+
+#include "Chip8.h"
+#include "Environment.h"
+#include "Lockstep.h"
+#include "error.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <dirent.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+static const char* USAGE = "Usage is chip8-bench [--engine interpreter|cached|jit|jit-checked|aot]... [--runs n] [--rom-cycles n] "
+                           "[--micro-cycles n] [--filter text] [--rom-dir dir] [--idle-skipping] [--out results.tsv] "
+                           "[--lockstep lanes] [--env settings [--env-instances n] [--env-steps n]]";
+
+static const uint32_t FRAMES_PER_CALL = 1000; // Frames per runFrames call, so the loop isn't what is measured
+
+/*
+ * A program to benchmark: either a ROM file or one of the programs
+ * below.
+ */
+struct Case
+{
+    std::string name;
+    std::string kind;                 // "rom" or "micro"
+    std::string path;                 // ROM file, empty for a micro benchmark
+    std::vector<uint8_t> program;     // Micro benchmark code, loaded at 0x200
+    uint64_t    cycles;               // Instructions per run
+};
+
+struct Stats
+{
+    double mean;
+    double stddev;
+};
+
+/*
+ * Micro benchmarks, each an endless loop of one kind of instruction.
+ */
+static const uint8_t MICRO_ALU[] =
+{
+    0x60, 0x01, 0x61, 0x03, 0x62, 0x07,             // V0..V2 = 1, 3, 7
+    0x80, 0x14, 0x81, 0x25, 0x82, 0x31, 0x80, 0x12, // 206: ADD, SUB, OR, AND
+    0x81, 0x23, 0x80, 0x16, 0x82, 0x1E, 0x80, 0x27, //      XOR, SHR, SHL, SUBN
+    0x81, 0x04, 0x12, 0x06                          //      ADD, JP 206
+};
+
+static const uint8_t MICRO_DRAW[] =
+{
+    0xA0, 0x00, 0x60, 0x00, 0x61, 0x00,             // I = font '0', V0 = V1 = 0
+    0xD0, 0x15, 0x70, 0x03, 0x71, 0x05, 0x12, 0x06  // 206: DRW V0, V1, 5; V0 += 3; V1 += 5; JP 206
+};
+
+static const uint8_t MICRO_MEMORY[] =
+{
+    0xA4, 0x00,                                     // I = 0x400, away from the code
+    0xFF, 0x55, 0xFF, 0x65, 0x12, 0x02              // 202: LD [I], VF; LD VF, [I]; JP 202
+};
+
+static const uint8_t MICRO_BRANCH[] =
+{
+    0x60, 0x00,                                     // V0 = 0
+    0x70, 0x01, 0x30, 0xFF, 0x12, 0x02,             // 202: V0 += 1; SE V0, FF; JP 202
+    0x60, 0x00, 0x40, 0x00, 0x12, 0x02              //      V0 = 0; SNE V0, 0; JP 202
+};
+
+/*
+ * IN:  (vector<double>) samples
+ * OUT: (Stats) their mean and sample standard deviation
+ */
+static Stats summarise(const std::vector<double>& samples)
+{
+    Stats s = {};
+    if (samples.empty())
+        return s;
+
+    for (size_t i = 0; i < samples.size(); ++i)
+        s.mean += samples[i];
+    s.mean /= samples.size();
+
+    if (samples.size() > 1)
+    {
+        double sum = 0;
+        for (size_t i = 0; i < samples.size(); ++i)
+            sum += (samples[i] - s.mean) * (samples[i] - s.mean);
+        s.stddev = std::sqrt(sum / (samples.size() - 1));
+    }
+    return s;
+}
+
+/*
+ * IN:  (string) directory to look in
+ *      (uint64_t) instructions per run
+ *      (vector<Case>&) gets a case for every file in it, sorted by name
+ */
+static void findROMs(const std::string& dir, uint64_t cycles, std::vector<Case>& cases)
+{
+    DIR* d = opendir(dir.c_str());
+    if (!d)
+    {
+        printChip8Error("Unable to open ROM directory " + dir);
+        return;
+    }
+
+    std::vector<std::string> names;
+    while (dirent* entry = readdir(d))
+        if (entry->d_name[0] != '.')
+            names.push_back(entry->d_name);
+    closedir(d);
+
+    std::sort(names.begin(), names.end());
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        Case c;
+        c.name = names[i];
+        c.kind = "rom";
+        c.path = dir + "/" + names[i];
+        c.cycles = cycles;
+        cases.push_back(c);
+    }
+}
+
+/*
+ * IN:  (string) name
+ *      (const uint8_t*, size_t) the program
+ *      (uint64_t) instructions per run
+ * OUT: (Case) a micro benchmark
+ */
+static Case micro(const std::string& name, const uint8_t* program, size_t size, uint64_t cycles)
+{
+    Case c;
+    c.name = name;
+    c.kind = "micro";
+    c.program.assign(program, program + size);
+    c.cycles = cycles;
+    return c;
+}
+
+/*
+ * IN:  (const Case&) what to run
+ *      (Engine) how to run it
+ *      (bool) skip idle loops
+ *      (uint64_t&) instructions actually executed
+ *      (uint64_t&) frames run
+ * OUT: (double) seconds taken, negative if the program wouldn't load
+ *      Runs whole frames on a fresh machine until the instruction budget
+ *      is spent or the machine halts. Loading is not timed.
+ */
+static double runOnce(const Case& c, Engine engine, bool idleSkipping, uint64_t& instructions, uint64_t& frames)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    Chip8 chip8;
+    chip8.setEngine(engine);
+    chip8.setIdleSkipping(idleSkipping);
+    bool loaded = c.path.empty() ? chip8.loadProgram(c.program.data(), c.program.size(), c.name) : chip8.loadROM(c.path);
+    if (!loaded)
+        return -1;
+
+    instructions = 0;
+    frames = 0;
+    uint64_t ipf = chip8.getCyclesPerFrame();
+    Clock::time_point start = Clock::now();
+    while (instructions < c.cycles && chip8.isRunning())
+    {
+        uint32_t n = static_cast<uint32_t>(std::min<uint64_t>(FRAMES_PER_CALL, (c.cycles - instructions + ipf - 1) / ipf));
+        instructions += chip8.runFrames(n).cycles;
+        frames += n;
+    }
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/*
+ * IN:  (const Case&) a ROM
+ *      (size_t) lanes, each running its share of the case's instructions
+ *      (uint64_t&) instructions executed by all the lanes together
+ *      (uint64_t&) frames run
+ * OUT: (double) seconds taken, negative if the ROM wouldn't load
+ *      Lane n is seeded with n, so the lanes drift apart wherever the
+ *      ROM uses RND.
+ */
+static double runLockstep(const Case& c, size_t lanes, uint64_t& instructions, uint64_t& frames)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    Lockstep lockstep(lanes);
+    if (!lockstep.loadROM(c.path))
+        return -1;
+    for (size_t lane = 0; lane < lanes; ++lane)
+        lockstep.seed(lane, lane);
+
+    instructions = 0;
+    frames = 0;
+    uint64_t ipf = lockstep.getCyclesPerFrame();
+    uint64_t budget = std::max<uint64_t>(c.cycles / lanes, 1);
+    Clock::time_point start = Clock::now();
+    while (frames * ipf < budget)
+    {
+        uint32_t n = static_cast<uint32_t>(std::min<uint64_t>(FRAMES_PER_CALL, (budget - frames * ipf + ipf - 1) / ipf));
+        uint64_t executed = lockstep.runFrames(n);
+        instructions += executed;
+        frames += n;
+        if (executed == 0)
+            break;
+    }
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/*
+ * IN:  (const Case&) a ROM
+ *      (size_t) machines, each running its share of the case's instructions
+ *      (Engine) how they run it
+ *      (bool) skip idle loops
+ *      (uint64_t&) instructions executed by all the machines together
+ *      (uint64_t&) frames run
+ * OUT: (double) seconds taken, negative if the ROM wouldn't load
+ *      What runLockstep does, with a Chip8 for every lane. Each machine
+ *      runs up to FRAMES_PER_CALL frames before the next one gets a turn.
+ */
+static double runMachines(const Case& c, size_t count, Engine engine, bool idleSkipping, uint64_t& instructions, uint64_t& frames)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    std::vector<std::unique_ptr<Chip8> > machines(count);
+    for (size_t m = 0; m < count; ++m)
+    {
+        machines[m].reset(new Chip8());
+        machines[m]->setEngine(engine);
+        machines[m]->setIdleSkipping(idleSkipping);
+        machines[m]->seed(m);
+        if (!machines[m]->loadROM(c.path))
+            return -1;
+    }
+
+    instructions = 0;
+    frames = 0;
+    uint64_t ipf = machines[0]->getCyclesPerFrame();
+    uint64_t budget = std::max<uint64_t>(c.cycles / count, 1);
+    Clock::time_point start = Clock::now();
+    while (frames * ipf < budget)
+    {
+        uint32_t n = static_cast<uint32_t>(std::min<uint64_t>(FRAMES_PER_CALL, (budget - frames * ipf + ipf - 1) / ipf));
+        uint64_t executed = 0;
+        for (size_t m = 0; m < count; ++m)
+            if (machines[m]->isRunning())
+                executed += machines[m]->runFrames(n).cycles;
+        instructions += executed;
+        frames += n;
+        if (executed == 0)
+            break;
+    }
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/*
+ * IN:  (string) environment settings file
+ *      (size_t) instances
+ *      (uint64_t) steps to take on each
+ * OUT: (int) exit status
+ *      Actions come from one generator seeded with 0, so runs repeat.
+ *      Drawing them is timed along with the steps, as it would be in
+ *      training.
+ */
+static int benchEnvironment(const std::string& path, size_t instances, uint64_t steps)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    EnvConfig config;
+    Environment env(instances);
+    if (!config.load(path) || !env.load(config))
+        return 1;
+
+    std::vector<uint8_t> actions(instances);
+    uint64_t rng = seedRandom(0);
+    uint64_t episodes = 0;
+    double rewards = 0;
+    Clock::time_point start = Clock::now();
+    for (uint64_t s = 0; s < steps; ++s)
+    {
+        for (size_t i = 0; i < instances; ++i)
+            actions[i] = static_cast<uint8_t>(nextRandom(rng) % env.actionCount());
+        env.step(actions.data());
+        for (size_t i = 0; i < instances; ++i)
+        {
+            episodes += env.dones()[i];
+            rewards += env.rewards()[i];
+        }
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::printf("%s: %zu instances, %llu steps each, %.2f s\n", config.rom.c_str(), instances, static_cast<unsigned long long>(steps), seconds);
+    std::printf("%.0f steps/s, %.0f frames/s, %llu episodes ended, %.1f reward per episode\n", instances * steps / seconds,
+            env.framesRun() / seconds, static_cast<unsigned long long>(episodes), episodes ? rewards / episodes : rewards);
+    return 0;
+}
+
+/*
+ * IN:  (string) a column of the table
+ *      (size_t) width of the column
+ * OUT: (string) the text padded with spaces to the width
+ */
+static std::string pad(const std::string& s, size_t width)
+{
+    return s.size() >= width ? s : s + std::string(width - s.size(), ' ');
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> engines;
+    unsigned runs = 5;
+    uint64_t romCycles = 2000000;
+    uint64_t microCycles = 10000000;
+    std::string filter;
+    std::string romDir = "rom";
+    std::string out;
+    bool idleSkipping = false;
+    size_t lanes = 0;
+    std::string envPath;
+    size_t envInstances = 64;
+    uint64_t envSteps = 2000;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--engine" && i + 1 < argc)
+            engines.push_back(argv[++i]);
+        else if (arg == "--runs" && i + 1 < argc)
+            runs = std::atoi(argv[++i]);
+        else if (arg == "--rom-cycles" && i + 1 < argc)
+            romCycles = std::strtoull(argv[++i], nullptr, 0);
+        else if (arg == "--micro-cycles" && i + 1 < argc)
+            microCycles = std::strtoull(argv[++i], nullptr, 0);
+        else if (arg == "--filter" && i + 1 < argc)
+            filter = argv[++i];
+        else if (arg == "--rom-dir" && i + 1 < argc)
+            romDir = argv[++i];
+        else if (arg == "--idle-skipping")
+            idleSkipping = true;
+        else if (arg == "--out" && i + 1 < argc)
+            out = argv[++i];
+        else if (arg == "--lockstep" && i + 1 < argc)
+        {
+            lanes = std::strtoull(argv[++i], nullptr, 0);
+            if (lanes == 0)
+                abortChip8("--lockstep needs at least one lane");
+        }
+        else if (arg == "--env" && i + 1 < argc)
+            envPath = argv[++i];
+        else if (arg == "--env-instances" && i + 1 < argc)
+            envInstances = std::strtoull(argv[++i], nullptr, 0);
+        else if (arg == "--env-steps" && i + 1 < argc)
+            envSteps = std::strtoull(argv[++i], nullptr, 0);
+        else
+            abortChip8(USAGE);
+    }
+    if (!envPath.empty())
+        return benchEnvironment(envPath, envInstances, envSteps);
+    if (engines.empty())
+    {
+        engines.push_back("interpreter");
+        engines.push_back("cached");
+        engines.push_back("jit");
+    }
+    if (runs == 0)
+        abortChip8("--runs needs at least one run");
+
+    std::vector<Case> all;
+    all.push_back(micro("alu-8xyn", MICRO_ALU, sizeof(MICRO_ALU), microCycles));
+    all.push_back(micro("draw-dxyn", MICRO_DRAW, sizeof(MICRO_DRAW), microCycles));
+    all.push_back(micro("memory-fx55-fx65", MICRO_MEMORY, sizeof(MICRO_MEMORY), microCycles));
+    all.push_back(micro("branch-3xkk-1nnn", MICRO_BRANCH, sizeof(MICRO_BRANCH), microCycles));
+    findROMs(romDir, romCycles, all);
+
+    std::vector<Case> cases;
+    for (size_t i = 0; i < all.size(); ++i)
+        if ((filter.empty() || all[i].name.find(filter) != std::string::npos) && (lanes == 0 || !all[i].path.empty()))
+            cases.push_back(all[i]);
+    if (lanes > 0)
+        engines.insert(engines.begin(), "lockstep");
+
+    FILE* tsv = nullptr;
+    if (!out.empty())
+    {
+        tsv = std::fopen(out.c_str(), "w");
+        if (!tsv)
+            abortChip8("Unable to write " + out);
+
+        char date[32];
+        std::time_t now = std::time(nullptr);
+        std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+        std::fprintf(tsv, "# chip8-bench\n# date\t%s\n", date);
+#ifdef __VERSION__
+        std::fprintf(tsv, "# compiler\t%s\n", __VERSION__);
+#endif
+        std::fprintf(tsv, "# runs\t%u\n# jit\t%s\n", runs, Jit::available() ? "yes" : "no");
+        std::fprintf(tsv, "# idle skipping\t%s\n", idleSkipping ? "yes" : "no");
+        if (lanes > 0)
+            std::fprintf(tsv, "# lockstep lanes\t%zu\n", lanes);
+        std::fprintf(tsv, "# name\tkind\tengine\tinstructions\tmips_mean\tmips_stddev\tns_per_instruction\tfps_mean\tfps_stddev\n");
+    }
+
+    std::printf("%s%-12s %10s %8s %10s %12s %10s\n", pad("case", 24).c_str(), "engine", "MIPS", "+/-", "ns/instr", "frames/s", "+/-");
+    for (size_t i = 0; i < cases.size(); ++i)
+    {
+        for (size_t e = 0; e < engines.size(); ++e)
+        {
+            Engine engine = Engine::Interpreter;
+            bool lockstep = engines[e] == "lockstep";
+            if (!lockstep && !engineFromName(engines[e], engine))
+                abortChip8("Unknown engine \"" + engines[e] + "\"");
+
+            uint64_t instructions = 0, frames = 0;
+            auto run = [&]() -> double
+            {
+                if (lockstep)
+                    return runLockstep(cases[i], lanes, instructions, frames);
+                if (lanes > 0)
+                    return runMachines(cases[i], lanes, engine, idleSkipping, instructions, frames);
+                return runOnce(cases[i], engine, idleSkipping, instructions, frames);
+            };
+            if (run() < 0)
+                break;
+
+            std::vector<double> mips, fps;
+            for (unsigned r = 0; r < runs; ++r)
+            {
+                double seconds = run();
+                if (seconds <= 0)
+                    continue;
+                mips.push_back(instructions / seconds / 1e6);
+                fps.push_back(frames / seconds);
+            }
+            Stats m = summarise(mips);
+            Stats f = summarise(fps);
+            double ns = m.mean > 0 ? 1000.0 / m.mean : 0;
+
+            std::printf("%s%-12s %10.1f %8.1f %10.2f %12.0f %10.0f\n", pad(cases[i].name, 24).c_str(), engines[e].c_str(),
+                    m.mean, m.stddev, ns, f.mean, f.stddev);
+            if (tsv)
+                std::fprintf(tsv, "%s\t%s\t%s\t%llu\t%.3f\t%.3f\t%.3f\t%.1f\t%.1f\n", cases[i].name.c_str(), cases[i].kind.c_str(),
+                        engines[e].c_str(), static_cast<unsigned long long>(instructions), m.mean, m.stddev, ns, f.mean, f.stddev);
+        }
+    }
+
+    if (tsv)
+        std::fclose(tsv);
+    return 0;
+}
@@ -0,0 +1,427 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * debug.cpp is the entry point for chip8-debug, a console debugger. It
+ * needs no window, so it works over ssh and with commands piped in. The
+ * commands are read from standard input one per line, in the spirit of
+ * gdb; `help` lists them. Ctrl-C stops a running machine and gives the
+ * prompt back.
+ *
+ * Frames are kept track of here rather than with Chip8::runFrames, so
+ * that a machine stopped in the middle of a frame carries on from the
+ * same instruction and its timers tick exactly when they would have.
+ */
+
+#include "Chip8.h"
+#include "Debugger.h"
+#include "error.h"
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+static const char* USAGE = "Usage is chip8-debug [--ipf instructions_per_frame] [--seed n] [--load-state savestate] "
+                           "[--break addr]... [--watch addr]... <path_to_ROM>";
+
+static const char* HELP =
+    "Addresses are hex (0x optional), counts are decimal.\n"
+    "  c, continue [frames]   run until a breakpoint, a watchpoint, Ctrl-C, or that many frames\n"
+    "  s, step [n]            run n instructions, default 1\n"
+    "  n, next                step, running a CALL until it returns\n"
+    "  b, break addr          stop before the instruction at addr runs\n"
+    "  w, watch addr [len]    stop after anything writes addr, or len bytes from it\n"
+    "  d, delete addr         remove the breakpoint at addr\n"
+    "  unwatch addr [len]     remove watchpoints\n"
+    "  i, info                list breakpoints and watchpoints\n"
+    "  r, regs                registers, stack and timers\n"
+    "  x addr [len]           dump memory, default 64 bytes\n"
+    "  l, list [addr] [n]     disassemble n instructions, default 10 from pc\n"
+    "  screen                 draw the screen\n"
+    "  key k down|up          press or release key k\n"
+    "  save file, load file   write or read a savestate\n"
+    "  q, quit\n"
+    "An empty line repeats the last command.";
+
+static Debugger* interruptTarget = nullptr;
+
+/*
+ * IN:  (int) the signal
+ * OUT: void
+ *      Only sets a flag the machine checks before its next instruction.
+ */
+static void onInterrupt(int)
+{
+    if (interruptTarget)
+        interruptTarget->interrupt();
+}
+
+/*
+ * A machine with a debugger attached, and how far into the current
+ * frame it is.
+ */
+struct Session
+{
+    Chip8&    chip8;
+    Debugger& debugger;
+    uint32_t  intoFrame;              // Instructions run of the current frame
+    uint64_t  frame;                  // Frames finished
+
+    Session(Chip8& c, Debugger& d) : chip8(c), debugger(d), intoFrame(0), frame(0) {}
+
+    /*
+     * IN:  void
+     * OUT: void
+     *      Runs the rest of the current frame, or until the debugger
+     *      stops the machine, ticking the timers if the frame finished.
+     */
+    void advance()
+    {
+        StepResult r = chip8.step(chip8.getCyclesPerFrame() - intoFrame);
+        intoFrame += r.cycles;
+        if (intoFrame >= chip8.getCyclesPerFrame())
+        {
+            chip8.tickTimers();
+            intoFrame = 0;
+            ++frame;
+        }
+    }
+
+    /*
+     * IN:  (uint64_t) frames to run at most, 0 for no limit
+     * OUT: void
+     */
+    void run(uint64_t frames)
+    {
+        uint64_t until = frame + frames;
+        while (!debugger.paused())
+        {
+            if (frames != 0 && frame >= until)
+                debugger.pause(StopReason::Step);
+            else
+                advance();
+        }
+    }
+};
+
+/*
+ * IN:  (string) hex, with or without 0x
+ *      (uint16_t&) the address
+ * OUT: (bool) false if it isn't a hex number
+ */
+static bool parseAddress(const std::string& text, uint16_t& addr)
+{
+    char* end = nullptr;
+    unsigned long value = std::strtoul(text.c_str(), &end, 16);
+    if (text.empty() || *end != '\0' || value > 0xFFF)
+        return false;
+    addr = static_cast<uint16_t>(value);
+    return true;
+}
+
+/*
+ * IN:  (const Chip8State&) the machine
+ *      (uint16_t) an address
+ * OUT: (uint16_t) the two bytes there as an opcode
+ */
+static uint16_t opcodeAt(const Chip8State& s, uint16_t addr)
+{
+    return static_cast<uint16_t>(s.memory[addr & 0xFFF] << 8 | s.memory[(addr + 1) & 0xFFF]);
+}
+
+/*
+ * IN:  (const Session&) the debugged machine
+ * OUT: void
+ *      Says why the machine stopped and where it is.
+ */
+static void where(const Session& session)
+{
+    const Debugger& d = session.debugger;
+    const Chip8State& s = session.chip8.state();
+
+    switch (d.reason())
+    {
+        case StopReason::Breakpoint:
+            std::printf("Breakpoint at 0x%03X\n", s.pc);
+            break;
+        case StopReason::Watchpoint:
+            std::printf("Watchpoint: 0x%03X written by the instruction at 0x%03X\n", d.watchAddress(), d.watchWriter());
+            break;
+        case StopReason::Interrupted:
+            std::printf("Interrupted\n");
+            break;
+        case StopReason::Halted:
+            std::printf("The machine halted\n");
+            break;
+        default:
+            break;
+    }
+    std::printf("frame %llu + %u  0x%03X  %04X  %s\n", static_cast<unsigned long long>(session.frame), session.intoFrame,
+            s.pc, opcodeAt(s, s.pc), disassemble(opcodeAt(s, s.pc)).c_str());
+}
+
+/*
+ * IN:  (const Chip8State&) the machine
+ * OUT: void
+ */
+static void registers(const Chip8State& s)
+{
+    for (int i = 0; i < 16; ++i)
+        std::printf("V%X=%02X%s", i, s.V[i], i % 8 == 7 ? "\n" : "  ");
+    std::printf("I=%03X  pc=%03X  sp=%X  DT=%02X  ST=%02X\n", s.I, s.pc, s.sp, s.delayTimer, s.soundTimer);
+
+    // CALL stores at stack[++sp], so stack[0] is never used
+    std::printf("stack:");
+    for (int i = 1; i <= s.sp && i < 16; ++i)
+        std::printf(" %03X", s.stack[i]);
+    std::printf("\nkeys down:");
+    for (int k = 0; k < 16; ++k)
+        if (s.key[k])
+            std::printf(" %X", k);
+    std::printf("\n");
+}
+
+/*
+ * IN:  (const Chip8State&) the machine
+ *      (uint16_t) first address
+ *      (uint32_t) bytes to show
+ * OUT: void
+ */
+static void dump(const Chip8State& s, uint16_t addr, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i += 16)
+    {
+        std::printf("%03X:", (addr + i) & 0xFFF);
+        for (uint32_t j = i; j < len && j < i + 16; ++j)
+            std::printf(" %02X", s.memory[(addr + j) & 0xFFF]);
+        std::printf("\n");
+    }
+}
+
+/*
+ * IN:  (const Session&) the debugged machine
+ *      (uint16_t) first address
+ *      (uint32_t) instructions to show
+ * OUT: void
+ *      '>' marks the pc and '*' a breakpoint.
+ */
+static void list(const Session& session, uint16_t addr, uint32_t count)
+{
+    const Chip8State& s = session.chip8.state();
+    for (uint32_t i = 0; i < count; ++i, addr = (addr + 2) & 0xFFF)
+        std::printf("%c%c 0x%03X  %04X  %s\n", addr == s.pc ? '>' : ' ', session.debugger.isBreakpoint(addr) ? '*' : ' ',
+                addr, opcodeAt(s, addr), disassemble(opcodeAt(s, addr)).c_str());
+}
+
+/*
+ * IN:  (const Chip8&) the machine
+ * OUT: void
+ */
+static void screen(const Chip8& chip8)
+{
+    if (chip8.hiresMode())
+    {
+        const uint64_t* rows = chip8.hiresFramebuffer();
+        for (int y = 0; y < HI_Y_RES; ++y)
+        {
+            std::string line(HI_X_RES, '.');
+            for (int x = 0; x < HI_X_RES; ++x)
+                if ((rows[2 * y + x / 64] >> (63 - x % 64)) & 1)
+                    line[x] = '#';
+            std::printf("%s\n", line.c_str());
+        }
+        return;
+    }
+
+    const uint64_t* rows = chip8.framebuffer();
+    for (int y = 0; y < Y_RES; ++y)
+    {
+        std::string line(X_RES, '.');
+        for (int x = 0; x < X_RES; ++x)
+            if ((rows[y] >> (63 - x)) & 1)
+                line[x] = '#';
+        std::printf("%s\n", line.c_str());
+    }
+}
+
+/*
+ * IN:  (Session&) the debugged machine
+ *      (string) one command line
+ * OUT: (bool) false to quit
+ */
+static bool command(Session& session, const std::string& line)
+{
+    Chip8& chip8 = session.chip8;
+    Debugger& debugger = session.debugger;
+    std::istringstream in(line);
+    std::string cmd, a, b;
+    in >> cmd >> a >> b;
+    uint16_t addr = 0;
+
+    bool runs = cmd == "c" || cmd == "continue" || cmd == "s" || cmd == "step" || cmd == "n" || cmd == "next";
+    if (runs && !chip8.isRunning())
+    {
+        std::printf("The machine has halted, load a savestate to carry on\n");
+        return true;
+    }
+
+    if (cmd == "c" || cmd == "continue")
+    {
+        debugger.resume();
+        session.run(a.empty() ? 0 : std::strtoull(a.c_str(), nullptr, 10));
+        where(session);
+    }
+    else if (cmd == "s" || cmd == "step")
+    {
+        debugger.step(a.empty() ? 1 : std::strtoul(a.c_str(), nullptr, 10));
+        session.run(0);
+        where(session);
+    }
+    else if (cmd == "n" || cmd == "next")
+    {
+        debugger.stepOver(chip8.state());
+        session.run(0);
+        where(session);
+    }
+    else if ((cmd == "b" || cmd == "break") && parseAddress(a, addr))
+        debugger.setBreakpoint(addr, true);
+    else if ((cmd == "d" || cmd == "delete") && parseAddress(a, addr))
+        debugger.setBreakpoint(addr, false);
+    else if ((cmd == "w" || cmd == "watch") && parseAddress(a, addr))
+        debugger.setWatchpoint(addr, b.empty() ? 1 : std::strtoul(b.c_str(), nullptr, 10), true);
+    else if (cmd == "unwatch" && parseAddress(a, addr))
+        debugger.setWatchpoint(addr, b.empty() ? 1 : std::strtoul(b.c_str(), nullptr, 10), false);
+    else if (cmd == "i" || cmd == "info")
+    {
+        std::vector<uint16_t> found = debugger.breakpoints();
+        std::printf("breakpoints:");
+        for (size_t i = 0; i < found.size(); ++i)
+            std::printf(" %03X", found[i]);
+        found = debugger.watchpoints();
+        std::printf("\nwatchpoints:");
+        for (size_t i = 0; i < found.size(); ++i)
+            std::printf(" %03X", found[i]);
+        std::printf("\n");
+    }
+    else if (cmd == "r" || cmd == "regs")
+        registers(chip8.state());
+    else if (cmd == "x" && parseAddress(a, addr))
+        dump(chip8.state(), addr, b.empty() ? 64 : std::strtoul(b.c_str(), nullptr, 10));
+    else if (cmd == "l" || cmd == "list")
+    {
+        if (a.empty())
+            addr = chip8.state().pc;
+        if (a.empty() || parseAddress(a, addr))
+            list(session, addr, b.empty() ? 10 : std::strtoul(b.c_str(), nullptr, 10));
+        else
+            std::printf("Bad address \"%s\"\n", a.c_str());
+    }
+    else if (cmd == "screen")
+        screen(chip8);
+    else if (cmd == "key" && parseAddress(a, addr) && addr < 16 && (b == "down" || b == "up"))
+        chip8.setKey(addr, b == "down");
+    else if (cmd == "save" && !a.empty())
+    {
+        Savestate s;
+        chip8.saveState(s);
+        if (writeSavestate(a, s))
+            std::printf("Saved %s\n", a.c_str());
+    }
+    else if (cmd == "load" && !a.empty())
+    {
+        SavestateFile file;
+        if (file.open(a) && chip8.loadState(*file.get()))
+        {
+            session.intoFrame = 0;
+            where(session);
+        }
+    }
+    else if (cmd == "h" || cmd == "help")
+        std::printf("%s\n", HELP);
+    else if (cmd == "q" || cmd == "quit")
+        return false;
+    else
+        std::printf("Don't know \"%s\", try help\n", line.c_str());
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    Chip8 chip8;
+    Debugger debugger;
+    std::string rom;
+    std::string state;
+    uint16_t addr = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--ipf" && i + 1 < argc)
+        {
+            int ipf = std::atoi(argv[++i]);
+            if (ipf <= 0)
+                abortChip8("--ipf needs a positive number of instructions");
+            chip8.setCyclesPerFrame(ipf);
+        }
+        else if (arg == "--seed" && i + 1 < argc)
+            chip8.seed(std::strtoull(argv[++i], nullptr, 0));
+        else if (arg == "--load-state" && i + 1 < argc)
+            state = argv[++i];
+        else if (arg == "--break" && i + 1 < argc && parseAddress(argv[i + 1], addr))
+        {
+            debugger.setBreakpoint(addr, true);
+            ++i;
+        }
+        else if (arg == "--watch" && i + 1 < argc && parseAddress(argv[i + 1], addr))
+        {
+            debugger.setWatchpoint(addr, 1, true);
+            ++i;
+        }
+        else if (rom.empty() && arg.compare(0, 2, "--") != 0)
+            rom = arg;
+        else
+            abortChip8(USAGE);
+    }
+    if (rom.empty())
+        abortChip8(USAGE);
+
+    if (!chip8.loadROM(rom))
+        abortChip8("Unable to load ROM");
+    if (!state.empty())
+    {
+        SavestateFile file;
+        if (!file.open(state) || !chip8.loadState(*file.get()))
+            abortChip8("Unable to load savestate");
+    }
+
+    chip8.setDebugger(&debugger);
+    Session session(chip8, debugger);
+    interruptTarget = &debugger;
+    std::signal(SIGINT, onInterrupt);
+
+    where(session);
+    std::string line, last;
+    while (true)
+    {
+        std::printf("(chip8) ");
+        std::fflush(stdout);
+        if (!std::getline(std::cin, line))
+            break;
+        if (line.find_first_not_of(" \t") == std::string::npos)
+            line = last;
+        if (line.empty())
+            continue;
+        last = line;
+        if (!command(session, line))
+            break;
+    }
+    std::printf("\n");
+    return 0;
+}
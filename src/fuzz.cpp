@@ -0,0 +1,476 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * fuzz.cpp is the entry point for chip8-fuzz, which throws random
+ * programs and key presses at the core to find inputs that make it read
+ * or write outside of the machine, or make an engine disagree with the
+ * interpreter. `make fuzz` builds it with AddressSanitizer and
+ * UndefinedBehaviorSanitizer, so anything out of bounds stops it on the
+ * spot.
+ *
+ * An input is a few bytes saying how to run it, then the program:
+ *
+ *   byte 0       platform (bits 0-1) and engine (bits 2-3)
+ *   byte 1       frames to run, 1 + byte % MAX_FRAMES
+ *   byte 2       instructions per frame, 1 + byte % MAX_IPF
+ *   byte 3       key changes, byte % MAX_KEY_EVENTS
+ *   2 per key    frame it happens on, key (bits 0-3) and down (bit 4)
+ *   the rest     the program, loaded at 0x200
+ *
+ * Input that runs out early reads as zeros. An engine other than the
+ * interpreter is checked against a second machine on the interpreter;
+ * a different end state is a failure like any crash. Running the input
+ * twice and hashing both states costs more than the run itself, so only
+ * one input in --reference-every n (16 unless told otherwise) is checked,
+ * picked by a hash of its header. The same input is always picked or
+ * always passed over, so a saved disagreement shows up again when it is
+ * run, and inputs named on the command line are all checked.
+ *
+ * Machines are never rebuilt between inputs. Each goes back to the boot
+ * state with Chip8::resetTo, which copies the registers and screens and
+ * only the 64-byte lines of memory that the last input's program or its
+ * writes touched, so code the engines decoded elsewhere stays decoded.
+ * The boot state already holds SUPER-CHIP's big digits, so switching a
+ * machine to that platform doesn't write them again each time.
+ *
+ * Built with clang's -fsanitize=fuzzer (`make fuzz CC=clang++
+ * LIBFUZZER=1`) LLVMFuzzerTestOneInput is all there is and libFuzzer
+ * does the rest. Otherwise main() runs saved inputs given on the command
+ * line, or mutates the ROMs in a corpus directory for --runs inputs,
+ * SEED_RUN in a row from each ROM it picks so that consecutive programs
+ * differ in a few lines and resetTo leaves the rest decoded. If
+ * an input crashes it, whether through a sanitizer, a signal or a
+ * disagreement, the input is written to the crash file first so it can
+ * be run again with `chip8-fuzz crash-file`.
+ */
+
+#include "Chip8.h"
+#include "RomCatalog.h"
+#include "error.h"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CHIP8_CRASH_FILES 1
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#define CHIP8_CRASH_FILES 0
+#endif
+
+static const char* USAGE = "Usage is chip8-fuzz [--runs n] [--seed n] [--corpus dir] [--crash file] [--reference-every n] [input...]";
+
+static const uint32_t HEADER_SIZE    = 4;
+static const uint32_t MAX_FRAMES     = 8;
+static const uint32_t MAX_IPF        = 64;
+static const uint32_t MAX_KEY_EVENTS = 8;
+static const uint32_t MAX_INPUT      = HEADER_SIZE + 2 * MAX_KEY_EVENTS + (END_PROG_MEM + 1 - START_PROG_MEM);
+static const uint32_t REFERENCE_EVERY = 16; // Inputs per one checked against the interpreter, by default
+static const uint32_t SEED_RUN       = 64; // Inputs mutated from one corpus ROM before picking another
+
+static const Engine ENGINES[4] = { Engine::Interpreter, Engine::Cached, Engine::Jit, Engine::JitChecked };
+
+/*
+ * IN:  (uint32_t) first address
+ *      (uint32_t) bytes from there
+ * OUT: (uint64_t) bit n set for each 64-byte line of memory they touch
+ */
+static uint64_t linesOf(uint32_t addr, uint32_t len)
+{
+    uint64_t lines = 0;
+    for (uint32_t line = addr >> 6; len > 0 && line <= (addr + len - 1) >> 6; ++line)
+        lines |= 1ULL << line;
+    return lines;
+}
+
+/*
+ * IN:  void
+ * OUT: (Chip8State) a fresh machine with SUPER-CHIP's big digits in memory
+ */
+static Chip8State bootState()
+{
+    Chip8 fresh;
+    fresh.setPlatform(Platform::SuperChip);
+    return fresh.state();
+}
+
+/*
+ * The machines every input runs on, and the boot state they go back to.
+ */
+class FuzzTarget
+{
+    public:
+        explicit FuzzTarget(uint32_t every = REFERENCE_EVERY);
+
+        void run(const uint8_t*, size_t); // One input, aborts if the engines disagree
+        uint64_t instructions() const { return executed; }
+    private:
+        void runOn(Chip8&, Engine, uint64_t&); // Reset a machine and run the input on it
+
+        Chip8      machine;           // Runs the input on the engine it asks for
+        Chip8      reference;         // Runs it again on the interpreter
+        Chip8State boot;              // Fresh machine with the current input's program loaded
+        uint32_t   loaded;            // Bytes of program in boot
+        uint64_t   machineLines;      // Lines of boot changed since machine was last reset
+        uint64_t   referenceLines;    // The same for reference, which only some inputs run on
+        uint32_t   referenceEvery;    // Inputs per one that reference checks
+        /* THE CURRENT INPUT */
+        Platform   platform;
+        uint32_t   frames;
+        uint32_t   ipf;
+        uint32_t   keyEvents;
+        uint8_t    keys[MAX_KEY_EVENTS][2];
+        uint64_t   executed;          // Instructions run on machine, over every input
+};
+
+/*
+ * Constructor
+ */
+FuzzTarget::FuzzTarget(uint32_t every) : boot(bootState()), loaded(0), machineLines(0), referenceLines(0), referenceEvery(std::max<uint32_t>(every, 1)), platform(Platform::Chip8), frames(1), ipf(1), keyEvents(0), keys(), executed(0)
+{
+    machine.resetTo(boot, ~0ULL);
+    reference.resetTo(boot, ~0ULL);
+}
+
+/*
+ * IN:  (const uint8_t*) an input as laid out at the top of this file
+ *      (size_t) its size
+ * OUT: void
+ */
+void FuzzTarget::run(const uint8_t* data, size_t size)
+{
+    uint8_t header[HEADER_SIZE + 2 * MAX_KEY_EVENTS] = {};
+    size_t used = std::min(size, sizeof(header));
+    std::memcpy(header, data, used);
+
+    platform = static_cast<Platform>(header[0] % PLATFORM_COUNT);
+    Engine engine = ENGINES[(header[0] >> 2) & 3];
+    frames = 1 + header[1] % MAX_FRAMES;
+    ipf = 1 + header[2] % MAX_IPF;
+    keyEvents = header[3] % MAX_KEY_EVENTS;
+    std::memcpy(keys, header + HEADER_SIZE, 2 * keyEvents);
+
+    // The program follows the key changes, clipped to program memory
+    size_t start = std::min(size, static_cast<size_t>(HEADER_SIZE + 2 * keyEvents));
+    uint32_t n = static_cast<uint32_t>(std::min<size_t>(size - start, END_PROG_MEM + 1 - START_PROG_MEM));
+    uint64_t lines = linesOf(START_PROG_MEM, std::max(n, loaded));
+    machineLines |= lines;
+    referenceLines |= lines;
+    if (loaded > n)
+        std::memset(boot.memory + START_PROG_MEM + n, 0, loaded - n);
+    std::memcpy(boot.memory + START_PROG_MEM, data + start, n);
+    loaded = n;
+
+    runOn(machine, engine, machineLines);
+    if (machine.getJitMismatches() != 0)
+    {
+        printChip8Error("A compiled block disagreed with the interpreter");
+        std::abort();
+    }
+
+    // Other platforms always run on the interpreter, there is nothing to compare
+    if (engine == Engine::Interpreter || platform != Platform::Chip8)
+        return;
+    uint32_t pick = (header[0] | header[1] << 8 | header[2] << 16 | static_cast<uint32_t>(header[3]) << 24) * 0x9E3779B1u;
+    if ((pick >> 16) % referenceEvery != 0)
+        return;
+    runOn(reference, Engine::Interpreter, referenceLines);
+    if (hashState(machine.state()) != hashState(reference.state()) || machine.isRunning() != reference.isRunning())
+    {
+        printChip8Error("The engine and the interpreter ended up in different states");
+        std::abort();
+    }
+}
+
+/*
+ * IN:  (Chip8&) one of the machines
+ *      (Engine) engine to run the input on
+ *      (uint64_t&) lines of boot that changed since this machine was
+ *      last reset, cleared
+ * OUT: void
+ */
+void FuzzTarget::runOn(Chip8& chip8, Engine engine, uint64_t& lines)
+{
+    chip8.resetTo(boot, lines | chip8.takeDirtyMemory());
+    lines = 0;
+    if (chip8.getPlatform() != platform)
+        chip8.setPlatform(platform);
+    chip8.setEngine(engine);
+    chip8.setCyclesPerFrame(ipf);
+
+    for (uint32_t f = 0; f < frames && chip8.isRunning(); ++f)
+    {
+        for (uint32_t e = 0; e < keyEvents; ++e)
+            if (keys[e][0] % frames == f)
+                chip8.setKey(keys[e][1] & 0xF, (keys[e][1] & 0x10) != 0);
+        uint32_t cycles = chip8.runFrames(1).cycles;
+        if (&chip8 == &machine)
+            executed += cycles;
+    }
+}
+
+/*
+ * Crash files. The input being run is kept where a signal handler can
+ * get at it, and written out with nothing but write(2) if the process
+ * dies.
+ */
+static const uint8_t* crashInput = nullptr;
+static size_t         crashSize = 0;
+static char           crashPath[4096] = "";
+
+extern "C" void __sanitizer_set_death_callback(void (*)(void)) __attribute__((weak));
+
+/*
+ * IN:  void
+ * OUT: void
+ *      Only async-signal-safe calls, it runs from signal handlers and
+ *      from the sanitizers as they die.
+ */
+static void saveCrash()
+{
+#if CHIP8_CRASH_FILES
+    if (!crashInput || crashPath[0] == '\0')
+        return;
+    int fd = ::open(crashPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return;
+    ssize_t wrote = ::write(fd, crashInput, crashSize);
+    ::close(fd);
+
+    static const char saved[] = "chip8-fuzz: the input that crashed is in ";
+    if (wrote == static_cast<ssize_t>(crashSize) && ::write(2, saved, sizeof(saved) - 1) > 0)
+    {
+        ssize_t ignored = ::write(2, crashPath, std::strlen(crashPath));
+        ignored = ::write(2, "\n", 1);
+        (void)ignored;
+    }
+    crashInput = nullptr;
+#endif
+}
+
+/*
+ * IN:  (int) the signal
+ * OUT: void
+ */
+static void crashed(int sig)
+{
+    saveCrash();
+    std::signal(sig, SIG_DFL);
+    std::raise(sig);
+}
+
+/*
+ * IN:  (string) where to write the input that crashes
+ * OUT: void
+ *      With a sanitizer linked in, it handles the memory faults itself
+ *      and calls back before it exits; an abort is left to us.
+ */
+static void catchCrashes(const std::string& path)
+{
+    std::snprintf(crashPath, sizeof(crashPath), "%s", path.c_str());
+    if (__sanitizer_set_death_callback)
+        __sanitizer_set_death_callback(saveCrash);
+    else
+    {
+        std::signal(SIGSEGV, crashed);
+        std::signal(SIGFPE, crashed);
+        std::signal(SIGILL, crashed);
+#ifdef SIGBUS
+        std::signal(SIGBUS, crashed);
+#endif
+    }
+    std::signal(SIGABRT, crashed);
+}
+
+/*
+ * IN:  (uint64_t&) generator state, advanced
+ *      (uint32_t) how many values there are
+ * OUT: (uint32_t) one from 0 to n - 1
+ */
+static uint32_t below(uint64_t& rng, uint32_t n)
+{
+    uint32_t r = nextRandom(rng) | nextRandom(rng) << 8 | nextRandom(rng) << 16;
+    return r % n;
+}
+
+/*
+ * IN:  (vector<uint8_t>&) an input, changed in place
+ *      (uint64_t&) generator state
+ * OUT: void
+ *      A new header, then one to eight changes to the program, weighted
+ *      towards the instructions that go through the stack or I.
+ */
+static void mutate(std::vector<uint8_t>& input, uint64_t& rng)
+{
+    static const uint16_t RISKY[] =
+    {
+        0x2000, 0x00EE, 0xA000, 0xB000, 0xD000, 0xF01E, 0xF033, 0xF055, 0xF065, 0xF029, 0xF030,
+        0x00C0, 0x00FB, 0x00FC, 0x00FE, 0x00FF, 0xF075, 0xF085, 0xF00A, 0xE09E, 0x0000, 0x1000
+    };
+
+    if (input.size() < HEADER_SIZE)
+        input.resize(HEADER_SIZE);
+    for (uint32_t i = 0; i < HEADER_SIZE; ++i)
+        input[i] = nextRandom(rng);
+
+    uint32_t changes = 1 + below(rng, 8);
+    for (uint32_t c = 0; c < changes; ++c)
+    {
+        uint32_t at = HEADER_SIZE + below(rng, static_cast<uint32_t>(input.size() - HEADER_SIZE + 2));
+        if (at + 2 > MAX_INPUT)
+            at = MAX_INPUT - 2;
+        if (at + 2 > input.size())
+            input.resize(at + 2);
+
+        switch (below(rng, 4))
+        {
+            case 0:
+                input[at] = nextRandom(rng);
+                break;
+            case 1:
+                input[at] ^= static_cast<uint8_t>(1 << below(rng, 8));
+                break;
+            case 2:
+                {
+                    // A risky instruction with random operands, keeping its kind
+                    uint16_t op = RISKY[below(rng, sizeof(RISKY) / sizeof(RISKY[0]))];
+                    uint16_t operands = (op & 0x0FFF) ? 0x0F00 : 0x0FFF;
+                    if ((op & 0xF000) == 0 && op != 0)
+                        operands = 0x000F;
+                    op |= static_cast<uint16_t>(below(rng, 0x10000)) & operands;
+                    input[at] = op >> 8;
+                    input[at + 1] = op & 0xFF;
+                    break;
+                }
+            case 3:
+                input.resize(at);
+                break;
+        }
+    }
+}
+
+/*
+ * IN:  (string) path of a saved input
+ *      (FuzzTarget&) machines to run it on
+ * OUT: (bool) false if it can't be read
+ */
+static bool runFile(const std::string& path, FuzzTarget& target)
+{
+    std::ifstream fin(path.c_str(), std::ios::binary);
+    if (!fin.is_open())
+    {
+        printChip8Error("Failed to open \"" + path + "\"");
+        return false;
+    }
+    std::vector<uint8_t> input((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+    crashInput = input.data();
+    crashSize = input.size();
+    target.run(input.data(), input.size());
+    crashInput = nullptr;
+    std::printf("%s\tok\n", path.c_str());
+    return true;
+}
+
+#if CHIP8_LIBFUZZER
+/*
+ * IN:  (const uint8_t*) an input from libFuzzer
+ *      (size_t) its size
+ * OUT: (int) always 0
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    static FuzzTarget* target = new FuzzTarget();
+    target->run(data, size);
+    return 0;
+}
+#else
+int main(int argc, char* argv[])
+{
+    uint64_t runs = 1000000;
+    uint64_t seed = 0;
+    std::string corpusDir = "rom";
+    std::string crashFile;
+    uint32_t every = REFERENCE_EVERY;
+    std::vector<std::string> inputs;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--runs" && i + 1 < argc)
+            runs = std::strtoull(argv[++i], nullptr, 0);
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = std::strtoull(argv[++i], nullptr, 0);
+        else if (arg == "--corpus" && i + 1 < argc)
+            corpusDir = argv[++i];
+        else if (arg == "--crash" && i + 1 < argc)
+            crashFile = argv[++i];
+        else if (arg == "--reference-every" && i + 1 < argc)
+            every = std::strtoul(argv[++i], nullptr, 0);
+        else if (arg.compare(0, 2, "--") != 0)
+            inputs.push_back(arg);
+        else
+            abortChip8(USAGE);
+    }
+
+    if (!inputs.empty())
+    {
+        FuzzTarget target(1);
+        bool ok = true;
+        for (size_t i = 0; i < inputs.size(); ++i)
+            ok = runFile(inputs[i], target) && ok;
+        return ok ? 0 : 1;
+    }
+    FuzzTarget target(every);
+
+    // Every ROM in the corpus is a starting point, behind an empty header
+    RomCatalog corpus;
+    corpus.scan(corpusDir);
+    std::vector<std::vector<uint8_t> > seeds;
+    for (size_t i = 0; i < corpus.size(); ++i)
+    {
+        std::vector<uint8_t> input(HEADER_SIZE, 0);
+        input.insert(input.end(), corpus[i].data, corpus[i].data + corpus[i].size);
+        seeds.push_back(input);
+    }
+    if (seeds.empty())
+        seeds.push_back(std::vector<uint8_t>(HEADER_SIZE + 64, 0));
+
+    catchCrashes(crashFile.empty() ? "crash-" + std::to_string(seed) + ".c8f" : crashFile);
+    uint64_t rng = seedRandom(seed);
+    std::vector<uint8_t> input;
+    input.reserve(MAX_INPUT);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t from = 0;
+    for (uint64_t r = 0; r < runs; ++r)
+    {
+        if (r % SEED_RUN == 0)
+            from = below(rng, static_cast<uint32_t>(seeds.size()));
+        input = seeds[from];
+        mutate(input, rng);
+        crashInput = input.data();
+        crashSize = input.size();
+        target.run(input.data(), input.size());
+    }
+    crashInput = nullptr;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("%llu inputs in %.2f s, %.0f per second, %.1f million instructions\n", static_cast<unsigned long long>(runs),
+                seconds, runs / seconds, target.instructions() / 1e6);
+    return 0;
+}
+#endif
@@ -8,21 +8,149 @@
  * instructions.
  *
  * main.cpp is the entry point for the Chip8 interpreter. It will perform
- * a cursory error check to make sure the appropriate number of command line
- * arguments are present and then hands control over to a Chip8 object.
+ * a cursory error check to make sure the command line arguments make
+ * sense and then hands control over to a Chip8 object and
+ * the SDL2 front end that displays it.
  */
 
 #include "Chip8.h"
+#include "Frontend.h"
+#include "SharedState.h"
 #include "error.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+static const char* USAGE = "Usage is chip8 [--engine interpreter|cached|jit|jit-checked|aot] [--platform chip8|cosmac|chip48|schip] [--vsync] [--turbo] [--turbo-speed times] [--audio-buffer samples] [--ipf instructions_per_frame] [--load-state savestate] [--record input_log] [--shm name] [--profile prefix] [--latency] <path_to_ROM>";
 
 int main(int argc, char* argv[])
 {
-    if (argc != 2)
-        abortChip8("Usage is chip8 <path_to_ROM>");
-
     Chip8 chip8;
-    chip8.loadROM(argv[1]);
-    chip8.play();
+    std::string rom;
+    std::string state;
+    std::string log;
+    std::string profile;
+    std::string shm;
+    bool vsync = false;
+    bool latency = false;
+    bool turbo = false;
+    bool forcePlatform = false;
+    Platform platform = Platform::Chip8;
+    int turboSpeed = 0;
+    int audioSamples = Audio::DEFAULT_SAMPLES;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--engine" && i + 1 < argc)
+        {
+            std::string name = argv[++i];
+            Engine engine;
+            if (!engineFromName(name, engine))
+                abortChip8("Unknown engine \"" + name + "\"");
+            chip8.setEngine(engine);
+        }
+        else if (arg == "--platform" && i + 1 < argc)
+        {
+            std::string name = argv[++i];
+            if (!platformFromName(name, platform))
+                abortChip8("Unknown platform \"" + name + "\"");
+            forcePlatform = true;
+        }
+        else if (arg == "--ipf" && i + 1 < argc)
+        {
+            int ipf = std::atoi(argv[++i]);
+            if (ipf <= 0)
+                abortChip8("--ipf needs a positive number of instructions");
+            chip8.setCyclesPerFrame(ipf);
+        }
+        else if (arg == "--audio-buffer" && i + 1 < argc)
+        {
+            // SDL wants a power of two, 0 turns the sound off
+            audioSamples = std::atoi(argv[++i]);
+            if (audioSamples != 0 && (audioSamples < 64 || audioSamples > 8192 || (audioSamples & (audioSamples - 1)) != 0))
+                abortChip8("--audio-buffer needs 0 or a power of two from 64 to 8192 samples");
+        }
+        else if (arg == "--load-state" && i + 1 < argc)
+            state = argv[++i];
+        else if (arg == "--record" && i + 1 < argc)
+            log = argv[++i];
+        else if (arg == "--profile" && i + 1 < argc)
+            profile = argv[++i];
+        else if (arg == "--shm" && i + 1 < argc)
+            shm = argv[++i];
+        else if (arg == "--vsync")
+            vsync = true;
+        else if (arg == "--latency")
+            latency = true;
+        else if (arg == "--turbo")
+            turbo = true;
+        else if (arg == "--turbo-speed" && i + 1 < argc)
+        {
+            turboSpeed = std::atoi(argv[++i]);
+            if (turboSpeed < 0)
+                abortChip8("--turbo-speed needs a multiple of real time, or 0 for no limit");
+        }
+        else if (rom.empty() && arg.compare(0, 2, "--") != 0)
+            rom = arg;
+        else
+            abortChip8(USAGE);
+    }
+    if (rom.empty())
+        abortChip8(USAGE);
+    if (!profile.empty() && !Profiler::available())
+        abortChip8("--profile needs a build with the profiler in it, rebuild with `make clean && make PROFILE=1`");
+
+    if (!chip8.loadROM(rom))
+        abortChip8("Unable to load ROM");
+    if (forcePlatform)
+        chip8.setPlatform(platform);
+
+    if (!state.empty() && !log.empty())
+        abortChip8("A recording has to start from the beginning, not from a savestate");
+    if (!state.empty())
+    {
+        SavestateFile file;
+        if (!file.open(state) || !chip8.loadState(*file.get()))
+            abortChip8("Unable to load savestate");
+    }
+
+    Profiler profiler;
+    if (!profile.empty())
+        chip8.setProfiler(&profiler);
+
+    // Other processes watch the machine and press its keys through this
+    SharedState shared;
+    if (!shm.empty() && !shared.create(shm))
+        abortChip8("Unable to share the machine as \"" + shm + "\"");
+
+    InputRecorder recorder(chip8, 0);
+    Frontend frontend(chip8, vsync, log.empty() ? nullptr : &recorder, static_cast<uint16_t>(audioSamples));
+    frontend.setFastForward(turbo, static_cast<uint32_t>(turboSpeed));
+    frontend.setShared(shared.isOpen() ? &shared : nullptr);
+    frontend.play();
+
+    if (latency)
+    {
+        const InputLatency& input = frontend.inputLatency();
+        double mean = input.events ? std::chrono::duration<double, std::milli>(input.total).count() / input.events : 0.0;
+        std::printf("%llu key changes reached the machine after %.2f ms on average, %.2f ms at worst. %llu frames dropped.\n",
+                    static_cast<unsigned long long>(input.events), mean, std::chrono::duration<double, std::milli>(input.worst).count(),
+                    static_cast<unsigned long long>(frontend.droppedFrames()));
+    }
+
+    if (!log.empty() && !writeInputLog(log, recorder.log()))
+        return 1;
+
+    // The flat report for reading, the folded stacks for a flame graph
+    if (!profile.empty())
+    {
+        std::ofstream report((profile + ".txt").c_str());
+        profiler.report(report, rom);
+        if (!report || !profiler.writeFolded(profile + ".folded", rom))
+            return 1;
+    }
 
     return 0;
 }
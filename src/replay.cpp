@@ -0,0 +1,306 @@
+/*
+ * Connor Kuehl
+ * connorkuehl95@gmail.com
+ *
+ * This program is a Chip8 Emulator (though I think 'interpreter' is
+ * the more technically correct term based on what I've read. Using the
+ * Chip8 object, this program will load Chip8 programs and execute their
+ * instructions.
+ *
+ * replay.cpp is the entry point for chip8-replay. Given input logs it
+ * replays each one headlessly and checks that the machine goes through
+ * exactly the states that were recorded, printing PASS or FAIL per log.
+ * It exits with 1 if any log fails, so `make check` can run it over the
+ * golden logs after every change to the core.
+ *
+ * With --record it writes a log instead, without a window: the ROM runs
+ * for the given number of frames with either no input or, with
+ * --monkey, random key presses from a seeded generator. It stops a
+ * checkpoint interval after the program halts. That is how the golden
+ * logs for the bundled ROMs were made.
+ *
+ * With --profile (in a `make PROFILE=1` build) every replay is watched by
+ * a Profiler and its report and folded stacks are written next to each
+ * other in the given directory, named after the log.
+ *
+ * With --lockstep n every log runs on n lanes of a Lockstep instead, each
+ * lane checked against a Chip8 of its own (see replayLockstep). Lanes
+ * only run chip8 programs, so logs for other platforms are skipped.
+ *
+ * With --engine aot a log whose ROM has no module from `make aot` is
+ * skipped too, since it would only run on the block cache.
+ */
+
+#include "Chip8.h"
+#include "InputLog.h"
+#include "ThreadPool.h"
+#include "error.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+static const char* USAGE = "Usage is chip8-replay [--threads n] [--engine interpreter|cached|jit|jit-checked|aot] [--profile dir] [--lockstep lanes] <input_log>...\n"
+                           "      or chip8-replay --record <path_to_ROM> <input_log> [--frames n] [--ipf n] [--seed n] [--monkey n] [--platform chip8|cosmac|chip48|schip]";
+
+/*
+ * IN:  (const Chip8&) a machine, after a frame
+ * OUT: (bool) true if it can never do anything again: it stopped, or it
+ *      is on a jump to itself, which is how most games end
+ */
+static bool halted(const Chip8& chip8)
+{
+    const Chip8State& s = chip8.state();
+    if (!chip8.isRunning())
+        return true;
+    if (s.pc + 1 >= 4096)
+        return false;
+    uint16_t op = static_cast<uint16_t>(s.memory[s.pc] << 8 | s.memory[s.pc + 1]);
+    return (op & 0xF000) == 0x1000 && (op & 0x0FFF) == s.pc;
+}
+
+/*
+ * IN:  (Chip8&) a machine with its ROM loaded
+ *      (InputRecorder&) records what happens
+ *      (uint32_t) frames to run
+ *      (uint64_t) seed for the key presses, 0 for no input at all
+ * OUT: (uint32_t) the frame the program halted after, 0 if it didn't
+ *      Holds a random key down for a random number of frames now and
+ *      then, roughly what someone mashing the keypad would do. Once the
+ *      program halts only one more checkpoint interval is recorded, as
+ *      the rest would hash the same frozen screen over and over.
+ */
+static uint32_t monkey(Chip8& chip8, InputRecorder& recorder, uint32_t frames, uint64_t seed)
+{
+    uint64_t rng = seedRandom(seed);
+    int held = -1;
+    uint32_t release = 0;
+    uint32_t haltedAt = 0;
+
+    for (uint32_t frame = 0; frame < frames; ++frame)
+    {
+        if (seed != 0)
+        {
+            if (held >= 0 && frame >= release)
+            {
+                chip8.setKey(held, false);
+                recorder.setKey(held, false);
+                held = -1;
+            }
+            else if (held < 0 && nextRandom(rng) < 32)
+            {
+                held = nextRandom(rng) & 0xF;
+                release = frame + 2 + (nextRandom(rng) & 0x1F);
+                chip8.setKey(held, true);
+                recorder.setKey(held, true);
+            }
+        }
+
+        chip8.runFrames(1);
+        recorder.endFrame(chip8.state());
+
+        if (haltedAt == 0 && halted(chip8))
+            haltedAt = frame + 1;
+        if (haltedAt != 0 && frame + 1 >= haltedAt + CHECKPOINT_INTERVAL)
+            break;
+    }
+    return haltedAt;
+}
+
+/*
+ * IN:  (int, char*[]) the arguments after --record
+ * OUT: (int) exit status
+ */
+static int record(int argc, char* argv[])
+{
+    if (argc < 2)
+        abortChip8(USAGE);
+
+    std::string rom = argv[0];
+    std::string out = argv[1];
+    uint32_t frames = 60 * FRAME_RATE;
+    uint32_t ipf = CYCLES_PER_FRAME;
+    uint64_t seed = 0;
+    uint64_t keys = 0;
+    bool forcePlatform = false;
+    Platform platform = Platform::Chip8;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc)
+            frames = std::strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--ipf" && i + 1 < argc)
+            ipf = std::strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = std::strtoull(argv[++i], nullptr, 0);
+        else if (arg == "--monkey" && i + 1 < argc)
+            keys = std::strtoull(argv[++i], nullptr, 0);
+        else if (arg == "--platform" && i + 1 < argc)
+        {
+            std::string name = argv[++i];
+            if (!platformFromName(name, platform))
+                abortChip8("Unknown platform \"" + name + "\"");
+            forcePlatform = true;
+        }
+        else
+            abortChip8(USAGE);
+    }
+    if (ipf == 0)
+        abortChip8("--ipf needs a positive number of instructions");
+
+    Chip8 chip8;
+    chip8.setCyclesPerFrame(ipf);
+    chip8.seed(seed);
+    if (!chip8.loadROM(rom))
+        abortChip8("Unable to load ROM");
+    if (forcePlatform)
+        chip8.setPlatform(platform);
+
+    InputRecorder recorder(chip8, seed);
+    uint32_t haltedAt = monkey(chip8, recorder, frames, keys);
+    if (!writeInputLog(out, recorder.log()))
+        return 1;
+
+    std::printf("%s\t%u frames\t%zu events\t%zu checkpoints", out.c_str(), recorder.log().frames,
+            recorder.log().events.size(), recorder.log().checkpoints.size());
+    if (haltedAt != 0)
+        std::printf("\thalted after frame %u", haltedAt);
+    std::printf("\n");
+    return 0;
+}
+
+/*
+ * IN:  (const InputLog&) a recording of a chip8 program
+ * OUT: (bool) true if its ROM loads but chip8-aot hasn't made a module
+ *      for it, so --engine aot would only run the block cache. A ROM that
+ *      doesn't load is left for the replay to report.
+ */
+static bool missingAotModule(const InputLog& log)
+{
+    Chip8 chip8;
+    if (!chip8.loadROM(log.rom))
+        return false;
+    chip8.setPlatform(log.platform);
+
+    Aot aot;
+    return chip8.getPlatform() != Platform::Chip8 || !aot.attach(programImageHash(chip8.state()));
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && std::string(argv[1]) == "--record")
+        return record(argc - 2, argv + 2);
+
+    unsigned threads = 0;
+    Engine engine = Engine::Cached;
+    std::string profileDir;
+    size_t lanes = 0;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc)
+            threads = std::atoi(argv[++i]);
+        else if (arg == "--engine" && i + 1 < argc)
+        {
+            std::string name = argv[++i];
+            if (!engineFromName(name, engine))
+                abortChip8("Unknown engine \"" + name + "\"");
+        }
+        else if (arg == "--profile" && i + 1 < argc)
+            profileDir = argv[++i];
+        else if (arg == "--lockstep" && i + 1 < argc)
+        {
+            lanes = std::strtoull(argv[++i], nullptr, 0);
+            if (lanes == 0)
+                abortChip8("--lockstep needs at least one lane");
+        }
+        else if (arg.compare(0, 2, "--") != 0)
+            paths.push_back(arg);
+        else
+            abortChip8(USAGE);
+    }
+    if (paths.empty())
+        abortChip8(USAGE);
+    if (!profileDir.empty() && !Profiler::available())
+        abortChip8("--profile needs a build with the profiler in it, rebuild with `make clean && make PROFILE=1`");
+
+    std::vector<InputLog> logs(paths.size());
+    std::vector<ReplayResult> results(paths.size());
+    std::vector<char> started(paths.size(), 0);
+    std::vector<char> skipped(paths.size(), 0);
+    ThreadPool pool(threads);
+    pool.run(paths.size(), [&](size_t j)
+    {
+        if (lanes > 0)
+        {
+            if (!readInputLog(paths[j], logs[j]))
+                return;
+            skipped[j] = logs[j].platform != Platform::Chip8;
+            started[j] = !skipped[j] && replayLockstep(logs[j], lanes, results[j]);
+            return;
+        }
+        if (!readInputLog(paths[j], logs[j]))
+            return;
+        skipped[j] = engine == Engine::Aot && missingAotModule(logs[j]);
+        if (skipped[j])
+            return;
+        if (profileDir.empty())
+        {
+            started[j] = replayInputLog(logs[j], engine, results[j]);
+            return;
+        }
+
+        // A Profiler is large, so only make one when it's wanted
+        std::unique_ptr<Profiler> profiler(new Profiler());
+        started[j] = replayInputLog(logs[j], engine, results[j], profiler.get());
+        if (started[j])
+        {
+            std::string base = paths[j].substr(paths[j].find_last_of('/') + 1);
+            std::string prefix = profileDir + "/" + base.substr(0, base.find_last_of('.'));
+            std::ofstream report((prefix + ".txt").c_str());
+            profiler->report(report, logs[j].rom);
+            profiler->writeFolded(prefix + ".folded", logs[j].rom);
+        }
+    });
+
+    int failed = 0;
+    size_t skips = 0;
+    for (size_t j = 0; j < paths.size(); ++j)
+    {
+        const ReplayResult& r = results[j];
+        if (skipped[j] && lanes > 0)
+        {
+            std::printf("SKIP\t%s\ta %s program, lanes only run chip8 ones\n", paths[j].c_str(), platformName(logs[j].platform));
+            ++skips;
+            continue;
+        }
+        if (skipped[j])
+        {
+            if (logs[j].platform != Platform::Chip8)
+                std::printf("SKIP\t%s\ta %s program, only chip8 ones run recompiled\n", paths[j].c_str(), platformName(logs[j].platform));
+            else
+                std::printf("SKIP\t%s\tno module from `make aot` for this program\n", paths[j].c_str());
+            ++skips;
+            continue;
+        }
+        if (!started[j])
+            std::printf("FAIL\t%s\tcould not be replayed\n", paths[j].c_str());
+        else if (!r.ok && lanes > 0)
+            std::printf("FAIL\t%s\tlane %u diverged after frame %u: expected %016llx, got %016llx\n", paths[j].c_str(), r.badLane,
+                    r.badFrame, static_cast<unsigned long long>(r.expected), static_cast<unsigned long long>(r.actual));
+        else if (!r.ok)
+            std::printf("FAIL\t%s\tdiverged after frame %u: expected %016llx, got %016llx\n", paths[j].c_str(), r.badFrame,
+                    static_cast<unsigned long long>(r.expected), static_cast<unsigned long long>(r.actual));
+        else
+            std::printf("PASS\t%s\t%u frames\t%llu instructions\n", paths[j].c_str(), r.frames,
+                    static_cast<unsigned long long>(r.instructions));
+        failed += (!started[j] || !r.ok) ? 1 : 0;
+    }
+    std::fprintf(stderr, "%zu of %zu input logs passed\n", paths.size() - skips - failed, paths.size() - skips);
+
+    return failed ? 1 : 0;
+}